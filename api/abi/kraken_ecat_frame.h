@@ -0,0 +1,384 @@
+#ifndef KRAKEN_ECAT_FRAME_H
+#define KRAKEN_ECAT_FRAME_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ------------------------------------------------------------------ */
+/* EtherCAT frame builder                                             */
+/*                                                                    */
+/* Builds the EtherCAT part of a frame (everything after the Ethernet */
+/* header, which the conduit prepends): a 2-byte EtherCAT header and  */
+/* one or more chained datagrams. Appending a datagram sets the "more */
+/* follows" bit of the previous one; finishing writes the header.     */
+/* Signed frames carry the Kraken signature once, in front of the     */
+/* first datagram's data, so captures can be filtered on "KRKN".      */
+/* Tagged frames follow the signature with a 32-bit sequence tag that */
+/* kraken_ecat_parse/kraken_ecat_tag recover from frames seen again.  */
+/* Stamped frames instead open with a NOP datagram, which slaves     */
+/* pass on untouched, whose data is the signature, run id, sequence,  */
+/* TX time and a check word, so any capture can be decoded for loss,  */
+/* reordering and one-way latency (kraken_ecat_stamp.h).              */
+/*                                                                    */
+/* Usage:                                                             */
+/*   uint8_t buf[KRAKEN_ECAT_MAX_FRAME];                              */
+/*   KrakenEcatFrame f;                                               */
+/*   kraken_ecat_frame_init(&f, buf, sizeof(buf), true);              */
+/*   KrakenEcatDatagram d = {.cmd = KRAKEN_ECAT_CMD_BRD, .len = 2};   */
+/*   while (kraken_ecat_frame_append(&f, &d))                         */
+/*       d.index++;                                                   */
+/*   ops->send(conn, buf, kraken_ecat_frame_finish(&f), 100);         */
+/* ------------------------------------------------------------------ */
+
+#define KRAKEN_ECAT_SIG "KRKN" /* Wireshark: frame contains "KRKN" */
+#define KRAKEN_ECAT_SIG_LEN 4
+#define KRAKEN_ECAT_TAG_LEN 4 /* little-endian, after the signature of tagged frames */
+/* Stamp block: signature, run id (4), sequence (4), TX time (8), check (4) */
+#define KRAKEN_ECAT_STAMP_LEN 24
+/* Bytes the NOP datagram carrying the stamp block adds to a frame */
+#define KRAKEN_ECAT_STAMP_OVERHEAD (KRAKEN_ECAT_DGRAM_HDR_LEN + KRAKEN_ECAT_STAMP_LEN + KRAKEN_ECAT_WKC_LEN)
+
+#define KRAKEN_ECAT_TYPE_COMMAND 1
+#define KRAKEN_ECAT_HDR_LEN 2
+#define KRAKEN_ECAT_DGRAM_HDR_LEN 10
+#define KRAKEN_ECAT_WKC_LEN 2
+#define KRAKEN_ECAT_MAX_FRAME 1500u /* Ethernet payload MTU */
+#define KRAKEN_ECAT_LEN_MASK 0x07FFu
+#define KRAKEN_ECAT_MORE 0x8000u /* datagram len/flags: another datagram follows */
+
+/* Datagram commands used by the modules */
+#define KRAKEN_ECAT_CMD_NOP 0
+#define KRAKEN_ECAT_CMD_APRD 1
+#define KRAKEN_ECAT_CMD_APWR 2
+#define KRAKEN_ECAT_CMD_FPRD 4
+#define KRAKEN_ECAT_CMD_FPWR 5
+#define KRAKEN_ECAT_CMD_BRD 7
+#define KRAKEN_ECAT_CMD_BWR 8
+#define KRAKEN_ECAT_CMD_LRD 10
+#define KRAKEN_ECAT_CMD_LWR 11
+#define KRAKEN_ECAT_CMD_LRW 12
+
+typedef struct {
+    uint8_t cmd;
+    uint8_t index;       /* echoed back by the slaves, for matching replies */
+    uint16_t adp;        /* position or station address */
+    uint16_t ado;        /* register offset */
+    uint16_t irq;
+    uint16_t wkc;
+    const uint8_t *data; /* NULL = zero-filled */
+    uint16_t len;        /* data bytes, signature not included */
+} KrakenEcatDatagram;
+
+/* Identity of a stamped frame. TX time is CLOCK_REALTIME, the clock of
+   kernel receive timestamps and pcapng files, so a capture taken on the
+   same host gives one-way latency directly. */
+typedef struct {
+    uint32_t run;  /* sender's run id: frames of other runs are not counted */
+    uint32_t seq;  /* per run, from 0 */
+    int64_t tx_ns; /* 0 = not sent yet */
+} KrakenEcatStamp;
+
+typedef struct {
+    uint8_t *buf;
+    size_t cap;     /* usable bytes of buf, at most KRAKEN_ECAT_MAX_FRAME */
+    size_t len;     /* bytes written, EtherCAT header included */
+    size_t last;    /* offset of the last datagram header, 0 = none yet */
+    uint16_t count; /* datagrams appended */
+    bool sign;      /* put KRAKEN_ECAT_SIG in front of the first datagram's data */
+    bool tagged;    /* ...followed by `tag` */
+    uint32_t tag;
+    bool stamped;   /* open with a NOP datagram carrying `stamp` instead */
+    KrakenEcatStamp stamp;
+} KrakenEcatFrame;
+
+/* Decoded view of a received EtherCAT payload */
+typedef struct {
+    uint16_t datagrams;
+    uint32_t wkc;        /* summed over all datagrams */
+    uint8_t cmd;         /* first datagram */
+    uint8_t index;
+    const uint8_t *data; /* first datagram's data, signature included */
+    uint16_t data_len;
+    bool sig;            /* first datagram's data starts with KRAKEN_ECAT_SIG */
+} KrakenEcatInfo;
+
+static inline void kraken_ecat_put16(uint8_t *p, uint16_t v) {
+    p[0] = (uint8_t)(v & 0xFF);
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static inline uint16_t kraken_ecat_get16(const uint8_t *p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static inline void kraken_ecat_frame_init(KrakenEcatFrame *f, uint8_t *buf, size_t cap, bool sign) {
+    f->buf = buf;
+    f->cap = cap < KRAKEN_ECAT_MAX_FRAME ? cap : KRAKEN_ECAT_MAX_FRAME;
+    f->len = KRAKEN_ECAT_HDR_LEN;
+    f->last = 0;
+    f->count = 0;
+    f->sign = sign;
+    f->tagged = false;
+    f->tag = 0;
+    f->stamped = false;
+    memset(&f->stamp, 0, sizeof(f->stamp));
+}
+
+/* Signed frame whose signature is followed by `tag` */
+static inline void kraken_ecat_frame_init_tagged(KrakenEcatFrame *f, uint8_t *buf, size_t cap, uint32_t tag) {
+    kraken_ecat_frame_init(f, buf, cap, true);
+    f->tagged = true;
+    f->tag = tag;
+}
+
+/* Frame opening with a NOP datagram that carries `stamp` */
+static inline void kraken_ecat_frame_init_stamped(KrakenEcatFrame *f, uint8_t *buf, size_t cap, const KrakenEcatStamp *stamp) {
+    kraken_ecat_frame_init(f, buf, cap, true);
+    f->stamped = true;
+    f->stamp = *stamp;
+}
+
+/* Bytes the next datagram costs beyond its own: signature and tag (or
+   the stamp datagram) go with the first datagram only */
+static inline size_t kraken_ecat_frame_prefix(const KrakenEcatFrame *f) {
+    if (!f->sign || f->count > 0)
+        return 0;
+    if (f->stamped)
+        return KRAKEN_ECAT_STAMP_OVERHEAD;
+    return KRAKEN_ECAT_SIG_LEN + (f->tagged ? KRAKEN_ECAT_TAG_LEN : 0);
+}
+
+/* FNV-1a over run id, sequence and TX time: tells a stamp block from
+   process data that happens to follow a signature */
+static inline uint32_t kraken_ecat_stamp_check(const uint8_t *block) {
+    uint32_t h = 2166136261u;
+    for (size_t i = KRAKEN_ECAT_SIG_LEN; i < KRAKEN_ECAT_STAMP_LEN - 4; i++)
+        h = (h ^ block[i]) * 16777619u;
+    return h;
+}
+
+static inline void kraken_ecat_stamp_put(uint8_t *block, const KrakenEcatStamp *st) {
+    memcpy(block, KRAKEN_ECAT_SIG, KRAKEN_ECAT_SIG_LEN);
+    uint8_t *p = block + KRAKEN_ECAT_SIG_LEN;
+    uint64_t tx = (uint64_t)st->tx_ns;
+    kraken_ecat_put16(p, (uint16_t)st->run);
+    kraken_ecat_put16(p + 2, (uint16_t)(st->run >> 16));
+    kraken_ecat_put16(p + 4, (uint16_t)st->seq);
+    kraken_ecat_put16(p + 6, (uint16_t)(st->seq >> 16));
+    for (int i = 0; i < 4; i++)
+        kraken_ecat_put16(p + 8 + 2 * i, (uint16_t)(tx >> (16 * i)));
+    uint32_t check = kraken_ecat_stamp_check(block);
+    kraken_ecat_put16(p + 16, (uint16_t)check);
+    kraken_ecat_put16(p + 18, (uint16_t)(check >> 16));
+}
+
+/* Decode a stamp block.
+   Returns: false unless it starts with the signature and its check word
+   matches. */
+static inline bool kraken_ecat_stamp_get(const uint8_t *block, size_t len, KrakenEcatStamp *st) {
+    if (len < KRAKEN_ECAT_STAMP_LEN || memcmp(block, KRAKEN_ECAT_SIG, KRAKEN_ECAT_SIG_LEN) != 0)
+        return false;
+    const uint8_t *p = block + KRAKEN_ECAT_SIG_LEN;
+    uint32_t check = (uint32_t)kraken_ecat_get16(p + 16) | ((uint32_t)kraken_ecat_get16(p + 18) << 16);
+    if (check != kraken_ecat_stamp_check(block))
+        return false;
+    st->run = (uint32_t)kraken_ecat_get16(p) | ((uint32_t)kraken_ecat_get16(p + 2) << 16);
+    st->seq = (uint32_t)kraken_ecat_get16(p + 4) | ((uint32_t)kraken_ecat_get16(p + 6) << 16);
+    uint64_t tx = 0;
+    for (int i = 0; i < 4; i++)
+        tx |= (uint64_t)kraken_ecat_get16(p + 8 + 2 * i) << (16 * i);
+    st->tx_ns = (int64_t)tx;
+    return true;
+}
+
+/* Bytes the next datagram takes with `data_len` bytes of data */
+static inline size_t kraken_ecat_frame_cost(const KrakenEcatFrame *f, size_t data_len) {
+    return KRAKEN_ECAT_DGRAM_HDR_LEN + kraken_ecat_frame_prefix(f) + data_len + KRAKEN_ECAT_WKC_LEN;
+}
+
+static inline bool kraken_ecat_frame_fits(const KrakenEcatFrame *f, size_t data_len) {
+    return f->len + kraken_ecat_frame_cost(f, data_len) <= f->cap;
+}
+
+/* How many datagrams of `data_len` bytes fit in an empty frame of `cap`
+   bytes whose first datagram carries `prefix` extra bytes */
+static inline size_t kraken_ecat_frame_capacity_prefixed(size_t cap, size_t data_len, size_t prefix) {
+    if (cap > KRAKEN_ECAT_MAX_FRAME)
+        cap = KRAKEN_ECAT_MAX_FRAME;
+    size_t each = KRAKEN_ECAT_DGRAM_HDR_LEN + data_len + KRAKEN_ECAT_WKC_LEN;
+    size_t first = each + prefix;
+    if (cap < KRAKEN_ECAT_HDR_LEN + first)
+        return 0;
+    return 1 + (cap - KRAKEN_ECAT_HDR_LEN - first) / each;
+}
+
+/* How many datagrams of `data_len` bytes fit in an empty frame of `cap` bytes */
+static inline size_t kraken_ecat_frame_capacity(size_t cap, size_t data_len, bool sign) {
+    return kraken_ecat_frame_capacity_prefixed(cap, data_len, sign ? KRAKEN_ECAT_SIG_LEN : 0);
+}
+
+/* Append a datagram.
+   Returns: its data area in the frame (after the signature), so callers can
+   fill or patch it in place, or NULL when it does not fit. */
+static inline uint8_t *kraken_ecat_frame_append(KrakenEcatFrame *f, const KrakenEcatDatagram *d) {
+    if (d->len > KRAKEN_ECAT_LEN_MASK || !kraken_ecat_frame_fits(f, d->len))
+        return NULL;
+    size_t prefix = kraken_ecat_frame_prefix(f);
+    if (f->stamped && prefix) {
+        uint8_t *nop = f->buf + f->len;
+        memset(nop, 0, KRAKEN_ECAT_STAMP_OVERHEAD);
+        kraken_ecat_put16(nop + 6, KRAKEN_ECAT_STAMP_LEN);
+        kraken_ecat_stamp_put(nop + KRAKEN_ECAT_DGRAM_HDR_LEN, &f->stamp);
+        f->last = f->len;
+        f->len += KRAKEN_ECAT_STAMP_OVERHEAD;
+        prefix = 0;
+    }
+    uint16_t data_len = (uint16_t)(d->len + prefix);
+
+    if (f->last)
+        f->buf[f->last + 7] |= (uint8_t)(KRAKEN_ECAT_MORE >> 8);
+
+    uint8_t *p = f->buf + f->len;
+    p[0] = d->cmd;
+    p[1] = d->index;
+    kraken_ecat_put16(p + 2, d->adp);
+    kraken_ecat_put16(p + 4, d->ado);
+    kraken_ecat_put16(p + 6, data_len & KRAKEN_ECAT_LEN_MASK);
+    kraken_ecat_put16(p + 8, d->irq);
+
+    uint8_t *data = p + KRAKEN_ECAT_DGRAM_HDR_LEN;
+    if (prefix) {
+        memcpy(data, KRAKEN_ECAT_SIG, KRAKEN_ECAT_SIG_LEN);
+        if (f->tagged) {
+            kraken_ecat_put16(data + KRAKEN_ECAT_SIG_LEN, (uint16_t)(f->tag & 0xFFFF));
+            kraken_ecat_put16(data + KRAKEN_ECAT_SIG_LEN + 2, (uint16_t)(f->tag >> 16));
+        }
+        data += prefix;
+    }
+    if (d->data && d->len > 0)
+        memcpy(data, d->data, d->len);
+    else if (d->len > 0)
+        memset(data, 0, d->len);
+    kraken_ecat_put16(data + d->len, d->wkc);
+
+    f->last = f->len;
+    f->len += KRAKEN_ECAT_DGRAM_HDR_LEN + data_len + KRAKEN_ECAT_WKC_LEN;
+    f->count++;
+    return data;
+}
+
+/* Write the EtherCAT header.
+   Returns: frame length (0 for a frame without datagrams). */
+static inline size_t kraken_ecat_frame_finish(KrakenEcatFrame *f) {
+    if (f->count == 0)
+        return 0;
+    uint16_t body = (uint16_t)(f->len - KRAKEN_ECAT_HDR_LEN);
+    kraken_ecat_put16(f->buf, (uint16_t)((body & KRAKEN_ECAT_LEN_MASK) | (KRAKEN_ECAT_TYPE_COMMAND << 12)));
+    return f->len;
+}
+
+/* Signed single-datagram frame with index 1, the layout every EtherCAT
+   module used before frames were packed.
+   Returns: frame length, 0 if it does not fit in `cap`. */
+static inline size_t kraken_ecat_build(uint8_t *buf, size_t cap, uint8_t cmd, uint16_t adp, uint16_t ado, const uint8_t *data, uint16_t data_len,
+                                       uint16_t wkc) {
+    KrakenEcatFrame f;
+    kraken_ecat_frame_init(&f, buf, cap, true);
+    KrakenEcatDatagram d = {cmd, 0x01, adp, ado, 0, wkc, data, data_len};
+    if (!kraken_ecat_frame_append(&f, &d))
+        return 0;
+    return kraken_ecat_frame_finish(&f);
+}
+
+/* Walk the datagram chain of an EtherCAT payload (after the Ethernet
+   header). Trailing Ethernet padding is ignored.
+   Returns: false unless it is a well-formed command frame. */
+static inline bool kraken_ecat_parse(const uint8_t *p, size_t len, KrakenEcatInfo *info) {
+    if (len < KRAKEN_ECAT_HDR_LEN)
+        return false;
+    uint16_t header = kraken_ecat_get16(p);
+    if ((header >> 12) != KRAKEN_ECAT_TYPE_COMMAND)
+        return false;
+    size_t end = KRAKEN_ECAT_HDR_LEN + (header & KRAKEN_ECAT_LEN_MASK);
+    if (end > len)
+        end = len;
+
+    memset(info, 0, sizeof(*info));
+    size_t off = KRAKEN_ECAT_HDR_LEN;
+    for (;;) {
+        if (off + KRAKEN_ECAT_DGRAM_HDR_LEN + KRAKEN_ECAT_WKC_LEN > end)
+            return false;
+        uint16_t len_flags = kraken_ecat_get16(p + off + 6);
+        size_t dlen = len_flags & KRAKEN_ECAT_LEN_MASK;
+        if (off + KRAKEN_ECAT_DGRAM_HDR_LEN + dlen + KRAKEN_ECAT_WKC_LEN > end)
+            return false;
+        const uint8_t *data = p + off + KRAKEN_ECAT_DGRAM_HDR_LEN;
+        if (info->datagrams == 0) {
+            info->cmd = p[off];
+            info->index = p[off + 1];
+            info->data = data;
+            info->data_len = (uint16_t)dlen;
+            info->sig = dlen >= KRAKEN_ECAT_SIG_LEN && memcmp(data, KRAKEN_ECAT_SIG, KRAKEN_ECAT_SIG_LEN) == 0;
+        }
+        info->wkc += kraken_ecat_get16(data + dlen);
+        info->datagrams++;
+        off += KRAKEN_ECAT_DGRAM_HDR_LEN + dlen + KRAKEN_ECAT_WKC_LEN;
+        if (!(len_flags & KRAKEN_ECAT_MORE))
+            return true;
+    }
+}
+
+/* Stamp block of an EtherCAT payload, which sits at a fixed offset: the
+   data of the first (NOP) datagram.
+   Returns: a pointer to it, or NULL when the payload is too short or the
+   first datagram cannot hold one. */
+static inline uint8_t *kraken_ecat_stamp_block(const uint8_t *p, size_t len) {
+    size_t off = KRAKEN_ECAT_HDR_LEN + KRAKEN_ECAT_DGRAM_HDR_LEN;
+    if (len < off + KRAKEN_ECAT_STAMP_LEN || (kraken_ecat_get16(p) >> 12) != KRAKEN_ECAT_TYPE_COMMAND ||
+        (kraken_ecat_get16(p + KRAKEN_ECAT_HDR_LEN + 6) & KRAKEN_ECAT_LEN_MASK) < KRAKEN_ECAT_STAMP_LEN)
+        return NULL;
+    return (uint8_t *)p + off;
+}
+
+/* Rewrite sequence and TX time of a stamped payload just before it goes
+   out; the run id stays. Lets one built frame be sent many times.
+   Returns: false when the payload carries no stamp block. */
+static inline bool kraken_ecat_restamp(uint8_t *p, size_t len, uint32_t seq, int64_t tx_ns) {
+    uint8_t *block = kraken_ecat_stamp_block(p, len);
+    KrakenEcatStamp st;
+    if (!block || !kraken_ecat_stamp_get(block, KRAKEN_ECAT_STAMP_LEN, &st))
+        return false;
+    st.seq = seq;
+    st.tx_ns = tx_ns;
+    kraken_ecat_stamp_put(block, &st);
+    return true;
+}
+
+/* Stamp of a parsed stamped frame.
+   Returns: false when the first datagram does not carry an intact stamp
+   block. */
+static inline bool kraken_ecat_stamp(const KrakenEcatInfo *info, KrakenEcatStamp *st) {
+    return info->sig && kraken_ecat_stamp_get(info->data, info->data_len, st);
+}
+
+/* Tag of a parsed tagged frame. Only meaningful for frames known to be
+   tagged; callers should check the value against what they sent. */
+static inline bool kraken_ecat_tag(const KrakenEcatInfo *info, uint32_t *tag) {
+    if (!info->sig || info->data_len < KRAKEN_ECAT_SIG_LEN + KRAKEN_ECAT_TAG_LEN)
+        return false;
+    const uint8_t *t = info->data + KRAKEN_ECAT_SIG_LEN;
+    *tag = (uint32_t)kraken_ecat_get16(t) | ((uint32_t)kraken_ecat_get16(t + 2) << 16);
+    return true;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* KRAKEN_ECAT_FRAME_H */
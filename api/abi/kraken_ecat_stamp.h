@@ -0,0 +1,143 @@
+#ifndef KRAKEN_ECAT_STAMP_H
+#define KRAKEN_ECAT_STAMP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "kraken_ecat_frame.h"
+#include "kraken_histogram.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ------------------------------------------------------------------ */
+/* Stamped frame accounting                                           */
+/*                                                                    */
+/* Decoder side of stamped frames (kraken_ecat_frame_init_stamped).   */
+/* Feed it every frame of a capture - live or read back from a pcapng */
+/* file - with its receive time; it keeps the frames of one run and   */
+/* counts how many arrived, how many came after a later sequence      */
+/* number (reordered) or more than once (duplicates), and the one-way */
+/* latency from the TX time in the stamp to the receive time.         */
+/*                                                                    */
+/* Duplicates are caught within KRAKEN_STAMP_WINDOW sequence numbers  */
+/* of the highest seen; older stragglers count as reordered only.     */
+/*                                                                    */
+/* Usage:                                                             */
+/*   KrakenStampStats st;                                             */
+/*   kraken_stamp_stats_init(&st, run);                               */
+/*   for each frame: kraken_stamp_stats_frame(&st, frame, len, rx_ns);*/
+/*   lost = sent - st.received;  (or kraken_stamp_stats_lost(&st))    */
+/* ------------------------------------------------------------------ */
+
+#define KRAKEN_STAMP_WINDOW 1024
+
+typedef struct {
+    uint32_t run;           /* frames of other runs are ignored */
+    bool any_run;           /* adopt the run of the first stamp seen */
+    bool started;
+    uint32_t min_seq;
+    uint32_t max_seq;
+    uint64_t received;      /* distinct sequence numbers */
+    uint64_t reordered;     /* arrived after a higher sequence number */
+    uint64_t duplicates;
+    uint64_t clock_skew;    /* received before their TX time: no latency sample */
+    uint64_t other_runs;    /* valid stamps of another run */
+    uint64_t seen[KRAKEN_STAMP_WINDOW / 64]; /* bit per sequence number, mod the window */
+    KrakenHistogram latency; /* receive time - TX time, ns */
+} KrakenStampStats;
+
+/* `run` 0 accepts the first run seen */
+static inline void kraken_stamp_stats_init(KrakenStampStats *st, uint32_t run) {
+    memset(st, 0, sizeof(*st));
+    st->run = run;
+    st->any_run = run == 0;
+    kraken_hist_init(&st->latency);
+}
+
+static inline bool kraken_stamp_seen(KrakenStampStats *st, uint32_t seq, bool set) {
+    uint64_t *word = &st->seen[(seq % KRAKEN_STAMP_WINDOW) / 64];
+    uint64_t bit = 1ULL << (seq % 64);
+    bool was = (*word & bit) != 0;
+    if (set)
+        *word |= bit;
+    else
+        *word &= ~bit;
+    return was;
+}
+
+/* Count one decoded stamp received at rx_ns (0 = unknown, no latency).
+   Returns: true when it is a new frame of the tracked run. */
+static inline bool kraken_stamp_stats_add(KrakenStampStats *st, const KrakenEcatStamp *s, int64_t rx_ns) {
+    if (st->any_run && !st->started)
+        st->run = s->run;
+    if (s->run != st->run) {
+        st->other_runs++;
+        return false;
+    }
+
+    uint32_t seq = s->seq;
+    if (!st->started) {
+        st->started = true;
+        st->min_seq = st->max_seq = seq;
+        kraken_stamp_seen(st, seq, true);
+    } else if ((int32_t)(seq - st->max_seq) > 0) {
+        /* Sequence numbers entering the window are not seen yet */
+        if (seq - st->max_seq >= KRAKEN_STAMP_WINDOW)
+            memset(st->seen, 0, sizeof(st->seen));
+        else
+            for (uint32_t q = st->max_seq + 1; q != seq; q++)
+                kraken_stamp_seen(st, q, false);
+        kraken_stamp_seen(st, seq, true);
+        st->max_seq = seq;
+    } else {
+        if ((int32_t)(seq - st->min_seq) < 0)
+            st->min_seq = seq;
+        if (st->max_seq - seq < KRAKEN_STAMP_WINDOW && kraken_stamp_seen(st, seq, true)) {
+            st->duplicates++;
+            return false;
+        }
+        st->reordered++;
+    }
+    st->received++;
+
+    if (rx_ns > 0 && s->tx_ns > 0) {
+        if (rx_ns >= s->tx_ns)
+            kraken_hist_record(&st->latency, (uint64_t)(rx_ns - s->tx_ns));
+        else
+            st->clock_skew++;
+    }
+    return true;
+}
+
+/* Count one raw Ethernet frame; anything without an intact stamp block
+   is skipped.
+   Returns: true when it is a new frame of the tracked run. */
+static inline bool kraken_stamp_stats_frame(KrakenStampStats *st, const uint8_t *frame, size_t len, int64_t rx_ns) {
+    if (len < 14 || frame[12] != 0x88 || frame[13] != 0xA4)
+        return false;
+    const uint8_t *block = kraken_ecat_stamp_block(frame + 14, len - 14);
+    KrakenEcatStamp s;
+    if (!block || !kraken_ecat_stamp_get(block, KRAKEN_ECAT_STAMP_LEN, &s))
+        return false;
+    return kraken_stamp_stats_add(st, &s, rx_ns);
+}
+
+/* Frames missing between the lowest and highest sequence number seen.
+   A sender that knows how many it sent should use that instead, which
+   also counts losses at either end. */
+static inline uint64_t kraken_stamp_stats_lost(const KrakenStampStats *st) {
+    if (!st->started)
+        return 0;
+    uint64_t span = (uint64_t)(uint32_t)(st->max_seq - st->min_seq) + 1;
+    return span > st->received ? span - st->received : 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* KRAKEN_ECAT_STAMP_H */
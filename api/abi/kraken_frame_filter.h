@@ -0,0 +1,172 @@
+#ifndef KRAKEN_FRAME_FILTER_H
+#define KRAKEN_FRAME_FILTER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "kraken_module_abi_v2.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ------------------------------------------------------------------ */
+/* Receive filter presets                                             */
+/*                                                                    */
+/* Compiles the named presets of KrakenFrameFilter to classic BPF, so */
+/* any conduit that can attach a socket filter (SO_ATTACH_FILTER on   */
+/* Linux) offers the same presets.                                    */
+/*                                                                    */
+/* "ethercat+station" walks the first KRAKEN_FILTER_STATION_DGRAMS    */
+/* datagrams of a frame; a datagram for the station further down a    */
+/* longer chain is not seen.                                          */
+/*                                                                    */
+/* Usage:                                                             */
+/*   KrakenBpfInsn prog[KRAKEN_FILTER_MAX_INSNS];                     */
+/*   int n = kraken_frame_filter_compile(filter, prog,                */
+/*                                       KRAKEN_FILTER_MAX_INSNS);    */
+/*   if (n > 0) attach prog[0..n)                                     */
+/* ------------------------------------------------------------------ */
+
+#define KRAKEN_FILTER_MAX_INSNS 256
+#define KRAKEN_FILTER_STATION_DGRAMS 8
+#define KRAKEN_FILTER_SNAPLEN 0x40000u /* accept: keep the whole frame */
+
+/* Classic BPF opcodes (linux/filter.h), spelled out so this header
+   builds without kernel headers */
+#define KRAKEN_BPF_LD_H_ABS 0x28
+#define KRAKEN_BPF_LD_B_ABS 0x30
+#define KRAKEN_BPF_LD_H_IND 0x48
+#define KRAKEN_BPF_LD_B_IND 0x50
+#define KRAKEN_BPF_LDX_IMM 0x01
+#define KRAKEN_BPF_LDX_MEM 0x61
+#define KRAKEN_BPF_ST 0x02
+#define KRAKEN_BPF_ADD_K 0x04
+#define KRAKEN_BPF_ADD_X 0x0c
+#define KRAKEN_BPF_AND_K 0x54
+#define KRAKEN_BPF_LSH_K 0x64
+#define KRAKEN_BPF_JEQ_K 0x15
+#define KRAKEN_BPF_JSET_K 0x45
+#define KRAKEN_BPF_RET_K 0x06
+#define KRAKEN_BPF_TAX 0x07
+
+/* Symbolic jump targets, resolved once the program is complete */
+#define KRAKEN_FILTER_TO_ACCEPT 0xFF
+#define KRAKEN_FILTER_TO_REJECT 0xFE
+
+typedef struct {
+    KrakenBpfInsn *out;
+    size_t max;
+    size_t count;
+} KrakenFilterProg;
+
+static inline void kraken_filter_emit(KrakenFilterProg *p, uint16_t code, uint8_t jt, uint8_t jf, uint32_t k) {
+    if (p->count < p->max) {
+        p->out[p->count].code = code;
+        p->out[p->count].jt = jt;
+        p->out[p->count].jf = jf;
+        p->out[p->count].k = k;
+    }
+    p->count++;
+}
+
+/* Append the accept and reject returns and point the symbolic jumps at
+   them; a program that runs off its end accepts.
+   Returns: instruction count, or -1 if the program does not fit. */
+static inline int kraken_filter_finish(KrakenFilterProg *p) {
+    size_t accept = p->count;
+    kraken_filter_emit(p, KRAKEN_BPF_RET_K, 0, 0, KRAKEN_FILTER_SNAPLEN);
+    kraken_filter_emit(p, KRAKEN_BPF_RET_K, 0, 0, 0);
+    if (p->count > p->max)
+        return -1;
+    for (size_t pc = 0; pc < accept; pc++) {
+        KrakenBpfInsn *in = &p->out[pc];
+        if ((in->code & 0x07) != 0x05)
+            continue;
+        uint8_t *targets[2] = {&in->jt, &in->jf};
+        for (int t = 0; t < 2; t++) {
+            if (*targets[t] != KRAKEN_FILTER_TO_ACCEPT && *targets[t] != KRAKEN_FILTER_TO_REJECT)
+                continue;
+            size_t to = *targets[t] == KRAKEN_FILTER_TO_ACCEPT ? accept : accept + 1;
+            if (to - pc - 1 >= KRAKEN_FILTER_TO_REJECT)
+                return -1;
+            *targets[t] = (uint8_t)(to - pc - 1);
+        }
+    }
+    return (int)p->count;
+}
+
+/* EtherType 0x88A4 */
+static inline void kraken_filter_ethertype(KrakenFilterProg *p) {
+    kraken_filter_emit(p, KRAKEN_BPF_LD_H_ABS, 0, 0, 12);
+    kraken_filter_emit(p, KRAKEN_BPF_JEQ_K, 0, KRAKEN_FILTER_TO_REJECT, 0x88A4);
+}
+
+/* EtherCAT command frame whose datagrams include FPRD/FPWR/FPRW/FRMW for
+   `station`. X holds the offset of the current datagram past byte 16. */
+static inline void kraken_filter_station(KrakenFilterProg *p, uint16_t station) {
+    kraken_filter_ethertype(p);
+    kraken_filter_emit(p, KRAKEN_BPF_LD_B_ABS, 0, 0, 15); /* type in the top nibble of the LE header */
+    kraken_filter_emit(p, KRAKEN_BPF_AND_K, 0, 0, 0xF0);
+    kraken_filter_emit(p, KRAKEN_BPF_JEQ_K, 0, KRAKEN_FILTER_TO_REJECT, 0x10);
+    kraken_filter_emit(p, KRAKEN_BPF_LDX_IMM, 0, 0, 0);
+
+    /* ADP is little-endian on the wire, BPF loads big-endian */
+    uint32_t adp = (uint32_t)(((station & 0xFF) << 8) | (station >> 8));
+    for (int i = 0; i < KRAKEN_FILTER_STATION_DGRAMS; i++) {
+        kraken_filter_emit(p, KRAKEN_BPF_LD_B_IND, 0, 0, 16);
+        kraken_filter_emit(p, KRAKEN_BPF_JEQ_K, 3, 0, 4);  /* FPRD */
+        kraken_filter_emit(p, KRAKEN_BPF_JEQ_K, 2, 0, 5);  /* FPWR */
+        kraken_filter_emit(p, KRAKEN_BPF_JEQ_K, 1, 0, 6);  /* FPRW */
+        kraken_filter_emit(p, KRAKEN_BPF_JEQ_K, 0, 2, 14); /* FRMW */
+        kraken_filter_emit(p, KRAKEN_BPF_LD_H_IND, 0, 0, 18);
+        kraken_filter_emit(p, KRAKEN_BPF_JEQ_K, KRAKEN_FILTER_TO_ACCEPT, 0, adp);
+        if (i == KRAKEN_FILTER_STATION_DGRAMS - 1)
+            break;
+        /* Stop at the last datagram, else X += 10 + len + 2 */
+        kraken_filter_emit(p, KRAKEN_BPF_LD_B_IND, 0, 0, 23);
+        kraken_filter_emit(p, KRAKEN_BPF_JSET_K, 0, KRAKEN_FILTER_TO_REJECT, 0x80);
+        kraken_filter_emit(p, KRAKEN_BPF_AND_K, 0, 0, 0x07);
+        kraken_filter_emit(p, KRAKEN_BPF_LSH_K, 0, 0, 8);
+        kraken_filter_emit(p, KRAKEN_BPF_ADD_X, 0, 0, 0);
+        kraken_filter_emit(p, KRAKEN_BPF_ADD_K, 0, 0, 12);
+        kraken_filter_emit(p, KRAKEN_BPF_ST, 0, 0, 0);
+        kraken_filter_emit(p, KRAKEN_BPF_LD_B_IND, 0, 0, 22);
+        kraken_filter_emit(p, KRAKEN_BPF_LDX_MEM, 0, 0, 0);
+        kraken_filter_emit(p, KRAKEN_BPF_ADD_X, 0, 0, 0);
+        kraken_filter_emit(p, KRAKEN_BPF_TAX, 0, 0, 0);
+    }
+    kraken_filter_emit(p, KRAKEN_BPF_RET_K, 0, 0, 0);
+}
+
+/* Compile `filter` into out[0..max): presets are expanded, raw programs
+   copied as given.
+   Returns: instruction count, or -1 for an unknown preset, an empty
+   program or one longer than `max`. */
+static inline int kraken_frame_filter_compile(const KrakenFrameFilter *filter, KrakenBpfInsn *out, size_t max) {
+    if (!filter)
+        return -1;
+    if (!filter->preset) {
+        if (!filter->insns || filter->insn_count == 0 || filter->insn_count > max)
+            return -1;
+        memcpy(out, filter->insns, filter->insn_count * sizeof(*out));
+        return (int)filter->insn_count;
+    }
+
+    KrakenFilterProg p = {out, max, 0};
+    if (strcmp(filter->preset, "ethercat") == 0)
+        kraken_filter_ethertype(&p);
+    else if (strcmp(filter->preset, "ethercat+station") == 0)
+        kraken_filter_station(&p, filter->station);
+    else
+        return -1;
+    return kraken_filter_finish(&p);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* KRAKEN_FRAME_FILTER_H */
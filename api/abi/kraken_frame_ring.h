@@ -0,0 +1,152 @@
+#ifndef KRAKEN_FRAME_RING_H
+#define KRAKEN_FRAME_RING_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ------------------------------------------------------------------ */
+/* Single-producer single-consumer frame ring                         */
+/*                                                                    */
+/* Fixed number of fixed-size frame slots allocated once, so memory   */
+/* stays bounded however long a capture runs. One thread produces     */
+/* (e.g. a capture thread receiving straight into the slots), one     */
+/* thread consumes; neither takes a lock. Head and tail live on their */
+/* own cache lines and both sides work in batches, so the other       */
+/* side's index is read once per batch rather than once per frame.    */
+/*                                                                    */
+/* A producer that finds the ring full drops the frame and counts it  */
+/* in `dropped` rather than waiting: live traffic does not wait.      */
+/*                                                                    */
+/* Usage (producer):                                                  */
+/*   size_t n = kraken_frame_ring_writable(&r);                       */
+/*   for (i < n) fill kraken_frame_ring_write_slot(&r, i);            */
+/*   kraken_frame_ring_publish(&r, filled);                           */
+/* Usage (consumer):                                                  */
+/*   size_t n = kraken_frame_ring_readable(&r);                       */
+/*   for (i < n) use kraken_frame_ring_read_slot(&r, i);              */
+/*   kraken_frame_ring_consume(&r, n);                                */
+/* ------------------------------------------------------------------ */
+
+#define KRAKEN_FRAME_RING_LINE 64
+
+/* Slot header; frame bytes follow it (kraken_frame_ring_data) */
+typedef struct {
+    uint32_t len;         /* bytes stored */
+    uint32_t flags;       /* KRAKEN_RECV_F_* or module-defined */
+    int64_t timestamp_ns; /* CLOCK_REALTIME ns, 0 = unknown */
+} KrakenRingFrame;
+
+typedef struct {
+    uint8_t *mem;
+    size_t stride;    /* header + slot_size, cache-line aligned */
+    size_t slot_size; /* frame bytes per slot */
+    uint64_t mask;    /* slots - 1 */
+
+    uint8_t pad0[KRAKEN_FRAME_RING_LINE];
+    uint64_t head;    /* producer: next slot to publish */
+    uint64_t dropped; /* producer: frames that found the ring full */
+
+    uint8_t pad1[KRAKEN_FRAME_RING_LINE];
+    uint64_t tail; /* consumer: next slot to read */
+    uint64_t peak; /* consumer: most frames seen queued at once */
+    uint8_t pad2[KRAKEN_FRAME_RING_LINE];
+} KrakenFrameRing;
+
+/* Allocate `slots` (rounded up to a power of two) slots of `slot_size` bytes.
+   Returns: 0 on success, -1 on allocation failure. */
+static inline int kraken_frame_ring_init(KrakenFrameRing *r, size_t slots, size_t slot_size) {
+    memset(r, 0, sizeof(*r));
+    size_t n = 1;
+    while (n < slots)
+        n <<= 1;
+    r->slot_size = slot_size;
+    r->stride = (sizeof(KrakenRingFrame) + slot_size + KRAKEN_FRAME_RING_LINE - 1) & ~(size_t)(KRAKEN_FRAME_RING_LINE - 1);
+    r->mask = n - 1;
+    r->mem = (uint8_t *)calloc(n, r->stride);
+    return r->mem ? 0 : -1;
+}
+
+static inline void kraken_frame_ring_free(KrakenFrameRing *r) {
+    free(r->mem);
+    r->mem = NULL;
+}
+
+static inline size_t kraken_frame_ring_slots(const KrakenFrameRing *r) {
+    return (size_t)r->mask + 1;
+}
+
+static inline KrakenRingFrame *kraken_frame_ring_slot(const KrakenFrameRing *r, uint64_t pos) {
+    return (KrakenRingFrame *)(r->mem + (size_t)(pos & r->mask) * r->stride);
+}
+
+static inline uint8_t *kraken_frame_ring_data(KrakenRingFrame *f) {
+    return (uint8_t *)(f + 1);
+}
+
+/* ---- producer side ---- */
+
+/* Free slots the producer may fill before publishing */
+static inline size_t kraken_frame_ring_writable(const KrakenFrameRing *r) {
+    uint64_t tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+    return (size_t)(r->mask + 1 - (r->head - tail));
+}
+
+/* i-th free slot, i < kraken_frame_ring_writable() */
+static inline KrakenRingFrame *kraken_frame_ring_write_slot(const KrakenFrameRing *r, size_t i) {
+    return kraken_frame_ring_slot(r, r->head + i);
+}
+
+/* Hand the first `n` filled slots to the consumer */
+static inline void kraken_frame_ring_publish(KrakenFrameRing *r, size_t n) {
+    __atomic_store_n(&r->head, r->head + n, __ATOMIC_RELEASE);
+}
+
+/* Copy one frame in (truncated to slot_size).
+   Returns: false, counting a drop, when the ring is full. */
+static inline bool kraken_frame_ring_push(KrakenFrameRing *r, const uint8_t *data, size_t len, int64_t timestamp_ns, uint32_t flags) {
+    if (kraken_frame_ring_writable(r) == 0) {
+        r->dropped++;
+        return false;
+    }
+    KrakenRingFrame *f = kraken_frame_ring_write_slot(r, 0);
+    size_t n = len < r->slot_size ? len : r->slot_size;
+    memcpy(kraken_frame_ring_data(f), data, n);
+    f->len = (uint32_t)n;
+    f->flags = flags;
+    f->timestamp_ns = timestamp_ns;
+    kraken_frame_ring_publish(r, 1);
+    return true;
+}
+
+/* ---- consumer side ---- */
+
+/* Frames published and not yet consumed */
+static inline size_t kraken_frame_ring_readable(KrakenFrameRing *r) {
+    size_t n = (size_t)(__atomic_load_n(&r->head, __ATOMIC_ACQUIRE) - r->tail);
+    if (n > r->peak)
+        r->peak = n;
+    return n;
+}
+
+/* i-th queued frame, i < kraken_frame_ring_readable() */
+static inline KrakenRingFrame *kraken_frame_ring_read_slot(const KrakenFrameRing *r, size_t i) {
+    return kraken_frame_ring_slot(r, r->tail + i);
+}
+
+/* Give the first `n` read slots back to the producer */
+static inline void kraken_frame_ring_consume(KrakenFrameRing *r, size_t n) {
+    __atomic_store_n(&r->tail, r->tail + n, __ATOMIC_RELEASE);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* KRAKEN_FRAME_RING_H */
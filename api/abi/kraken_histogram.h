@@ -0,0 +1,108 @@
+#ifndef KRAKEN_HISTOGRAM_H
+#define KRAKEN_HISTOGRAM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ------------------------------------------------------------------ */
+/* Log-linear histogram                                               */
+/*                                                                    */
+/* Fixed-size, allocation-free histogram for latencies and jitter in  */
+/* nanoseconds. Values below KRAKEN_HIST_SUB are counted exactly;     */
+/* above that every power of two is split into KRAKEN_HIST_SUB        */
+/* buckets, so a percentile is off by at most 1/KRAKEN_HIST_SUB       */
+/* (12.5%) of its value. Recording is O(1).                           */
+/* ------------------------------------------------------------------ */
+
+#define KRAKEN_HIST_SUB_BITS 3
+#define KRAKEN_HIST_SUB (1u << KRAKEN_HIST_SUB_BITS)
+#define KRAKEN_HIST_BUCKETS (64u * KRAKEN_HIST_SUB)
+
+typedef struct {
+    uint64_t counts[KRAKEN_HIST_BUCKETS];
+    uint64_t total;
+    uint64_t min;
+    uint64_t max;
+    double sum;
+} KrakenHistogram;
+
+static inline void kraken_hist_init(KrakenHistogram *h) {
+    memset(h, 0, sizeof(*h));
+    h->min = UINT64_MAX;
+}
+
+static inline unsigned kraken_hist_bucket(uint64_t v) {
+    if (v < KRAKEN_HIST_SUB)
+        return (unsigned)v;
+    unsigned shift = (unsigned)(63 - __builtin_clzll(v)) - KRAKEN_HIST_SUB_BITS;
+    return (shift + 1) * KRAKEN_HIST_SUB + ((unsigned)(v >> shift) & (KRAKEN_HIST_SUB - 1));
+}
+
+/* Largest value that lands in bucket `b` */
+static inline uint64_t kraken_hist_bucket_max(unsigned b) {
+    if (b < KRAKEN_HIST_SUB)
+        return b;
+    unsigned shift = b / KRAKEN_HIST_SUB - 1;
+    uint64_t lower = (uint64_t)(KRAKEN_HIST_SUB + b % KRAKEN_HIST_SUB) << shift;
+    return lower + (((uint64_t)1 << shift) - 1);
+}
+
+static inline void kraken_hist_record(KrakenHistogram *h, uint64_t v) {
+    h->counts[kraken_hist_bucket(v)]++;
+    h->total++;
+    h->sum += (double)v;
+    if (v < h->min)
+        h->min = v;
+    if (v > h->max)
+        h->max = v;
+}
+
+static inline void kraken_hist_merge(KrakenHistogram *dst, const KrakenHistogram *src) {
+    for (unsigned i = 0; i < KRAKEN_HIST_BUCKETS; i++)
+        dst->counts[i] += src->counts[i];
+    dst->total += src->total;
+    dst->sum += src->sum;
+    if (src->min < dst->min)
+        dst->min = src->min;
+    if (src->max > dst->max)
+        dst->max = src->max;
+}
+
+/* Value at quantile q (0..1), reported as its bucket's upper bound
+   clamped to the observed range. Returns 0 for an empty histogram. */
+static inline uint64_t kraken_hist_percentile(const KrakenHistogram *h, double q) {
+    if (h->total == 0)
+        return 0;
+    uint64_t rank = (uint64_t)(q * (double)h->total + 0.5);
+    if (rank < 1)
+        rank = 1;
+    if (rank > h->total)
+        rank = h->total;
+    uint64_t seen = 0;
+    for (unsigned i = 0; i < KRAKEN_HIST_BUCKETS; i++) {
+        seen += h->counts[i];
+        if (seen >= rank) {
+            uint64_t v = kraken_hist_bucket_max(i);
+            if (v < h->min)
+                v = h->min;
+            return v > h->max ? h->max : v;
+        }
+    }
+    return h->max;
+}
+
+static inline double kraken_hist_mean(const KrakenHistogram *h) {
+    return h->total ? h->sum / (double)h->total : 0.0;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* KRAKEN_HISTOGRAM_H */
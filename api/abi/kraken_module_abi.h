@@ -84,6 +84,9 @@ KRAKEN_API void kraken_free(void *p);
 #include <string.h>
 #include <stdio.h>
 
+/* Legacy single-key lookup that rescans `json` on every call. New code should
+   use kraken_params.h, which tokenizes params_json once and never matches keys
+   inside values. */
 static char *json_extract_string(const char *json, const char *key) {
     if (!json)
         return NULL;
@@ -92,12 +92,217 @@ typedef KrakenConnectionHandle (*KrakenOpenFn)(KrakenConnectionHandle conn, uint
 */
 typedef void (*KrakenCloseFn)(KrakenConnectionHandle conn);
 
+/* One outgoing frame/datagram for KrakenSendBatchFn */
+typedef struct {
+    const uint8_t *data;
+    size_t len;
+} KrakenBuffer;
+
+/* Send several frames or datagrams in one call (e.g. sendmmsg).
+   Each buffer is one message; it is never split or coalesced.
+   - conn: connection handle
+   - bufs: array of `count` buffers, sent in order
+   - timeout_ms: operation timeout for the whole batch (0 = no timeout)
+   Returns: number of buffers sent (a prefix of `bufs`), or -1 if none
+   could be sent */
+typedef int64_t (*KrakenSendBatchFn)(KrakenConnectionHandle conn, const KrakenBuffer *bufs, size_t count, uint32_t timeout_ms);
+
+/* One receive slot for KrakenRecvBatchFn. The caller provides `data` and
+   `size`; the conduit fills in the rest. */
+typedef struct {
+    uint8_t *data;
+    size_t size;
+    size_t len;           /* bytes stored in `data` */
+    int64_t timestamp_ns; /* receive time, CLOCK_REALTIME ns (0 = unknown) */
+    uint32_t flags;       /* KRAKEN_RECV_F_* */
+} KrakenRecvSlot;
+
+#define KRAKEN_RECV_F_TRUNCATED 0x1u /* message was larger than `size` */
+#define KRAKEN_RECV_F_SW_TIMESTAMP 0x2u /* timestamp taken in user space, not by the kernel/NIC */
+#define KRAKEN_RECV_F_HW_TIMESTAMP 0x4u /* timestamp taken by the NIC, on its PTP clock */
+
+/* Receive several frames or datagrams in one call (e.g. recvmmsg).
+   Waits up to timeout_ms for the first message, then returns whatever
+   else is already queued without blocking again.
+   - conn: connection handle
+   - slots: array of `count` receive slots, filled in order
+   - timeout_ms: wait for the first message (0 = no timeout)
+   Returns: number of slots filled, 0 on timeout, or -1 on error */
+typedef int64_t (*KrakenRecvBatchFn)(KrakenConnectionHandle conn, KrakenRecvSlot *slots, size_t count, uint32_t timeout_ms);
+
+/* One receive slot for KrakenRecvExFn: KrakenRecvSlot plus what the
+   conduit knows about the frame besides its bytes. */
+typedef struct {
+    uint8_t *data;
+    size_t size;
+    size_t len;           /* bytes stored in `data` */
+    size_t orig_len;      /* length on the wire, above `len` when truncated */
+    int64_t timestamp_ns; /* receive time, CLOCK_REALTIME ns (0 = unknown); with
+                             KRAKEN_RECV_F_HW_TIMESTAMP the NIC clock, which
+                             follows CLOCK_REALTIME only where it is synced
+                             (e.g. phc2sys) */
+    uint32_t flags;       /* KRAKEN_RECV_F_* */
+    uint32_t ifindex;     /* interface the frame arrived on (0 = unknown) */
+} KrakenRecvExSlot;
+
+/* KrakenRecvBatchFn with per-frame metadata: the NIC timestamp where the
+   conduit has hardware timestamping on, else the kernel's, the length
+   before truncation and the receiving interface. Same waiting rules.
+   Returns: number of slots filled, 0 on timeout, or -1 on error */
+typedef int64_t (*KrakenRecvExFn)(KrakenConnectionHandle conn, KrakenRecvExSlot *slots, size_t count, uint32_t timeout_ms);
+
+/* A received frame lent to the module by the conduit, e.g. a view into an
+   mmap'ed receive ring. Read-only; valid until released. */
+typedef struct {
+    const uint8_t *data;
+    size_t len;
+    int64_t timestamp_ns; /* receive time, CLOCK_REALTIME ns (0 = unknown) */
+    uint32_t flags;       /* KRAKEN_RECV_F_* */
+    uint64_t token;       /* conduit-private, pass back unchanged */
+} KrakenBorrowedFrame;
+
+/* Borrow up to `max` received frames without copying them.
+   Same waiting rules as KrakenRecvBatchFn. Every borrowed frame must be
+   handed back with KrakenRecvReleaseFn (in any order, before the
+   connection is closed). Frames held for long stall the conduit's
+   receive ring, so copy out what must be kept and release promptly.
+   Returns: number of frames borrowed, 0 on timeout, or -1 on error */
+typedef int64_t (*KrakenRecvBorrowFn)(KrakenConnectionHandle conn, KrakenBorrowedFrame *frames, size_t max, uint32_t timeout_ms);
+
+/* Return frames obtained from KrakenRecvBorrowFn to the conduit. */
+typedef void (*KrakenRecvReleaseFn)(KrakenConnectionHandle conn, const KrakenBorrowedFrame *frames, size_t count);
+
+/* One classic BPF instruction, same layout as Linux struct sock_filter. */
+typedef struct {
+    uint16_t code;
+    uint8_t jt;
+    uint8_t jf;
+    uint32_t k;
+} KrakenBpfInsn;
+
+/* Receive filter for KrakenSetFilterFn: a named preset, or a classic BPF
+   program run over each whole received frame (Ethernet header at offset
+   0) that returns 0 to drop it. Presets (kraken_frame_filter.h):
+     "ethercat"          EtherType 0x88A4
+     "ethercat+station"  EtherCAT command frames with a configured-address
+                         datagram (FPRD/FPWR/FPRW/FRMW) for `station` */
+typedef struct {
+    const char *preset;         /* NULL = run `insns` */
+    uint16_t station;           /* "ethercat+station" */
+    const KrakenBpfInsn *insns; /* preset == NULL */
+    size_t insn_count;
+} KrakenFrameFilter;
+
+/* Install a receive filter on a frame connection, in the kernel where the
+   conduit can, so rejected frames never reach the module. Replaces any
+   earlier filter on `conn` (NULL removes it); connections opened later
+   start without one. Frames queued before the call may still arrive, so
+   modules keep checking what they receive.
+   Returns: 0 installed, -1 if the conduit cannot apply this filter (unknown
+   preset, program rejected, not a frame connection) */
+typedef int (*KrakenSetFilterFn)(KrakenConnectionHandle conn, const KrakenFrameFilter *filter);
+
+/* ------------------------------------------------------------------ */
+/* Asynchronous operations                                            */
+/* ------------------------------------------------------------------ */
+
+/* Completion-based counterpart of send/recv/open for modules that keep
+   many operations in flight from one thread: requests go into a queue,
+   results come back as completions tagged with the caller's user_data.
+
+   - Operations on different connections proceed independently. Keep at
+     most one SEND and one RECV in flight per connection; their relative
+     order is not defined.
+   - Buffers referenced by a request must stay valid until its completion
+     has been polled.
+   - Connections produced by KRAKEN_ASYNC_OPEN are ordinary handles: use
+     them with every other op and release them with ops->close once no
+     request on them is pending. */
+typedef void *KrakenAsyncQueue;
+
+typedef enum {
+    KRAKEN_ASYNC_OPEN = 1, /* new connection configured like `conn` */
+    KRAKEN_ASYNC_SEND = 2, /* send all of data[0..len) */
+    KRAKEN_ASYNC_RECV = 3, /* receive at most len bytes into buffer */
+} KrakenAsyncOpcode;
+
+/* Completion results below zero */
+#define KRAKEN_ASYNC_ERROR (-1)
+#define KRAKEN_ASYNC_TIMEDOUT (-2)
+
+typedef struct {
+    KrakenAsyncOpcode opcode;
+    KrakenConnectionHandle conn;
+    const uint8_t *data; /* SEND */
+    uint8_t *buffer;     /* RECV */
+    size_t len;          /* SEND: bytes in data, RECV: size of buffer */
+    uint32_t timeout_ms; /* 0 = no timeout */
+    uint64_t user_data;  /* returned untouched in the completion */
+} KrakenAsyncRequest;
+
+typedef struct {
+    uint64_t user_data;
+    KrakenAsyncOpcode opcode;
+    /* OPEN: 0, SEND: bytes sent, RECV: bytes received (0 on EOF),
+       or KRAKEN_ASYNC_ERROR / KRAKEN_ASYNC_TIMEDOUT */
+    int64_t result;
+    /* OPEN: the new connection (NULL unless result is 0),
+       otherwise the request's connection */
+    KrakenConnectionHandle conn;
+} KrakenAsyncCompletion;
+
+/* Create a queue for up to `depth` requests in flight (0 = conduit
+   default). `conn` picks the conduit the requests will use.
+   Returns: queue, or NULL on error */
+typedef KrakenAsyncQueue (*KrakenAsyncCreateFn)(KrakenConnectionHandle conn, uint32_t depth);
+
+/* Queue requests. Never blocks; requests may complete before it returns.
+   Returns: number of requests accepted (a prefix of `reqs`; fewer than
+   `count` when the queue is full), or -1 on error */
+typedef int64_t (*KrakenAsyncSubmitFn)(KrakenAsyncQueue q, const KrakenAsyncRequest *reqs, size_t count);
+
+/* Collect finished requests, waiting up to timeout_ms for the first one
+   (0 = do not wait).
+   Returns: number of completions stored in `out`, or -1 on error */
+typedef int64_t (*KrakenAsyncPollFn)(KrakenAsyncQueue q, KrakenAsyncCompletion *out, size_t max, uint32_t timeout_ms);
+
+/* File descriptor that polls readable while completions may be ready,
+   for modules that multiplex the queue with their own descriptors.
+   Returns: fd owned by the queue, or -1 if the conduit has none */
+typedef int (*KrakenAsyncFdFn)(KrakenAsyncQueue q);
+
+/* Drop pending requests without completing them and free the queue.
+   Connections opened through the queue stay open. */
+typedef void (*KrakenAsyncDestroyFn)(KrakenAsyncQueue q);
+
+typedef struct {
+    KrakenAsyncCreateFn create;
+    KrakenAsyncSubmitFn submit;
+    KrakenAsyncPollFn poll;
+    KrakenAsyncFdFn fd;
+    KrakenAsyncDestroyFn destroy;
+} KrakenAsyncOps;
+
+/* Operations table handed to the module.
+
+   Members after `close` are ABI v3 extensions. Runners that enter a
+   module through kraken_run_v3 pass the full struct, with NULL for
+   whatever their conduit does not implement. kraken_run_v2 callers may
+   pass only the first five members, so v2 entrypoints must not read the
+   extensions (kraken_result_run_v2 hides them from module code). */
 typedef struct {
     KrakenSendFn send;
     KrakenRecvFn recv;
     KrakenGetConnectionInfoFn get_info;
     KrakenOpenFn open;   /* optional, may be NULL */
     KrakenCloseFn close; /* optional, may be NULL */
+    KrakenSendBatchFn send_batch; /* optional, may be NULL */
+    KrakenRecvBatchFn recv_batch; /* optional, may be NULL */
+    KrakenRecvBorrowFn recv_borrow;   /* optional, set together with recv_release */
+    KrakenRecvReleaseFn recv_release; /* optional, set together with recv_borrow */
+    const KrakenAsyncOps *async;      /* optional, may be NULL */
+    KrakenSetFilterFn set_filter;     /* optional, may be NULL */
+    KrakenRecvExFn recv_ex;           /* optional, may be NULL */
 } KrakenConnectionOps;
 
 /* V2 Finding - uses KrakenTarget instead of KrakenHostPort */
@@ -155,19 +360,19 @@ KRAKEN_API void kraken_cleanup(void);
 /* V2 Helper Functions                                                */
 /* ------------------------------------------------------------------ */
 
-static void add_log_v2(KrakenRunResultV2 *result, const char *log_line) {
+static inline void add_log_v2(KrakenRunResultV2 *result, const char *log_line) {
     result->logs.count++;
     result->logs.strings = (const char **)realloc((void *)result->logs.strings, result->logs.count * sizeof(char *));
     result->logs.strings[result->logs.count - 1] = mystrdup(log_line);
 }
 
-static void add_finding_v2(KrakenRunResultV2 *result, KrakenFindingV2 *finding) {
+static inline void add_finding_v2(KrakenRunResultV2 *result, KrakenFindingV2 *finding) {
     result->findings_count++;
     result->findings = (KrakenFindingV2 *)realloc(result->findings, result->findings_count * sizeof(KrakenFindingV2));
     result->findings[result->findings_count - 1] = *finding;
 }
 
-static void copy_target(KrakenTarget *dst, const KrakenTarget *src) {
+static inline void copy_target(KrakenTarget *dst, const KrakenTarget *src) {
     dst->kind = src->kind;
     if (src->kind == KRAKEN_TARGET_KIND_NETWORK) {
         dst->u.network.host = mystrdup(src->u.network.host);
@@ -186,7 +391,7 @@ static void copy_target(KrakenTarget *dst, const KrakenTarget *src) {
     }
 }
 
-static void free_target(KrakenTarget *t) {
+static inline void free_target(KrakenTarget *t) {
     if (t->kind == KRAKEN_TARGET_KIND_NETWORK) {
         free((void *)t->u.network.host);
     } else if (t->kind == KRAKEN_TARGET_KIND_ETHERCAT) {
@@ -0,0 +1,189 @@
+#ifndef KRAKEN_MODULE_ABI_V3_H
+#define KRAKEN_MODULE_ABI_V3_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "kraken_module_abi_v2.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define KRAKEN_ABI_VERSION_V3 3u
+
+/* Result sink: the runner receives every log line and finding as soon as
+   the module produces it instead of a KrakenRunResultV2 at the end.
+
+   - Pointers handed to the callbacks (line, finding and everything it
+     references) are only valid for the duration of the call; the runner
+     must copy what it keeps.
+   - Callbacks are never invoked concurrently for one run. They may be
+     invoked from a module thread other than the one that called
+     kraken_run_v3.
+   - Either callback may be NULL, in which case that record kind is dropped. */
+typedef void (*KrakenSinkLogFn)(void *ctx, const char *line);
+typedef void (*KrakenSinkFindingFn)(void *ctx, const KrakenFindingV2 *finding);
+
+typedef struct {
+    void *ctx;
+    KrakenSinkLogFn on_log;
+    KrakenSinkFindingFn on_finding;
+} KrakenResultSink;
+
+/* Streaming entrypoint: same contract as kraken_run_v2, except that logs
+   and findings are delivered through `sink` while the module runs. Nothing
+   is returned to free afterwards. `ops` is the full KrakenConnectionOps,
+   extension members included (NULL where unsupported).
+
+   Modules export it next to kraken_run_v2; runners look it up with dlsym
+   and fall back to kraken_run_v3_via_v2 when it is missing.
+
+   Returns: 0 on success, nonzero on error. */
+typedef int (*KrakenRunV3Fn)(KrakenConnectionHandle conn, const KrakenConnectionOps *ops, const KrakenTarget *target, uint32_t timeout_ms,
+                             const char *params_json, const KrakenResultSink *sink);
+
+KRAKEN_API int kraken_run_v3(KrakenConnectionHandle conn, const KrakenConnectionOps *ops, const KrakenTarget *target, uint32_t timeout_ms,
+                             const char *params_json, const KrakenResultSink *sink);
+
+/* ------------------------------------------------------------------ */
+/* Module-side helpers for optional ops                               */
+/* ------------------------------------------------------------------ */
+
+/* Send `count` frames through ops->send_batch when the conduit has it,
+   otherwise with one ops->send per frame. A frame counts as sent once the
+   conduit accepts it (send >= 0, or inside the prefix send_batch reports).
+   Stops at the first frame the conduit does not accept, so the frames sent
+   are always frames[0..n).
+   Returns: n, the number of frames sent. */
+static inline size_t kraken_send_frames(KrakenConnectionHandle conn, const KrakenConnectionOps *ops, const KrakenBuffer *frames, size_t count,
+                                        uint32_t timeout_ms) {
+    size_t sent = 0;
+    if (ops->send_batch) {
+        while (sent < count) {
+            int64_t n = ops->send_batch(conn, frames + sent, count - sent, timeout_ms);
+            if (n <= 0)
+                break;
+            sent += (size_t)n;
+        }
+        return sent;
+    }
+    while (sent < count && ops->send(conn, frames[sent].data, frames[sent].len, timeout_ms) >= 0)
+        sent++;
+    return sent;
+}
+
+/* Receive up to `count` frames through ops->recv_batch when the conduit
+   has it. Otherwise fill one slot with ops->recv and stamp it with the
+   user-space clock (KRAKEN_RECV_F_SW_TIMESTAMP).
+   Returns: slots filled, 0 on timeout, -1 on error. */
+static inline int64_t kraken_recv_frames(KrakenConnectionHandle conn, const KrakenConnectionOps *ops, KrakenRecvSlot *slots, size_t count,
+                                         uint32_t timeout_ms) {
+    if (count == 0)
+        return 0;
+    if (ops->recv_batch)
+        return ops->recv_batch(conn, slots, count, timeout_ms);
+    int64_t n = ops->recv(conn, slots[0].data, slots[0].size, timeout_ms);
+    if (n <= 0)
+        return n;
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    slots[0].len = (size_t)n;
+    slots[0].timestamp_ns = (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+    slots[0].flags = KRAKEN_RECV_F_SW_TIMESTAMP;
+    return 1;
+}
+
+/* kraken_recv_frames with per-frame metadata, through ops->recv_ex when
+   the conduit has it. Otherwise receives at most KRAKEN_RECV_EX_FALLBACK
+   frames through kraken_recv_frames, with orig_len = len (the length
+   before truncation is not known there) and ifindex 0.
+   Returns: slots filled, 0 on timeout, -1 on error. */
+#define KRAKEN_RECV_EX_FALLBACK 64
+
+static inline int64_t kraken_recv_frames_ex(KrakenConnectionHandle conn, const KrakenConnectionOps *ops, KrakenRecvExSlot *slots, size_t count,
+                                            uint32_t timeout_ms) {
+    if (ops->recv_ex)
+        return count ? ops->recv_ex(conn, slots, count, timeout_ms) : 0;
+    KrakenRecvSlot plain[KRAKEN_RECV_EX_FALLBACK];
+    if (count > KRAKEN_RECV_EX_FALLBACK)
+        count = KRAKEN_RECV_EX_FALLBACK;
+    for (size_t i = 0; i < count; i++) {
+        plain[i].data = slots[i].data;
+        plain[i].size = slots[i].size;
+    }
+    int64_t n = kraken_recv_frames(conn, ops, plain, count, timeout_ms);
+    for (int64_t i = 0; i < n; i++) {
+        slots[i].len = plain[i].len;
+        slots[i].orig_len = plain[i].len;
+        slots[i].timestamp_ns = plain[i].timestamp_ns;
+        slots[i].flags = plain[i].flags;
+        slots[i].ifindex = 0;
+    }
+    return n;
+}
+
+/* Where a received frame's timestamp came from, for logs and evidence */
+static inline const char *kraken_recv_clock(uint32_t flags, int64_t timestamp_ns) {
+    if (timestamp_ns == 0)
+        return "none";
+    if (flags & KRAKEN_RECV_F_HW_TIMESTAMP)
+        return "hardware";
+    if (flags & KRAKEN_RECV_F_SW_TIMESTAMP)
+        return "user space";
+    return "kernel";
+}
+
+/* Ask the conduit to drop every frame but those matching `preset` (see
+   KrakenFrameFilter) before they reach the module. Only saves work: a
+   conduit without set_filter passes everything, so modules keep checking
+   what they receive.
+   Returns: true when the conduit installed the filter. */
+static inline bool kraken_filter_frames(KrakenConnectionHandle conn, const KrakenConnectionOps *ops, const char *preset, uint16_t station) {
+    if (!ops->set_filter)
+        return false;
+    KrakenFrameFilter filter = {0};
+    filter.preset = preset;
+    filter.station = station;
+    return ops->set_filter(conn, &filter) == 0;
+}
+
+/* ------------------------------------------------------------------ */
+/* Runner-side fallback for modules that only export kraken_run_v2    */
+/* ------------------------------------------------------------------ */
+
+/* Replay a finished v2 result into a sink, in production order per kind. */
+static inline void kraken_sink_replay_v2(const KrakenResultSink *sink, const KrakenRunResultV2 *result) {
+    if (!sink || !result)
+        return;
+    if (sink->on_log) {
+        for (size_t i = 0; i < result->logs.count; i++)
+            sink->on_log(sink->ctx, result->logs.strings[i]);
+    }
+    if (sink->on_finding) {
+        for (size_t i = 0; i < result->findings_count; i++)
+            sink->on_finding(sink->ctx, &result->findings[i]);
+    }
+}
+
+/* Drive a v2 module through the v3 contract: run it to completion, forward
+   the buffered result to `sink` and release it with the module's deallocator. */
+static inline int kraken_run_v3_via_v2(KrakenRunV2Fn run_v2, KrakenFreeV2Fn free_v2, KrakenConnectionHandle conn, const KrakenConnectionOps *ops,
+                                       const KrakenTarget *target, uint32_t timeout_ms, const char *params_json, const KrakenResultSink *sink) {
+    KrakenRunResultV2 *result = NULL;
+    int rc = run_v2(conn, ops, target, timeout_ms, params_json, &result);
+    if (result) {
+        kraken_sink_replay_v2(sink, result);
+        if (free_v2)
+            free_v2(result);
+    }
+    return rc;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* KRAKEN_MODULE_ABI_V3_H */
@@ -0,0 +1,159 @@
+#ifndef KRAKEN_PACER_H
+#define KRAKEN_PACER_H
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "kraken_histogram.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ------------------------------------------------------------------ */
+/* Rate pacer                                                         */
+/*                                                                    */
+/* Releases bursts of frames on a CLOCK_MONOTONIC schedule so floods  */
+/* run at a calibrated rate. Waiting is hybrid: clock_nanosleep until */
+/* spin_ns before the deadline, then a short spin, which keeps the    */
+/* release accurate without burning a core between bursts.            */
+/*                                                                    */
+/* A sender that falls more than KRAKEN_PACER_MAX_LAG_NS behind (e.g. */
+/* a blocking send) restarts the schedule from "now" instead of       */
+/* bursting to catch up; each restart counts as a slip.               */
+/*                                                                    */
+/* Usage:                                                             */
+/*   KrakenPacer p;                                                   */
+/*   kraken_pacer_init(&p, 10000, 1, KRAKEN_PACE_UNIFORM, 1);         */
+/*   int64_t end = kraken_pacer_start(&p) + 500 * 1000000LL;          */
+/*   while (kraken_pacer_wait(&p, end))                               */
+/*       send p.burst frames;                                         */
+/* ------------------------------------------------------------------ */
+
+#define KRAKEN_PACER_SPIN_NS 50000LL       /* spin this long before a deadline */
+#define KRAKEN_PACER_MAX_LAG_NS 10000000LL /* resync when further behind */
+
+typedef enum {
+    KRAKEN_PACE_UNIFORM = 0, /* bursts evenly spaced */
+    KRAKEN_PACE_RANDOM = 1,  /* gaps uniform in [0, 2x mean): same rate, no fixed cadence */
+} KrakenPacePattern;
+
+typedef struct {
+    double fps;     /* target frames per second, 0 = unpaced */
+    uint32_t burst; /* frames released per deadline */
+    KrakenPacePattern pattern;
+    uint64_t rng; /* xorshift64 state, seeded for reproducible RANDOM runs */
+    int64_t spin_ns;
+
+    int64_t start_ns;
+    int64_t next_ns; /* deadline of the next burst */
+    int64_t prev_deadline_ns;
+    int64_t prev_release_ns;
+    uint64_t bursts;
+    uint64_t slips;
+    KrakenHistogram jitter; /* |actual gap - scheduled gap| between bursts, ns */
+} KrakenPacer;
+
+static inline int64_t kraken_pacer_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* Parse a pattern name; unknown names fall back to UNIFORM. */
+static inline KrakenPacePattern kraken_pacer_pattern(const char *name) {
+    if (name && strcmp(name, "random") == 0)
+        return KRAKEN_PACE_RANDOM;
+    return KRAKEN_PACE_UNIFORM;
+}
+
+static inline void kraken_pacer_init(KrakenPacer *p, double fps, uint32_t burst, KrakenPacePattern pattern, uint64_t seed) {
+    memset(p, 0, sizeof(*p));
+    p->fps = fps > 0 ? fps : 0;
+    p->burst = burst ? burst : 1;
+    p->pattern = pattern;
+    p->rng = seed ? seed : 0x9E3779B97F4A7C15ULL;
+    p->spin_ns = KRAKEN_PACER_SPIN_NS;
+    kraken_hist_init(&p->jitter);
+}
+
+/* Start the schedule; the first burst is due immediately.
+   Returns: start time (CLOCK_MONOTONIC ns). */
+static inline int64_t kraken_pacer_start(KrakenPacer *p) {
+    p->start_ns = kraken_pacer_now_ns();
+    p->next_ns = p->start_ns;
+    p->bursts = 0;
+    p->slips = 0;
+    return p->start_ns;
+}
+
+/* Time covered by the bursts released so far: up to the next deadline,
+   or up to now when running behind or unpaced. Dividing frames sent by
+   this gives the achieved rate. */
+static inline int64_t kraken_pacer_span_ns(const KrakenPacer *p) {
+    int64_t now = kraken_pacer_now_ns();
+    int64_t until = (p->fps > 0 && p->next_ns > now) ? p->next_ns : now;
+    return until - p->start_ns;
+}
+
+/* Scheduled gap until the next burst */
+static inline int64_t kraken_pacer_gap_ns(KrakenPacer *p) {
+    double mean = (double)p->burst * 1e9 / p->fps;
+    if (p->pattern != KRAKEN_PACE_RANDOM)
+        return (int64_t)mean;
+    p->rng ^= p->rng << 13;
+    p->rng ^= p->rng >> 7;
+    p->rng ^= p->rng << 17;
+    return (int64_t)(2.0 * mean * ((double)(p->rng >> 11) / 9007199254740992.0));
+}
+
+static inline void kraken_pacer_sleep_until(const KrakenPacer *p, int64_t deadline_ns) {
+    int64_t wake = deadline_ns - p->spin_ns;
+    if (wake > kraken_pacer_now_ns()) {
+        struct timespec ts = {.tv_sec = (time_t)(wake / 1000000000LL), .tv_nsec = (long)(wake % 1000000000LL)};
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+        }
+    }
+    while (kraken_pacer_now_ns() < deadline_ns) {
+    }
+}
+
+/* Wait for the next burst deadline.
+   Returns: true when the caller should send p->burst frames now, false
+   once the next burst would start at or after end_ns. */
+static inline bool kraken_pacer_wait(KrakenPacer *p, int64_t end_ns) {
+    if (p->fps <= 0)
+        return kraken_pacer_now_ns() < end_ns;
+
+    int64_t deadline = p->next_ns;
+    if (deadline >= end_ns)
+        return false;
+    int64_t now = kraken_pacer_now_ns();
+    if (now < deadline) {
+        kraken_pacer_sleep_until(p, deadline);
+        now = kraken_pacer_now_ns();
+    } else if (now - deadline > KRAKEN_PACER_MAX_LAG_NS) {
+        p->slips++;
+        deadline = now;
+    }
+
+    if (p->bursts > 0) {
+        int64_t d = (now - p->prev_release_ns) - (deadline - p->prev_deadline_ns);
+        kraken_hist_record(&p->jitter, (uint64_t)(d < 0 ? -d : d));
+    }
+    p->prev_release_ns = now;
+    p->prev_deadline_ns = deadline;
+    p->bursts++;
+    p->next_ns = deadline + kraken_pacer_gap_ns(p);
+    return true;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* KRAKEN_PACER_H */
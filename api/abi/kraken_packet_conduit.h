@@ -0,0 +1,1437 @@
+#ifndef KRAKEN_PACKET_CONDUIT_H
+#define KRAKEN_PACKET_CONDUIT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "kraken_frame_filter.h"
+#include "kraken_module_abi_v2.h"
+
+#if defined(__linux__)
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/filter.h>
+#include <linux/if_packet.h>
+#include <linux/net_tstamp.h>
+#include <linux/sockios.h>
+#include <net/if.h>
+#include <netdb.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ------------------------------------------------------------------ */
+/* Reference Linux conduit                                            */
+/*                                                                    */
+/* Implements KrakenConnectionOps for runners and test harnesses     */
+/* that need a working conduit without the full runner stack:         */
+/*                                                                    */
+/*   KRAKEN_CONN_TYPE_FRAME    AF_PACKET raw socket on an interface.  */
+/*                             send() takes the payload after the     */
+/*                             Ethernet header (the conduit prepends  */
+/*                             it), recv() returns whole frames.      */
+/*   KRAKEN_CONN_TYPE_DATAGRAM connected UDP socket.                  */
+/*   KRAKEN_CONN_TYPE_STREAM   TCP socket.                            */
+/*                                                                    */
+/* sendmmsg/recvmmsg need _GNU_SOURCE defined before the first system */
+/* header of the including translation unit.                          */
+/*                                                                    */
+/* Usage:                                                             */
+/*   KrakenPacketConduit *c = kraken_conduit_open_frame("eth0", NULL, */
+/*                                                      0x88A4);      */
+/*   kraken_run_v3(c, kraken_conduit_ops(), &target, 5000, NULL,      */
+/*                 &sink);                                            */
+/*   kraken_conduit_close(c);                                         */
+/*                                                                    */
+/* recv_ex reports NIC timestamps once                                */
+/* kraken_conduit_enable_hw_timestamps() succeeded, else the kernel's. */
+/*                                                                    */
+/* Frame conduits implement set_filter with SO_ATTACH_FILTER, presets  */
+/* compiled by kraken_frame_filter.h.                                 */
+/*                                                                    */
+/* Frame conduits can switch to a TPACKET_V3 RX ring with             */
+/* kraken_conduit_enable_rx_ring(); pass kraken_conduit_ops_for(c) so */
+/* modules see recv_borrow/recv_release. Alternatively they can map a */
+/* TPACKET_V2 TX ring with kraken_conduit_enable_tx_ring(), after     */
+/* which send/send_batch queue into the ring and kick the kernel once */
+/* per call.                                                          */
+/* ------------------------------------------------------------------ */
+
+#define KRAKEN_CONDUIT_ETH_HLEN 14
+#define KRAKEN_CONDUIT_BATCH_MAX 64 /* messages per sendmmsg call */
+
+#define KRAKEN_CONDUIT_RING_BLOCK_SIZE (1u << 18)
+#define KRAKEN_CONDUIT_RING_BLOCK_COUNT 16u
+#define KRAKEN_CONDUIT_RING_RETIRE_MS 2u
+
+#define KRAKEN_CONDUIT_TX_FRAME_SIZE 2048u
+#define KRAKEN_CONDUIT_TX_BLOCK_SIZE (1u << 16)
+#define KRAKEN_CONDUIT_TX_FRAME_COUNT 1024u
+
+/* TPACKET_V3 receive ring state. A block goes back to the kernel once
+   the cursor has walked past all of its frames and none of them are
+   still borrowed. */
+typedef struct {
+    uint8_t *map;
+    size_t map_len;
+    uint32_t block_size;
+    uint32_t block_count;
+    uint32_t cur;       /* block the cursor is in or waiting for */
+    uint32_t pkts_left; /* frames of `cur` not yet handed out */
+    uint8_t *next_pkt;
+    uint32_t *outstanding; /* per block: frames handed out, not released */
+    uint8_t *walked;       /* per block: cursor has moved past it */
+} KrakenConduitRing;
+
+/* TPACKET_V2 transmit ring state. Slots are filled in order; the kernel
+   hands a slot back (TP_STATUS_AVAILABLE) once the frame has left. */
+typedef struct {
+    uint8_t *map;
+    size_t map_len;
+    uint32_t frame_size;
+    uint32_t frame_count;
+    uint32_t cur;      /* next slot to fill */
+    size_t prefilled;  /* length of the frame every slot holds, 0 = none */
+    bool qdisc_bypass; /* PACKET_QDISC_BYPASS accepted by the kernel */
+} KrakenConduitTxRing;
+
+typedef struct {
+    int fd;
+    KrakenConnectionType type;
+
+    /* FRAME */
+    char iface[IF_NAMESIZE];
+    uint32_t ifindex;
+    bool hw_timestamps; /* kraken_conduit_enable_hw_timestamps succeeded */
+    uint16_t ethertype;
+    uint8_t dst_mac[6];
+    uint8_t eth_header[KRAKEN_CONDUIT_ETH_HLEN]; /* prepended to every send */
+
+    /* DATAGRAM, STREAM */
+    char host[256];
+    uint16_t port;
+
+    char local_addr[64];
+    char remote_addr[300];
+    KrakenConnectionInfo info;
+
+    KrakenConduitRing *ring;       /* FRAME with kraken_conduit_enable_rx_ring */
+    KrakenConduitTxRing *tx_ring; /* FRAME with kraken_conduit_enable_tx_ring */
+} KrakenPacketConduit;
+
+static inline void kraken_conduit_format_mac(char *out, size_t size, const uint8_t mac[6]) {
+    snprintf(out, size, "%02x:%02x:%02x:%02x:%02x:%02x", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+}
+
+/* Wait until `fd` is ready for `events`.
+   Returns: 1 ready, 0 timed out, -1 error. timeout_ms 0 waits forever. */
+static inline int kraken_conduit_wait(int fd, short events, uint32_t timeout_ms) {
+    struct pollfd pfd = {.fd = fd, .events = events};
+    for (;;) {
+        int pr = poll(&pfd, 1, timeout_ms ? (int)timeout_ms : -1);
+        if (pr < 0 && errno == EINTR)
+            continue;
+        if (pr < 0)
+            return -1;
+        return pr > 0 ? 1 : 0;
+    }
+}
+
+/* Kernel receive timestamps for recv_batch, and (frames) no loopback of
+   our own transmissions where the kernel supports it. */
+static inline void kraken_conduit_setup_rx(KrakenPacketConduit *c) {
+    int one = 1;
+    setsockopt(c->fd, SOL_SOCKET, SO_TIMESTAMPNS, &one, sizeof(one));
+#ifdef PACKET_IGNORE_OUTGOING
+    if (c->type == KRAKEN_CONN_TYPE_FRAME)
+        setsockopt(c->fd, SOL_PACKET, PACKET_IGNORE_OUTGOING, &one, sizeof(one));
+#endif
+}
+
+static inline void kraken_conduit_init_info(KrakenPacketConduit *c) {
+    c->info.type = c->type;
+    c->info.local_addr = c->local_addr;
+    c->info.remote_addr = c->remote_addr;
+    c->info.stack_layers = NULL;
+    c->info.stack_layers_count = 0;
+}
+
+/* Raw Ethernet conduit on `iface`. `dst_mac` NULL = broadcast, which is
+   what EtherCAT masters and slaves use. Needs CAP_NET_RAW. */
+static inline KrakenPacketConduit *kraken_conduit_open_frame(const char *iface, const uint8_t dst_mac[6], uint16_t ethertype) {
+    if (!iface || strlen(iface) >= IF_NAMESIZE)
+        return NULL;
+    unsigned ifindex = if_nametoindex(iface);
+    if (ifindex == 0)
+        return NULL;
+
+    KrakenPacketConduit *c = (KrakenPacketConduit *)calloc(1, sizeof(*c));
+    if (!c)
+        return NULL;
+    c->type = KRAKEN_CONN_TYPE_FRAME;
+    c->ethertype = ethertype;
+    c->ifindex = ifindex;
+    strcpy(c->iface, iface);
+    if (dst_mac)
+        memcpy(c->dst_mac, dst_mac, 6);
+    else
+        memset(c->dst_mac, 0xFF, 6);
+
+    c->fd = socket(AF_PACKET, SOCK_RAW | SOCK_CLOEXEC, htons(ethertype));
+    if (c->fd < 0) {
+        free(c);
+        return NULL;
+    }
+    struct sockaddr_ll sll = {0};
+    sll.sll_family = AF_PACKET;
+    sll.sll_protocol = htons(ethertype);
+    sll.sll_ifindex = (int)ifindex;
+    if (bind(c->fd, (struct sockaddr *)&sll, sizeof(sll)) != 0) {
+        close(c->fd);
+        free(c);
+        return NULL;
+    }
+
+    uint8_t src_mac[6] = {0};
+    struct ifreq ifr;
+    memset(&ifr, 0, sizeof(ifr));
+    strcpy(ifr.ifr_name, iface);
+    if (ioctl(c->fd, SIOCGIFHWADDR, &ifr) == 0)
+        memcpy(src_mac, ifr.ifr_hwaddr.sa_data, 6);
+
+    memcpy(c->eth_header, c->dst_mac, 6);
+    memcpy(c->eth_header + 6, src_mac, 6);
+    c->eth_header[12] = (uint8_t)(ethertype >> 8);
+    c->eth_header[13] = (uint8_t)ethertype;
+
+    char mac[18];
+    kraken_conduit_format_mac(mac, sizeof(mac), src_mac);
+    snprintf(c->local_addr, sizeof(c->local_addr), "%s/%s", iface, mac);
+    kraken_conduit_format_mac(c->remote_addr, sizeof(c->remote_addr), c->dst_mac);
+    kraken_conduit_setup_rx(c);
+    kraken_conduit_init_info(c);
+    return c;
+}
+
+/* Put the interface of a frame conduit in promiscuous mode for as long
+   as the socket is open, so unicast frames for other stations arrive
+   too (bridges and taps need every frame on the segment).
+   Returns: 0 on success, -1 on error. */
+static inline int kraken_conduit_set_promisc(KrakenPacketConduit *c) {
+    struct packet_mreq mr;
+    memset(&mr, 0, sizeof(mr));
+    mr.mr_ifindex = (int)if_nametoindex(c->iface);
+    mr.mr_type = PACKET_MR_PROMISC;
+    return setsockopt(c->fd, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &mr, sizeof(mr));
+}
+
+/* Have the NIC timestamp every received frame and report those stamps
+   through recv_ex and the RX ring. Reconfigures the interface for every
+   socket on it and needs CAP_NET_ADMIN and driver support; call it
+   before kraken_conduit_enable_rx_ring.
+   Returns: 0 on success, -1 when the interface cannot timestamp. */
+static inline int kraken_conduit_enable_hw_timestamps(KrakenPacketConduit *c) {
+    if (c->type != KRAKEN_CONN_TYPE_FRAME)
+        return -1;
+    struct hwtstamp_config cfg;
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.tx_type = HWTSTAMP_TX_OFF;
+    cfg.rx_filter = HWTSTAMP_FILTER_ALL;
+    struct ifreq ifr;
+    memset(&ifr, 0, sizeof(ifr));
+    strcpy(ifr.ifr_name, c->iface);
+    ifr.ifr_data = (char *)&cfg;
+    if (ioctl(c->fd, SIOCSHWTSTAMP, &ifr) != 0 || cfg.rx_filter == HWTSTAMP_FILTER_NONE)
+        return -1;
+    int flags = SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE;
+    if (setsockopt(c->fd, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) != 0)
+        return -1;
+    int ring_ts = SOF_TIMESTAMPING_RAW_HARDWARE;
+    setsockopt(c->fd, SOL_PACKET, PACKET_TIMESTAMP, &ring_ts, sizeof(ring_ts));
+    c->hw_timestamps = true;
+    return 0;
+}
+
+/* Send whole Ethernet frames exactly as given, header included, instead
+   of behind the conduit's own header: for forwarding frames between
+   interfaces with their addresses intact. Bypasses the TX ring.
+   Returns: frames sent, or -1 if none could be. */
+static inline int64_t kraken_conduit_forward(KrakenPacketConduit *c, const KrakenBuffer *frames, size_t count, uint32_t timeout_ms) {
+    struct mmsghdr msgs[KRAKEN_CONDUIT_BATCH_MAX];
+    struct iovec iovs[KRAKEN_CONDUIT_BATCH_MAX];
+    size_t sent = 0;
+    while (sent < count) {
+        size_t chunk = count - sent;
+        if (chunk > KRAKEN_CONDUIT_BATCH_MAX)
+            chunk = KRAKEN_CONDUIT_BATCH_MAX;
+        memset(msgs, 0, chunk * sizeof(msgs[0]));
+        for (size_t i = 0; i < chunk; i++) {
+            iovs[i].iov_base = (void *)frames[sent + i].data;
+            iovs[i].iov_len = frames[sent + i].len;
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+        int n = sendmmsg(c->fd, msgs, (unsigned)chunk, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (n > 0) {
+            sent += (size_t)n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS) && kraken_conduit_wait(c->fd, POLLOUT, timeout_ms) > 0)
+            continue;
+        break;
+    }
+    return sent > 0 ? (int64_t)sent : -1;
+}
+
+/* Start connecting a non-blocking socket of `socktype` to host:port,
+   trying each resolved address until one connects or is in progress.
+   Name resolution itself blocks.
+   Returns: 0 connected, 1 in progress (wait for POLLOUT, then check
+   SO_ERROR), -1 error. */
+static inline int kraken_conduit_dial(const char *host, uint16_t port, int socktype, int *fd_out) {
+    *fd_out = -1;
+    char port_str[8];
+    snprintf(port_str, sizeof(port_str), "%u", (unsigned)port);
+    struct addrinfo hints = {0};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = socktype;
+    struct addrinfo *res = NULL;
+    if (getaddrinfo(host, port_str, &hints, &res) != 0)
+        return -1;
+
+    int rc = -1;
+    for (struct addrinfo *ai = res; ai; ai = ai->ai_next) {
+        int fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC | SOCK_NONBLOCK, ai->ai_protocol);
+        if (fd < 0)
+            continue;
+        if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0)
+            rc = 0;
+        else if (errno == EINPROGRESS)
+            rc = 1;
+        if (rc >= 0) {
+            *fd_out = fd;
+            break;
+        }
+        close(fd);
+    }
+    freeaddrinfo(res);
+    return rc;
+}
+
+/* Conduit around a connected socket; takes ownership of `fd`. */
+static inline KrakenPacketConduit *kraken_conduit_wrap(int fd, KrakenConnectionType type, const char *host, uint16_t port) {
+    KrakenPacketConduit *c = (KrakenPacketConduit *)calloc(1, sizeof(*c));
+    if (!c) {
+        close(fd);
+        return NULL;
+    }
+    c->fd = fd;
+    c->type = type;
+    strcpy(c->host, host);
+    c->port = port;
+
+    struct sockaddr_storage local;
+    socklen_t local_len = sizeof(local);
+    char addr[INET6_ADDRSTRLEN] = "?";
+    if (getsockname(fd, (struct sockaddr *)&local, &local_len) == 0) {
+        if (local.ss_family == AF_INET6) {
+            inet_ntop(AF_INET6, &((struct sockaddr_in6 *)&local)->sin6_addr, addr, sizeof(addr));
+            snprintf(c->local_addr, sizeof(c->local_addr), "[%s]:%u", addr, ntohs(((struct sockaddr_in6 *)&local)->sin6_port));
+        } else {
+            inet_ntop(AF_INET, &((struct sockaddr_in *)&local)->sin_addr, addr, sizeof(addr));
+            snprintf(c->local_addr, sizeof(c->local_addr), "%s:%u", addr, ntohs(((struct sockaddr_in *)&local)->sin_port));
+        }
+    }
+    snprintf(c->remote_addr, sizeof(c->remote_addr), "%s:%u", host, (unsigned)port);
+    kraken_conduit_setup_rx(c);
+    kraken_conduit_init_info(c);
+    return c;
+}
+
+/* Connected UDP conduit to host:port. */
+static inline KrakenPacketConduit *kraken_conduit_open_udp(const char *host, uint16_t port) {
+    if (!host || strlen(host) >= sizeof(((KrakenPacketConduit *)0)->host))
+        return NULL;
+    int fd;
+    if (kraken_conduit_dial(host, port, SOCK_DGRAM, &fd) != 0) {
+        if (fd >= 0)
+            close(fd);
+        return NULL;
+    }
+    return kraken_conduit_wrap(fd, KRAKEN_CONN_TYPE_DATAGRAM, host, port);
+}
+
+/* TCP conduit to host:port. timeout_ms bounds the handshake (0 = no
+   timeout). */
+static inline KrakenPacketConduit *kraken_conduit_open_tcp(const char *host, uint16_t port, uint32_t timeout_ms) {
+    if (!host || strlen(host) >= sizeof(((KrakenPacketConduit *)0)->host))
+        return NULL;
+    int fd;
+    int rc = kraken_conduit_dial(host, port, SOCK_STREAM, &fd);
+    if (rc == 1) {
+        int err = 0;
+        socklen_t err_len = sizeof(err);
+        if (kraken_conduit_wait(fd, POLLOUT, timeout_ms) > 0 && getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &err_len) == 0 && err == 0)
+            rc = 0;
+    }
+    if (rc != 0) {
+        if (fd >= 0)
+            close(fd);
+        return NULL;
+    }
+    return kraken_conduit_wrap(fd, KRAKEN_CONN_TYPE_STREAM, host, port);
+}
+
+/* ------------------------------------------------------------------ */
+/* TPACKET_V3 receive ring (frame conduits)                           */
+/* ------------------------------------------------------------------ */
+
+static inline void kraken_conduit_ring_free(KrakenConduitRing *r) {
+    if (!r)
+        return;
+    if (r->map && r->map != MAP_FAILED)
+        munmap(r->map, r->map_len);
+    free(r->outstanding);
+    free(r->walked);
+    free(r);
+}
+
+/* Switch a frame conduit to an mmap'ed TPACKET_V3 receive ring. From then
+   on frames land in the ring: recv/recv_batch copy out of it and
+   recv_borrow lends views into it. Zero arguments pick the defaults;
+   retire_ms bounds how long a partly filled block waits before it is
+   handed to user space.
+   Returns: 0 on success, -1 on error (conduit unchanged). */
+static inline int kraken_conduit_enable_rx_ring(KrakenPacketConduit *c, uint32_t block_size, uint32_t block_count, uint32_t retire_ms) {
+    if (!c || c->type != KRAKEN_CONN_TYPE_FRAME || c->ring || c->tx_ring)
+        return -1;
+    KrakenConduitRing *r = (KrakenConduitRing *)calloc(1, sizeof(*r));
+    if (!r)
+        return -1;
+    r->block_size = block_size ? block_size : KRAKEN_CONDUIT_RING_BLOCK_SIZE;
+    r->block_count = block_count ? block_count : KRAKEN_CONDUIT_RING_BLOCK_COUNT;
+    r->outstanding = (uint32_t *)calloc(r->block_count, sizeof(uint32_t));
+    r->walked = (uint8_t *)calloc(r->block_count, 1);
+    if (!r->outstanding || !r->walked) {
+        kraken_conduit_ring_free(r);
+        return -1;
+    }
+
+    int version = TPACKET_V3;
+    struct tpacket_req3 req;
+    memset(&req, 0, sizeof(req));
+    req.tp_block_size = r->block_size;
+    req.tp_block_nr = r->block_count;
+    req.tp_frame_size = 2048;
+    req.tp_frame_nr = (r->block_size / req.tp_frame_size) * r->block_count;
+    req.tp_retire_blk_tov = retire_ms ? retire_ms : KRAKEN_CONDUIT_RING_RETIRE_MS;
+    if (setsockopt(c->fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) != 0 ||
+        setsockopt(c->fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) != 0) {
+        kraken_conduit_ring_free(r);
+        return -1;
+    }
+    r->map_len = (size_t)r->block_size * r->block_count;
+    r->map = (uint8_t *)mmap(NULL, r->map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_LOCKED, c->fd, 0);
+    if (r->map == MAP_FAILED)
+        r->map = (uint8_t *)mmap(NULL, r->map_len, PROT_READ | PROT_WRITE, MAP_SHARED, c->fd, 0);
+    if (r->map == MAP_FAILED) {
+        kraken_conduit_ring_free(r);
+        return -1;
+    }
+    c->ring = r;
+    return 0;
+}
+
+static inline struct tpacket_block_desc *kraken_conduit_ring_block(KrakenConduitRing *r, uint32_t i) {
+    return (struct tpacket_block_desc *)(r->map + (size_t)i * r->block_size);
+}
+
+static inline void kraken_conduit_ring_maybe_return(KrakenConduitRing *r, uint32_t i) {
+    if (r->walked[i] && r->outstanding[i] == 0) {
+        r->walked[i] = 0;
+        __atomic_store_n(&kraken_conduit_ring_block(r, i)->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+    }
+}
+
+/* Next incoming frame in the ring; its block is pinned until
+   kraken_conduit_ring_put. Waits up to timeout_ms when `wait` is set.
+   Returns: frame header, or NULL (*err set on error, clear on timeout). */
+static inline struct tpacket3_hdr *kraken_conduit_ring_get(KrakenPacketConduit *c, bool wait, uint32_t timeout_ms, uint32_t *block_out,
+                                                           bool *err) {
+    KrakenConduitRing *r = c->ring;
+    *err = false;
+    for (;;) {
+        if (r->pkts_left == 0) {
+            struct tpacket_block_desc *bd = kraken_conduit_ring_block(r, r->cur);
+            uint32_t status = __atomic_load_n(&bd->hdr.bh1.block_status, __ATOMIC_ACQUIRE);
+            if (!(status & TP_STATUS_USER) || r->walked[r->cur]) {
+                if (!wait)
+                    return NULL;
+                int w = kraken_conduit_wait(c->fd, POLLIN, timeout_ms);
+                if (w < 0)
+                    *err = true;
+                if (w <= 0)
+                    return NULL;
+                wait = false; /* one wait per call, like recv_batch */
+                continue;
+            }
+            r->pkts_left = bd->hdr.bh1.num_pkts;
+            r->next_pkt = (uint8_t *)bd + bd->hdr.bh1.offset_to_first_pkt;
+            if (r->pkts_left == 0) {
+                r->walked[r->cur] = 1;
+                kraken_conduit_ring_maybe_return(r, r->cur);
+                r->cur = (r->cur + 1) % r->block_count;
+                continue;
+            }
+        }
+
+        struct tpacket3_hdr *pkt = (struct tpacket3_hdr *)r->next_pkt;
+        uint32_t block = r->cur;
+        if (--r->pkts_left == 0) {
+            r->walked[block] = 1;
+            r->cur = (r->cur + 1) % r->block_count;
+        } else {
+            r->next_pkt += pkt->tp_next_offset;
+        }
+
+        const struct sockaddr_ll *from = (const struct sockaddr_ll *)((uint8_t *)pkt + TPACKET_ALIGN(sizeof(struct tpacket3_hdr)));
+        if (from->sll_pkttype == PACKET_OUTGOING) {
+            kraken_conduit_ring_maybe_return(r, block);
+            continue;
+        }
+        r->outstanding[block]++;
+        *block_out = block;
+        return pkt;
+    }
+}
+
+static inline void kraken_conduit_ring_put(KrakenConduitRing *r, uint32_t block) {
+    if (block < r->block_count && r->outstanding[block] > 0) {
+        r->outstanding[block]--;
+        kraken_conduit_ring_maybe_return(r, block);
+    }
+}
+
+static inline void kraken_conduit_ring_view(const struct tpacket3_hdr *pkt, const uint8_t **data, size_t *len, int64_t *ts, uint32_t *flags) {
+    *data = (const uint8_t *)pkt + pkt->tp_mac;
+    *len = pkt->tp_snaplen;
+    *ts = (int64_t)pkt->tp_sec * 1000000000LL + pkt->tp_nsec;
+    *flags = pkt->tp_snaplen < pkt->tp_len ? KRAKEN_RECV_F_TRUNCATED : 0;
+    if (pkt->tp_status & TP_STATUS_TS_RAW_HARDWARE)
+        *flags |= KRAKEN_RECV_F_HW_TIMESTAMP;
+}
+
+/* ------------------------------------------------------------------ */
+/* TPACKET_V2 transmit ring (frame conduits)                          */
+/* ------------------------------------------------------------------ */
+
+static inline void kraken_conduit_tx_ring_free(KrakenConduitTxRing *t) {
+    if (!t)
+        return;
+    if (t->map && t->map != MAP_FAILED)
+        munmap(t->map, t->map_len);
+    free(t);
+}
+
+/* Map a TPACKET_V2 transmit ring on a frame conduit. Frames are written
+   straight into shared slots and one send() per batch makes the kernel
+   transmit every queued slot. With `qdisc_bypass` the frames also skip
+   the qdisc layer (PACKET_QDISC_BYPASS, where supported), which means
+   local taps on the interface no longer see them. Cannot be combined
+   with the RX ring. frame_count 0 picks the default.
+   Returns: 0 on success, -1 on error (conduit unchanged). */
+static inline int kraken_conduit_enable_tx_ring(KrakenPacketConduit *c, uint32_t frame_count, bool qdisc_bypass) {
+    if (!c || c->type != KRAKEN_CONN_TYPE_FRAME || c->ring || c->tx_ring)
+        return -1;
+    KrakenConduitTxRing *t = (KrakenConduitTxRing *)calloc(1, sizeof(*t));
+    if (!t)
+        return -1;
+    uint32_t per_block = KRAKEN_CONDUIT_TX_BLOCK_SIZE / KRAKEN_CONDUIT_TX_FRAME_SIZE;
+    uint32_t want = frame_count ? frame_count : KRAKEN_CONDUIT_TX_FRAME_COUNT;
+    struct tpacket_req req;
+    memset(&req, 0, sizeof(req));
+    req.tp_block_size = KRAKEN_CONDUIT_TX_BLOCK_SIZE;
+    req.tp_block_nr = (want + per_block - 1) / per_block;
+    req.tp_frame_size = KRAKEN_CONDUIT_TX_FRAME_SIZE;
+    req.tp_frame_nr = req.tp_block_nr * per_block;
+
+    int version = TPACKET_V2;
+    if (setsockopt(c->fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) != 0) {
+        free(t);
+        return -1;
+    }
+#ifdef PACKET_QDISC_BYPASS
+    int one = 1;
+    if (qdisc_bypass)
+        t->qdisc_bypass = setsockopt(c->fd, SOL_PACKET, PACKET_QDISC_BYPASS, &one, sizeof(one)) == 0;
+#else
+    (void)qdisc_bypass;
+#endif
+    if (setsockopt(c->fd, SOL_PACKET, PACKET_TX_RING, &req, sizeof(req)) != 0) {
+        free(t);
+        return -1;
+    }
+    t->frame_size = req.tp_frame_size;
+    t->frame_count = req.tp_frame_nr;
+    t->map_len = (size_t)req.tp_block_size * req.tp_block_nr;
+    t->map = (uint8_t *)mmap(NULL, t->map_len, PROT_READ | PROT_WRITE, MAP_SHARED, c->fd, 0);
+    if (t->map == MAP_FAILED) {
+        kraken_conduit_tx_ring_free(t);
+        return -1;
+    }
+    c->tx_ring = t;
+    return 0;
+}
+
+static inline struct tpacket2_hdr *kraken_conduit_tx_slot(KrakenConduitTxRing *t, uint32_t i) {
+    return (struct tpacket2_hdr *)(t->map + (size_t)i * t->frame_size);
+}
+
+/* Frame bytes start right after the aligned slot header */
+static inline uint8_t *kraken_conduit_tx_data(struct tpacket2_hdr *hdr) {
+    return (uint8_t *)hdr + TPACKET_ALIGN(sizeof(struct tpacket2_hdr));
+}
+
+static inline bool kraken_conduit_tx_free(struct tpacket2_hdr *hdr) {
+    uint32_t status = __atomic_load_n(&hdr->tp_status, __ATOMIC_ACQUIRE);
+    return status == TP_STATUS_AVAILABLE || (status & TP_STATUS_WRONG_FORMAT);
+}
+
+/* Have the kernel transmit every slot marked TP_STATUS_SEND_REQUEST.
+   A full device queue is not an error: the slots stay requested and go
+   out with the next kick. */
+static inline int kraken_conduit_tx_kick(KrakenPacketConduit *c) {
+    for (;;) {
+        if (send(c->fd, NULL, 0, MSG_DONTWAIT) >= 0)
+            return 0;
+        if (errno == EINTR)
+            continue;
+        return (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS) ? 0 : -1;
+    }
+}
+
+/* Slot under the cursor once the kernel has released it, kicking and
+   then waiting up to timeout_ms while the ring is full.
+   Returns: slot header, or NULL on timeout or error. */
+static inline struct tpacket2_hdr *kraken_conduit_tx_acquire(KrakenPacketConduit *c, uint32_t timeout_ms) {
+    struct tpacket2_hdr *hdr = kraken_conduit_tx_slot(c->tx_ring, c->tx_ring->cur);
+    if (kraken_conduit_tx_free(hdr))
+        return hdr;
+    if (kraken_conduit_tx_kick(c) != 0)
+        return NULL;
+    if (kraken_conduit_tx_free(hdr))
+        return hdr;
+    if (kraken_conduit_wait(c->fd, POLLOUT, timeout_ms) <= 0 || !kraken_conduit_tx_free(hdr))
+        return NULL;
+    return hdr;
+}
+
+static inline void kraken_conduit_tx_queue(KrakenConduitTxRing *t, struct tpacket2_hdr *hdr, uint32_t len) {
+    hdr->tp_len = len;
+    __atomic_store_n(&hdr->tp_status, TP_STATUS_SEND_REQUEST, __ATOMIC_RELEASE);
+    t->cur = (t->cur + 1) % t->frame_count;
+}
+
+/* Copy frames (payload after the Ethernet header) into the ring and kick
+   once. Payloads that do not fit a slot are skipped.
+   Returns: frames queued, or -1 if none could be. */
+static inline int64_t kraken_conduit_tx_send(KrakenPacketConduit *c, const KrakenBuffer *bufs, size_t count, uint32_t timeout_ms) {
+    KrakenConduitTxRing *t = c->tx_ring;
+    size_t room = t->frame_size - TPACKET_ALIGN(sizeof(struct tpacket2_hdr)) - KRAKEN_CONDUIT_ETH_HLEN;
+    size_t queued = 0;
+    t->prefilled = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (bufs[i].len > room)
+            continue;
+        struct tpacket2_hdr *hdr = kraken_conduit_tx_acquire(c, timeout_ms);
+        if (!hdr)
+            break;
+        uint8_t *data = kraken_conduit_tx_data(hdr);
+        memcpy(data, c->eth_header, KRAKEN_CONDUIT_ETH_HLEN);
+        memcpy(data + KRAKEN_CONDUIT_ETH_HLEN, bufs[i].data, bufs[i].len);
+        kraken_conduit_tx_queue(t, hdr, (uint32_t)(KRAKEN_CONDUIT_ETH_HLEN + bufs[i].len));
+        queued++;
+    }
+    if (queued > 0 && kraken_conduit_tx_kick(c) != 0)
+        return -1;
+    return queued > 0 ? (int64_t)queued : -1;
+}
+
+/* Write one frame (payload after the Ethernet header) into every slot,
+   so floods of identical frames only flip slot states afterwards. Needs
+   an idle ring: no slot may still be waiting for the kernel.
+   Returns: 0 on success, -1 on error. */
+static inline int kraken_conduit_tx_prefill(KrakenPacketConduit *c, const uint8_t *payload, size_t len) {
+    KrakenConduitTxRing *t = c->tx_ring;
+    if (!t || len == 0 || len > t->frame_size - TPACKET_ALIGN(sizeof(struct tpacket2_hdr)) - KRAKEN_CONDUIT_ETH_HLEN)
+        return -1;
+    for (uint32_t i = 0; i < t->frame_count; i++) {
+        if (!kraken_conduit_tx_free(kraken_conduit_tx_slot(t, i)))
+            return -1;
+    }
+    for (uint32_t i = 0; i < t->frame_count; i++) {
+        struct tpacket2_hdr *hdr = kraken_conduit_tx_slot(t, i);
+        uint8_t *data = kraken_conduit_tx_data(hdr);
+        memcpy(data, c->eth_header, KRAKEN_CONDUIT_ETH_HLEN);
+        memcpy(data + KRAKEN_CONDUIT_ETH_HLEN, payload, len);
+        hdr->tp_len = (uint32_t)(KRAKEN_CONDUIT_ETH_HLEN + len);
+    }
+    t->prefilled = KRAKEN_CONDUIT_ETH_HLEN + len;
+    return 0;
+}
+
+/* Queue `count` copies of the prefilled frame and kick once.
+   Returns: frames queued (fewer when the ring stays full past
+   timeout_ms). */
+static inline size_t kraken_conduit_tx_send_prefilled(KrakenPacketConduit *c, size_t count, uint32_t timeout_ms) {
+    KrakenConduitTxRing *t = c->tx_ring;
+    if (!t || t->prefilled == 0)
+        return 0;
+    size_t queued = 0;
+    for (; queued < count; queued++) {
+        struct tpacket2_hdr *hdr = kraken_conduit_tx_acquire(c, timeout_ms);
+        if (!hdr)
+            break;
+        kraken_conduit_tx_queue(t, hdr, (uint32_t)t->prefilled);
+    }
+    if (queued > 0)
+        kraken_conduit_tx_kick(c);
+    return queued;
+}
+
+static inline void kraken_conduit_close(KrakenPacketConduit *c) {
+    if (!c)
+        return;
+    kraken_conduit_ring_free(c->ring);
+    kraken_conduit_tx_ring_free(c->tx_ring);
+    if (c->fd >= 0)
+        close(c->fd);
+    free(c);
+}
+
+/* ------------------------------------------------------------------ */
+/* KrakenConnectionOps implementation                                 */
+/* ------------------------------------------------------------------ */
+
+/* iovecs for one outgoing message: Ethernet header (frames) + payload */
+static inline int kraken_conduit_iov(KrakenPacketConduit *c, struct iovec iov[2], const uint8_t *data, size_t len) {
+    int n = 0;
+    if (c->type == KRAKEN_CONN_TYPE_FRAME) {
+        iov[n].iov_base = c->eth_header;
+        iov[n].iov_len = KRAKEN_CONDUIT_ETH_HLEN;
+        n++;
+    }
+    iov[n].iov_base = (void *)data;
+    iov[n].iov_len = len;
+    return n + 1;
+}
+
+static inline int64_t kraken_conduit_op_send(KrakenConnectionHandle conn, const uint8_t *data, size_t len, uint32_t timeout_ms) {
+    KrakenPacketConduit *c = (KrakenPacketConduit *)conn;
+    if (c->tx_ring) {
+        KrakenBuffer buf = {data, len};
+        return kraken_conduit_tx_send(c, &buf, 1, timeout_ms) == 1 ? (int64_t)len : -1;
+    }
+    struct iovec iov[2];
+    struct msghdr msg = {0};
+    msg.msg_iov = iov;
+    msg.msg_iovlen = (size_t)kraken_conduit_iov(c, iov, data, len);
+    size_t done = 0;
+    for (;;) {
+        ssize_t n = sendmsg(c->fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (n >= 0) {
+            /* Only streams write partially; frames and datagrams are atomic */
+            done += (size_t)n;
+            if (c->type != KRAKEN_CONN_TYPE_STREAM || done >= len)
+                return (int64_t)len;
+            iov[0].iov_base = (void *)(data + done);
+            iov[0].iov_len = len - done;
+            continue;
+        }
+        if (errno == EINTR)
+            continue;
+        if ((errno != EAGAIN && errno != EWOULDBLOCK && errno != ENOBUFS) || kraken_conduit_wait(c->fd, POLLOUT, timeout_ms) <= 0)
+            return -1;
+    }
+}
+
+/* sendmmsg in chunks of KRAKEN_CONDUIT_BATCH_MAX. Frames share the
+   conduit's Ethernet header iovec, so payloads are never copied. */
+static inline int64_t kraken_conduit_op_send_batch(KrakenConnectionHandle conn, const KrakenBuffer *bufs, size_t count, uint32_t timeout_ms) {
+    KrakenPacketConduit *c = (KrakenPacketConduit *)conn;
+    struct mmsghdr msgs[KRAKEN_CONDUIT_BATCH_MAX];
+    struct iovec iovs[KRAKEN_CONDUIT_BATCH_MAX][2];
+    size_t sent = 0;
+
+    if (c->tx_ring)
+        return kraken_conduit_tx_send(c, bufs, count, timeout_ms);
+
+    /* A stream has no message boundaries to batch on */
+    if (c->type == KRAKEN_CONN_TYPE_STREAM) {
+        while (sent < count && kraken_conduit_op_send(conn, bufs[sent].data, bufs[sent].len, timeout_ms) >= 0)
+            sent++;
+        return sent > 0 ? (int64_t)sent : -1;
+    }
+
+    while (sent < count) {
+        size_t chunk = count - sent;
+        if (chunk > KRAKEN_CONDUIT_BATCH_MAX)
+            chunk = KRAKEN_CONDUIT_BATCH_MAX;
+        memset(msgs, 0, chunk * sizeof(msgs[0]));
+        for (size_t i = 0; i < chunk; i++) {
+            msgs[i].msg_hdr.msg_iov = iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = (size_t)kraken_conduit_iov(c, iovs[i], bufs[sent + i].data, bufs[sent + i].len);
+        }
+        int n = sendmmsg(c->fd, msgs, (unsigned)chunk, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (n > 0) {
+            sent += (size_t)n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS) && kraken_conduit_wait(c->fd, POLLOUT, timeout_ms) > 0)
+            continue;
+        break;
+    }
+    return sent > 0 ? (int64_t)sent : -1;
+}
+
+/* Receive one message without blocking. Frames sent by this host are
+   looped back to packet sockets; skip them so modules only see traffic
+   from the segment.
+   Returns: bytes received (0 on EOF for streams), or -1 with errno set
+   (EAGAIN when nothing is queued). */
+static inline int64_t kraken_conduit_recv_now(KrakenPacketConduit *c, uint8_t *buffer, size_t buffer_size) {
+    if (c->ring) {
+        uint32_t block;
+        bool err;
+        struct tpacket3_hdr *pkt = kraken_conduit_ring_get(c, false, 0, &block, &err);
+        if (!pkt) {
+            errno = EAGAIN;
+            return -1;
+        }
+        const uint8_t *data;
+        size_t len;
+        int64_t ts;
+        uint32_t flags;
+        kraken_conduit_ring_view(pkt, &data, &len, &ts, &flags);
+        if (len > buffer_size)
+            len = buffer_size;
+        memcpy(buffer, data, len);
+        kraken_conduit_ring_put(c->ring, block);
+        return (int64_t)len;
+    }
+    for (;;) {
+        struct sockaddr_ll from;
+        socklen_t from_len = sizeof(from);
+        ssize_t n = recvfrom(c->fd, buffer, buffer_size, MSG_DONTWAIT, (struct sockaddr *)&from, &from_len);
+        if (n >= 0 && c->type == KRAKEN_CONN_TYPE_FRAME && from.sll_pkttype == PACKET_OUTGOING)
+            continue;
+        return (int64_t)n;
+    }
+}
+
+static inline int64_t kraken_conduit_op_recv(KrakenConnectionHandle conn, uint8_t *buffer, size_t buffer_size, uint32_t timeout_ms) {
+    KrakenPacketConduit *c = (KrakenPacketConduit *)conn;
+    for (;;) {
+        int64_t n = kraken_conduit_recv_now(c, buffer, buffer_size);
+        if (n >= 0)
+            return n;
+        if (errno == EINTR)
+            continue;
+        if (errno != EAGAIN && errno != EWOULDBLOCK)
+            return -1;
+        int w = kraken_conduit_wait(c->fd, POLLIN, timeout_ms);
+        if (w <= 0)
+            return w < 0 ? -1 : 0;
+    }
+}
+
+/* recvmmsg straight into the caller's slots, with SO_TIMESTAMPNS kernel
+   timestamps (NIC ones via SO_TIMESTAMPING when enabled). MSG_TRUNC makes
+   msg_len the length before truncation; stream sockets would take it as
+   "discard", so they go without. Outgoing frames that slip past
+   PACKET_IGNORE_OUTGOING (older kernels) are compacted away. */
+static inline int64_t kraken_conduit_op_recv_ex(KrakenConnectionHandle conn, KrakenRecvExSlot *slots, size_t count, uint32_t timeout_ms) {
+    KrakenPacketConduit *c = (KrakenPacketConduit *)conn;
+    struct mmsghdr msgs[KRAKEN_CONDUIT_BATCH_MAX];
+    struct iovec iovs[KRAKEN_CONDUIT_BATCH_MAX];
+    struct sockaddr_ll from[KRAKEN_CONDUIT_BATCH_MAX];
+    union {
+        char buf[CMSG_SPACE(sizeof(struct timespec)) + CMSG_SPACE(3 * sizeof(struct timespec))];
+        struct cmsghdr align;
+    } ctrl[KRAKEN_CONDUIT_BATCH_MAX];
+
+    if (c->ring) {
+        size_t n = 0;
+        bool err = false;
+        while (n < count) {
+            uint32_t block;
+            struct tpacket3_hdr *pkt = kraken_conduit_ring_get(c, n == 0, timeout_ms, &block, &err);
+            if (!pkt)
+                break;
+            const uint8_t *data;
+            size_t len;
+            kraken_conduit_ring_view(pkt, &data, &len, &slots[n].timestamp_ns, &slots[n].flags);
+            if (len > slots[n].size) {
+                len = slots[n].size;
+                slots[n].flags |= KRAKEN_RECV_F_TRUNCATED;
+            }
+            memcpy(slots[n].data, data, len);
+            slots[n].len = len;
+            slots[n].orig_len = pkt->tp_len;
+            slots[n].ifindex = c->ifindex;
+            kraken_conduit_ring_put(c->ring, block);
+            n++;
+        }
+        return (n == 0 && err) ? -1 : (int64_t)n;
+    }
+
+    if (count > KRAKEN_CONDUIT_BATCH_MAX)
+        count = KRAKEN_CONDUIT_BATCH_MAX;
+    if (count == 0)
+        return 0;
+    memset(msgs, 0, count * sizeof(msgs[0]));
+    for (size_t i = 0; i < count; i++) {
+        iovs[i].iov_base = slots[i].data;
+        iovs[i].iov_len = slots[i].size;
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        msgs[i].msg_hdr.msg_name = &from[i];
+        msgs[i].msg_hdr.msg_namelen = sizeof(from[i]);
+        msgs[i].msg_hdr.msg_control = ctrl[i].buf;
+        msgs[i].msg_hdr.msg_controllen = sizeof(ctrl[i].buf);
+    }
+
+    int recv_flags = MSG_DONTWAIT | (c->type == KRAKEN_CONN_TYPE_STREAM ? 0 : MSG_TRUNC);
+    int n;
+    for (;;) {
+        n = recvmmsg(c->fd, msgs, (unsigned)count, recv_flags, NULL);
+        if (n > 0)
+            break;
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+            return -1;
+        int w = kraken_conduit_wait(c->fd, POLLIN, timeout_ms);
+        if (w <= 0)
+            return w < 0 ? -1 : 0;
+    }
+
+    size_t out = 0;
+    for (int i = 0; i < n; i++) {
+        bool frame = c->type == KRAKEN_CONN_TYPE_FRAME;
+        if (frame && from[i].sll_pkttype == PACKET_OUTGOING)
+            continue;
+        KrakenRecvExSlot *slot = &slots[out];
+        size_t len = msgs[i].msg_len;
+        if (len > slots[i].size)
+            len = slots[i].size;
+        if ((size_t)i != out)
+            memcpy(slot->data, slots[i].data, len < slot->size ? len : slot->size);
+        slot->len = len < slot->size ? len : slot->size;
+        slot->orig_len = msgs[i].msg_len > slot->len ? msgs[i].msg_len : slot->len;
+        slot->flags = (msgs[i].msg_hdr.msg_flags & MSG_TRUNC) ? KRAKEN_RECV_F_TRUNCATED : 0;
+        slot->ifindex = frame ? (uint32_t)from[i].sll_ifindex : 0;
+        slot->timestamp_ns = 0;
+        int64_t hw_ns = 0;
+        for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msgs[i].msg_hdr); cm; cm = CMSG_NXTHDR(&msgs[i].msg_hdr, cm)) {
+            if (cm->cmsg_level != SOL_SOCKET)
+                continue;
+            struct timespec ts[3];
+            if (cm->cmsg_type == SCM_TIMESTAMPNS) {
+                memcpy(ts, CMSG_DATA(cm), sizeof(ts[0]));
+                slot->timestamp_ns = (int64_t)ts[0].tv_sec * 1000000000LL + ts[0].tv_nsec;
+            } else if (cm->cmsg_type == SCM_TIMESTAMPING) {
+                /* software, legacy, raw hardware */
+                memcpy(ts, CMSG_DATA(cm), sizeof(ts));
+                hw_ns = (int64_t)ts[2].tv_sec * 1000000000LL + ts[2].tv_nsec;
+            }
+        }
+        if (hw_ns > 0) {
+            slot->timestamp_ns = hw_ns;
+            slot->flags |= KRAKEN_RECV_F_HW_TIMESTAMP;
+        }
+        out++;
+    }
+    return (int64_t)out;
+}
+
+/* recv_ex without the metadata. */
+static inline int64_t kraken_conduit_op_recv_batch(KrakenConnectionHandle conn, KrakenRecvSlot *slots, size_t count, uint32_t timeout_ms) {
+    KrakenRecvExSlot ex[KRAKEN_CONDUIT_BATCH_MAX];
+    if (count > KRAKEN_CONDUIT_BATCH_MAX)
+        count = KRAKEN_CONDUIT_BATCH_MAX;
+    for (size_t i = 0; i < count; i++) {
+        ex[i].data = slots[i].data;
+        ex[i].size = slots[i].size;
+    }
+    int64_t n = kraken_conduit_op_recv_ex(conn, ex, count, timeout_ms);
+    for (int64_t i = 0; i < n; i++) {
+        slots[i].len = ex[i].len;
+        slots[i].timestamp_ns = ex[i].timestamp_ns;
+        slots[i].flags = ex[i].flags;
+    }
+    return n;
+}
+
+/* Lend frames straight out of the RX ring; the token is the block index. */
+static inline int64_t kraken_conduit_op_recv_borrow(KrakenConnectionHandle conn, KrakenBorrowedFrame *frames, size_t max, uint32_t timeout_ms) {
+    KrakenPacketConduit *c = (KrakenPacketConduit *)conn;
+    if (!c->ring)
+        return -1;
+    size_t n = 0;
+    bool err = false;
+    while (n < max) {
+        uint32_t block;
+        struct tpacket3_hdr *pkt = kraken_conduit_ring_get(c, n == 0, timeout_ms, &block, &err);
+        if (!pkt)
+            break;
+        kraken_conduit_ring_view(pkt, &frames[n].data, &frames[n].len, &frames[n].timestamp_ns, &frames[n].flags);
+        frames[n].token = block;
+        n++;
+    }
+    return (n == 0 && err) ? -1 : (int64_t)n;
+}
+
+static inline void kraken_conduit_op_recv_release(KrakenConnectionHandle conn, const KrakenBorrowedFrame *frames, size_t count) {
+    KrakenPacketConduit *c = (KrakenPacketConduit *)conn;
+    if (!c->ring)
+        return;
+    for (size_t i = 0; i < count; i++)
+        kraken_conduit_ring_put(c->ring, (uint32_t)frames[i].token);
+}
+
+static inline const KrakenConnectionInfo *kraken_conduit_op_get_info(KrakenConnectionHandle conn) {
+    return &((KrakenPacketConduit *)conn)->info;
+}
+
+static inline KrakenConnectionHandle kraken_conduit_op_open(KrakenConnectionHandle conn, uint32_t timeout_ms) {
+    KrakenPacketConduit *c = (KrakenPacketConduit *)conn;
+    if (c->type == KRAKEN_CONN_TYPE_FRAME)
+        return kraken_conduit_open_frame(c->iface, c->dst_mac, c->ethertype);
+    if (c->type == KRAKEN_CONN_TYPE_STREAM)
+        return kraken_conduit_open_tcp(c->host, c->port, timeout_ms);
+    return kraken_conduit_open_udp(c->host, c->port);
+}
+
+static inline void kraken_conduit_op_close(KrakenConnectionHandle conn) {
+    kraken_conduit_close((KrakenPacketConduit *)conn);
+}
+
+/* KrakenBpfInsn has the layout of struct sock_filter, so programs go to
+   the kernel as they are. The filter also applies to the RX ring. */
+static inline int kraken_conduit_op_set_filter(KrakenConnectionHandle conn, const KrakenFrameFilter *filter) {
+    KrakenPacketConduit *c = (KrakenPacketConduit *)conn;
+    if (c->type != KRAKEN_CONN_TYPE_FRAME)
+        return -1;
+    if (!filter) {
+        int zero = 0;
+        if (setsockopt(c->fd, SOL_SOCKET, SO_DETACH_FILTER, &zero, sizeof(zero)) != 0 && errno != ENOENT)
+            return -1;
+        return 0;
+    }
+
+    KrakenBpfInsn prog[KRAKEN_FILTER_MAX_INSNS];
+    const KrakenBpfInsn *insns = filter->insns;
+    size_t count = filter->insn_count;
+    if (filter->preset) {
+        int n = kraken_frame_filter_compile(filter, prog, KRAKEN_FILTER_MAX_INSNS);
+        if (n <= 0)
+            return -1;
+        insns = prog;
+        count = (size_t)n;
+    }
+    if (!insns || count == 0 || count > BPF_MAXINSNS)
+        return -1;
+    struct sock_fprog fprog;
+    fprog.len = (unsigned short)count;
+    fprog.filter = (struct sock_filter *)(void *)insns;
+    return setsockopt(c->fd, SOL_SOCKET, SO_ATTACH_FILTER, &fprog, sizeof(fprog)) == 0 ? 0 : -1;
+}
+
+/* ------------------------------------------------------------------ */
+/* Async queue (epoll)                                                */
+/* ------------------------------------------------------------------ */
+
+/* Requests are tried right away; one that would block is parked on a
+   dup() of its socket registered with epoll, so a SEND and a RECV on the
+   same connection wait independently. Request deadlines drive a timerfd
+   and queued completions an eventfd, both in the same epoll set, which
+   makes the epoll fd itself the queue's waitable fd. */
+
+#define KRAKEN_CONDUIT_ASYNC_DEPTH 256u
+
+#define KRAKEN_CONDUIT_ASYNC_KEY_EVENT UINT64_MAX
+#define KRAKEN_CONDUIT_ASYNC_KEY_TIMER (UINT64_MAX - 1)
+
+typedef struct {
+    bool used;
+    KrakenAsyncRequest req;
+    int wait_fd;         /* dup registered with epoll while parked, else -1 */
+    int dial_fd;         /* OPEN of a stream: socket being connected, else -1 */
+    size_t done;         /* SEND: bytes written so far */
+    int64_t deadline_ns; /* CLOCK_MONOTONIC, 0 = none */
+} KrakenConduitAsyncOp;
+
+typedef struct {
+    int epfd;
+    int event_fd; /* readable while completions are queued */
+    int timer_fd; /* expires at the nearest request deadline */
+    uint32_t depth;
+    uint32_t inflight; /* accepted and not yet polled */
+    uint32_t next_slot;
+    KrakenConduitAsyncOp *ops;
+    KrakenAsyncCompletion *cq; /* ring of `depth` entries */
+    uint32_t cq_head;
+    uint32_t cq_count;
+} KrakenConduitAsync;
+
+static inline int64_t kraken_conduit_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static inline void kraken_conduit_async_complete(KrakenConduitAsync *q, uint32_t slot, int64_t result, KrakenConnectionHandle conn) {
+    KrakenConduitAsyncOp *op = &q->ops[slot];
+    if (op->wait_fd >= 0) {
+        epoll_ctl(q->epfd, EPOLL_CTL_DEL, op->wait_fd, NULL);
+        close(op->wait_fd);
+        op->wait_fd = -1;
+    }
+    if (op->dial_fd >= 0) {
+        close(op->dial_fd);
+        op->dial_fd = -1;
+    }
+    KrakenAsyncCompletion *cqe = &q->cq[(q->cq_head + q->cq_count) % q->depth];
+    cqe->user_data = op->req.user_data;
+    cqe->opcode = op->req.opcode;
+    cqe->result = result;
+    cqe->conn = conn;
+    if (q->cq_count++ == 0) {
+        uint64_t one = 1;
+        if (write(q->event_fd, &one, sizeof(one)) < 0) {
+            /* counter saturated: already readable */
+        }
+    }
+    op->used = false;
+}
+
+/* Park a request until `fd` is ready for `events`. */
+static inline int kraken_conduit_async_park(KrakenConduitAsync *q, uint32_t slot, int fd, uint32_t events) {
+    KrakenConduitAsyncOp *op = &q->ops[slot];
+    if (op->wait_fd >= 0)
+        return 0;
+    op->wait_fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+    if (op->wait_fd < 0)
+        return -1;
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = events;
+    ev.data.u64 = slot;
+    if (epoll_ctl(q->epfd, EPOLL_CTL_ADD, op->wait_fd, &ev) != 0) {
+        close(op->wait_fd);
+        op->wait_fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+/* Make as much progress on a request as possible without blocking. */
+static inline void kraken_conduit_async_step(KrakenConduitAsync *q, uint32_t slot) {
+    KrakenConduitAsyncOp *op = &q->ops[slot];
+    KrakenPacketConduit *c = (KrakenPacketConduit *)op->req.conn;
+
+    switch (op->req.opcode) {
+    case KRAKEN_ASYNC_SEND:
+        for (;;) {
+            struct iovec iov[2];
+            struct msghdr msg = {0};
+            msg.msg_iov = iov;
+            msg.msg_iovlen = (size_t)kraken_conduit_iov(c, iov, op->req.data + op->done, op->req.len - op->done);
+            ssize_t n = sendmsg(c->fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+            if (n >= 0) {
+                op->done += (size_t)n;
+                if (c->type != KRAKEN_CONN_TYPE_STREAM || op->done >= op->req.len) {
+                    kraken_conduit_async_complete(q, slot, (int64_t)op->req.len, c);
+                    return;
+                }
+                continue;
+            }
+            if (errno == EINTR)
+                continue;
+            if ((errno != EAGAIN && errno != EWOULDBLOCK && errno != ENOBUFS) || kraken_conduit_async_park(q, slot, c->fd, EPOLLOUT) != 0)
+                kraken_conduit_async_complete(q, slot, KRAKEN_ASYNC_ERROR, c);
+            return;
+        }
+
+    case KRAKEN_ASYNC_RECV:
+        for (;;) {
+            int64_t n = kraken_conduit_recv_now(c, op->req.buffer, op->req.len);
+            if (n >= 0) {
+                kraken_conduit_async_complete(q, slot, n, c);
+                return;
+            }
+            if (errno == EINTR)
+                continue;
+            if ((errno != EAGAIN && errno != EWOULDBLOCK) || kraken_conduit_async_park(q, slot, c->fd, EPOLLIN) != 0)
+                kraken_conduit_async_complete(q, slot, KRAKEN_ASYNC_ERROR, c);
+            return;
+        }
+
+    case KRAKEN_ASYNC_OPEN: {
+        if (c->type != KRAKEN_CONN_TYPE_STREAM) {
+            KrakenConnectionHandle h = kraken_conduit_op_open(c, op->req.timeout_ms);
+            kraken_conduit_async_complete(q, slot, h ? 0 : KRAKEN_ASYNC_ERROR, h);
+            return;
+        }
+        if (op->dial_fd < 0) {
+            int rc = kraken_conduit_dial(c->host, c->port, SOCK_STREAM, &op->dial_fd);
+            if (rc < 0 || (rc == 1 && kraken_conduit_async_park(q, slot, op->dial_fd, EPOLLOUT) != 0)) {
+                kraken_conduit_async_complete(q, slot, KRAKEN_ASYNC_ERROR, NULL);
+                return;
+            }
+            if (rc == 1)
+                return;
+        } else {
+            int err = 0;
+            socklen_t err_len = sizeof(err);
+            if (getsockopt(op->dial_fd, SOL_SOCKET, SO_ERROR, &err, &err_len) != 0 || err != 0) {
+                kraken_conduit_async_complete(q, slot, KRAKEN_ASYNC_ERROR, NULL);
+                return;
+            }
+        }
+        int fd = op->dial_fd;
+        op->dial_fd = -1;
+        KrakenPacketConduit *nc = kraken_conduit_wrap(fd, KRAKEN_CONN_TYPE_STREAM, c->host, c->port);
+        kraken_conduit_async_complete(q, slot, nc ? 0 : KRAKEN_ASYNC_ERROR, nc);
+        return;
+    }
+
+    default:
+        kraken_conduit_async_complete(q, slot, KRAKEN_ASYNC_ERROR, c);
+        return;
+    }
+}
+
+/* Time out expired requests and point the timerfd at the next deadline. */
+static inline void kraken_conduit_async_expire(KrakenConduitAsync *q) {
+    int64_t now = kraken_conduit_now_ns();
+    int64_t next = 0;
+    for (uint32_t i = 0; i < q->depth; i++) {
+        KrakenConduitAsyncOp *op = &q->ops[i];
+        if (!op->used || op->deadline_ns == 0)
+            continue;
+        if (now >= op->deadline_ns)
+            kraken_conduit_async_complete(q, i, KRAKEN_ASYNC_TIMEDOUT, op->req.opcode == KRAKEN_ASYNC_OPEN ? NULL : op->req.conn);
+        else if (next == 0 || op->deadline_ns < next)
+            next = op->deadline_ns;
+    }
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec = (time_t)(next / 1000000000LL);
+    its.it_value.tv_nsec = (long)(next % 1000000000LL);
+    timerfd_settime(q->timer_fd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+static inline void kraken_conduit_async_destroy(KrakenAsyncQueue queue) {
+    KrakenConduitAsync *q = (KrakenConduitAsync *)queue;
+    if (!q)
+        return;
+    for (uint32_t i = 0; q->ops && i < q->depth; i++) {
+        if (q->ops[i].wait_fd >= 0)
+            close(q->ops[i].wait_fd);
+        if (q->ops[i].dial_fd >= 0)
+            close(q->ops[i].dial_fd);
+    }
+    if (q->epfd >= 0)
+        close(q->epfd);
+    if (q->event_fd >= 0)
+        close(q->event_fd);
+    if (q->timer_fd >= 0)
+        close(q->timer_fd);
+    free(q->ops);
+    free(q->cq);
+    free(q);
+}
+
+static inline KrakenAsyncQueue kraken_conduit_async_create(KrakenConnectionHandle conn, uint32_t depth) {
+    if (!conn)
+        return NULL;
+    KrakenConduitAsync *q = (KrakenConduitAsync *)calloc(1, sizeof(*q));
+    if (!q)
+        return NULL;
+    q->depth = depth ? depth : KRAKEN_CONDUIT_ASYNC_DEPTH;
+    q->ops = (KrakenConduitAsyncOp *)calloc(q->depth, sizeof(*q->ops));
+    q->cq = (KrakenAsyncCompletion *)calloc(q->depth, sizeof(*q->cq));
+    q->epfd = epoll_create1(EPOLL_CLOEXEC);
+    q->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    q->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    for (uint32_t i = 0; q->ops && i < q->depth; i++) {
+        q->ops[i].wait_fd = -1;
+        q->ops[i].dial_fd = -1;
+    }
+    if (!q->ops || !q->cq || q->epfd < 0 || q->event_fd < 0 || q->timer_fd < 0) {
+        kraken_conduit_async_destroy(q);
+        return NULL;
+    }
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.u64 = KRAKEN_CONDUIT_ASYNC_KEY_EVENT;
+    int rc = epoll_ctl(q->epfd, EPOLL_CTL_ADD, q->event_fd, &ev);
+    ev.data.u64 = KRAKEN_CONDUIT_ASYNC_KEY_TIMER;
+    if (rc != 0 || epoll_ctl(q->epfd, EPOLL_CTL_ADD, q->timer_fd, &ev) != 0) {
+        kraken_conduit_async_destroy(q);
+        return NULL;
+    }
+    return q;
+}
+
+static inline int64_t kraken_conduit_async_submit(KrakenAsyncQueue queue, const KrakenAsyncRequest *reqs, size_t count) {
+    KrakenConduitAsync *q = (KrakenConduitAsync *)queue;
+    if (!q)
+        return -1;
+    int64_t now = kraken_conduit_now_ns();
+    size_t accepted = 0;
+    while (accepted < count && q->inflight < q->depth) {
+        while (q->ops[q->next_slot].used)
+            q->next_slot = (q->next_slot + 1) % q->depth;
+        uint32_t slot = q->next_slot;
+        KrakenConduitAsyncOp *op = &q->ops[slot];
+        op->used = true;
+        op->req = reqs[accepted++];
+        op->done = 0;
+        op->deadline_ns = op->req.timeout_ms ? now + (int64_t)op->req.timeout_ms * 1000000LL : 0;
+        q->inflight++;
+        if (op->req.conn)
+            kraken_conduit_async_step(q, slot);
+        else
+            kraken_conduit_async_complete(q, slot, KRAKEN_ASYNC_ERROR, NULL);
+    }
+    kraken_conduit_async_expire(q);
+    return (int64_t)accepted;
+}
+
+static inline int64_t kraken_conduit_async_poll(KrakenAsyncQueue queue, KrakenAsyncCompletion *out, size_t max, uint32_t timeout_ms) {
+    KrakenConduitAsync *q = (KrakenConduitAsync *)queue;
+    if (!q)
+        return -1;
+    int64_t end = kraken_conduit_now_ns() + (int64_t)timeout_ms * 1000000LL;
+    for (;;) {
+        int wait_ms = 0;
+        if (q->cq_count == 0 && timeout_ms) {
+            int64_t left = end - kraken_conduit_now_ns();
+            wait_ms = left > 0 ? (int)((left + 999999) / 1000000) : 0;
+        }
+        struct epoll_event evs[64];
+        int n = epoll_wait(q->epfd, evs, 64, wait_ms);
+        if (n < 0 && errno != EINTR)
+            return -1;
+        for (int i = 0; i < n; i++) {
+            uint64_t key = evs[i].data.u64;
+            if (key == KRAKEN_CONDUIT_ASYNC_KEY_TIMER) {
+                uint64_t ticks;
+                if (read(q->timer_fd, &ticks, sizeof(ticks)) < 0) {
+                    /* already consumed */
+                }
+            } else if (key < q->depth && q->ops[key].used) {
+                kraken_conduit_async_step(q, (uint32_t)key);
+            }
+        }
+        kraken_conduit_async_expire(q);
+        if (q->cq_count > 0 || wait_ms == 0)
+            break;
+    }
+
+    size_t got = 0;
+    while (got < max && q->cq_count > 0) {
+        out[got++] = q->cq[q->cq_head];
+        q->cq_head = (q->cq_head + 1) % q->depth;
+        q->cq_count--;
+        q->inflight--;
+    }
+    if (q->cq_count == 0) {
+        uint64_t value;
+        if (read(q->event_fd, &value, sizeof(value)) < 0) {
+            /* already clear */
+        }
+    }
+    return (int64_t)got;
+}
+
+static inline int kraken_conduit_async_fd(KrakenAsyncQueue queue) {
+    return queue ? ((KrakenConduitAsync *)queue)->epfd : -1;
+}
+
+static const KrakenAsyncOps kraken_conduit_async_ops = {
+    .create = kraken_conduit_async_create,
+    .submit = kraken_conduit_async_submit,
+    .poll = kraken_conduit_async_poll,
+    .fd = kraken_conduit_async_fd,
+    .destroy = kraken_conduit_async_destroy,
+};
+
+/* Ops for conduits without an RX ring (no recv_borrow). */
+static inline const KrakenConnectionOps *kraken_conduit_ops(void) {
+    static const KrakenConnectionOps ops = {
+        .send = kraken_conduit_op_send,
+        .recv = kraken_conduit_op_recv,
+        .get_info = kraken_conduit_op_get_info,
+        .open = kraken_conduit_op_open,
+        .close = kraken_conduit_op_close,
+        .send_batch = kraken_conduit_op_send_batch,
+        .recv_batch = kraken_conduit_op_recv_batch,
+        .async = &kraken_conduit_async_ops,
+        .set_filter = kraken_conduit_op_set_filter,
+        .recv_ex = kraken_conduit_op_recv_ex,
+    };
+    return &ops;
+}
+
+/* Ops matching `c`: adds recv_borrow/recv_release once the RX ring is on. */
+static inline const KrakenConnectionOps *kraken_conduit_ops_for(const KrakenPacketConduit *c) {
+    static const KrakenConnectionOps ring_ops = {
+        .send = kraken_conduit_op_send,
+        .recv = kraken_conduit_op_recv,
+        .get_info = kraken_conduit_op_get_info,
+        .open = kraken_conduit_op_open,
+        .close = kraken_conduit_op_close,
+        .send_batch = kraken_conduit_op_send_batch,
+        .recv_batch = kraken_conduit_op_recv_batch,
+        .recv_borrow = kraken_conduit_op_recv_borrow,
+        .recv_release = kraken_conduit_op_recv_release,
+        .async = &kraken_conduit_async_ops,
+        .set_filter = kraken_conduit_op_set_filter,
+        .recv_ex = kraken_conduit_op_recv_ex,
+    };
+    return (c && c->ring) ? &ring_ops : kraken_conduit_ops();
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __linux__ */
+
+#endif /* KRAKEN_PACKET_CONDUIT_H */
@@ -0,0 +1,560 @@
+#ifndef KRAKEN_PARAMS_H
+#define KRAKEN_PARAMS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ------------------------------------------------------------------ */
+/* params_json parser                                                 */
+/*                                                                    */
+/* kraken_params_parse tokenizes params_json once into a flat token   */
+/* array (no copies of the input) and hashes the top-level keys, so   */
+/* every typed lookup afterwards is O(1). Tokens live inline in       */
+/* KrakenParams; only payloads with more than                         */
+/* KRAKEN_PARAMS_INLINE_TOKENS tokens (large inline arrays) touch the */
+/* heap, with geometric growth.                                       */
+/*                                                                    */
+/* Usage:                                                             */
+/*   KrakenParams params;                                             */
+/*   if (kraken_params_parse(&params, params_json) != 0) ...          */
+/*   char topic[256];                                                 */
+/*   kraken_params_string(&params, "topic", topic, sizeof(topic));    */
+/*   int64_t n = kraken_params_int(&params, "sequence_num", 0);       */
+/*   size_t count;                                                    */
+/*   const KrakenJsonTok *arr = kraken_params_array(&params, "creds", */
+/*                                                  &count);          */
+/*   for (size_t i = 0; i < count; i++)                               */
+/*       kraken_params_tok_string(&params,                            */
+/*           kraken_params_at(&params, arr, i), buf, sizeof(buf));    */
+/*   kraken_params_free(&params);                                     */
+/* ------------------------------------------------------------------ */
+
+#define KRAKEN_PARAMS_INLINE_TOKENS 128
+#define KRAKEN_PARAMS_INDEX_SIZE 64 /* power of two */
+#define KRAKEN_PARAMS_MAX_DEPTH 32
+
+typedef enum {
+    KRAKEN_JSON_NULL = 0,
+    KRAKEN_JSON_BOOL = 1,
+    KRAKEN_JSON_NUMBER = 2,
+    KRAKEN_JSON_STRING = 3,
+    KRAKEN_JSON_ARRAY = 4,
+    KRAKEN_JSON_OBJECT = 5,
+} KrakenJsonType;
+
+#define KRAKEN_JSON_F_ESCAPED 0x1u /* string contains backslash escapes */
+#define KRAKEN_JSON_F_FLAT 0x2u    /* array/object without nested containers */
+
+typedef struct {
+    uint32_t start; /* byte offset; strings start after the opening quote */
+    uint32_t len;   /* byte length; strings exclude quotes and stay escaped */
+    uint32_t next;  /* index of the first token after this subtree */
+    uint32_t count; /* arrays: elements, objects: members */
+    uint16_t type;  /* KrakenJsonType */
+    uint16_t flags; /* KRAKEN_JSON_F_* */
+} KrakenJsonTok;
+
+typedef struct {
+    const char *json;
+    KrakenJsonTok *toks;
+    uint32_t count;
+    uint32_t cap;
+    bool indexed;                             /* false: too many keys, lookups scan */
+    uint32_t index[KRAKEN_PARAMS_INDEX_SIZE]; /* key token index + 1, 0 = empty */
+    KrakenJsonTok inline_toks[KRAKEN_PARAMS_INLINE_TOKENS];
+} KrakenParams;
+
+static inline uint32_t kraken_params_hash(const char *s, size_t len) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (uint8_t)s[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static inline int kraken_params_push(KrakenParams *p, KrakenJsonType type, size_t start) {
+    if (p->count == p->cap) {
+        uint32_t ncap = p->cap * 2;
+        KrakenJsonTok *nt;
+        if (p->toks == p->inline_toks) {
+            nt = (KrakenJsonTok *)malloc(ncap * sizeof(KrakenJsonTok));
+            if (nt)
+                memcpy(nt, p->toks, p->count * sizeof(KrakenJsonTok));
+        } else {
+            nt = (KrakenJsonTok *)realloc(p->toks, ncap * sizeof(KrakenJsonTok));
+        }
+        if (!nt)
+            return -1;
+        p->toks = nt;
+        p->cap = ncap;
+    }
+    KrakenJsonTok *t = &p->toks[p->count];
+    memset(t, 0, sizeof(*t));
+    t->type = (uint16_t)type;
+    t->start = (uint32_t)start;
+    t->next = p->count + 1;
+    return (int)p->count++;
+}
+
+static inline void kraken_params_free(KrakenParams *p) {
+    if (p->toks && p->toks != p->inline_toks)
+        free(p->toks);
+    p->toks = p->inline_toks;
+    p->count = 0;
+    p->cap = KRAKEN_PARAMS_INLINE_TOKENS;
+}
+
+static inline void kraken_params_build_index(KrakenParams *p) {
+    memset(p->index, 0, sizeof(p->index));
+    p->indexed = false;
+    if (p->count == 0 || p->toks[0].type != KRAKEN_JSON_OBJECT || p->toks[0].count > KRAKEN_PARAMS_INDEX_SIZE * 3 / 4)
+        return;
+
+    uint32_t k = 1;
+    for (uint32_t m = 0; m < p->toks[0].count; m++) {
+        if (k + 1 >= p->count)
+            return; /* members and tokens disagree: leave lookups to the bounded scan */
+        const KrakenJsonTok *key = &p->toks[k];
+        uint32_t slot = kraken_params_hash(p->json + key->start, key->len) & (KRAKEN_PARAMS_INDEX_SIZE - 1);
+        while (p->index[slot])
+            slot = (slot + 1) & (KRAKEN_PARAMS_INDEX_SIZE - 1);
+        p->index[slot] = k + 1;
+        k = p->toks[k + 1].next; /* skip the value subtree */
+    }
+    p->indexed = true;
+}
+
+static inline bool kraken_params_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static inline bool kraken_params_hex(char c) {
+    return kraken_params_digit(c) || ((c | 0x20) >= 'a' && (c | 0x20) <= 'f');
+}
+
+/* Length of the JSON number at `s` (-?int frac? exp?), 0 if there is none */
+static inline size_t kraken_params_number_len(const char *s) {
+    size_t j = s[0] == '-';
+    if (s[j] == '0')
+        j++;
+    else if (kraken_params_digit(s[j]))
+        while (kraken_params_digit(s[j]))
+            j++;
+    else
+        return 0;
+    if (s[j] == '.') {
+        if (!kraken_params_digit(s[++j]))
+            return 0;
+        while (kraken_params_digit(s[j]))
+            j++;
+    }
+    if (s[j] == 'e' || s[j] == 'E') {
+        j++;
+        if (s[j] == '+' || s[j] == '-')
+            j++;
+        if (!kraken_params_digit(s[j]))
+            return 0;
+        while (kraken_params_digit(s[j]))
+            j++;
+    }
+    return j;
+}
+
+/* Tokenize `json` (may be NULL or empty: yields no parameters).
+   `json` must outlive `p`. Returns 0 on success, -1 on malformed input or
+   allocation failure; `p` is always safe to query and free afterwards. */
+static inline int kraken_params_parse(KrakenParams *p, const char *json) {
+    p->json = json ? json : "";
+    p->toks = p->inline_toks;
+    p->count = 0;
+    p->cap = KRAKEN_PARAMS_INLINE_TOKENS;
+    p->indexed = false;
+
+    uint32_t stack[KRAKEN_PARAMS_MAX_DEPTH];
+    bool want_key[KRAKEN_PARAMS_MAX_DEPTH];
+    bool want_colon[KRAKEN_PARAMS_MAX_DEPTH]; /* a key was read, its ':' was not */
+    bool want_value[KRAKEN_PARAMS_MAX_DEPTH]; /* ',' or ':' was read, the item after it was not */
+    bool have_value[KRAKEN_PARAMS_MAX_DEPTH]; /* a value was read since the last ',' */
+    int depth = 0;
+    const char *s = p->json;
+    size_t i = 0;
+
+    for (;;) {
+        while (s[i] == ' ' || s[i] == '\t' || s[i] == '\n' || s[i] == '\r')
+            i++;
+        char c = s[i];
+        if (c == '\0')
+            break;
+
+        if (c == ',' || c == ':') {
+            if (depth == 0)
+                goto fail;
+            bool in_object = p->toks[stack[depth - 1]].type == KRAKEN_JSON_OBJECT;
+            if ((c == ':') != (in_object && want_colon[depth - 1]))
+                goto fail; /* ':' only right after a key, ',' never */
+            if (c == ',' && !have_value[depth - 1])
+                goto fail; /* ',' only right after a value */
+            if (c == ',' && in_object)
+                want_key[depth - 1] = true;
+            want_colon[depth - 1] = false;
+            want_value[depth - 1] = true;
+            have_value[depth - 1] = false;
+            i++;
+            continue;
+        }
+
+        if (c == '}' || c == ']') {
+            if (depth == 0 || want_colon[depth - 1] || want_value[depth - 1])
+                goto fail; /* nothing may dangle: a key, ':' or ',' */
+            KrakenJsonTok *t = &p->toks[stack[--depth]];
+            if ((c == '}') != (t->type == KRAKEN_JSON_OBJECT))
+                goto fail;
+            t->len = (uint32_t)(i + 1 - t->start);
+            t->next = p->count;
+            i++;
+            continue;
+        }
+
+        /* A value (or an object key) starts here. */
+        if (depth == 0 && p->count > 0)
+            goto fail; /* trailing garbage after the root value */
+        bool is_key = depth > 0 && p->toks[stack[depth - 1]].type == KRAKEN_JSON_OBJECT && want_key[depth - 1];
+        if ((is_key && c != '"') || (depth > 0 && (want_colon[depth - 1] || have_value[depth - 1])))
+            goto fail; /* a value needs a ',' after the one before */
+        if (depth > 0) {
+            want_value[depth - 1] = false;
+            have_value[depth - 1] = !is_key;
+        }
+        if (depth > 0 && !is_key) {
+            KrakenJsonTok *parent = &p->toks[stack[depth - 1]];
+            parent->count++;
+            if (c == '{' || c == '[')
+                parent->flags &= (uint16_t)~KRAKEN_JSON_F_FLAT;
+        }
+        if (is_key) {
+            want_key[depth - 1] = false;
+            want_colon[depth - 1] = true;
+        }
+
+        if (c == '{' || c == '[') {
+            if (depth == KRAKEN_PARAMS_MAX_DEPTH)
+                goto fail;
+            int idx = kraken_params_push(p, c == '{' ? KRAKEN_JSON_OBJECT : KRAKEN_JSON_ARRAY, i);
+            if (idx < 0)
+                goto fail;
+            p->toks[idx].flags = KRAKEN_JSON_F_FLAT;
+            want_key[depth] = (c == '{');
+            want_colon[depth] = false;
+            want_value[depth] = false;
+            have_value[depth] = false;
+            stack[depth++] = (uint32_t)idx;
+            i++;
+            continue;
+        }
+
+        if (c == '"') {
+            int idx = kraken_params_push(p, KRAKEN_JSON_STRING, i + 1);
+            if (idx < 0)
+                goto fail;
+            size_t j = i + 1;
+            while (s[j] && s[j] != '"') {
+                if (s[j] == '\\') {
+                    p->toks[idx].flags |= KRAKEN_JSON_F_ESCAPED;
+                    if (!s[++j])
+                        break;
+                    if (s[j] == 'u') {
+                        for (int k = 1; k <= 4; k++)
+                            if (!kraken_params_hex(s[j + k]))
+                                goto fail; /* stops at the terminator too */
+                        j += 4;
+                    }
+                }
+                j++;
+            }
+            if (s[j] != '"')
+                goto fail;
+            p->toks[idx].len = (uint32_t)(j - (i + 1));
+            i = j + 1;
+            continue;
+        }
+
+        /* true / false / null / number */
+        size_t j = i;
+        while (s[j] && s[j] != ',' && s[j] != ':' && s[j] != '}' && s[j] != ']' && s[j] != ' ' && s[j] != '\t' && s[j] != '\n' && s[j] != '\r')
+            j++;
+        KrakenJsonType type;
+        if (j - i == 4 && memcmp(s + i, "true", 4) == 0)
+            type = KRAKEN_JSON_BOOL;
+        else if (j - i == 5 && memcmp(s + i, "false", 5) == 0)
+            type = KRAKEN_JSON_BOOL;
+        else if (j - i == 4 && memcmp(s + i, "null", 4) == 0)
+            type = KRAKEN_JSON_NULL;
+        else if (kraken_params_number_len(s + i) == j - i)
+            type = KRAKEN_JSON_NUMBER; /* the whole token, so not "12abc" */
+        else
+            goto fail;
+        int idx = kraken_params_push(p, type, i);
+        if (idx < 0)
+            goto fail;
+        p->toks[idx].len = (uint32_t)(j - i);
+        i = j;
+    }
+
+    if (depth != 0)
+        goto fail;
+    kraken_params_build_index(p);
+    return 0;
+
+fail:
+    kraken_params_free(p);
+    return -1;
+}
+
+/* Value token of a top-level key, or NULL. */
+static inline const KrakenJsonTok *kraken_params_find(const KrakenParams *p, const char *key) {
+    if (!key || p->count == 0 || p->toks[0].type != KRAKEN_JSON_OBJECT)
+        return NULL;
+    size_t klen = strlen(key);
+
+    if (p->indexed) {
+        uint32_t slot = kraken_params_hash(key, klen) & (KRAKEN_PARAMS_INDEX_SIZE - 1);
+        while (p->index[slot]) {
+            const KrakenJsonTok *k = &p->toks[p->index[slot] - 1];
+            if (k->len == klen && memcmp(p->json + k->start, key, klen) == 0)
+                return k + 1;
+            slot = (slot + 1) & (KRAKEN_PARAMS_INDEX_SIZE - 1);
+        }
+        return NULL;
+    }
+
+    uint32_t k = 1;
+    for (uint32_t m = 0; m < p->toks[0].count && k + 1 < p->count; m++) {
+        if (p->toks[k].len == klen && memcmp(p->json + p->toks[k].start, key, klen) == 0)
+            return &p->toks[k + 1];
+        k = p->toks[k + 1].next;
+    }
+    return NULL;
+}
+
+static inline bool kraken_params_has(const KrakenParams *p, const char *key) {
+    return kraken_params_find(p, key) != NULL;
+}
+
+/* Copy a string token into `buf`, resolving escapes (\uXXXX is emitted as
+   UTF-8, surrogate pairs are not combined). Returns the string length or
+   -1 if `t` is not a string or does not fit. */
+static inline int kraken_params_tok_string(const KrakenParams *p, const KrakenJsonTok *t, char *buf, size_t size) {
+    if (!t || t->type != KRAKEN_JSON_STRING || size == 0)
+        return -1;
+    const char *s = p->json + t->start;
+    if (!(t->flags & KRAKEN_JSON_F_ESCAPED)) {
+        if (t->len >= size)
+            return -1;
+        memcpy(buf, s, t->len);
+        buf[t->len] = '\0';
+        return (int)t->len;
+    }
+
+    size_t o = 0;
+    for (uint32_t i = 0; i < t->len; i++) {
+        char c = s[i];
+        if (c == '\\' && i + 1 < t->len) {
+            c = s[++i];
+            switch (c) {
+                case 'n': c = '\n'; break;
+                case 't': c = '\t'; break;
+                case 'r': c = '\r'; break;
+                case 'b': c = '\b'; break;
+                case 'f': c = '\f'; break;
+                case 'u': {
+                    unsigned cp = 0;
+                    for (int k = 0; k < 4 && i + 1 < t->len; k++) {
+                        char h = s[++i];
+                        cp = (cp << 4) | (unsigned)(h >= '0' && h <= '9' ? h - '0' : (h | 0x20) - 'a' + 10);
+                    }
+                    char u[3];
+                    size_t n;
+                    if (cp < 0x80) {
+                        u[0] = (char)cp;
+                        n = 1;
+                    } else if (cp < 0x800) {
+                        u[0] = (char)(0xC0 | (cp >> 6));
+                        u[1] = (char)(0x80 | (cp & 0x3F));
+                        n = 2;
+                    } else {
+                        u[0] = (char)(0xE0 | (cp >> 12));
+                        u[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+                        u[2] = (char)(0x80 | (cp & 0x3F));
+                        n = 3;
+                    }
+                    if (o + n >= size)
+                        return -1;
+                    memcpy(buf + o, u, n);
+                    o += n;
+                    continue;
+                }
+                default: break; /* \" \\ \/ */
+            }
+        }
+        if (o + 1 >= size)
+            return -1;
+        buf[o++] = c;
+    }
+    buf[o] = '\0';
+    return (int)o;
+}
+
+/* malloc'd copy of a string token, or NULL. */
+static inline char *kraken_params_tok_strdup(const KrakenParams *p, const KrakenJsonTok *t) {
+    if (!t || t->type != KRAKEN_JSON_STRING)
+        return NULL;
+    char *out = (char *)malloc((size_t)t->len + 1); /* unescaping never grows */
+    if (out && kraken_params_tok_string(p, t, out, (size_t)t->len + 1) < 0) {
+        free(out);
+        out = NULL;
+    }
+    return out;
+}
+
+/* Numbers, and numeric strings ("3") for callers that used to receive
+   everything as strings. Fractions and exponents are applied before the
+   value is truncated toward zero (1e3 is 1000, 2.5e-1 is 0, -3.9 is -3).
+   Values outside int64 give `def`. */
+static inline int64_t kraken_params_tok_int(const KrakenParams *p, const KrakenJsonTok *t, int64_t def) {
+    if (!t || (t->type != KRAKEN_JSON_NUMBER && t->type != KRAKEN_JSON_STRING) || t->len == 0)
+        return def;
+    const char *s = p->json + t->start;
+    uint32_t i = 0;
+    bool neg = false;
+    if (s[0] == '-') {
+        neg = true;
+        i++;
+    }
+    if (i == t->len)
+        return def;
+
+    /* Significant digits while they fit in v; scale counts the powers of
+       ten v is off by (dropped integer digits up, kept fraction digits
+       down) */
+    uint64_t v = 0;
+    int64_t scale = 0;
+    bool fraction = false;
+    for (; i < t->len; i++) {
+        char c = s[i];
+        if (c == '.' && t->type == KRAKEN_JSON_NUMBER && !fraction) {
+            fraction = true;
+            continue;
+        }
+        if (!kraken_params_digit(c))
+            break;
+        if (v <= (UINT64_MAX - 9) / 10) {
+            v = v * 10 + (uint64_t)(c - '0');
+            if (fraction)
+                scale--;
+        } else if (!fraction) {
+            scale++;
+        }
+    }
+    if (i < t->len && (s[i] == 'e' || s[i] == 'E') && t->type == KRAKEN_JSON_NUMBER) {
+        bool eneg = s[++i] == '-';
+        if (s[i] == '+' || s[i] == '-')
+            i++;
+        int64_t e = 0;
+        for (; i < t->len && kraken_params_digit(s[i]); i++)
+            if (e < 100000)
+                e = e * 10 + (s[i] - '0');
+        scale += eneg ? -e : e;
+    }
+    if (i < t->len)
+        return def; /* numeric strings are digits only */
+
+    /* Out of int64 range is as unusable as malformed */
+    uint64_t limit = neg ? (uint64_t)INT64_MAX + 1 : (uint64_t)INT64_MAX;
+    for (; scale < 0 && v; scale++)
+        v /= 10;
+    for (; scale > 0 && v; scale--) {
+        if (v > limit / 10)
+            return def;
+        v *= 10;
+    }
+    if (v > limit)
+        return def;
+    return neg ? (int64_t)(0 - v) : (int64_t)v;
+}
+
+static inline bool kraken_params_tok_bool(const KrakenParams *p, const KrakenJsonTok *t, bool def) {
+    if (!t)
+        return def;
+    const char *s = p->json + t->start;
+    if (t->type == KRAKEN_JSON_BOOL || t->type == KRAKEN_JSON_STRING) {
+        if (t->len == 4 && memcmp(s, "true", 4) == 0)
+            return true;
+        if (t->len == 5 && memcmp(s, "false", 5) == 0)
+            return false;
+        return def;
+    }
+    if (t->type == KRAKEN_JSON_NUMBER)
+        return kraken_params_tok_int(p, t, 0) != 0;
+    return def;
+}
+
+/* i-th element of an array token: O(1) for arrays of scalars, otherwise a
+   walk over the preceding siblings. */
+static inline const KrakenJsonTok *kraken_params_at(const KrakenParams *p, const KrakenJsonTok *arr, size_t i) {
+    if (!arr || arr->type != KRAKEN_JSON_ARRAY || i >= arr->count)
+        return NULL;
+    uint32_t first = (uint32_t)(arr - p->toks) + 1;
+    if (arr->flags & KRAKEN_JSON_F_FLAT)
+        return &p->toks[first + i];
+    uint32_t k = first;
+    while (i-- && k < p->count)
+        k = p->toks[k].next;
+    return k < p->count ? &p->toks[k] : NULL;
+}
+
+/* ------------------------------------------------------------------ */
+/* Typed lookups by top-level key                                     */
+/* ------------------------------------------------------------------ */
+
+static inline int kraken_params_string(const KrakenParams *p, const char *key, char *buf, size_t size) {
+    return kraken_params_tok_string(p, kraken_params_find(p, key), buf, size);
+}
+
+static inline char *kraken_params_strdup(const KrakenParams *p, const char *key) {
+    return kraken_params_tok_strdup(p, kraken_params_find(p, key));
+}
+
+static inline int64_t kraken_params_int(const KrakenParams *p, const char *key, int64_t def) {
+    return kraken_params_tok_int(p, kraken_params_find(p, key), def);
+}
+
+static inline bool kraken_params_bool(const KrakenParams *p, const char *key, bool def) {
+    return kraken_params_tok_bool(p, kraken_params_find(p, key), def);
+}
+
+/* Array token for `key` (NULL if absent or not an array); element count in *count. */
+static inline const KrakenJsonTok *kraken_params_array(const KrakenParams *p, const char *key, size_t *count) {
+    const KrakenJsonTok *t = kraken_params_find(p, key);
+    if (!t || t->type != KRAKEN_JSON_ARRAY) {
+        if (count)
+            *count = 0;
+        return NULL;
+    }
+    if (count)
+        *count = t->count;
+    return t;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* KRAKEN_PARAMS_H */
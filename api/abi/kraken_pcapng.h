@@ -0,0 +1,431 @@
+#ifndef KRAKEN_PCAPNG_H
+#define KRAKEN_PCAPNG_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "kraken_params.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ------------------------------------------------------------------ */
+/* Streaming pcapng writer                                            */
+/*                                                                    */
+/* Records the frames a module saw and sent, with nanosecond          */
+/* timestamps, a direction flag and an optional comment per packet.   */
+/* Recording only copies the packet into an in-memory buffer under a  */
+/* short lock; a writer thread owns the file. Two buffers alternate:  */
+/* when the one being filled is full while the writer still holds the */
+/* other, the packet is counted in `dropped` rather than waiting, so  */
+/* capture and send loops never block on disk. Any thread may record. */
+/*                                                                    */
+/* Files can be capped at max_bytes. With files > 1 they form a ring  */
+/* (path_0.pcapng, path_1.pcapng, ...) where the oldest is reused;    */
+/* with a single file, packets past the cap are counted in            */
+/* `truncated`. Every file starts with its own section header.        */
+/*                                                                    */
+/* Usage:                                                             */
+/*   KrakenPcapngConfig cfg;                                          */
+/*   kraken_pcapng_config(&cfg, &params);  // pcap_* keys             */
+/*   KrakenPcapng pcap;                                               */
+/*   kraken_pcapng_open(&pcap, &cfg, "eth0", 0x88A4);                 */
+/*   kraken_pcapng_write(&pcap, frame, len, ts_ns,                    */
+/*                       KRAKEN_PCAPNG_IN, NULL);                     */
+/*   kraken_pcapng_close(&pcap);                                      */
+/* ------------------------------------------------------------------ */
+
+#define KRAKEN_PCAPNG_BUFFER (1u << 20) /* bytes per buffer; two are allocated */
+#define KRAKEN_PCAPNG_COMMENT_MAX 255u
+#define KRAKEN_PCAPNG_FILES_MAX 1000u
+
+/* epb_flags inbound/outbound */
+#define KRAKEN_PCAPNG_IN 1u
+#define KRAKEN_PCAPNG_OUT 2u
+
+typedef struct {
+    char path[256];     /* "" = recording disabled */
+    uint64_t max_bytes; /* per file, 0 = unbounded */
+    uint32_t files;     /* > 1: ring of that many files */
+} KrakenPcapngConfig;
+
+typedef struct {
+    KrakenPcapngConfig cfg;
+    uint8_t header[256]; /* section header + interface description, starts every file */
+    size_t header_len;
+    uint8_t eth_header[14]; /* prepended by kraken_pcapng_write_payload */
+
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    pthread_t tid;
+    uint8_t *buf[2];
+    size_t len[2];
+    int active;   /* buffer being filled */
+    bool pending; /* the other buffer is waiting for the writer */
+    bool stop;
+    uint64_t packets; /* recorded */
+    uint64_t dropped; /* both buffers full */
+
+    /* Writer thread; read them after kraken_pcapng_close */
+    int fd;
+    uint32_t file_index;
+    uint64_t file_bytes;
+    uint64_t truncated; /* packets past max_bytes of a single file */
+    uint64_t written;   /* bytes, all files */
+    uint32_t files_opened;
+    int error; /* errno of the first failed open or write, 0 = none */
+} KrakenPcapng;
+
+/* Read pcap_path, pcap_max_mb and pcap_files from module params. */
+static inline void kraken_pcapng_config(KrakenPcapngConfig *cfg, const KrakenParams *params) {
+    memset(cfg, 0, sizeof(*cfg));
+    if (kraken_params_string(params, "pcap_path", cfg->path, sizeof(cfg->path)) <= 0)
+        cfg->path[0] = '\0';
+    int64_t mb = kraken_params_int(params, "pcap_max_mb", 0);
+    cfg->max_bytes = mb > 0 ? (uint64_t)mb << 20 : 0;
+    int64_t files = kraken_params_int(params, "pcap_files", 1);
+    cfg->files = files < 1 ? 1 : files > KRAKEN_PCAPNG_FILES_MAX ? KRAKEN_PCAPNG_FILES_MAX : (uint32_t)files;
+}
+
+static inline bool kraken_pcapng_enabled(const KrakenPcapng *w) {
+    return w->buf[0] != NULL;
+}
+
+static inline size_t kraken_pcapng_pad(size_t n) {
+    return (n + 3) & ~(size_t)3;
+}
+
+static inline void kraken_pcapng_put16(uint8_t *p, uint16_t v) {
+    memcpy(p, &v, 2);
+}
+
+static inline void kraken_pcapng_put32(uint8_t *p, uint32_t v) {
+    memcpy(p, &v, 4);
+}
+
+/* One option (code, length, value padded to 4). Returns: bytes written. */
+static inline size_t kraken_pcapng_opt(uint8_t *p, uint16_t code, const void *value, size_t len) {
+    kraken_pcapng_put16(p, code);
+    kraken_pcapng_put16(p + 2, (uint16_t)len);
+    memcpy(p + 4, value, len);
+    memset(p + 4 + len, 0, kraken_pcapng_pad(len) - len);
+    return 4 + kraken_pcapng_pad(len);
+}
+
+/* Section header and one Ethernet interface with nanosecond timestamps */
+static inline void kraken_pcapng_build_header(KrakenPcapng *w, const char *iface) {
+    uint8_t *p = w->header;
+    size_t n = 0;
+
+    kraken_pcapng_put32(p, 0x0A0D0D0A);
+    kraken_pcapng_put32(p + 8, 0x1A2B3C4D);
+    kraken_pcapng_put16(p + 12, 1);
+    kraken_pcapng_put16(p + 14, 0);
+    memset(p + 16, 0xFF, 8); /* section length unknown */
+    n = 24;
+    n += kraken_pcapng_opt(p + n, 4, "kraken", 6); /* shb_userappl */
+    memset(p + n, 0, 4);                           /* opt_endofopt */
+    n += 4;
+    kraken_pcapng_put32(p + n, (uint32_t)(n + 4));
+    kraken_pcapng_put32(p + 4, (uint32_t)(n + 4));
+    n += 4;
+
+    uint8_t *idb = p + n;
+    size_t name_len = iface ? strlen(iface) : 0;
+    if (name_len > 64)
+        name_len = 64;
+    kraken_pcapng_put32(idb, 1);
+    kraken_pcapng_put16(idb + 8, 1); /* LINKTYPE_ETHERNET */
+    kraken_pcapng_put16(idb + 10, 0);
+    kraken_pcapng_put32(idb + 12, 0); /* no snap length */
+    size_t m = 16;
+    if (name_len)
+        m += kraken_pcapng_opt(idb + m, 2, iface, name_len); /* if_name */
+    uint8_t tsresol = 9;
+    m += kraken_pcapng_opt(idb + m, 9, &tsresol, 1); /* if_tsresol: ns */
+    memset(idb + m, 0, 4);
+    m += 4;
+    kraken_pcapng_put32(idb + m, (uint32_t)(m + 4));
+    kraken_pcapng_put32(idb + 4, (uint32_t)(m + 4));
+    m += 4;
+    w->header_len = n + m;
+}
+
+/* path, or path_<index> before the extension for a ring of files */
+static inline void kraken_pcapng_file_name(const KrakenPcapng *w, uint32_t index, char *out, size_t size) {
+    const char *path = w->cfg.path;
+    if (w->cfg.files <= 1) {
+        snprintf(out, size, "%s", path);
+        return;
+    }
+    const char *dot = strrchr(path, '.');
+    const char *slash = strrchr(path, '/');
+    if (!dot || (slash && dot < slash))
+        dot = path + strlen(path);
+    snprintf(out, size, "%.*s_%u%s", (int)(dot - path), path, index, dot);
+}
+
+static inline int kraken_pcapng_write_all(KrakenPcapng *w, const uint8_t *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(w->fd, data, len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0) {
+            if (!w->error)
+                w->error = n < 0 ? errno : EIO;
+            return -1;
+        }
+        data += n;
+        len -= (size_t)n;
+        w->file_bytes += (uint64_t)n;
+        w->written += (uint64_t)n;
+    }
+    return 0;
+}
+
+/* Writer thread: (re)open file `index` and write the header */
+static inline int kraken_pcapng_open_file(KrakenPcapng *w, uint32_t index) {
+    if (w->fd >= 0)
+        close(w->fd);
+    char name[300];
+    kraken_pcapng_file_name(w, index, name, sizeof(name));
+    w->fd = open(name, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (w->fd < 0) {
+        if (!w->error)
+            w->error = errno;
+        return -1;
+    }
+    w->file_index = index;
+    w->file_bytes = 0;
+    w->files_opened++;
+    return kraken_pcapng_write_all(w, w->header, w->header_len);
+}
+
+/* Writer thread: write whole blocks, moving to the next file of the ring
+   (or stopping, for a single file) at max_bytes */
+static inline void kraken_pcapng_flush_buffer(KrakenPcapng *w, const uint8_t *data, size_t len) {
+    size_t off = 0;
+    while (off < len && w->fd >= 0) {
+        size_t run = 0;
+        while (off + run < len) {
+            uint32_t blen;
+            memcpy(&blen, data + off + run + 4, 4);
+            if (w->cfg.max_bytes && w->file_bytes + run + blen > w->cfg.max_bytes && (w->file_bytes > w->header_len || run > 0))
+                break;
+            run += blen;
+        }
+        if (run > 0 && kraken_pcapng_write_all(w, data + off, run) != 0)
+            return;
+        off += run;
+        if (off == len)
+            return;
+        if (w->cfg.files > 1) {
+            if (kraken_pcapng_open_file(w, (w->file_index + 1) % w->cfg.files) != 0)
+                return;
+            continue;
+        }
+        for (; off < len; w->truncated++) {
+            uint32_t blen;
+            memcpy(&blen, data + off + 4, 4);
+            off += blen;
+        }
+    }
+}
+
+static inline void *kraken_pcapng_writer(void *arg) {
+    KrakenPcapng *w = (KrakenPcapng *)arg;
+    pthread_mutex_lock(&w->lock);
+    for (;;) {
+        while (!w->pending && !w->stop)
+            pthread_cond_wait(&w->cond, &w->lock);
+        /* A full buffer first, then on stop whatever is left in the active one */
+        int b = w->pending ? w->active ^ 1 : w->active;
+        bool last = !w->pending;
+        pthread_mutex_unlock(&w->lock);
+        kraken_pcapng_flush_buffer(w, w->buf[b], w->len[b]);
+        pthread_mutex_lock(&w->lock);
+        w->len[b] = 0;
+        if (last)
+            break;
+        w->pending = false;
+    }
+    pthread_mutex_unlock(&w->lock);
+    return NULL;
+}
+
+/* Start recording to cfg->path; `iface` names the capture interface and
+   `ethertype` goes into headers built by kraken_pcapng_write_payload.
+   An empty path leaves the writer disabled (every call a no-op).
+   Returns: 0 on success or when disabled, -1 if the file cannot be
+   created (writer disabled, errno set). */
+static inline int kraken_pcapng_open(KrakenPcapng *w, const KrakenPcapngConfig *cfg, const char *iface, uint16_t ethertype) {
+    memset(w, 0, sizeof(*w));
+    w->fd = -1;
+    w->cfg = *cfg;
+    if (!cfg->path[0])
+        return 0;
+
+    kraken_pcapng_build_header(w, iface);
+    memset(w->eth_header, 0xFF, 6);
+    w->eth_header[12] = (uint8_t)(ethertype >> 8);
+    w->eth_header[13] = (uint8_t)ethertype;
+    if (kraken_pcapng_open_file(w, 0) != 0) {
+        int err = w->error;
+        if (w->fd >= 0)
+            close(w->fd);
+        w->fd = -1;
+        errno = err;
+        return -1;
+    }
+
+    w->buf[0] = (uint8_t *)malloc(KRAKEN_PCAPNG_BUFFER);
+    w->buf[1] = (uint8_t *)malloc(KRAKEN_PCAPNG_BUFFER);
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_cond_init(&w->cond, NULL);
+    if (!w->buf[0] || !w->buf[1] || pthread_create(&w->tid, NULL, kraken_pcapng_writer, w) != 0) {
+        free(w->buf[0]);
+        free(w->buf[1]);
+        w->buf[0] = w->buf[1] = NULL;
+        pthread_mutex_destroy(&w->lock);
+        pthread_cond_destroy(&w->cond);
+        close(w->fd);
+        w->fd = -1;
+        errno = ENOMEM;
+        return -1;
+    }
+    return 0;
+}
+
+/* Source MAC of headers built by kraken_pcapng_write_payload, taken from
+   a conduit address of the form "iface/aa:bb:cc:dd:ee:ff" when it has
+   one (the reference conduit's local_addr). */
+static inline void kraken_pcapng_set_source(KrakenPcapng *w, const char *local_addr) {
+    const char *mac = local_addr ? strrchr(local_addr, '/') : NULL;
+    unsigned b[6];
+    if (mac && sscanf(mac + 1, "%x:%x:%x:%x:%x:%x", &b[0], &b[1], &b[2], &b[3], &b[4], &b[5]) == 6) {
+        for (int i = 0; i < 6; i++)
+            w->eth_header[6 + i] = (uint8_t)b[i];
+    }
+}
+
+/* Record one packet made of `hdr` followed by `data`.
+   Returns: false if it was dropped because the writer is behind. */
+static inline bool kraken_pcapng_record(KrakenPcapng *w, const uint8_t *hdr, size_t hdr_len, const uint8_t *data, size_t len,
+                                        int64_t ts_ns, uint32_t dir, const char *comment) {
+    if (!kraken_pcapng_enabled(w))
+        return true;
+    if (ts_ns == 0) {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts_ns = (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+    }
+    size_t caplen = hdr_len + len;
+    size_t clen = comment ? strlen(comment) : 0;
+    if (clen > KRAKEN_PCAPNG_COMMENT_MAX)
+        clen = KRAKEN_PCAPNG_COMMENT_MAX;
+    size_t blen = 28 + kraken_pcapng_pad(caplen) + (dir ? 8 : 0) + (clen ? 4 + kraken_pcapng_pad(clen) : 0) + 4 + 4;
+    if (blen > KRAKEN_PCAPNG_BUFFER)
+        return false;
+
+    pthread_mutex_lock(&w->lock);
+    if (w->len[w->active] + blen > KRAKEN_PCAPNG_BUFFER) {
+        if (w->pending) {
+            w->dropped++;
+            pthread_mutex_unlock(&w->lock);
+            return false;
+        }
+        w->pending = true;
+        w->active ^= 1;
+        pthread_cond_signal(&w->cond);
+    }
+    uint8_t *p = w->buf[w->active] + w->len[w->active];
+    kraken_pcapng_put32(p, 6); /* enhanced packet block */
+    kraken_pcapng_put32(p + 4, (uint32_t)blen);
+    kraken_pcapng_put32(p + 8, 0);
+    kraken_pcapng_put32(p + 12, (uint32_t)((uint64_t)ts_ns >> 32));
+    kraken_pcapng_put32(p + 16, (uint32_t)ts_ns);
+    kraken_pcapng_put32(p + 20, (uint32_t)caplen);
+    kraken_pcapng_put32(p + 24, (uint32_t)caplen);
+    size_t n = 28;
+    if (hdr_len)
+        memcpy(p + n, hdr, hdr_len);
+    memcpy(p + n + hdr_len, data, len);
+    memset(p + n + caplen, 0, kraken_pcapng_pad(caplen) - caplen);
+    n += kraken_pcapng_pad(caplen);
+    if (dir)
+        n += kraken_pcapng_opt(p + n, 2, &dir, 4); /* epb_flags */
+    if (clen)
+        n += kraken_pcapng_opt(p + n, 1, comment, clen); /* opt_comment */
+    memset(p + n, 0, 4);
+    kraken_pcapng_put32(p + n + 4, (uint32_t)blen);
+    w->len[w->active] += blen;
+    w->packets++;
+    pthread_mutex_unlock(&w->lock);
+    return true;
+}
+
+/* Record a whole Ethernet frame */
+static inline bool kraken_pcapng_write(KrakenPcapng *w, const uint8_t *frame, size_t len, int64_t ts_ns, uint32_t dir,
+                                       const char *comment) {
+    return kraken_pcapng_record(w, NULL, 0, frame, len, ts_ns, dir, comment);
+}
+
+/* Record a payload sent through a frame conduit, behind the broadcast
+   Ethernet header the conduit would have prepended */
+static inline bool kraken_pcapng_write_payload(KrakenPcapng *w, const uint8_t *payload, size_t len, int64_t ts_ns, uint32_t dir,
+                                               const char *comment) {
+    return kraken_pcapng_record(w, w->eth_header, sizeof(w->eth_header), payload, len, ts_ns, dir, comment);
+}
+
+/* Write out everything recorded, stop the writer and close the file. */
+static inline void kraken_pcapng_close(KrakenPcapng *w) {
+    if (!kraken_pcapng_enabled(w))
+        return;
+    pthread_mutex_lock(&w->lock);
+    w->stop = true;
+    pthread_cond_signal(&w->cond);
+    pthread_mutex_unlock(&w->lock);
+    pthread_join(w->tid, NULL);
+    if (w->fd >= 0)
+        close(w->fd);
+    w->fd = -1;
+    free(w->buf[0]);
+    free(w->buf[1]);
+    w->buf[0] = w->buf[1] = NULL;
+    pthread_mutex_destroy(&w->lock);
+    pthread_cond_destroy(&w->cond);
+}
+
+/* One-line account of a closed writer for the module log */
+static inline void kraken_pcapng_summary(const KrakenPcapng *w, char *out, size_t size) {
+    if (w->error) {
+        /* strerror_r: modules summarise from concurrent runs */
+        char err[128];
+#if defined(__GLIBC__) && defined(_GNU_SOURCE)
+        const char *msg = strerror_r(w->error, err, sizeof(err));
+#else
+        const char *msg = strerror_r(w->error, err, sizeof(err)) == 0 ? err : "write error";
+#endif
+        snprintf(out, size, "pcapng %s: %s after %llu bytes", w->cfg.path, msg, (unsigned long long)w->written);
+        return;
+    }
+    snprintf(out, size, "pcapng %s: %llu packets, %llu bytes in %u file%s, %llu dropped (writer behind), %llu past the size cap",
+             w->cfg.path, (unsigned long long)w->packets, (unsigned long long)w->written, w->files_opened,
+             w->files_opened == 1 ? "" : "s", (unsigned long long)w->dropped, (unsigned long long)w->truncated);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* KRAKEN_PCAPNG_H */
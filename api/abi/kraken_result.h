@@ -0,0 +1,410 @@
+#ifndef KRAKEN_RESULT_H
+#define KRAKEN_RESULT_H
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "kraken_module_abi_v2.h"
+#include "kraken_module_abi_v3.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ------------------------------------------------------------------ */
+/* Arena-backed KrakenRunResultV2 builder                             */
+/*                                                                    */
+/* Every string, array, evidence item, tag and the shared target copy */
+/* of a result lives in a chain of blocks owned by that result. Logs  */
+/* and findings are appended in amortized O(1) and kraken_result_free */
+/* releases everything by walking the (short, geometrically growing)  */
+/* block chain instead of freeing each field.                         */
+/*                                                                    */
+/* Usage:                                                             */
+/*   KrakenRunResultV2 *r = kraken_result_new(target);                */
+/*   kraken_result_logf(r, "sent %d frames", n);                      */
+/*   KrakenFindingV2 f = {0};                                         */
+/*   f.id = kraken_result_strdup(r, "ECAT-DOS");                      */
+/*   f.target = r->target;  // shared, never deep-copied              */
+/*   kraken_finding_add_tag(r, &f, "ethercat");                       */
+/*   kraken_result_add_finding(r, &f);                                */
+/*   ...                                                              */
+/*   KRAKEN_API void kraken_free_v2(void *p) { kraken_result_free(p); }*/
+/*                                                                    */
+/* Streaming (kraken_run_v3): a result created with                   */
+/* kraken_result_new_streaming hands each log line and finding to the */
+/* sink as it is added and recycles its arena memory right after, so  */
+/* a run keeps a bounded footprint. In that mode arena memory         */
+/* allocated since the previous kraken_result_add_finding is reused   */
+/* once a finding is emitted: build one finding at a time.            */
+/* ------------------------------------------------------------------ */
+
+#define KRAKEN_ARENA_FIRST_BLOCK 4096u
+#define KRAKEN_ARENA_MAX_BLOCK (1u << 20)
+
+typedef struct KrakenArenaBlock {
+    struct KrakenArenaBlock *next; /* older block */
+    size_t cap;
+    size_t used;
+    unsigned char data[];
+} KrakenArenaBlock;
+
+typedef struct {
+    KrakenArenaBlock *head; /* newest block, allocations are served from here */
+} KrakenArena;
+
+typedef struct {
+    KrakenArenaBlock *block;
+    size_t used;
+} KrakenArenaMark;
+
+typedef struct {
+    KrakenRunResultV2 result; /* must stay first: kraken_free_v2 receives &result */
+    KrakenArena arena;
+    size_t logs_cap;
+    size_t findings_cap;
+    const KrakenResultSink *sink; /* non-NULL: stream instead of buffering */
+    KrakenArenaMark finding_mark; /* streaming: start of the finding being built */
+} KrakenResultBuilder;
+
+static inline KrakenArenaBlock *kraken_arena_block_new(size_t cap) {
+    KrakenArenaBlock *b = (KrakenArenaBlock *)malloc(sizeof(KrakenArenaBlock) + cap);
+    if (!b)
+        return NULL;
+    b->next = NULL;
+    b->cap = cap;
+    b->used = 0;
+    return b;
+}
+
+static inline void *kraken_arena_alloc(KrakenArena *a, size_t size, size_t align) {
+    KrakenArenaBlock *b = a->head;
+    if (b) {
+        uintptr_t at = (uintptr_t)(b->data + b->used);
+        size_t pad = (size_t)(-at & (uintptr_t)(align - 1));
+        if (b->used + pad + size <= b->cap) {
+            void *p = b->data + b->used + pad;
+            b->used += pad + size;
+            return p;
+        }
+    }
+
+    size_t cap = b ? b->cap * 2 : KRAKEN_ARENA_FIRST_BLOCK;
+    if (cap > KRAKEN_ARENA_MAX_BLOCK)
+        cap = KRAKEN_ARENA_MAX_BLOCK;
+    if (cap < size + align)
+        cap = size + align;
+
+    KrakenArenaBlock *nb = kraken_arena_block_new(cap);
+    if (!nb)
+        return NULL;
+    nb->next = b;
+    a->head = nb;
+
+    uintptr_t at = (uintptr_t)nb->data;
+    size_t pad = (size_t)(-at & (uintptr_t)(align - 1));
+    nb->used = pad + size;
+    return nb->data + pad;
+}
+
+static inline char *kraken_arena_strndup(KrakenArena *a, const char *s, size_t len) {
+    char *p = (char *)kraken_arena_alloc(a, len + 1, 1);
+    if (p) {
+        memcpy(p, s, len);
+        p[len] = '\0';
+    }
+    return p;
+}
+
+static inline char *kraken_arena_vsprintf(KrakenArena *a, const char *fmt, va_list ap) {
+    va_list retry;
+    va_copy(retry, ap);
+
+    /* Format straight into the free tail of the current block; only fall
+       back to a sized allocation when the line does not fit. */
+    KrakenArenaBlock *b = a->head;
+    size_t avail = b ? b->cap - b->used : 0;
+    char *dst = b ? (char *)b->data + b->used : NULL;
+    int n = vsnprintf(dst, avail, fmt, ap);
+    if (n < 0) {
+        va_end(retry);
+        return NULL;
+    }
+    if ((size_t)n < avail) {
+        b->used += (size_t)n + 1;
+        va_end(retry);
+        return dst;
+    }
+
+    char *p = (char *)kraken_arena_alloc(a, (size_t)n + 1, 1);
+    if (p)
+        vsnprintf(p, (size_t)n + 1, fmt, retry);
+    va_end(retry);
+    return p;
+}
+
+static inline KrakenArenaMark kraken_arena_mark(const KrakenArena *a) {
+    KrakenArenaMark m = {a->head, a->head ? a->head->used : 0};
+    return m;
+}
+
+/* Drop every allocation made after `m` was taken. */
+static inline void kraken_arena_rewind(KrakenArena *a, KrakenArenaMark m) {
+    while (a->head && a->head != m.block) {
+        KrakenArenaBlock *next = a->head->next;
+        free(a->head);
+        a->head = next;
+    }
+    if (a->head)
+        a->head->used = m.used;
+}
+
+static inline void kraken_arena_release(KrakenArenaBlock *b) {
+    while (b) {
+        KrakenArenaBlock *next = b->next;
+        free(b);
+        b = next;
+    }
+}
+
+/* First capacity of a grown list; kraken_list_cap relies on it. */
+#define KRAKEN_ARENA_LIST_CAP 8
+
+/* Grow an arena-backed array to hold at least `need` elements. The old
+   storage is abandoned in the arena; doubling keeps the waste bounded by
+   the final array size. */
+static inline void *kraken_arena_grow(KrakenArena *a, void *old, size_t count, size_t *cap, size_t need, size_t elem) {
+    if (need <= *cap)
+        return old;
+    size_t ncap = *cap ? *cap * 2 : KRAKEN_ARENA_LIST_CAP;
+    while (ncap < need)
+        ncap *= 2;
+    void *p = kraken_arena_alloc(a, ncap * elem, _Alignof(max_align_t));
+    if (!p)
+        return NULL;
+    if (old && count)
+        memcpy(p, old, count * elem);
+    *cap = ncap;
+    return p;
+}
+
+static inline KrakenResultBuilder *kraken_result_builder(KrakenRunResultV2 *result) {
+    return (KrakenResultBuilder *)result;
+}
+
+static inline KrakenArena *kraken_result_arena(KrakenRunResultV2 *result) {
+    return &kraken_result_builder(result)->arena;
+}
+
+/* Copy a target into the arena. The EtherCAT slaves array and all strings
+   are copied once; findings then share the copy by value. */
+static inline void kraken_result_copy_target(KrakenRunResultV2 *result, KrakenTarget *dst, const KrakenTarget *src) {
+    KrakenArena *a = kraken_result_arena(result);
+    memset(dst, 0, sizeof(*dst));
+    if (!src)
+        return;
+    dst->kind = src->kind;
+    if (src->kind == KRAKEN_TARGET_KIND_NETWORK) {
+        const char *host = src->u.network.host;
+        dst->u.network.host = host ? kraken_arena_strndup(a, host, strlen(host)) : NULL;
+        dst->u.network.port = src->u.network.port;
+    } else if (src->kind == KRAKEN_TARGET_KIND_ETHERCAT) {
+        const KrakenEtherCATTarget *e = &src->u.ethercat;
+        dst->u.ethercat.iface = e->iface ? kraken_arena_strndup(a, e->iface, strlen(e->iface)) : NULL;
+        dst->u.ethercat.mac_address = e->mac_address ? kraken_arena_strndup(a, e->mac_address, strlen(e->mac_address)) : NULL;
+        dst->u.ethercat.slave_count = e->slave_count;
+        if (e->slaves && e->slaves_len > 0) {
+            uint16_t *slaves = (uint16_t *)kraken_arena_alloc(a, e->slaves_len * sizeof(uint16_t), _Alignof(uint16_t));
+            if (slaves) {
+                memcpy(slaves, e->slaves, e->slaves_len * sizeof(uint16_t));
+                dst->u.ethercat.slaves = slaves;
+                dst->u.ethercat.slaves_len = e->slaves_len;
+            }
+        }
+    }
+}
+
+/* Allocate an empty result owning its arena. Returns NULL on allocation failure. */
+static inline KrakenRunResultV2 *kraken_result_new(const KrakenTarget *target) {
+    KrakenArena arena = {kraken_arena_block_new(KRAKEN_ARENA_FIRST_BLOCK)};
+    if (!arena.head)
+        return NULL;
+    KrakenResultBuilder *b = (KrakenResultBuilder *)kraken_arena_alloc(&arena, sizeof(*b), _Alignof(KrakenResultBuilder));
+    memset(b, 0, sizeof(*b));
+    b->arena = arena;
+    kraken_result_copy_target(&b->result, &b->result.target, target);
+    b->finding_mark = kraken_arena_mark(&b->arena);
+    return &b->result;
+}
+
+/* Allocate a result that forwards logs and findings to `sink` instead of
+   storing them. The returned result still has to be released with
+   kraken_result_free. */
+static inline KrakenRunResultV2 *kraken_result_new_streaming(const KrakenTarget *target, const KrakenResultSink *sink) {
+    KrakenRunResultV2 *result = kraken_result_new(target);
+    if (result)
+        kraken_result_builder(result)->sink = sink;
+    return result;
+}
+
+/* Release a result created by kraken_result_new (suitable as kraken_free_v2 body). */
+static inline void kraken_result_free(void *p) {
+    if (!p)
+        return;
+    kraken_arena_release(kraken_result_arena((KrakenRunResultV2 *)p)->head);
+}
+
+static inline const char *kraken_result_strdup(KrakenRunResultV2 *result, const char *s) {
+    if (!s)
+        return NULL;
+    return kraken_arena_strndup(kraken_result_arena(result), s, strlen(s));
+}
+
+static inline const char *kraken_result_sprintf(KrakenRunResultV2 *result, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    const char *s = kraken_arena_vsprintf(kraken_result_arena(result), fmt, ap);
+    va_end(ap);
+    return s;
+}
+
+static inline void kraken_result_push_log(KrakenRunResultV2 *result, const char *line) {
+    KrakenResultBuilder *b = kraken_result_builder(result);
+    if (!line)
+        return;
+    if (b->sink) {
+        if (b->sink->on_log)
+            b->sink->on_log(b->sink->ctx, line);
+        return;
+    }
+    const char **strings = (const char **)kraken_arena_grow(&b->arena, (void *)result->logs.strings, result->logs.count, &b->logs_cap,
+                                                          result->logs.count + 1, sizeof(char *));
+    if (!strings)
+        return;
+    strings[result->logs.count++] = line;
+    result->logs.strings = strings;
+}
+
+static inline void kraken_result_log(KrakenRunResultV2 *result, const char *line) {
+    KrakenResultBuilder *b = kraken_result_builder(result);
+    if (b->sink) {
+        /* Streamed lines never need a copy. */
+        if (line && b->sink->on_log)
+            b->sink->on_log(b->sink->ctx, line);
+        return;
+    }
+    kraken_result_push_log(result, kraken_result_strdup(result, line));
+}
+
+static inline void kraken_result_logf(KrakenRunResultV2 *result, const char *fmt, ...) {
+    KrakenArena *a = kraken_result_arena(result);
+    KrakenArenaMark m = kraken_arena_mark(a);
+    va_list ap;
+    va_start(ap, fmt);
+    const char *line = kraken_arena_vsprintf(a, fmt, ap);
+    va_end(ap);
+    kraken_result_push_log(result, line);
+    if (kraken_result_builder(result)->sink)
+        kraken_arena_rewind(a, m);
+}
+
+/* Per-finding lists carry no capacity field; their capacity is implied by
+   the count: powers of two from KRAKEN_ARENA_LIST_CAP, as kraken_arena_grow
+   allocates them. */
+static inline size_t kraken_list_cap(size_t count) {
+    size_t cap = KRAKEN_ARENA_LIST_CAP;
+    while (cap < count)
+        cap *= 2;
+    return count ? cap : 0;
+}
+
+static inline void kraken_finding_add_tag(KrakenRunResultV2 *result, KrakenFindingV2 *f, const char *tag) {
+    size_t cap = kraken_list_cap(f->tags.count);
+    const char **strings = (const char **)kraken_arena_grow(kraken_result_arena(result), (void *)f->tags.strings, f->tags.count, &cap,
+                                                          f->tags.count + 1, sizeof(char *));
+    if (!strings)
+        return;
+    strings[f->tags.count++] = kraken_result_strdup(result, tag);
+    f->tags.strings = strings;
+}
+
+static inline void kraken_finding_add_evidence(KrakenRunResultV2 *result, KrakenFindingV2 *f, const char *key, const char *value) {
+    size_t cap = kraken_list_cap(f->evidence.count);
+    KrakenKeyValue *items = (KrakenKeyValue *)kraken_arena_grow(kraken_result_arena(result), f->evidence.items, f->evidence.count, &cap,
+                                                                f->evidence.count + 1, sizeof(KrakenKeyValue));
+    if (!items)
+        return;
+    items[f->evidence.count].key = kraken_result_strdup(result, key);
+    items[f->evidence.count].value = kraken_result_strdup(result, value ? value : "");
+    f->evidence.count++;
+    f->evidence.items = items;
+}
+
+/* Append a finding. Its strings and lists must already live in the result
+   arena (kraken_result_strdup / kraken_finding_add_*); the struct itself
+   is copied, so a stack KrakenFindingV2 is fine. */
+static inline void kraken_result_add_finding(KrakenRunResultV2 *result, const KrakenFindingV2 *finding) {
+    KrakenResultBuilder *b = kraken_result_builder(result);
+    if (b->sink) {
+        if (b->sink->on_finding)
+            b->sink->on_finding(b->sink->ctx, finding);
+        kraken_arena_rewind(&b->arena, b->finding_mark);
+        return;
+    }
+    KrakenFindingV2 *findings = (KrakenFindingV2 *)kraken_arena_grow(&b->arena, result->findings, result->findings_count, &b->findings_cap,
+                                                                     result->findings_count + 1, sizeof(KrakenFindingV2));
+    if (!findings)
+        return;
+    findings[result->findings_count++] = *finding;
+    result->findings = findings;
+}
+
+/* ------------------------------------------------------------------ */
+/* Entrypoint glue                                                    */
+/* ------------------------------------------------------------------ */
+
+/* Module body shared by kraken_run_v2 and kraken_run_v3. It only ever
+   talks to `result` through the kraken_result_* helpers, so the same code
+   buffers under v2 and streams under v3. */
+typedef int (*KrakenModuleRunFn)(KrakenConnectionHandle conn, const KrakenConnectionOps *ops, KrakenRunResultV2 *result, uint32_t timeout_ms,
+                                 const char *params_json);
+
+static inline int kraken_result_run_v2(KrakenModuleRunFn run, KrakenConnectionHandle conn, const KrakenConnectionOps *ops, const KrakenTarget *target,
+                                       uint32_t timeout_ms, const char *params_json, KrakenRunResultV2 **out_result) {
+    KrakenRunResultV2 *result = kraken_result_new(target);
+    if (!result)
+        return -1;
+    /* v2 runners may hand over the original five-member ops table */
+    KrakenConnectionOps base = {0};
+    if (ops) {
+        base.send = ops->send;
+        base.recv = ops->recv;
+        base.get_info = ops->get_info;
+        base.open = ops->open;
+        base.close = ops->close;
+    }
+    int rc = run(conn, ops ? &base : NULL, result, timeout_ms, params_json);
+    *out_result = result;
+    return rc;
+}
+
+static inline int kraken_result_run_v3(KrakenModuleRunFn run, KrakenConnectionHandle conn, const KrakenConnectionOps *ops, const KrakenTarget *target,
+                                       uint32_t timeout_ms, const char *params_json, const KrakenResultSink *sink) {
+    KrakenRunResultV2 *result = kraken_result_new_streaming(target, sink);
+    if (!result)
+        return -1;
+    int rc = run(conn, ops, result, timeout_ms, params_json);
+    kraken_result_free(result);
+    return rc;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* KRAKEN_RESULT_H */
@@ -0,0 +1,908 @@
+#ifndef KRAKEN_MQTT_H
+#define KRAKEN_MQTT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ------------------------------------------------------------------ */
+/* MQTT 3.1.1 / 5.0 codec                                             */
+/*                                                                    */
+/* Encoders write a complete packet straight into a caller buffer:    */
+/* the body size is computed first, so the fixed header and its       */
+/* variable-length remaining length are emitted in place without a    */
+/* scratch packet or memmove. Like snprintf, every encoder returns    */
+/* the full packet length and only writes when it fits in `cap`;      */
+/* 0 means the arguments cannot be encoded (string > 65535 bytes,     */
+/* packet > 256 MiB).                                                 */
+/*                                                                    */
+/* Decoders never copy: KrakenMqttReader frames packets out of a      */
+/* receive buffer that is filled incrementally, and the typed parsers */
+/* return pointers into the frame (topics, payloads, reason codes,    */
+/* property blocks).                                                  */
+/*                                                                    */
+/* Usage:                                                             */
+/*   uint8_t out[256];                                                */
+/*   KrakenMqttConnect c = {.version = KRAKEN_MQTT_V5,                */
+/*                          .client_id = "kraken", .keep_alive = 60}; */
+/*   size_t n = kraken_mqtt_encode_connect(out, sizeof(out), &c);     */
+/*   if (n == 0 || n > sizeof(out)) ...                               */
+/*                                                                    */
+/*   uint8_t rx[2048];                                                */
+/*   KrakenMqttReader rd;                                             */
+/*   kraken_mqtt_reader_init(&rd, rx, sizeof(rx));                    */
+/*   KrakenMqttFrame f;                                               */
+/*   while (kraken_mqtt_reader_next(&rd, &f) == 0) {                  */
+/*       size_t room;                                                 */
+/*       uint8_t *dst = kraken_mqtt_reader_space(&rd, &room);         */
+/*       kraken_mqtt_reader_commit(&rd, recv(sock, dst, room, 0));    */
+/*   }                                                                */
+/*   KrakenMqttConnack ack;                                           */
+/*   kraken_mqtt_parse_connack(&f, KRAKEN_MQTT_V5, &ack);             */
+/* ------------------------------------------------------------------ */
+
+#define KRAKEN_MQTT_V311 4u
+#define KRAKEN_MQTT_V5 5u
+
+#define KRAKEN_MQTT_MAX_REMAINING 268435455u /* 4-byte varint limit */
+
+typedef enum {
+    KRAKEN_MQTT_CONNECT = 1,
+    KRAKEN_MQTT_CONNACK = 2,
+    KRAKEN_MQTT_PUBLISH = 3,
+    KRAKEN_MQTT_PUBACK = 4,
+    KRAKEN_MQTT_PUBREC = 5,
+    KRAKEN_MQTT_PUBREL = 6,
+    KRAKEN_MQTT_PUBCOMP = 7,
+    KRAKEN_MQTT_SUBSCRIBE = 8,
+    KRAKEN_MQTT_SUBACK = 9,
+    KRAKEN_MQTT_UNSUBSCRIBE = 10,
+    KRAKEN_MQTT_UNSUBACK = 11,
+    KRAKEN_MQTT_PINGREQ = 12,
+    KRAKEN_MQTT_PINGRESP = 13,
+    KRAKEN_MQTT_DISCONNECT = 14,
+    KRAKEN_MQTT_AUTH = 15,
+} KrakenMqttPacketType;
+
+/* MQTT 5 property identifiers */
+typedef enum {
+    KRAKEN_MQTT_PROP_PAYLOAD_FORMAT = 0x01,
+    KRAKEN_MQTT_PROP_MESSAGE_EXPIRY = 0x02,
+    KRAKEN_MQTT_PROP_CONTENT_TYPE = 0x03,
+    KRAKEN_MQTT_PROP_RESPONSE_TOPIC = 0x08,
+    KRAKEN_MQTT_PROP_CORRELATION_DATA = 0x09,
+    KRAKEN_MQTT_PROP_SUBSCRIPTION_ID = 0x0B,
+    KRAKEN_MQTT_PROP_SESSION_EXPIRY = 0x11,
+    KRAKEN_MQTT_PROP_ASSIGNED_CLIENT_ID = 0x12,
+    KRAKEN_MQTT_PROP_SERVER_KEEP_ALIVE = 0x13,
+    KRAKEN_MQTT_PROP_AUTH_METHOD = 0x15,
+    KRAKEN_MQTT_PROP_AUTH_DATA = 0x16,
+    KRAKEN_MQTT_PROP_REQUEST_PROBLEM_INFO = 0x17,
+    KRAKEN_MQTT_PROP_WILL_DELAY = 0x18,
+    KRAKEN_MQTT_PROP_REQUEST_RESPONSE_INFO = 0x19,
+    KRAKEN_MQTT_PROP_RESPONSE_INFO = 0x1A,
+    KRAKEN_MQTT_PROP_SERVER_REFERENCE = 0x1C,
+    KRAKEN_MQTT_PROP_REASON_STRING = 0x1F,
+    KRAKEN_MQTT_PROP_RECEIVE_MAXIMUM = 0x21,
+    KRAKEN_MQTT_PROP_TOPIC_ALIAS_MAXIMUM = 0x22,
+    KRAKEN_MQTT_PROP_TOPIC_ALIAS = 0x23,
+    KRAKEN_MQTT_PROP_MAXIMUM_QOS = 0x24,
+    KRAKEN_MQTT_PROP_RETAIN_AVAILABLE = 0x25,
+    KRAKEN_MQTT_PROP_USER_PROPERTY = 0x26,
+    KRAKEN_MQTT_PROP_MAXIMUM_PACKET_SIZE = 0x27,
+    KRAKEN_MQTT_PROP_WILDCARD_SUB_AVAILABLE = 0x28,
+    KRAKEN_MQTT_PROP_SUB_ID_AVAILABLE = 0x29,
+    KRAKEN_MQTT_PROP_SHARED_SUB_AVAILABLE = 0x2A,
+} KrakenMqttPropId;
+
+typedef enum {
+    KRAKEN_MQTT_PT_INVALID = 0,
+    KRAKEN_MQTT_PT_BYTE,
+    KRAKEN_MQTT_PT_U16,
+    KRAKEN_MQTT_PT_U32,
+    KRAKEN_MQTT_PT_VARINT,
+    KRAKEN_MQTT_PT_STRING,
+    KRAKEN_MQTT_PT_BINARY,
+    KRAKEN_MQTT_PT_PAIR,
+} KrakenMqttPropType;
+
+/* ------------------------------------------------------------------ */
+/* Encoding                                                           */
+/* ------------------------------------------------------------------ */
+
+/* Bounded output cursor. Writes past `cap` are counted but dropped, so
+   the same body routine both measures and emits a packet. Also used by
+   callers to build MQTT 5 property blocks. */
+typedef struct {
+    uint8_t *buf;
+    size_t cap;
+    size_t len;
+    bool invalid; /* an argument could not be encoded */
+} KrakenMqttOut;
+
+static inline void kraken_mqtt_out_init(KrakenMqttOut *o, uint8_t *buf, size_t cap) {
+    o->buf = buf;
+    o->cap = buf ? cap : 0;
+    o->len = 0;
+    o->invalid = false;
+}
+
+static inline void kraken_mqtt_put_u8(KrakenMqttOut *o, uint8_t v) {
+    if (o->len < o->cap)
+        o->buf[o->len] = v;
+    o->len++;
+}
+
+static inline void kraken_mqtt_put_u16(KrakenMqttOut *o, uint16_t v) {
+    kraken_mqtt_put_u8(o, (uint8_t)(v >> 8));
+    kraken_mqtt_put_u8(o, (uint8_t)v);
+}
+
+static inline void kraken_mqtt_put_u32(KrakenMqttOut *o, uint32_t v) {
+    kraken_mqtt_put_u16(o, (uint16_t)(v >> 16));
+    kraken_mqtt_put_u16(o, (uint16_t)v);
+}
+
+static inline void kraken_mqtt_put_raw(KrakenMqttOut *o, const void *data, size_t len) {
+    if (len && o->len < o->cap) {
+        size_t room = o->cap - o->len;
+        memcpy(o->buf + o->len, data, len < room ? len : room);
+    }
+    o->len += len;
+}
+
+static inline size_t kraken_mqtt_varint_size(uint32_t v) {
+    return v < 128u ? 1 : v < 16384u ? 2 : v < 2097152u ? 3 : 4;
+}
+
+static inline void kraken_mqtt_put_varint(KrakenMqttOut *o, uint32_t v) {
+    if (v > KRAKEN_MQTT_MAX_REMAINING) {
+        o->invalid = true;
+        return;
+    }
+    do {
+        uint8_t b = (uint8_t)(v & 0x7F);
+        v >>= 7;
+        if (v)
+            b |= 0x80;
+        kraken_mqtt_put_u8(o, b);
+    } while (v);
+}
+
+/* Length-prefixed binary data / UTF-8 string */
+static inline void kraken_mqtt_put_bin(KrakenMqttOut *o, const void *data, size_t len) {
+    if (len > 0xFFFF) {
+        o->invalid = true;
+        return;
+    }
+    kraken_mqtt_put_u16(o, (uint16_t)len);
+    kraken_mqtt_put_raw(o, data, len);
+}
+
+static inline void kraken_mqtt_put_str(KrakenMqttOut *o, const char *s) {
+    kraken_mqtt_put_bin(o, s ? s : "", s ? strlen(s) : 0);
+}
+
+/* MQTT 5 properties, appended to a block built with KrakenMqttOut. The
+   block is passed to the encoders without its length prefix. */
+static inline void kraken_mqtt_prop_u8(KrakenMqttOut *o, uint8_t id, uint8_t v) {
+    kraken_mqtt_put_u8(o, id);
+    kraken_mqtt_put_u8(o, v);
+}
+
+static inline void kraken_mqtt_prop_u16(KrakenMqttOut *o, uint8_t id, uint16_t v) {
+    kraken_mqtt_put_u8(o, id);
+    kraken_mqtt_put_u16(o, v);
+}
+
+static inline void kraken_mqtt_prop_u32(KrakenMqttOut *o, uint8_t id, uint32_t v) {
+    kraken_mqtt_put_u8(o, id);
+    kraken_mqtt_put_u32(o, v);
+}
+
+static inline void kraken_mqtt_prop_str(KrakenMqttOut *o, uint8_t id, const char *s) {
+    kraken_mqtt_put_u8(o, id);
+    kraken_mqtt_put_str(o, s);
+}
+
+static inline void kraken_mqtt_prop_user(KrakenMqttOut *o, const char *key, const char *value) {
+    kraken_mqtt_put_u8(o, KRAKEN_MQTT_PROP_USER_PROPERTY);
+    kraken_mqtt_put_str(o, key);
+    kraken_mqtt_put_str(o, value);
+}
+
+/* Property block with its varint length prefix (MQTT 5 only) */
+static inline void kraken_mqtt_put_props(KrakenMqttOut *o, uint8_t version, const uint8_t *props, size_t props_len) {
+    if (version < KRAKEN_MQTT_V5)
+        return;
+    if (props_len > KRAKEN_MQTT_MAX_REMAINING) {
+        o->invalid = true;
+        return;
+    }
+    kraken_mqtt_put_varint(o, (uint32_t)props_len);
+    kraken_mqtt_put_raw(o, props, props_len);
+}
+
+typedef void (*KrakenMqttBodyFn)(KrakenMqttOut *o, const void *arg);
+
+/* Measure the body, then write fixed header + body in one pass. */
+static inline size_t kraken_mqtt_encode_packet(uint8_t *buf, size_t cap, uint8_t first_byte, KrakenMqttBodyFn body, const void *arg) {
+    KrakenMqttOut o;
+    kraken_mqtt_out_init(&o, NULL, 0);
+    body(&o, arg);
+    if (o.invalid || o.len > KRAKEN_MQTT_MAX_REMAINING)
+        return 0;
+    size_t total = 1 + kraken_mqtt_varint_size((uint32_t)o.len) + o.len;
+    if (total > cap)
+        return total;
+    size_t body_len = o.len;
+    kraken_mqtt_out_init(&o, buf, cap);
+    kraken_mqtt_put_u8(&o, first_byte);
+    kraken_mqtt_put_varint(&o, (uint32_t)body_len);
+    body(&o, arg);
+    return o.len;
+}
+
+typedef struct {
+    uint8_t version;      /* KRAKEN_MQTT_V311 or KRAKEN_MQTT_V5 (0 = 3.1.1) */
+    const char *client_id;
+    const char *username; /* NULL or "" = not sent */
+    const char *password; /* NULL or "" = not sent */
+    uint16_t keep_alive;
+    bool clean_start;
+    const uint8_t *properties; /* MQTT 5 CONNECT properties, may be NULL */
+    size_t properties_len;
+} KrakenMqttConnect;
+
+static inline void kraken_mqtt_connect_body(KrakenMqttOut *o, const void *arg) {
+    const KrakenMqttConnect *c = (const KrakenMqttConnect *)arg;
+    uint8_t version = c->version ? c->version : KRAKEN_MQTT_V311;
+    bool has_user = c->username && *c->username;
+    bool has_pass = c->password && *c->password;
+    uint8_t flags = 0;
+    if (has_user)
+        flags |= 0x80;
+    if (has_pass)
+        flags |= 0x40;
+    if (c->clean_start)
+        flags |= 0x02;
+
+    kraken_mqtt_put_str(o, "MQTT");
+    kraken_mqtt_put_u8(o, version);
+    kraken_mqtt_put_u8(o, flags);
+    kraken_mqtt_put_u16(o, c->keep_alive);
+    kraken_mqtt_put_props(o, version, c->properties, c->properties_len);
+    kraken_mqtt_put_str(o, c->client_id);
+    if (has_user)
+        kraken_mqtt_put_str(o, c->username);
+    if (has_pass)
+        kraken_mqtt_put_str(o, c->password);
+}
+
+static inline size_t kraken_mqtt_encode_connect(uint8_t *buf, size_t cap, const KrakenMqttConnect *c) {
+    return kraken_mqtt_encode_packet(buf, cap, KRAKEN_MQTT_CONNECT << 4, kraken_mqtt_connect_body, c);
+}
+
+typedef struct {
+    const char *topic;
+    uint8_t options; /* bits 0-1 max QoS; MQTT 5 adds no-local, RAP, retain handling */
+} KrakenMqttSubscription;
+
+typedef struct {
+    uint8_t version;
+    uint16_t packet_id; /* must be nonzero */
+    const KrakenMqttSubscription *subs;
+    size_t count;
+    const uint8_t *properties;
+    size_t properties_len;
+} KrakenMqttSubscribe;
+
+static inline void kraken_mqtt_subscribe_body(KrakenMqttOut *o, const void *arg) {
+    const KrakenMqttSubscribe *s = (const KrakenMqttSubscribe *)arg;
+    if (s->packet_id == 0 || s->count == 0) {
+        o->invalid = true;
+        return;
+    }
+    kraken_mqtt_put_u16(o, s->packet_id);
+    kraken_mqtt_put_props(o, s->version, s->properties, s->properties_len);
+    for (size_t i = 0; i < s->count; i++) {
+        kraken_mqtt_put_str(o, s->subs[i].topic);
+        kraken_mqtt_put_u8(o, s->subs[i].options);
+    }
+}
+
+static inline size_t kraken_mqtt_encode_subscribe(uint8_t *buf, size_t cap, const KrakenMqttSubscribe *s) {
+    return kraken_mqtt_encode_packet(buf, cap, (KRAKEN_MQTT_SUBSCRIBE << 4) | 0x02, kraken_mqtt_subscribe_body, s);
+}
+
+typedef struct {
+    uint8_t version;
+    const char *topic;
+    const void *payload;
+    size_t payload_len;
+    uint8_t qos;
+    bool retain;
+    bool dup;
+    uint16_t packet_id; /* QoS 1/2 only, must be nonzero */
+    const uint8_t *properties;
+    size_t properties_len;
+} KrakenMqttPublishOut;
+
+static inline void kraken_mqtt_publish_body(KrakenMqttOut *o, const void *arg) {
+    const KrakenMqttPublishOut *p = (const KrakenMqttPublishOut *)arg;
+    if (p->qos > 2 || (p->qos > 0 && p->packet_id == 0)) {
+        o->invalid = true;
+        return;
+    }
+    kraken_mqtt_put_str(o, p->topic);
+    if (p->qos > 0)
+        kraken_mqtt_put_u16(o, p->packet_id);
+    kraken_mqtt_put_props(o, p->version, p->properties, p->properties_len);
+    kraken_mqtt_put_raw(o, p->payload, p->payload_len);
+}
+
+static inline size_t kraken_mqtt_encode_publish(uint8_t *buf, size_t cap, const KrakenMqttPublishOut *p) {
+    uint8_t first = (uint8_t)((KRAKEN_MQTT_PUBLISH << 4) | ((p->qos & 0x03) << 1));
+    if (p->retain)
+        first |= 0x01;
+    if (p->dup)
+        first |= 0x08;
+    return kraken_mqtt_encode_packet(buf, cap, first, kraken_mqtt_publish_body, p);
+}
+
+typedef struct {
+    uint8_t version;
+    uint16_t packet_id;
+    uint8_t reason_code; /* MQTT 5; omitted on the wire when 0 */
+} KrakenMqttAckOut;
+
+static inline void kraken_mqtt_ack_body(KrakenMqttOut *o, const void *arg) {
+    const KrakenMqttAckOut *a = (const KrakenMqttAckOut *)arg;
+    kraken_mqtt_put_u16(o, a->packet_id);
+    if (a->version >= KRAKEN_MQTT_V5 && a->reason_code)
+        kraken_mqtt_put_u8(o, a->reason_code);
+}
+
+/* PUBACK / PUBREC / PUBREL / PUBCOMP */
+static inline size_t kraken_mqtt_encode_ack(uint8_t *buf, size_t cap, KrakenMqttPacketType type, const KrakenMqttAckOut *a) {
+    uint8_t first = (uint8_t)(type << 4);
+    if (type == KRAKEN_MQTT_PUBREL)
+        first |= 0x02;
+    return kraken_mqtt_encode_packet(buf, cap, first, kraken_mqtt_ack_body, a);
+}
+
+static inline size_t kraken_mqtt_encode_pingreq(uint8_t *buf, size_t cap) {
+    if (cap >= 2) {
+        buf[0] = KRAKEN_MQTT_PINGREQ << 4;
+        buf[1] = 0;
+    }
+    return 2;
+}
+
+/* MQTT 5 DISCONNECT carries a reason code; 3.1.1 (or reason 0) is bare. */
+static inline size_t kraken_mqtt_encode_disconnect(uint8_t *buf, size_t cap, uint8_t version, uint8_t reason_code) {
+    size_t n = (version >= KRAKEN_MQTT_V5 && reason_code) ? 3 : 2;
+    if (cap >= n) {
+        buf[0] = KRAKEN_MQTT_DISCONNECT << 4;
+        buf[1] = (uint8_t)(n - 2);
+        if (n == 3)
+            buf[2] = reason_code;
+    }
+    return n;
+}
+
+/* ------------------------------------------------------------------ */
+/* Framing                                                            */
+/* ------------------------------------------------------------------ */
+
+/* Decode a variable byte integer.
+   Returns: bytes consumed, 0 if `n` ends mid-integer, -1 if malformed. */
+static inline int kraken_mqtt_get_varint(const uint8_t *buf, size_t n, uint32_t *out) {
+    uint32_t v = 0;
+    for (size_t i = 0; i < 4; i++) {
+        if (i >= n)
+            return 0;
+        v |= (uint32_t)(buf[i] & 0x7F) << (7 * i);
+        if (!(buf[i] & 0x80)) {
+            *out = v;
+            return (int)i + 1;
+        }
+    }
+    return -1;
+}
+
+/* One complete packet; `body` points into the caller's buffer. */
+typedef struct {
+    uint8_t type;  /* KrakenMqttPacketType */
+    uint8_t flags; /* low nibble of the first byte */
+    const uint8_t *body;
+    uint32_t body_len;
+    size_t total_len; /* fixed header + body */
+} KrakenMqttFrame;
+
+/* Frame the packet at the start of `buf`.
+   Returns: 1 and fills `f`; 0 if more bytes are needed (`*need`, when
+   non-NULL, receives the full packet length once the fixed header is
+   complete, else 0); -1 if the fixed header is malformed. */
+static inline int kraken_mqtt_frame(const uint8_t *buf, size_t n, KrakenMqttFrame *f, size_t *need) {
+    if (need)
+        *need = 0;
+    if (n < 2)
+        return 0;
+    uint32_t body_len = 0;
+    int vl = kraken_mqtt_get_varint(buf + 1, n - 1, &body_len);
+    if (vl <= 0)
+        return vl;
+    size_t total = 1 + (size_t)vl + body_len;
+    if (n < total) {
+        if (need)
+            *need = total;
+        return 0;
+    }
+    f->type = buf[0] >> 4;
+    f->flags = buf[0] & 0x0F;
+    f->body = buf + 1 + vl;
+    f->body_len = body_len;
+    f->total_len = total;
+    return 1;
+}
+
+/* Incremental framer over a caller-owned receive buffer. Append received
+   bytes at kraken_mqtt_reader_space/_commit, then pull packets with
+   kraken_mqtt_reader_next; frames stay valid until the next call to
+   _space or _next. Packets larger than the buffer are skipped as they
+   stream past and counted in `oversized`. */
+typedef struct {
+    uint8_t *buf;
+    size_t cap;
+    size_t len;      /* bytes held */
+    size_t pos;      /* start of the next unread packet */
+    size_t discard;  /* bytes of an oversized packet still to skip */
+    size_t oversized;
+} KrakenMqttReader;
+
+static inline void kraken_mqtt_reader_init(KrakenMqttReader *r, uint8_t *buf, size_t cap) {
+    memset(r, 0, sizeof(*r));
+    r->buf = buf;
+    r->cap = cap;
+}
+
+/* Free space after the buffered bytes, compacting consumed ones first. */
+static inline uint8_t *kraken_mqtt_reader_space(KrakenMqttReader *r, size_t *room) {
+    if (r->pos) {
+        memmove(r->buf, r->buf + r->pos, r->len - r->pos);
+        r->len -= r->pos;
+        r->pos = 0;
+    }
+    *room = r->cap - r->len;
+    return r->buf + r->len;
+}
+
+/* Account for `n` bytes written at kraken_mqtt_reader_space (n <= 0 is ignored). */
+static inline void kraken_mqtt_reader_commit(KrakenMqttReader *r, int64_t n) {
+    if (n <= 0)
+        return;
+    size_t got = (size_t)n;
+    if (r->discard) {
+        size_t skip = got < r->discard ? got : r->discard;
+        memmove(r->buf + r->len, r->buf + r->len + skip, got - skip);
+        r->discard -= skip;
+        got -= skip;
+    }
+    r->len += got;
+}
+
+/* Returns: 1 with the next packet in `f`, 0 if more input is needed,
+   -1 if the stream is malformed (the connection should be dropped). */
+static inline int kraken_mqtt_reader_next(KrakenMqttReader *r, KrakenMqttFrame *f) {
+    for (;;) {
+        size_t need = 0;
+        int rc = kraken_mqtt_frame(r->buf + r->pos, r->len - r->pos, f, &need);
+        if (rc == 1) {
+            r->pos += f->total_len;
+            return 1;
+        }
+        if (rc < 0)
+            return -1;
+        if (need <= r->cap || r->discard)
+            return 0;
+        /* Oversized: drop what is buffered and skip the rest on commit. */
+        r->discard = need - (r->len - r->pos);
+        r->len = r->pos;
+        r->oversized++;
+    }
+}
+
+/* ------------------------------------------------------------------ */
+/* Typed parsers (zero-copy)                                          */
+/* ------------------------------------------------------------------ */
+
+/* MQTT 5 property block; iterate with kraken_mqtt_prop_next. */
+typedef struct {
+    const uint8_t *data;
+    size_t len;
+} KrakenMqttProps;
+
+typedef struct {
+    uint8_t id;
+    uint8_t type;   /* KrakenMqttPropType */
+    uint32_t value; /* BYTE, U16, U32, VARINT */
+    const uint8_t *data; /* STRING, BINARY, PAIR key */
+    uint16_t data_len;
+    const uint8_t *data2; /* PAIR value */
+    uint16_t data2_len;
+} KrakenMqttProp;
+
+static inline KrakenMqttPropType kraken_mqtt_prop_type(uint8_t id) {
+    switch (id) {
+        case KRAKEN_MQTT_PROP_PAYLOAD_FORMAT:
+        case KRAKEN_MQTT_PROP_REQUEST_PROBLEM_INFO:
+        case KRAKEN_MQTT_PROP_REQUEST_RESPONSE_INFO:
+        case KRAKEN_MQTT_PROP_MAXIMUM_QOS:
+        case KRAKEN_MQTT_PROP_RETAIN_AVAILABLE:
+        case KRAKEN_MQTT_PROP_WILDCARD_SUB_AVAILABLE:
+        case KRAKEN_MQTT_PROP_SUB_ID_AVAILABLE:
+        case KRAKEN_MQTT_PROP_SHARED_SUB_AVAILABLE:
+            return KRAKEN_MQTT_PT_BYTE;
+        case KRAKEN_MQTT_PROP_SERVER_KEEP_ALIVE:
+        case KRAKEN_MQTT_PROP_RECEIVE_MAXIMUM:
+        case KRAKEN_MQTT_PROP_TOPIC_ALIAS_MAXIMUM:
+        case KRAKEN_MQTT_PROP_TOPIC_ALIAS:
+            return KRAKEN_MQTT_PT_U16;
+        case KRAKEN_MQTT_PROP_MESSAGE_EXPIRY:
+        case KRAKEN_MQTT_PROP_SESSION_EXPIRY:
+        case KRAKEN_MQTT_PROP_WILL_DELAY:
+        case KRAKEN_MQTT_PROP_MAXIMUM_PACKET_SIZE:
+            return KRAKEN_MQTT_PT_U32;
+        case KRAKEN_MQTT_PROP_SUBSCRIPTION_ID:
+            return KRAKEN_MQTT_PT_VARINT;
+        case KRAKEN_MQTT_PROP_CONTENT_TYPE:
+        case KRAKEN_MQTT_PROP_RESPONSE_TOPIC:
+        case KRAKEN_MQTT_PROP_ASSIGNED_CLIENT_ID:
+        case KRAKEN_MQTT_PROP_AUTH_METHOD:
+        case KRAKEN_MQTT_PROP_RESPONSE_INFO:
+        case KRAKEN_MQTT_PROP_SERVER_REFERENCE:
+        case KRAKEN_MQTT_PROP_REASON_STRING:
+            return KRAKEN_MQTT_PT_STRING;
+        case KRAKEN_MQTT_PROP_CORRELATION_DATA:
+        case KRAKEN_MQTT_PROP_AUTH_DATA:
+            return KRAKEN_MQTT_PT_BINARY;
+        case KRAKEN_MQTT_PROP_USER_PROPERTY:
+            return KRAKEN_MQTT_PT_PAIR;
+        default:
+            return KRAKEN_MQTT_PT_INVALID;
+    }
+}
+
+static inline bool kraken_mqtt_get_bin(const uint8_t **p, const uint8_t *end, const uint8_t **data, uint16_t *len) {
+    if (end - *p < 2)
+        return false;
+    uint16_t l = (uint16_t)(((*p)[0] << 8) | (*p)[1]);
+    if ((size_t)(end - *p - 2) < l)
+        return false;
+    *data = *p + 2;
+    *len = l;
+    *p += 2 + l;
+    return true;
+}
+
+/* Pop the next property off `it`.
+   Returns: 1 with `out` filled, 0 at the end, -1 if malformed. */
+static inline int kraken_mqtt_prop_next(KrakenMqttProps *it, KrakenMqttProp *out) {
+    if (it->len == 0)
+        return 0;
+    const uint8_t *p = it->data;
+    const uint8_t *end = it->data + it->len;
+    memset(out, 0, sizeof(*out));
+    out->id = *p++;
+    out->type = (uint8_t)kraken_mqtt_prop_type(out->id);
+    size_t avail = (size_t)(end - p);
+    switch (out->type) {
+        case KRAKEN_MQTT_PT_BYTE:
+            if (avail < 1)
+                return -1;
+            out->value = p[0];
+            p += 1;
+            break;
+        case KRAKEN_MQTT_PT_U16:
+            if (avail < 2)
+                return -1;
+            out->value = ((uint32_t)p[0] << 8) | p[1];
+            p += 2;
+            break;
+        case KRAKEN_MQTT_PT_U32:
+            if (avail < 4)
+                return -1;
+            out->value = ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+            p += 4;
+            break;
+        case KRAKEN_MQTT_PT_VARINT: {
+            int vl = kraken_mqtt_get_varint(p, avail, &out->value);
+            if (vl <= 0)
+                return -1;
+            p += vl;
+            break;
+        }
+        case KRAKEN_MQTT_PT_STRING:
+        case KRAKEN_MQTT_PT_BINARY:
+            if (!kraken_mqtt_get_bin(&p, end, &out->data, &out->data_len))
+                return -1;
+            break;
+        case KRAKEN_MQTT_PT_PAIR:
+            if (!kraken_mqtt_get_bin(&p, end, &out->data, &out->data_len) || !kraken_mqtt_get_bin(&p, end, &out->data2, &out->data2_len))
+                return -1;
+            break;
+        default:
+            return -1;
+    }
+    it->len -= (size_t)(p - it->data);
+    it->data = p;
+    return 1;
+}
+
+/* First property with `id`, or false. */
+static inline bool kraken_mqtt_props_find(KrakenMqttProps props, uint8_t id, KrakenMqttProp *out) {
+    while (kraken_mqtt_prop_next(&props, out) == 1) {
+        if (out->id == id)
+            return true;
+    }
+    return false;
+}
+
+/* Split a varint-prefixed property block off the front of [*p, end). */
+static inline bool kraken_mqtt_get_props(const uint8_t **p, const uint8_t *end, KrakenMqttProps *props) {
+    uint32_t len = 0;
+    int vl = kraken_mqtt_get_varint(*p, (size_t)(end - *p), &len);
+    if (vl <= 0 || (size_t)(end - *p - vl) < len)
+        return false;
+    props->data = *p + vl;
+    props->len = len;
+    *p += (size_t)vl + len;
+    return true;
+}
+
+typedef struct {
+    bool session_present;
+    uint8_t reason_code; /* 3.1.1 return code or MQTT 5 reason code; 0 = accepted */
+    KrakenMqttProps props;
+} KrakenMqttConnack;
+
+/* Returns 0 on success, -1 if `f` is not a well-formed CONNACK. */
+static inline int kraken_mqtt_parse_connack(const KrakenMqttFrame *f, uint8_t version, KrakenMqttConnack *out) {
+    memset(out, 0, sizeof(*out));
+    if (f->type != KRAKEN_MQTT_CONNACK || f->body_len < 2)
+        return -1;
+    const uint8_t *p = f->body + 2;
+    const uint8_t *end = f->body + f->body_len;
+    out->session_present = f->body[0] & 0x01;
+    out->reason_code = f->body[1];
+    if (version >= KRAKEN_MQTT_V5 && p < end && !kraken_mqtt_get_props(&p, end, &out->props))
+        return -1;
+    return 0;
+}
+
+typedef struct {
+    uint16_t packet_id;
+    const uint8_t *reason_codes; /* one granted QoS / reason code per topic */
+    size_t count;
+    KrakenMqttProps props;
+} KrakenMqttSuback;
+
+static inline int kraken_mqtt_parse_suback(const KrakenMqttFrame *f, uint8_t version, KrakenMqttSuback *out) {
+    memset(out, 0, sizeof(*out));
+    if ((f->type != KRAKEN_MQTT_SUBACK && f->type != KRAKEN_MQTT_UNSUBACK) || f->body_len < 2)
+        return -1;
+    const uint8_t *p = f->body + 2;
+    const uint8_t *end = f->body + f->body_len;
+    out->packet_id = (uint16_t)((f->body[0] << 8) | f->body[1]);
+    if (version >= KRAKEN_MQTT_V5 && !kraken_mqtt_get_props(&p, end, &out->props))
+        return -1;
+    out->reason_codes = p;
+    out->count = (size_t)(end - p);
+    return 0;
+}
+
+/* PUBACK / PUBREC / PUBREL / PUBCOMP */
+typedef struct {
+    uint16_t packet_id;
+    uint8_t reason_code; /* 0 when omitted, always 0 on 3.1.1 */
+    KrakenMqttProps props;
+} KrakenMqttAck;
+
+static inline int kraken_mqtt_parse_ack(const KrakenMqttFrame *f, uint8_t version, KrakenMqttAck *out) {
+    memset(out, 0, sizeof(*out));
+    if (f->type < KRAKEN_MQTT_PUBACK || f->type > KRAKEN_MQTT_PUBCOMP || f->body_len < 2)
+        return -1;
+    const uint8_t *p = f->body + 2;
+    const uint8_t *end = f->body + f->body_len;
+    out->packet_id = (uint16_t)((f->body[0] << 8) | f->body[1]);
+    if (version >= KRAKEN_MQTT_V5 && p < end) {
+        out->reason_code = *p++;
+        if (p < end && !kraken_mqtt_get_props(&p, end, &out->props))
+            return -1;
+    }
+    return 0;
+}
+
+typedef struct {
+    uint8_t qos;
+    bool retain;
+    bool dup;
+    const char *topic; /* not NUL-terminated */
+    uint16_t topic_len;
+    uint16_t packet_id; /* 0 for QoS 0 */
+    KrakenMqttProps props;
+    const uint8_t *payload;
+    size_t payload_len;
+} KrakenMqttPublish;
+
+static inline int kraken_mqtt_parse_publish(const KrakenMqttFrame *f, uint8_t version, KrakenMqttPublish *out) {
+    memset(out, 0, sizeof(*out));
+    if (f->type != KRAKEN_MQTT_PUBLISH)
+        return -1;
+    const uint8_t *p = f->body;
+    const uint8_t *end = f->body + f->body_len;
+    const uint8_t *topic = NULL;
+    out->qos = (f->flags >> 1) & 0x03;
+    out->retain = f->flags & 0x01;
+    out->dup = (f->flags & 0x08) != 0;
+    if (out->qos > 2 || !kraken_mqtt_get_bin(&p, end, &topic, &out->topic_len))
+        return -1;
+    out->topic = (const char *)topic;
+    if (out->qos > 0) {
+        if (end - p < 2)
+            return -1;
+        out->packet_id = (uint16_t)((p[0] << 8) | p[1]);
+        p += 2;
+    }
+    if (version >= KRAKEN_MQTT_V5 && !kraken_mqtt_get_props(&p, end, &out->props))
+        return -1;
+    out->payload = p;
+    out->payload_len = (size_t)(end - p);
+    return 0;
+}
+
+typedef struct {
+    uint8_t reason_code;
+    KrakenMqttProps props;
+} KrakenMqttDisconnect;
+
+static inline int kraken_mqtt_parse_disconnect(const KrakenMqttFrame *f, uint8_t version, KrakenMqttDisconnect *out) {
+    memset(out, 0, sizeof(*out));
+    if (f->type != KRAKEN_MQTT_DISCONNECT)
+        return -1;
+    const uint8_t *p = f->body;
+    const uint8_t *end = f->body + f->body_len;
+    if (version >= KRAKEN_MQTT_V5 && p < end) {
+        out->reason_code = *p++;
+        if (p < end && !kraken_mqtt_get_props(&p, end, &out->props))
+            return -1;
+    }
+    return 0;
+}
+
+/* Human-readable reason code. CONNACK return codes 1-5 differ between
+   3.1.1 and 5.0, so the protocol version selects the table for them. */
+static inline const char *kraken_mqtt_reason_name(uint8_t version, uint8_t code) {
+    if (version < KRAKEN_MQTT_V5) {
+        switch (code) {
+            case 0x00:
+                return "Accepted";
+            case 0x01:
+                return "Unacceptable protocol version";
+            case 0x02:
+                return "Identifier rejected";
+            case 0x03:
+                return "Server unavailable";
+            case 0x04:
+                return "Bad user name or password";
+            case 0x05:
+                return "Not authorized";
+            case 0x80:
+                return "Failure";
+            default:
+                return "Unknown";
+        }
+    }
+    switch (code) {
+        case 0x00:
+            return "Success";
+        case 0x01:
+            return "Granted QoS 1";
+        case 0x02:
+            return "Granted QoS 2";
+        case 0x04:
+            return "Disconnect with Will Message";
+        case 0x10:
+            return "No matching subscribers";
+        case 0x11:
+            return "No subscription existed";
+        case 0x18:
+            return "Continue authentication";
+        case 0x19:
+            return "Re-authenticate";
+        case 0x80:
+            return "Unspecified error";
+        case 0x81:
+            return "Malformed Packet";
+        case 0x82:
+            return "Protocol Error";
+        case 0x83:
+            return "Implementation specific error";
+        case 0x84:
+            return "Unsupported Protocol Version";
+        case 0x85:
+            return "Client Identifier not valid";
+        case 0x86:
+            return "Bad User Name or Password";
+        case 0x87:
+            return "Not authorized";
+        case 0x88:
+            return "Server unavailable";
+        case 0x89:
+            return "Server busy";
+        case 0x8A:
+            return "Banned";
+        case 0x8B:
+            return "Server shutting down";
+        case 0x8C:
+            return "Bad authentication method";
+        case 0x8D:
+            return "Keep Alive timeout";
+        case 0x8E:
+            return "Session taken over";
+        case 0x8F:
+            return "Topic Filter invalid";
+        case 0x90:
+            return "Topic Name invalid";
+        case 0x91:
+            return "Packet Identifier in use";
+        case 0x92:
+            return "Packet Identifier not found";
+        case 0x93:
+            return "Receive Maximum exceeded";
+        case 0x94:
+            return "Topic Alias invalid";
+        case 0x95:
+            return "Packet too large";
+        case 0x96:
+            return "Message rate too high";
+        case 0x97:
+            return "Quota exceeded";
+        case 0x98:
+            return "Administrative action";
+        case 0x99:
+            return "Payload format invalid";
+        case 0x9A:
+            return "Retain not supported";
+        case 0x9B:
+            return "QoS not supported";
+        case 0x9C:
+            return "Use another server";
+        case 0x9D:
+            return "Server moved";
+        case 0x9E:
+            return "Shared Subscriptions not supported";
+        case 0x9F:
+            return "Connection rate exceeded";
+        case 0xA0:
+            return "Maximum connect time";
+        case 0xA1:
+            return "Subscription Identifiers not supported";
+        case 0xA2:
+            return "Wildcard Subscriptions not supported";
+        default:
+            return "Unknown";
+    }
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* KRAKEN_MQTT_H */
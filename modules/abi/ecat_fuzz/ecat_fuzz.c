@@ -0,0 +1,1004 @@
+// EtherCAT Fuzzing Module
+// Mutates captured frames at datagram level and watches how the network
+// answers: working counters of returned mutants, frames that never come
+// back and stalls in the master's cyclic traffic.
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // memmem
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "kraken_module_abi.h"
+#include "kraken_module_abi_v2.h"
+#include "kraken_module_abi_v3.h"
+#include "kraken_ecat_frame.h"
+#include "kraken_params.h"
+#include "kraken_result.h"
+
+#define FUZZ_MUTANTS 100000
+#define FUZZ_DURATION_MS 30000
+#define FUZZ_BATCH 64
+#define FUZZ_CAPTURE_MS 2000
+#define FUZZ_RESPONSE_MS 50
+
+#define FUZZ_MAX_CORPUS 256
+#define FUZZ_MAX_DGRAMS 32
+#define FUZZ_MAX_BATCH 256
+#define FUZZ_WINDOW 16384 // mutants in flight, power of two
+#define FUZZ_MAX_WKC_SEEN 16
+#define FUZZ_MAX_ANOMALIES 32
+#define FUZZ_MAX_GAPS 256
+#define FUZZ_MAX_RETRIES 1024 // lost mutants waiting to be sent once more
+#define FUZZ_CALIBRATION_ROUNDS 3 // unmutated sends per seed before fuzzing
+#define FUZZ_MAX_OPS 3            // mutators stacked on one mutant
+#define FUZZ_RX_BATCH 32
+#define FUZZ_RX_ROUNDS 8 // receive calls per batch while replies keep coming
+#define FUZZ_HEX_BYTES 64 // mutant bytes quoted in the report
+
+#define FUZZ_ENERGY_INIT 16
+#define FUZZ_ENERGY_NOVEL 8
+#define FUZZ_ENERGY_ANOMALY 32
+#define FUZZ_ENERGY_MAX 1024
+
+#define ETH_HDR_LEN 14
+
+typedef struct {
+    uint64_t seed;    // PRNG seed, 0 = derive from the clock
+    int64_t mutants;  // stop after this many mutants
+    int duration_ms;  // ...or after this long
+    int batch;        // mutants per send batch
+    int capture_ms;   // seed capture
+    int response_ms;  // a mutant that has not come back by then is lost
+} fuzz_config_t;
+
+static void load_config(fuzz_config_t *cfg, const char *params_json, KrakenRunResultV2 *result) {
+    KrakenParams params;
+    if (kraken_params_parse(&params, params_json) != 0)
+        kraken_result_log(result, "Malformed params_json, using defaults");
+
+    int64_t seed = kraken_params_int(&params, "seed", 0);
+    cfg->seed = (uint64_t)seed;
+    int64_t mutants = kraken_params_int(&params, "mutants", FUZZ_MUTANTS);
+    cfg->mutants = mutants < 1 ? FUZZ_MUTANTS : mutants;
+    int64_t duration = kraken_params_int(&params, "duration_ms", FUZZ_DURATION_MS);
+    cfg->duration_ms = duration < 1 ? FUZZ_DURATION_MS : (int)duration;
+    int64_t batch = kraken_params_int(&params, "batch", FUZZ_BATCH);
+    cfg->batch = batch < 1 ? 1 : batch > FUZZ_MAX_BATCH ? FUZZ_MAX_BATCH : (int)batch;
+    int64_t capture = kraken_params_int(&params, "capture_ms", FUZZ_CAPTURE_MS);
+    cfg->capture_ms = capture < 0 ? FUZZ_CAPTURE_MS : (int)capture;
+    int64_t response = kraken_params_int(&params, "response_ms", FUZZ_RESPONSE_MS);
+    cfg->response_ms = response < 1 ? FUZZ_RESPONSE_MS : (int)response;
+
+    kraken_params_free(&params);
+}
+
+static int64_t fuzz_now_ns(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* ------------------------------------------------------------------ */
+/* PRNG                                                               */
+/* ------------------------------------------------------------------ */
+
+// Every mutant gets its own xorshift64* stream seeded by splitmix64 of
+// (seed, mutant id), so any mutant can be rebuilt from the run seed, its
+// id and its parent without replaying the ones before it.
+typedef struct {
+    uint64_t s;
+} fuzz_rng_t;
+
+static uint64_t fuzz_mix(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+static fuzz_rng_t fuzz_rng(uint64_t seed, uint64_t stream) {
+    fuzz_rng_t r = {fuzz_mix(seed ^ fuzz_mix(stream))};
+    if (r.s == 0) r.s = 0x9E3779B97F4A7C15ULL;
+    return r;
+}
+
+static uint64_t fuzz_next(fuzz_rng_t *r) {
+    r->s ^= r->s >> 12;
+    r->s ^= r->s << 25;
+    r->s ^= r->s >> 27;
+    return r->s * 0x2545F4914F6CDD1DULL;
+}
+
+// Uniform in [0, n)
+static uint32_t fuzz_below(fuzz_rng_t *r, uint32_t n) {
+    return (uint32_t)(((fuzz_next(r) >> 32) * n) >> 32);
+}
+
+/* ------------------------------------------------------------------ */
+/* Structured frames                                                  */
+/* ------------------------------------------------------------------ */
+
+// A frame split into datagrams; data lives in `pool` so mutators can
+// resize and rewrite it
+typedef struct {
+    KrakenEcatDatagram d[FUZZ_MAX_DGRAMS];
+    uint8_t *data[FUZZ_MAX_DGRAMS];
+    int count;
+    uint8_t pool[2 * KRAKEN_ECAT_MAX_FRAME];
+    size_t pool_used;
+} fuzz_frame_t;
+
+static uint8_t *fuzz_alloc(fuzz_frame_t *m, size_t len) {
+    if (m->pool_used + len > sizeof(m->pool)) return NULL;
+    uint8_t *p = m->pool + m->pool_used;
+    m->pool_used += len;
+    return p;
+}
+
+// Split an EtherCAT payload into datagrams, dropping a Kraken signature
+// (and tag) in front of the first datagram's data.
+// Returns: false unless at least one datagram was read.
+static bool fuzz_split(fuzz_frame_t *m, const uint8_t *p, size_t len) {
+    m->count = 0;
+    m->pool_used = 0;
+    if (len < KRAKEN_ECAT_HDR_LEN) return false;
+    size_t end = KRAKEN_ECAT_HDR_LEN + (kraken_ecat_get16(p) & KRAKEN_ECAT_LEN_MASK);
+    if (end > len) end = len;
+
+    size_t off = KRAKEN_ECAT_HDR_LEN;
+    while (m->count < FUZZ_MAX_DGRAMS && off + KRAKEN_ECAT_DGRAM_HDR_LEN + KRAKEN_ECAT_WKC_LEN <= end) {
+        uint16_t len_flags = kraken_ecat_get16(p + off + 6);
+        size_t dlen = len_flags & KRAKEN_ECAT_LEN_MASK;
+        if (off + KRAKEN_ECAT_DGRAM_HDR_LEN + dlen + KRAKEN_ECAT_WKC_LEN > end) break;
+        const uint8_t *data = p + off + KRAKEN_ECAT_DGRAM_HDR_LEN;
+        size_t skip = 0;
+        if (m->count == 0 && dlen >= KRAKEN_ECAT_SIG_LEN && memcmp(data, KRAKEN_ECAT_SIG, KRAKEN_ECAT_SIG_LEN) == 0)
+            skip = dlen >= KRAKEN_ECAT_SIG_LEN + KRAKEN_ECAT_TAG_LEN ? KRAKEN_ECAT_SIG_LEN + KRAKEN_ECAT_TAG_LEN : KRAKEN_ECAT_SIG_LEN;
+
+        KrakenEcatDatagram *d = &m->d[m->count];
+        d->cmd = p[off];
+        d->index = p[off + 1];
+        d->adp = kraken_ecat_get16(p + off + 2);
+        d->ado = kraken_ecat_get16(p + off + 4);
+        d->irq = kraken_ecat_get16(p + off + 8);
+        d->wkc = kraken_ecat_get16(data + dlen);
+        d->len = (uint16_t)(dlen - skip);
+        m->data[m->count] = fuzz_alloc(m, d->len);
+        memcpy(m->data[m->count], data + skip, d->len);
+        d->data = m->data[m->count];
+        m->count++;
+
+        off += KRAKEN_ECAT_DGRAM_HDR_LEN + dlen + KRAKEN_ECAT_WKC_LEN;
+        if (!(len_flags & KRAKEN_ECAT_MORE)) break;
+    }
+    return m->count > 0;
+}
+
+// Serialize; datagrams that no longer fit are dropped.
+// Returns: payload length, 0 if not even the first datagram fits.
+static size_t fuzz_join(const fuzz_frame_t *m, uint8_t *buf, bool tagged, uint32_t tag) {
+    KrakenEcatFrame f;
+    if (tagged)
+        kraken_ecat_frame_init_tagged(&f, buf, KRAKEN_ECAT_MAX_FRAME, tag);
+    else
+        kraken_ecat_frame_init(&f, buf, KRAKEN_ECAT_MAX_FRAME, false);
+    for (int i = 0; i < m->count && kraken_ecat_frame_append(&f, &m->d[i]); i++) {
+    }
+    return f.count ? kraken_ecat_frame_finish(&f) : 0;
+}
+
+// Offset of the n-th datagram header in a serialized payload
+static size_t fuzz_dgram_offset(const uint8_t *buf, size_t len, int n) {
+    size_t off = KRAKEN_ECAT_HDR_LEN;
+    for (int i = 0; i < n; i++) {
+        size_t next = off + KRAKEN_ECAT_DGRAM_HDR_LEN + (kraken_ecat_get16(buf + off + 6) & KRAKEN_ECAT_LEN_MASK) + KRAKEN_ECAT_WKC_LEN;
+        if (next + KRAKEN_ECAT_DGRAM_HDR_LEN > len) break;
+        off = next;
+    }
+    return off;
+}
+
+/* ------------------------------------------------------------------ */
+/* Mutators                                                           */
+/* ------------------------------------------------------------------ */
+
+enum {
+    FUZZ_OP_CMD = 1 << 0,       // command byte
+    FUZZ_OP_ADDR = 1 << 1,      // ADP/ADO
+    FUZZ_OP_LEN = 1 << 2,       // resize datagram data
+    FUZZ_OP_WKC = 1 << 3,       // working counter as sent
+    FUZZ_OP_DATA = 1 << 4,      // data bytes
+    FUZZ_OP_CHAIN = 1 << 5,     // duplicate / drop / swap datagrams
+    FUZZ_OP_LEN_FIELD = 1 << 6, // length field disagrees with the data (after serializing)
+    FUZZ_OP_MORE = 1 << 7,      // "more datagrams" flag toggled (after serializing)
+};
+
+#define FUZZ_NUM_OPS 8
+#define FUZZ_RAW_OPS (FUZZ_OP_LEN_FIELD | FUZZ_OP_MORE)
+
+static const char *fuzz_op_names[FUZZ_NUM_OPS] = {"cmd", "addr", "len", "wkc", "data", "chain", "len_field", "more_flag"};
+
+// Registers worth aiming at: type, station address, DL control/status,
+// AL control/status/status code, watchdog, SM0/FMMU0
+static const uint16_t fuzz_registers[] = {0x0000, 0x0010, 0x0100, 0x0110, 0x0120, 0x0130, 0x0134, 0x0400, 0x0600, 0x0800};
+static const uint16_t fuzz_interesting16[] = {0x0000, 0x0001, 0x0002, 0x007F, 0x0080, 0x00FF, 0x0100, 0x1000, 0x1001, 0x7FFF, 0x8000, 0xFFFF};
+
+#define FUZZ_COUNT(a) (sizeof(a) / sizeof((a)[0]))
+
+static uint16_t fuzz_value16(fuzz_rng_t *r, uint16_t v) {
+    switch (fuzz_below(r, 4)) {
+    case 0: return (uint16_t)(v + 1 - 2 * fuzz_below(r, 2));
+    case 1: return (uint16_t)(v ^ (1u << fuzz_below(r, 16)));
+    case 2: return fuzz_interesting16[fuzz_below(r, FUZZ_COUNT(fuzz_interesting16))];
+    default: return (uint16_t)fuzz_next(r);
+    }
+}
+
+static void fuzz_mutate(fuzz_frame_t *m, fuzz_rng_t *r, unsigned op) {
+    int i = (int)fuzz_below(r, (uint32_t)m->count);
+    KrakenEcatDatagram *d = &m->d[i];
+
+    switch (op) {
+    case FUZZ_OP_CMD:
+        // Half the time turn a read into the matching write (and back)
+        if (fuzz_below(r, 2) && d->cmd >= KRAKEN_ECAT_CMD_APRD && d->cmd <= KRAKEN_ECAT_CMD_LWR && d->cmd % 3 != 0)
+            d->cmd = d->cmd % 3 == 1 ? d->cmd + 1 : d->cmd - 1;
+        else
+            d->cmd = (uint8_t)fuzz_below(r, 16); // 0..14 defined, 15 reserved
+        break;
+    case FUZZ_OP_ADDR:
+        if (fuzz_below(r, 2))
+            d->adp = fuzz_value16(r, d->adp);
+        else if (fuzz_below(r, 2))
+            d->ado = fuzz_registers[fuzz_below(r, FUZZ_COUNT(fuzz_registers))];
+        else
+            d->ado = fuzz_value16(r, d->ado);
+        break;
+    case FUZZ_OP_LEN: {
+        static const uint16_t lens[] = {0, 1, 2, 4, 8, 64, 256};
+        uint16_t len;
+        switch (fuzz_below(r, 3)) {
+        case 0: len = (uint16_t)(d->len / 2); break;
+        case 1: len = (uint16_t)(d->len * 2 + 1); break;
+        default: len = lens[fuzz_below(r, FUZZ_COUNT(lens))]; break;
+        }
+        uint8_t *data = fuzz_alloc(m, len);
+        if (!data) break;
+        size_t keep = len < d->len ? len : d->len;
+        memcpy(data, m->data[i], keep);
+        for (size_t j = keep; j < len; j++) data[j] = (uint8_t)fuzz_next(r);
+        m->data[i] = data;
+        d->data = data;
+        d->len = len;
+        break;
+    }
+    case FUZZ_OP_WKC:
+        d->wkc = fuzz_value16(r, d->wkc);
+        break;
+    case FUZZ_OP_DATA: {
+        if (d->len == 0) break;
+        int flips = 1 + (int)fuzz_below(r, 4);
+        for (int j = 0; j < flips; j++) {
+            uint8_t *b = &m->data[i][fuzz_below(r, d->len)];
+            *b = fuzz_below(r, 2) ? (uint8_t)(*b ^ (1u << fuzz_below(r, 8))) : (uint8_t)fuzz_next(r);
+        }
+        break;
+    }
+    case FUZZ_OP_CHAIN: {
+        uint32_t what = fuzz_below(r, 3);
+        if (what == 0 && m->count < FUZZ_MAX_DGRAMS) {
+            memmove(&m->d[i + 1], &m->d[i], (size_t)(m->count - i) * sizeof(m->d[0]));
+            memmove(&m->data[i + 1], &m->data[i], (size_t)(m->count - i) * sizeof(m->data[0]));
+            m->d[i + 1].index++;
+            m->count++;
+        } else if (what == 1 && m->count > 1) {
+            memmove(&m->d[i], &m->d[i + 1], (size_t)(m->count - i - 1) * sizeof(m->d[0]));
+            memmove(&m->data[i], &m->data[i + 1], (size_t)(m->count - i - 1) * sizeof(m->data[0]));
+            m->count--;
+        } else if (m->count > 1) {
+            int j = (int)fuzz_below(r, (uint32_t)m->count);
+            KrakenEcatDatagram td = m->d[i];
+            uint8_t *tp = m->data[i];
+            m->d[i] = m->d[j];
+            m->data[i] = m->data[j];
+            m->d[j] = td;
+            m->data[j] = tp;
+        }
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+// Mutators that lie about the structure work on the serialized payload
+static void fuzz_mutate_raw(uint8_t *buf, size_t len, int count, fuzz_rng_t *r, unsigned op) {
+    if (op == FUZZ_OP_LEN_FIELD) {
+        if (fuzz_below(r, 2)) {
+            // Frame header length
+            uint16_t header = kraken_ecat_get16(buf);
+            uint16_t flen = fuzz_value16(r, header & KRAKEN_ECAT_LEN_MASK) & KRAKEN_ECAT_LEN_MASK;
+            kraken_ecat_put16(buf, (uint16_t)((header & ~KRAKEN_ECAT_LEN_MASK) | flen));
+        } else {
+            size_t off = fuzz_dgram_offset(buf, len, (int)fuzz_below(r, (uint32_t)count));
+            uint16_t len_flags = kraken_ecat_get16(buf + off + 6);
+            uint16_t dlen = fuzz_value16(r, len_flags & KRAKEN_ECAT_LEN_MASK) & KRAKEN_ECAT_LEN_MASK;
+            kraken_ecat_put16(buf + off + 6, (uint16_t)((len_flags & ~KRAKEN_ECAT_LEN_MASK) | dlen));
+        }
+    } else if (op == FUZZ_OP_MORE) {
+        size_t off = fuzz_dgram_offset(buf, len, (int)fuzz_below(r, (uint32_t)count));
+        buf[off + 7] ^= (uint8_t)(KRAKEN_ECAT_MORE >> 8);
+    }
+}
+
+/* ------------------------------------------------------------------ */
+/* Fuzzer state                                                       */
+/* ------------------------------------------------------------------ */
+
+// Corpus entry: a captured frame or a mutant that produced new behaviour
+typedef struct {
+    uint8_t data[KRAKEN_ECAT_MAX_FRAME]; // EtherCAT payload, unsigned
+    size_t len;
+    int parent;      // corpus index, -1 for seeds
+    uint64_t origin; // mutant id it was saved from
+    uint32_t energy; // selection weight
+    uint32_t returned; // calibration replies; 0 = frames like it never come back
+    int32_t wkc_seen[FUZZ_MAX_WKC_SEEN]; // distinct WKC deltas in replies
+    int wkc_seen_count;
+} fuzz_entry_t;
+
+typedef struct {
+    uint64_t id;
+    uint64_t origin; // mutant this frame carries: id, or the lost mutant it retries
+    int64_t sent_ns; // CLOCK_MONOTONIC
+    uint32_t wkc;    // summed WKC as sent, UINT32_MAX = unknown
+    uint32_t head;   // first datagram's cmd, index and len/flags: slaves leave these alone
+    uint16_t parent;
+    uint16_t ops;
+    bool live;
+    bool seen;
+} fuzz_pending_t;
+
+typedef enum {
+    FUZZ_ANOMALY_WKC = 0, // reply WKC decreased or beyond what slaves add to unmutated seeds
+    FUZZ_ANOMALY_LOST,    // seed comes back, mutant did not (twice)
+    FUZZ_ANOMALY_STALL,   // master's cyclic traffic stopped while fuzzing
+    FUZZ_ANOMALY_KINDS
+} fuzz_anomaly_kind_t;
+
+static const char *fuzz_anomaly_names[FUZZ_ANOMALY_KINDS] = {"unexpected WKC", "mutant lost", "master stall"};
+
+typedef struct {
+    fuzz_anomaly_kind_t kind;
+    uint64_t id;     // mutant; for stalls the first mutant sent since the last master frame
+    uint64_t id_end; // stalls: one past the last mutant sent before traffic resumed
+    int parent;
+    unsigned ops;
+    int32_t wkc_delta;
+    int64_t gap_ns;
+} fuzz_anomaly_t;
+
+typedef struct {
+    fuzz_config_t cfg;
+
+    fuzz_entry_t *corpus;
+    int corpus_count;
+    int seed_count;
+    uint64_t energy_total;
+    fuzz_rng_t sched; // parent selection
+
+    fuzz_pending_t *window;
+    uint64_t next_id;
+    uint64_t expire_id;   // mutants below this have been judged
+    uint64_t calibration; // ids below this are unmutated seeds
+
+    int32_t wkc_per_datagram; // most any datagram of an unmutated seed gained
+    bool wkc_known;
+
+    // Lost mutants are sent once more before they count: a frame dropped
+    // under load is not an anomaly
+    struct {
+        uint64_t id;
+        uint16_t parent;
+        uint16_t ops;
+    } retries[FUZZ_MAX_RETRIES];
+    size_t retry_head;
+    size_t retry_count;
+
+    int64_t master_period_ns; // median cycle from the capture, 0 = no cyclic traffic
+    int64_t master_last_ns;   // CLOCK_REALTIME
+    uint64_t master_mark;     // next_id when the last master frame arrived
+    uint64_t master_frames;
+
+    uint64_t sent;
+    uint64_t returned;
+    uint64_t novel;
+    uint64_t anomaly_total[FUZZ_ANOMALY_KINDS];
+    fuzz_anomaly_t anomalies[FUZZ_MAX_ANOMALIES];
+    int anomaly_count;
+} fuzz_state_t;
+
+static void fuzz_add_entry(fuzz_state_t *st, const uint8_t *data, size_t len, int parent, uint64_t origin) {
+    if (st->corpus_count >= FUZZ_MAX_CORPUS || len == 0 || len > KRAKEN_ECAT_MAX_FRAME) return;
+    fuzz_entry_t *e = &st->corpus[st->corpus_count++];
+    memcpy(e->data, data, len);
+    e->len = len;
+    e->parent = parent;
+    e->origin = origin;
+    e->energy = FUZZ_ENERGY_INIT;
+    e->returned = 0;
+    e->wkc_seen_count = 0;
+    st->energy_total += e->energy;
+}
+
+static void fuzz_reward(fuzz_state_t *st, int parent, uint32_t energy) {
+    fuzz_entry_t *e = &st->corpus[parent];
+    uint32_t before = e->energy;
+    e->energy = e->energy + energy > FUZZ_ENERGY_MAX ? FUZZ_ENERGY_MAX : e->energy + energy;
+    st->energy_total += e->energy - before;
+}
+
+// Energy-weighted corpus pick
+static int fuzz_pick(fuzz_state_t *st) {
+    uint64_t x = fuzz_next(&st->sched) % st->energy_total;
+    for (int i = 0; i < st->corpus_count; i++) {
+        if (x < st->corpus[i].energy) return i;
+        x -= st->corpus[i].energy;
+    }
+    return st->corpus_count - 1;
+}
+
+// Build mutant `id` of corpus entry `parent` into buf; also leaves its
+// structured form in m. Calibration ids are sent unmutated.
+// Returns: payload length, 0 if nothing could be built.
+static size_t fuzz_generate(const fuzz_state_t *st, uint64_t id, int parent, fuzz_frame_t *m, uint8_t *buf, unsigned *ops_out) {
+    const fuzz_entry_t *e = &st->corpus[parent];
+    fuzz_rng_t r = fuzz_rng(st->cfg.seed, id);
+    unsigned ops[FUZZ_MAX_OPS];
+    int nops = id < st->calibration ? 0 : 1 + (int)fuzz_below(&r, FUZZ_MAX_OPS);
+    unsigned mask = 0;
+
+    *ops_out = 0;
+    if (!fuzz_split(m, e->data, e->len)) return 0;
+    for (int i = 0; i < nops; i++) {
+        ops[i] = 1u << fuzz_below(&r, FUZZ_NUM_OPS);
+        mask |= ops[i];
+        if (!(ops[i] & FUZZ_RAW_OPS)) fuzz_mutate(m, &r, ops[i]);
+    }
+    size_t len = fuzz_join(m, buf, true, (uint32_t)id);
+    if (len == 0) return 0;
+    for (int i = 0; i < nops; i++) {
+        if (ops[i] & FUZZ_RAW_OPS) fuzz_mutate_raw(buf, len, m->count, &r, ops[i]);
+    }
+    *ops_out = mask;
+    return len;
+}
+
+// Count an anomaly of mutant p (NULL for stalls).
+// Returns: the record kept for the report, NULL once the report is full.
+static fuzz_anomaly_t *fuzz_anomaly(fuzz_state_t *st, fuzz_anomaly_kind_t kind, const fuzz_pending_t *p) {
+    st->anomaly_total[kind]++;
+    if (p) fuzz_reward(st, p->parent, FUZZ_ENERGY_ANOMALY);
+    if (st->anomaly_count >= FUZZ_MAX_ANOMALIES) return NULL;
+    fuzz_anomaly_t *a = &st->anomalies[st->anomaly_count++];
+    memset(a, 0, sizeof(*a));
+    a->kind = kind;
+    a->parent = -1;
+    if (p) {
+        a->id = p->origin;
+        a->id_end = p->origin + 1;
+        a->parent = p->parent;
+        a->ops = p->ops;
+    }
+    return a;
+}
+
+// A mutant whose reply window closed. Slaves write WKCs where the length
+// fields say, which for lying lengths can be inside the signature or tag,
+// so only well-formed mutants count as lost.
+static void fuzz_judge(fuzz_state_t *st, fuzz_pending_t *p) {
+    if (!p->live) return;
+    p->live = false;
+    if (p->seen || p->id < st->calibration || (p->ops & FUZZ_RAW_OPS) || st->corpus[p->parent].returned == 0) return;
+    if (p->origin != p->id) {
+        fuzz_anomaly(st, FUZZ_ANOMALY_LOST, p);
+    } else if (st->retry_count < FUZZ_MAX_RETRIES) {
+        size_t i = (st->retry_head + st->retry_count++) % FUZZ_MAX_RETRIES;
+        st->retries[i].id = p->id;
+        st->retries[i].parent = p->parent;
+        st->retries[i].ops = p->ops;
+    }
+}
+
+static void fuzz_expire(fuzz_state_t *st, int64_t now) {
+    int64_t window_ns = (int64_t)st->cfg.response_ms * 1000000LL;
+    while (st->expire_id < st->next_id) {
+        fuzz_pending_t *p = &st->window[st->expire_id & (FUZZ_WINDOW - 1)];
+        if (p->live && p->id == st->expire_id && now - p->sent_ns < window_ns) break;
+        if (p->id == st->expire_id) fuzz_judge(st, p);
+        st->expire_id++;
+    }
+}
+
+static bool fuzz_wkc_seen(fuzz_entry_t *e, int32_t delta) {
+    for (int i = 0; i < e->wkc_seen_count; i++) {
+        if (e->wkc_seen[i] == delta) return true;
+    }
+    if (e->wkc_seen_count < FUZZ_MAX_WKC_SEEN) e->wkc_seen[e->wkc_seen_count++] = delta;
+    return false;
+}
+
+// Master silent for more than 4 cycles (at least 2 ms) with mutants in flight
+static void fuzz_master_gap(fuzz_state_t *st, int64_t ts) {
+    if (st->master_last_ns == 0 || st->master_period_ns == 0 || st->next_id == st->master_mark) return;
+    int64_t gap = ts - st->master_last_ns;
+    int64_t limit = 4 * st->master_period_ns > 2000000 ? 4 * st->master_period_ns : 2000000;
+    if (gap <= limit) return;
+    fuzz_anomaly_t *a = fuzz_anomaly(st, FUZZ_ANOMALY_STALL, NULL);
+    if (a) {
+        a->id = st->master_mark;
+        a->id_end = st->next_id;
+        a->gap_ns = gap;
+    }
+}
+
+static void fuzz_master_frame(fuzz_state_t *st, int64_t ts) {
+    if (st->next_id > st->calibration) fuzz_master_gap(st, ts);
+    st->master_last_ns = ts;
+    st->master_mark = st->next_id;
+    st->master_frames++;
+}
+
+static uint32_t fuzz_head(const uint8_t *payload) {
+    return (uint32_t)kraken_ecat_get16(payload + KRAKEN_ECAT_HDR_LEN) | ((uint32_t)kraken_ecat_get16(payload + KRAKEN_ECAT_HDR_LEN + 6) << 16);
+}
+
+static void fuzz_reply(fuzz_state_t *st, const uint8_t *frame, size_t len, int64_t ts) {
+    if (len < ETH_HDR_LEN + KRAKEN_ECAT_HDR_LEN + KRAKEN_ECAT_DGRAM_HDR_LEN || frame[12] != 0x88 || frame[13] != 0xA4) return;
+    const uint8_t *payload = frame + ETH_HDR_LEN;
+    size_t plen = len - ETH_HDR_LEN;
+
+    // Mutated length fields can hide the signature from a parser, so look for it directly
+    const uint8_t *sig = memmem(payload, plen, KRAKEN_ECAT_SIG, KRAKEN_ECAT_SIG_LEN);
+    if (!sig) {
+        fuzz_master_frame(st, ts);
+        return;
+    }
+    if ((size_t)(sig - payload) + KRAKEN_ECAT_SIG_LEN + KRAKEN_ECAT_TAG_LEN > plen) return;
+    const uint8_t *t = sig + KRAKEN_ECAT_SIG_LEN;
+    uint32_t tag = (uint32_t)kraken_ecat_get16(t) | ((uint32_t)kraken_ecat_get16(t + 2) << 16);
+
+    // Tags carry the low 32 bits of the mutant id
+    uint64_t id = (st->next_id & ~0xFFFFFFFFULL) | tag;
+    if (id >= st->next_id) {
+        if (id < 0x100000000ULL) return;
+        id -= 0x100000000ULL;
+    }
+    fuzz_pending_t *p = &st->window[id & (FUZZ_WINDOW - 1)];
+    if (!p->live || p->id != id || p->seen) return;
+    // A tag rewritten by a slave can name another mutant
+    if (fuzz_head(payload) != p->head) return;
+    p->seen = true;
+    st->returned++;
+
+    KrakenEcatInfo info;
+    if (p->origin != id || p->wkc == UINT32_MAX || !kraken_ecat_parse(payload, plen, &info) || !info.sig) return;
+    // Slaves count modulo 2^16
+    int32_t delta = (int16_t)(uint16_t)(info.wkc - p->wkc);
+    fuzz_entry_t *parent = &st->corpus[p->parent];
+
+    if (id < st->calibration) {
+        parent->returned++;
+        fuzz_wkc_seen(parent, delta);
+        int32_t per = delta > 0 ? (delta + info.datagrams - 1) / info.datagrams : 0;
+        if (per > st->wkc_per_datagram) st->wkc_per_datagram = per;
+        st->wkc_known = true;
+        return;
+    }
+
+    if (st->wkc_known && (delta < 0 || delta > st->wkc_per_datagram * info.datagrams)) {
+        fuzz_anomaly_t *a = fuzz_anomaly(st, FUZZ_ANOMALY_WKC, p);
+        if (a) a->wkc_delta = delta;
+    }
+
+    // New behaviour for this entry: keep the mutant as a corpus entry of its own
+    if (!fuzz_wkc_seen(parent, delta)) {
+        st->novel++;
+        fuzz_reward(st, p->parent, FUZZ_ENERGY_NOVEL);
+        if (!(p->ops & FUZZ_RAW_OPS) && st->corpus_count < FUZZ_MAX_CORPUS) {
+            fuzz_frame_t *m = malloc(sizeof(*m));
+            uint8_t buf[KRAKEN_ECAT_MAX_FRAME];
+            unsigned ops;
+            if (m && fuzz_generate(st, id, p->parent, m, buf, &ops) > 0) {
+                fuzz_add_entry(st, buf, fuzz_join(m, buf, false, 0), p->parent, id);
+                fuzz_entry_t *child = &st->corpus[st->corpus_count - 1];
+                if (child->origin == id) fuzz_wkc_seen(child, delta);
+            }
+            free(m);
+        }
+    }
+}
+
+// Match whatever arrives within wait_ms, then keep going while full
+// batches come in. Returns: false once the conduit reports an error.
+static bool fuzz_receive(KrakenConnectionHandle conn, const KrakenConnectionOps *ops, fuzz_state_t *st, uint32_t wait_ms) {
+    uint8_t bufs[FUZZ_RX_BATCH][1536];
+    KrakenRecvSlot slots[FUZZ_RX_BATCH];
+
+    for (int round = 0; round < FUZZ_RX_ROUNDS; round++) {
+        for (int i = 0; i < FUZZ_RX_BATCH; i++) {
+            slots[i].data = bufs[i];
+            slots[i].size = sizeof(bufs[i]);
+        }
+        int64_t n = kraken_recv_frames(conn, ops, slots, FUZZ_RX_BATCH, round == 0 ? wait_ms : 1);
+        if (n < 0) return false;
+        for (int64_t i = 0; i < n; i++) {
+            int64_t ts = slots[i].timestamp_ns ? slots[i].timestamp_ns : fuzz_now_ns(CLOCK_REALTIME);
+            fuzz_reply(st, slots[i].data, slots[i].len, ts);
+        }
+        if (n < FUZZ_RX_BATCH) break;
+    }
+    return true;
+}
+
+/* ------------------------------------------------------------------ */
+/* Phases                                                             */
+/* ------------------------------------------------------------------ */
+
+static int fuzz_cmp_i64(const void *a, const void *b) {
+    int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+// Collect unsigned EtherCAT command frames as seeds and estimate the
+// master's cycle from their spacing
+static void fuzz_capture(KrakenConnectionHandle conn, const KrakenConnectionOps *ops, fuzz_state_t *st, KrakenRunResultV2 *result) {
+    uint8_t bufs[FUZZ_RX_BATCH][1536];
+    KrakenRecvSlot slots[FUZZ_RX_BATCH];
+    int64_t gaps[FUZZ_MAX_GAPS];
+    int gap_count = 0;
+    int64_t last = 0;
+    uint64_t frames = 0;
+    int64_t end = fuzz_now_ns(CLOCK_MONOTONIC) + (int64_t)st->cfg.capture_ms * 1000000LL;
+
+    while (fuzz_now_ns(CLOCK_MONOTONIC) < end) {
+        for (int i = 0; i < FUZZ_RX_BATCH; i++) {
+            slots[i].data = bufs[i];
+            slots[i].size = sizeof(bufs[i]);
+        }
+        int64_t n = kraken_recv_frames(conn, ops, slots, FUZZ_RX_BATCH, 50);
+        if (n < 0) break;
+        for (int64_t i = 0; i < n; i++) {
+            const uint8_t *f = slots[i].data;
+            size_t len = slots[i].len;
+            KrakenEcatInfo info;
+            if (len < ETH_HDR_LEN || f[12] != 0x88 || f[13] != 0xA4) continue;
+            if (!kraken_ecat_parse(f + ETH_HDR_LEN, len - ETH_HDR_LEN, &info) || info.sig) continue;
+
+            int64_t ts = slots[i].timestamp_ns ? slots[i].timestamp_ns : fuzz_now_ns(CLOCK_REALTIME);
+            if (last > 0 && gap_count < FUZZ_MAX_GAPS) gaps[gap_count++] = ts - last;
+            last = ts;
+            frames++;
+
+            // One seed per distinct frame layout is plenty; cyclic traffic repeats itself
+            bool dup = false;
+            for (int j = 0; j < st->corpus_count && !dup; j++) {
+                const fuzz_entry_t *e = &st->corpus[j];
+                dup = e->len == len - ETH_HDR_LEN && memcmp(e->data, f + ETH_HDR_LEN, 2) == 0 && e->data[2] == f[ETH_HDR_LEN + 2];
+            }
+            if (!dup && st->corpus_count < FUZZ_MAX_CORPUS / 2) fuzz_add_entry(st, f + ETH_HDR_LEN, len - ETH_HDR_LEN, -1, 0);
+        }
+    }
+
+    if (gap_count >= 10) {
+        qsort(gaps, (size_t)gap_count, sizeof(gaps[0]), fuzz_cmp_i64);
+        st->master_period_ns = gaps[gap_count / 2];
+    }
+    st->master_last_ns = last;
+    kraken_result_logf(result, "  Captured %llu EtherCAT frames, %d distinct seeds", (unsigned long long)frames, st->corpus_count);
+    if (st->master_period_ns > 0) kraken_result_logf(result, "  Master cycle: %.1f us", st->master_period_ns / 1e3);
+}
+
+// Seeds for a quiet network: the reads and writes a master starts up with
+static void fuzz_builtin_seeds(fuzz_state_t *st) {
+    static const struct {
+        uint8_t cmd;
+        uint16_t adp, ado, len;
+    } seeds[] = {
+        {KRAKEN_ECAT_CMD_BRD, 0x0000, 0x0000, 2},  // type register
+        {KRAKEN_ECAT_CMD_APRD, 0x0000, 0x0130, 2}, // AL status of the first slave
+        {KRAKEN_ECAT_CMD_FPRD, 0x1000, 0x0130, 2}, // AL status by station address
+        {KRAKEN_ECAT_CMD_BWR, 0x0000, 0x0120, 2},  // AL control
+        {KRAKEN_ECAT_CMD_LRW, 0x0000, 0x0000, 8},  // process data
+    };
+    uint8_t buf[KRAKEN_ECAT_MAX_FRAME];
+    KrakenEcatFrame chain;
+    kraken_ecat_frame_init(&chain, buf, sizeof(buf), false);
+
+    for (size_t i = 0; i < FUZZ_COUNT(seeds); i++) {
+        uint8_t one[64];
+        KrakenEcatFrame f;
+        KrakenEcatDatagram d = {.cmd = seeds[i].cmd, .index = (uint8_t)i, .adp = seeds[i].adp, .ado = seeds[i].ado, .len = seeds[i].len};
+        kraken_ecat_frame_init(&f, one, sizeof(one), false);
+        kraken_ecat_frame_append(&f, &d);
+        fuzz_add_entry(st, one, kraken_ecat_frame_finish(&f), -1, 0);
+        kraken_ecat_frame_append(&chain, &d);
+    }
+    fuzz_add_entry(st, buf, kraken_ecat_frame_finish(&chain), -1, 0);
+}
+
+typedef struct {
+    uint8_t (*frames)[KRAKEN_ECAT_MAX_FRAME];
+    KrakenBuffer bufs[FUZZ_MAX_BATCH];
+    uint64_t ids[FUZZ_MAX_BATCH];
+    fuzz_frame_t m;
+} fuzz_batch_t;
+
+// Queue one frame carrying mutant `origin` of `parent` under tag `id`
+static void fuzz_batch_add(fuzz_state_t *st, fuzz_batch_t *b, size_t *count, uint64_t id, uint64_t origin, int parent, int64_t now) {
+    uint8_t *frame = b->frames[*count];
+    unsigned mask;
+    size_t len = fuzz_generate(st, origin, parent, &b->m, frame, &mask);
+    if (len == 0) return;
+    if (origin != id) {
+        // The tag follows the signature at the start of the first datagram's data
+        size_t tag_off = KRAKEN_ECAT_HDR_LEN + KRAKEN_ECAT_DGRAM_HDR_LEN + KRAKEN_ECAT_SIG_LEN;
+        kraken_ecat_put16(frame + tag_off, (uint16_t)(id & 0xFFFF));
+        kraken_ecat_put16(frame + tag_off + 2, (uint16_t)((id >> 16) & 0xFFFF));
+    }
+
+    // A slot still live here is younger than response_ms: too many in flight to judge it
+    fuzz_pending_t *p = &st->window[id & (FUZZ_WINDOW - 1)];
+    KrakenEcatInfo info;
+    p->id = id;
+    p->origin = origin;
+    p->sent_ns = now;
+    // WKCs of a frame with lying lengths are read from wherever the slaves put them
+    p->wkc = !(mask & FUZZ_RAW_OPS) && kraken_ecat_parse(frame, len, &info) ? info.wkc : UINT32_MAX;
+    p->head = fuzz_head(frame);
+    p->parent = (uint16_t)parent;
+    p->ops = (uint16_t)mask;
+    p->live = true;
+    p->seen = false;
+    b->bufs[*count].data = frame;
+    b->bufs[*count].len = len;
+    b->ids[*count] = id;
+    (*count)++;
+}
+
+// Build and send one batch: retries of lost mutants first, then new
+// mutants up to last_id. Returns: frames handed to the conduit.
+static size_t fuzz_send_batch(KrakenConnectionHandle conn, const KrakenConnectionOps *ops, fuzz_state_t *st, fuzz_batch_t *b, uint64_t last_id) {
+    size_t count = 0;
+    uint64_t first = st->next_id;
+    int64_t now = fuzz_now_ns(CLOCK_MONOTONIC);
+
+    while (count < (size_t)st->cfg.batch && st->retry_count > 0) {
+        size_t i = st->retry_head;
+        st->retry_head = (st->retry_head + 1) % FUZZ_MAX_RETRIES;
+        st->retry_count--;
+        fuzz_batch_add(st, b, &count, st->next_id++, st->retries[i].id, st->retries[i].parent, now);
+    }
+    while (count < (size_t)st->cfg.batch && st->next_id < last_id) {
+        // Calibration goes out on its own so its replies are in before mutants are judged
+        if (st->next_id == st->calibration && first < st->calibration) break;
+        uint64_t id = st->next_id++;
+        int parent = id < st->calibration ? (int)(id % (uint64_t)st->seed_count) : fuzz_pick(st);
+        fuzz_batch_add(st, b, &count, id, id, parent, now);
+    }
+    if (count == 0) return 0;
+
+    size_t sent = kraken_send_frames(conn, ops, b->bufs, count, 50);
+    // Frames past the sent prefix never went out; drop them so they are not judged lost
+    for (size_t i = sent; i < count; i++) st->window[b->ids[i] & (FUZZ_WINDOW - 1)].live = false;
+    st->sent += sent;
+    return sent;
+}
+
+// Receive until every frame in flight has had response_ms to come back
+static bool fuzz_settle(KrakenConnectionHandle conn, const KrakenConnectionOps *ops, fuzz_state_t *st) {
+    int64_t settle = fuzz_now_ns(CLOCK_MONOTONIC) + (int64_t)st->cfg.response_ms * 1000000LL;
+    bool rx = true;
+    while (rx && fuzz_now_ns(CLOCK_MONOTONIC) < settle) rx = fuzz_receive(conn, ops, st, 1);
+    if (rx) fuzz_expire(st, fuzz_now_ns(CLOCK_MONOTONIC));
+    return rx;
+}
+
+static void fuzz_loop(KrakenConnectionHandle conn, const KrakenConnectionOps *ops, fuzz_state_t *st) {
+    fuzz_batch_t *b = malloc(sizeof(*b));
+    if (!b) return;
+    b->frames = malloc(FUZZ_MAX_BATCH * sizeof(*b->frames));
+    if (!b->frames) {
+        free(b);
+        return;
+    }
+
+    uint64_t last_id = st->calibration + (uint64_t)st->cfg.mutants;
+    int64_t end = fuzz_now_ns(CLOCK_MONOTONIC) + (int64_t)st->cfg.duration_ms * 1000000LL;
+    bool rx = true;
+
+    // Calibration: every seed unmutated, to learn what comes back and with which WKC
+    while (st->next_id < st->calibration) fuzz_send_batch(conn, ops, st, b, st->calibration);
+    rx = fuzz_settle(conn, ops, st);
+    st->master_last_ns = 0; // stall detection starts with the mutants
+
+    while (st->next_id < last_id && fuzz_now_ns(CLOCK_MONOTONIC) < end) {
+        fuzz_send_batch(conn, ops, st, b, last_id);
+        if (rx) {
+            rx = fuzz_receive(conn, ops, st, 1);
+            fuzz_expire(st, fuzz_now_ns(CLOCK_MONOTONIC));
+        }
+    }
+
+    // Last replies, then one more chance for whatever got lost at the end
+    if (rx) rx = fuzz_settle(conn, ops, st);
+    if (rx && st->retry_count > 0) {
+        while (st->retry_count > 0) fuzz_send_batch(conn, ops, st, b, st->next_id);
+        rx = fuzz_settle(conn, ops, st);
+    }
+    if (rx) {
+        fuzz_expire(st, INT64_MAX);
+        fuzz_master_gap(st, fuzz_now_ns(CLOCK_REALTIME)); // master went quiet and stayed quiet
+    }
+    free(b->frames);
+    free(b);
+}
+
+/* ------------------------------------------------------------------ */
+/* Report                                                             */
+/* ------------------------------------------------------------------ */
+
+static void fuzz_ops_string(unsigned ops, char *out, size_t size) {
+    size_t n = 0;
+    out[0] = '\0';
+    for (int i = 0; i < FUZZ_NUM_OPS && n < size; i++) {
+        if (ops & (1u << i)) n += (size_t)snprintf(out + n, size - n, "%s%s", n ? "|" : "", fuzz_op_names[i]);
+    }
+    if (n == 0) snprintf(out, size, "none");
+}
+
+static void fuzz_report_anomaly(const fuzz_state_t *st, KrakenRunResultV2 *result, KrakenFindingV2 *finding, const fuzz_anomaly_t *a,
+                                fuzz_frame_t *m) {
+    char key[64];
+    char value[512];
+
+    if (a->kind == FUZZ_ANOMALY_STALL) {
+        snprintf(key, sizeof(key), "stall after mutant %llu", (unsigned long long)a->id);
+        snprintf(value, sizeof(value), "%s: no master frame for %.1f ms, mutants %llu..%llu in flight", fuzz_anomaly_names[a->kind], a->gap_ns / 1e6,
+                 (unsigned long long)a->id, (unsigned long long)(a->id_end ? a->id_end - 1 : a->id));
+    } else {
+        uint8_t buf[KRAKEN_ECAT_MAX_FRAME];
+        unsigned mask;
+        size_t len = fuzz_generate(st, a->id, a->parent, m, buf, &mask);
+        char ops[96];
+        char hex[2 * FUZZ_HEX_BYTES + 4];
+        size_t shown = len < FUZZ_HEX_BYTES ? len : FUZZ_HEX_BYTES;
+        fuzz_ops_string(a->ops, ops, sizeof(ops));
+        for (size_t i = 0; i < shown; i++) snprintf(hex + 2 * i, 3, "%02x", buf[i]);
+        if (len > shown) memcpy(hex + 2 * shown, "...", 4);
+        if (shown == 0) hex[0] = '\0';
+
+        snprintf(key, sizeof(key), "mutant %llu", (unsigned long long)a->id);
+        if (a->kind == FUZZ_ANOMALY_WKC)
+            snprintf(value, sizeof(value), "%s (%+d): parent #%d, ops %s, payload %s", fuzz_anomaly_names[a->kind], a->wkc_delta, a->parent, ops, hex);
+        else
+            snprintf(value, sizeof(value), "%s: parent #%d, ops %s, payload %s", fuzz_anomaly_names[a->kind], a->parent, ops, hex);
+    }
+    kraken_result_logf(result, "  %s: %s", key, value);
+    kraken_finding_add_evidence(result, finding, key, value);
+}
+
+static int run_fuzz(KrakenConnectionHandle conn, const KrakenConnectionOps *ops,
+                    KrakenRunResultV2 *result, uint32_t timeout_ms, const char *params_json) {
+    (void)timeout_ms;
+
+    kraken_result_log(result, "Starting EtherCAT fuzzing");
+
+    fuzz_state_t *st = calloc(1, sizeof(*st));
+    if (!st) return -1;
+    load_config(&st->cfg, params_json, result);
+    // Seeds and replies are EtherCAT frames; let the conduit drop the rest
+    kraken_filter_frames(conn, ops, "ethercat", 0);
+    st->corpus = calloc(FUZZ_MAX_CORPUS, sizeof(*st->corpus));
+    st->window = calloc(FUZZ_WINDOW, sizeof(*st->window));
+    fuzz_frame_t *m = malloc(sizeof(*m));
+    if (!st->corpus || !st->window || !m) {
+        free(st->corpus);
+        free(st->window);
+        free(m);
+        free(st);
+        return -1;
+    }
+    if (st->cfg.seed == 0) st->cfg.seed = fuzz_mix((uint64_t)fuzz_now_ns(CLOCK_REALTIME)) & 0x7FFFFFFFFFFFFFFFULL;
+    st->sched = fuzz_rng(st->cfg.seed, UINT64_MAX);
+
+    kraken_result_logf(result, "Phase 1: Capturing seed frames (%d ms)", st->cfg.capture_ms);
+    fuzz_capture(conn, ops, st, result);
+    if (st->corpus_count == 0) {
+        fuzz_builtin_seeds(st);
+        kraken_result_logf(result, "  No EtherCAT traffic captured, using %d built-in seeds", st->corpus_count);
+    }
+    st->seed_count = st->corpus_count;
+    st->calibration = (uint64_t)st->seed_count * FUZZ_CALIBRATION_ROUNDS;
+
+    kraken_result_logf(result, "Phase 2: Fuzzing with seed %llu, up to %lld mutants in %d ms, batches of %d",
+                       (unsigned long long)st->cfg.seed, (long long)st->cfg.mutants, st->cfg.duration_ms, st->cfg.batch);
+    int64_t start = fuzz_now_ns(CLOCK_MONOTONIC);
+    fuzz_loop(conn, ops, st);
+    double secs = (fuzz_now_ns(CLOCK_MONOTONIC) - start) / 1e9;
+
+    uint64_t mutants = st->sent > st->calibration ? st->sent - st->calibration : 0;
+    uint64_t anomalies = 0;
+    for (int k = 0; k < FUZZ_ANOMALY_KINDS; k++) anomalies += st->anomaly_total[k];
+
+    kraken_result_logf(result, "Sent %llu mutants in %.1f s (%.0f per minute), %llu came back",
+                       (unsigned long long)mutants, secs, secs > 0 ? mutants * 60.0 / secs : 0.0, (unsigned long long)st->returned);
+    kraken_result_logf(result, "Feedback: %llu novel replies, corpus grew from %d to %d entries",
+                       (unsigned long long)st->novel, st->seed_count, st->corpus_count);
+    for (int k = 0; k < FUZZ_ANOMALY_KINDS; k++) {
+        if (st->anomaly_total[k]) kraken_result_logf(result, "  %s: %llu", fuzz_anomaly_names[k], (unsigned long long)st->anomaly_total[k]);
+    }
+
+    KrakenFindingV2 finding = {0};
+    if (st->anomaly_count > 0) {
+        kraken_result_logf(result, "Anomalies (rerun with {\"seed\": %llu} and the same traffic to reproduce):", (unsigned long long)st->cfg.seed);
+        for (int i = 0; i < st->anomaly_count; i++) fuzz_report_anomaly(st, result, &finding, &st->anomalies[i], m);
+    }
+
+    const char *severity = "info";
+    if (st->anomaly_total[FUZZ_ANOMALY_STALL] || st->anomaly_total[FUZZ_ANOMALY_LOST])
+        severity = "high";
+    else if (st->anomaly_total[FUZZ_ANOMALY_WKC])
+        severity = "medium";
+
+    finding.id = kraken_result_strdup(result, "ecat-fuzz");
+    finding.module_id = kraken_result_strdup(result, "ecat_fuzz");
+    finding.success = anomalies > 0;
+    finding.title = kraken_result_strdup(result, "EtherCAT Fuzzing");
+    finding.severity = kraken_result_strdup(result, severity);
+    finding.description = kraken_result_sprintf(result,
+        "Sent %llu mutants (seed %llu); %llu unexpected WKC, %llu lost, %llu master stalls.",
+        (unsigned long long)mutants, (unsigned long long)st->cfg.seed, (unsigned long long)st->anomaly_total[FUZZ_ANOMALY_WKC],
+        (unsigned long long)st->anomaly_total[FUZZ_ANOMALY_LOST], (unsigned long long)st->anomaly_total[FUZZ_ANOMALY_STALL]);
+    finding.timestamp = (int64_t)time(NULL);
+    finding.target = result->target;
+
+    kraken_result_add_finding(result, &finding);
+
+    free(m);
+    free(st->corpus);
+    free(st->window);
+    free(st);
+    return 0;
+}
+
+KRAKEN_API int kraken_run_v2(
+    KrakenConnectionHandle conn,
+    const KrakenConnectionOps *ops,
+    const KrakenTarget *target,
+    uint32_t timeout_ms,
+    const char *params_json,
+    KrakenRunResultV2 **out_result
+) {
+    return kraken_result_run_v2(run_fuzz, conn, ops, target, timeout_ms, params_json, out_result);
+}
+
+KRAKEN_API int kraken_run_v3(
+    KrakenConnectionHandle conn,
+    const KrakenConnectionOps *ops,
+    const KrakenTarget *target,
+    uint32_t timeout_ms,
+    const char *params_json,
+    const KrakenResultSink *sink
+) {
+    return kraken_result_run_v3(run_fuzz, conn, ops, target, timeout_ms, params_json, sink);
+}
+
+KRAKEN_API void kraken_free_v2(void *p) {
+    kraken_result_free(p);
+}
@@ -1,6 +1,7 @@
 // EtherCAT Frame Injection Module
 // Tests master's handling of injected/malformed EtherCAT frames
 
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -9,236 +10,419 @@
 
 #include "kraken_module_abi.h"
 #include "kraken_module_abi_v2.h"
-
-#define ECAT_TYPE 1  // EtherCAT command frame type
-
-// Kraken signature for Wireshark filtering: "KRKN" = 0x4B524B4E
-// Filter in Wireshark: frame contains "KRKN"
-#define KRAKEN_SIG "KRKN"
-#define KRAKEN_SIG_LEN 4
-
-// Build a minimal EtherCAT frame with one datagram and Kraken signature
-// Returns frame length
-static size_t build_frame(uint8_t *buf, uint8_t cmd, uint16_t addr, uint16_t offset,
-                          const uint8_t *data, uint16_t data_len, uint16_t wkc) {
-    // Add signature to data - total data = user_data + signature
-    uint16_t total_data_len = data_len + KRAKEN_SIG_LEN;
-
-    // EtherCAT header: length (11 bits) | reserved (1 bit) | type (4 bits)
-    uint16_t frame_len = 10 + total_data_len + 2; // datagram header + data + wkc
-    uint16_t header = (frame_len & 0x7FF) | (ECAT_TYPE << 12);
-    buf[0] = header & 0xFF;
-    buf[1] = (header >> 8) & 0xFF;
-
-    // Datagram header
-    buf[2] = cmd;           // Command
-    buf[3] = 0x01;          // Index
-    buf[4] = addr & 0xFF;   // Address low (station addr for FPRD)
-    buf[5] = (addr >> 8);   // Address high
-    buf[6] = offset & 0xFF; // Offset low
-    buf[7] = (offset >> 8); // Offset high
-
-    // Length + flags (no more datagrams)
-    uint16_t len_flags = total_data_len & 0x7FF;
-    buf[8] = len_flags & 0xFF;
-    buf[9] = (len_flags >> 8) & 0xFF;
-
-    // IRQ
-    buf[10] = 0;
-    buf[11] = 0;
-
-    // Data: Kraken signature first, then user data
-    memcpy(buf + 12, KRAKEN_SIG, KRAKEN_SIG_LEN);
-    if (data && data_len > 0) {
-        memcpy(buf + 12 + KRAKEN_SIG_LEN, data, data_len);
-    } else if (data_len > 0) {
-        memset(buf + 12 + KRAKEN_SIG_LEN, 0, data_len);
-    }
-
-    // WKC
-    buf[12 + total_data_len] = wkc & 0xFF;
-    buf[12 + total_data_len + 1] = (wkc >> 8) & 0xFF;
-
-    return 2 + frame_len; // header + payload
+#include "kraken_module_abi_v3.h"
+#include "kraken_ecat_frame.h"
+#include "kraken_ecat_stamp.h"
+#include "kraken_histogram.h"
+#include "kraken_params.h"
+#include "kraken_pcapng.h"
+#include "kraken_result.h"
+
+#define NOP_FLOOD_COMMANDS 100
+#define INJECT_PROBES 10        // frames per single-frame test
+#define INJECT_INTERVAL_US 1000 // between injected frames
+#define INJECT_RESPONSE_MS 100  // wait for replies after the last frame
+#define INJECT_RX_BATCH 16
+#define INJECT_MAX_FRAMES 0xFFFF // bounds the probe table
+#define ECAT_ETHERTYPE 0x88A4
+
+// Load settings from params_json
+typedef struct {
+    int datagrams;   // datagrams packed into each flood frame
+    int probes;      // frames sent by each single-frame test
+    int interval_us; // gap between injected frames
+    int response_ms; // how long to keep matching replies after the last frame
+    KrakenPcapngConfig pcap;
+} inject_config_t;
+
+static void load_config(inject_config_t *cfg, const char *params_json, KrakenRunResultV2 *result) {
+    KrakenParams params;
+    if (kraken_params_parse(&params, params_json) != 0)
+        kraken_result_log(result, "Malformed params_json, using defaults");
+
+    // 0 packs as many datagrams as fit in one frame
+    int64_t datagrams = kraken_params_int(&params, "datagrams_per_frame", 0);
+    int max_datagrams = (int)kraken_ecat_frame_capacity_prefixed(KRAKEN_ECAT_MAX_FRAME, 0, KRAKEN_ECAT_STAMP_OVERHEAD);
+    cfg->datagrams = datagrams < 1 || datagrams > max_datagrams ? max_datagrams : (int)datagrams;
+    int64_t probes = kraken_params_int(&params, "probes", INJECT_PROBES);
+    cfg->probes = probes < 1 ? 1 : probes > 1000 ? 1000 : (int)probes;
+    int64_t interval = kraken_params_int(&params, "interval_us", INJECT_INTERVAL_US);
+    cfg->interval_us = interval < 0 ? INJECT_INTERVAL_US : (int)interval;
+    int64_t response = kraken_params_int(&params, "response_ms", INJECT_RESPONSE_MS);
+    cfg->response_ms = response < 1 ? INJECT_RESPONSE_MS : (int)response;
+    kraken_pcapng_config(&cfg->pcap, &params);
+
+    kraken_params_free(&params);
 }
 
+// Every injected frame is stamped (signature, run id, probe id as the
+// sequence number, TX time) and starts at a fresh datagram index, so
+// frames coming back - returned by the slaves or forwarded by the master -
+// can be matched to the probe that caused them, in a capture file too.
 typedef struct {
     const char *name;
     const char *description;
-    int (*test_fn)(KrakenConnectionHandle, const KrakenConnectionOps*, KrakenRunResultV2*);
+    int (*frames)(const inject_config_t *cfg);
+    size_t (*build)(uint8_t *buf, const KrakenEcatStamp *stamp, uint8_t index, int frame, const inject_config_t *cfg);
 } test_case_t;
 
-// Test 1: Inject broadcast read with high WKC (spoofed slave count)
-static int test_spoofed_wkc(KrakenConnectionHandle conn, const KrakenConnectionOps *ops, KrakenRunResultV2 *result) {
-    uint8_t frame[64];
-    uint8_t data[2] = {0};
+// Stamped frame of `count` copies of `d`, with consecutive indices
+static size_t stamped_frame(uint8_t *buf, const KrakenEcatStamp *stamp, KrakenEcatDatagram d, int count) {
+    KrakenEcatFrame f;
+    kraken_ecat_frame_init_stamped(&f, buf, KRAKEN_ECAT_MAX_FRAME, stamp);
+    for (int i = 0; i < count && kraken_ecat_frame_append(&f, &d); i++) d.index++;
+    return kraken_ecat_frame_finish(&f);
+}
 
+static int probe_frames(const inject_config_t *cfg) {
+    return cfg->probes;
+}
+
+// Test 1: Inject broadcast read with high WKC (spoofed slave count)
+static size_t build_spoofed_wkc(uint8_t *buf, const KrakenEcatStamp *stamp, uint8_t index, int frame, const inject_config_t *cfg) {
+    (void)frame;
+    (void)cfg;
     // BRD to TYPE register (0x0000) with WKC=99 (fake 99 slaves)
-    size_t len = build_frame(frame, 7, 0, 0, data, 2, 99);
+    uint8_t data[2] = {0};
+    KrakenEcatDatagram brd = {.cmd = KRAKEN_ECAT_CMD_BRD, .index = index, .data = data, .len = 2, .wkc = 99};
+    return stamped_frame(buf, stamp, brd, 1);
+}
 
-    int64_t sent = ops->send(conn, frame, len, 100);
-    if (sent < 0) {
-        add_log_v2(result, "  Failed to send spoofed WKC frame");
-        return -1;
-    }
+// Test 2: Inject frame with invalid length field
+static size_t build_invalid_length(uint8_t *buf, const KrakenEcatStamp *stamp, uint8_t index, int frame, const inject_config_t *cfg) {
+    (void)frame;
+    (void)cfg;
+    KrakenEcatDatagram brd = {.cmd = KRAKEN_ECAT_CMD_BRD, .index = index, .len = 2};
+    size_t len = stamped_frame(buf, stamp, brd, 1);
+    // Claim 100 bytes but send less
+    kraken_ecat_put16(buf, (uint16_t)((100 & KRAKEN_ECAT_LEN_MASK) | (KRAKEN_ECAT_TYPE_COMMAND << 12)));
+    return len;
+}
 
-    add_log_v2(result, "  Sent BRD with spoofed WKC=99");
-    return 0; // Can't easily verify master behavior, just confirm injection works
+// Test 3: Inject frame pretending to be a slave response
+static size_t build_slave_impersonation(uint8_t *buf, const KrakenEcatStamp *stamp, uint8_t index, int frame, const inject_config_t *cfg) {
+    (void)frame;
+    (void)cfg;
+    // FPRD response (as if from slave at 0x1000) with a fake TYPE register value
+    uint8_t data[2] = {0x12, 0x34};
+    KrakenEcatDatagram fprd = {.cmd = KRAKEN_ECAT_CMD_FPRD, .index = index, .adp = 0x1000, .data = data, .len = 2, .wkc = 1};
+    return stamped_frame(buf, stamp, fprd, 1);
 }
 
-// Test 2: Inject frame with invalid length field
-static int test_invalid_length(KrakenConnectionHandle conn, const KrakenConnectionOps *ops, KrakenRunResultV2 *result) {
-    uint8_t frame[64];
-
-    // Build frame manually with mismatched length
-    uint16_t header = (100 & 0x7FF) | (ECAT_TYPE << 12); // Claim 100 bytes but send less
-    frame[0] = header & 0xFF;
-    frame[1] = (header >> 8) & 0xFF;
-
-    // Minimal datagram
-    frame[2] = 7;  // BRD
-    frame[3] = 1;  // Index
-    memset(frame + 4, 0, 8); // Address, len_flags, IRQ
-    frame[8] = 2;  // data_len = 2
-    frame[12] = 0; // data
-    frame[13] = 0;
-    frame[14] = 0; // WKC
-    frame[15] = 0;
-
-    int64_t sent = ops->send(conn, frame, 16, 100);
-    if (sent < 0) {
-        add_log_v2(result, "  Failed to send invalid length frame");
-        return -1;
-    }
+// Test 4: Inject NOP flood, packed cfg->datagrams NOPs per frame
+static int nop_flood_frames(const inject_config_t *cfg) {
+    return (NOP_FLOOD_COMMANDS + cfg->datagrams - 1) / cfg->datagrams;
+}
 
-    add_log_v2(result, "  Sent frame with mismatched length field");
-    return 0;
+static size_t build_nop_flood(uint8_t *buf, const KrakenEcatStamp *stamp, uint8_t index, int frame, const inject_config_t *cfg) {
+    int left = NOP_FLOOD_COMMANDS - frame * cfg->datagrams;
+    KrakenEcatDatagram nop = {.cmd = KRAKEN_ECAT_CMD_NOP, .index = index};
+    return stamped_frame(buf, stamp, nop, left < cfg->datagrams ? left : cfg->datagrams);
 }
 
-// Test 3: Inject frame pretending to be a slave response
-static int test_slave_impersonation(KrakenConnectionHandle conn, const KrakenConnectionOps *ops, KrakenRunResultV2 *result) {
-    uint8_t frame[64];
-    uint8_t data[2] = {0x12, 0x34}; // Fake TYPE register value
+static test_case_t tests[] = {
+    {"spoofed_wkc", "Inject frame with spoofed working counter", probe_frames, build_spoofed_wkc},
+    {"invalid_length", "Inject frame with invalid length field", probe_frames, build_invalid_length},
+    {"slave_impersonation", "Inject frame impersonating slave response", probe_frames, build_slave_impersonation},
+    {"nop_flood", "Flood with NOP frames", nop_flood_frames, build_nop_flood},
+};
+
+#define NUM_TESTS (sizeof(tests) / sizeof(tests[0]))
+
+// One injected frame
+typedef struct {
+    int test;
+    int64_t sent_ns; // CLOCK_REALTIME, 0 = not sent
+    uint32_t wkc;    // summed WKC as sent
+    bool seen;
+} inject_probe_t;
 
-    // FPRD response (as if from slave at 0x1000)
-    size_t len = build_frame(frame, 4, 0x1000, 0, data, 2, 1);
+typedef struct {
+    int frames;
+    int sent;
+    int returned;    // came back at least once
+    int wkc_changed; // came back with a different WKC: processed by slaves
+    int64_t wkc_delta;
+    KrakenHistogram rtt; // send to first sighting, ns
+} inject_stats_t;
+
+// Unsigned EtherCAT traffic seen while injecting: the master's own frames
+typedef struct {
+    uint64_t frames;
+    int64_t last_ns;
+    int64_t max_gap_ns;
+} inject_master_t;
+
+typedef struct {
+    inject_probe_t *probes;
+    int total;
+    uint32_t run_id; // in every stamp, so frames of earlier runs never match
+    inject_stats_t stats[NUM_TESTS];
+    KrakenStampStats stamps; // loss, reordering and one-way latency over all probes
+    inject_master_t master;
+    KrakenPcapng pcap; // everything sent and received, when pcap_path is set
+} inject_run_t;
+
+static int64_t inject_now_ns(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
 
-    int64_t sent = ops->send(conn, frame, len, 100);
-    if (sent < 0) {
-        add_log_v2(result, "  Failed to send impersonation frame");
-        return -1;
+// Returns: what the frame turned out to be, for the capture file
+static const char *inject_match(inject_run_t *run, const uint8_t *frame, size_t len, int64_t ts) {
+    KrakenEcatInfo info;
+    if (len < 14 || frame[12] != 0x88 || frame[13] != 0xA4 || !kraken_ecat_parse(frame + 14, len - 14, &info)) return NULL;
+    if (!info.sig) {
+        inject_master_t *m = &run->master;
+        if (m->last_ns > 0 && ts - m->last_ns > m->max_gap_ns) m->max_gap_ns = ts - m->last_ns;
+        m->last_ns = ts;
+        m->frames++;
+        return "master";
     }
 
-    add_log_v2(result, "  Sent FPRD response impersonating slave 0x1000");
-    return 0;
+    KrakenEcatStamp stamp;
+    if (!kraken_ecat_stamp(&info, &stamp) || stamp.run != run->run_id) return NULL;
+    uint32_t id = stamp.seq;
+    if (id >= (uint32_t)run->total) return NULL;
+    kraken_stamp_stats_add(&run->stamps, &stamp, ts);
+    inject_probe_t *p = &run->probes[id];
+    if (p->sent_ns == 0) return NULL;
+    if (p->seen) return "reply (again)";
+
+    p->seen = true;
+    inject_stats_t *st = &run->stats[p->test];
+    st->returned++;
+    if (ts > p->sent_ns) kraken_hist_record(&st->rtt, (uint64_t)(ts - p->sent_ns));
+    if (info.wkc != p->wkc) {
+        st->wkc_changed++;
+        st->wkc_delta += (int64_t)info.wkc - (int64_t)p->wkc;
+    }
+    return tests[p->test].name;
 }
 
-// Test 4: Inject NOP flood
-static int test_nop_flood(KrakenConnectionHandle conn, const KrakenConnectionOps *ops, KrakenRunResultV2 *result) {
-    uint8_t frame[64];
-    size_t len = build_frame(frame, 0, 0, 0, NULL, 0, 0); // NOP
+// Receive for up to wait_ms and match what arrives.
+// Returns: false once the conduit reports an error.
+static bool inject_receive(KrakenConnectionHandle conn, const KrakenConnectionOps *ops, inject_run_t *run, uint32_t wait_ms) {
+    uint8_t bufs[INJECT_RX_BATCH][1536];
+    KrakenRecvSlot slots[INJECT_RX_BATCH];
+    for (int i = 0; i < INJECT_RX_BATCH; i++) {
+        slots[i].data = bufs[i];
+        slots[i].size = sizeof(bufs[i]);
+    }
+    int64_t n = kraken_recv_frames(conn, ops, slots, INJECT_RX_BATCH, wait_ms);
+    if (n < 0) return false;
+    for (int64_t i = 0; i < n; i++) {
+        int64_t ts = slots[i].timestamp_ns ? slots[i].timestamp_ns : inject_now_ns(CLOCK_REALTIME);
+        const char *what = inject_match(run, slots[i].data, slots[i].len, ts);
+        kraken_pcapng_write(&run->pcap, slots[i].data, slots[i].len, ts, KRAKEN_PCAPNG_IN, what);
+    }
+    return true;
+}
 
-    int sent_count = 0;
-    for (int i = 0; i < 100; i++) {
-        if (ops->send(conn, frame, len, 10) > 0) {
-            sent_count++;
+// Send every test's frames interleaved round-robin, one every interval_us,
+// matching replies in between; then keep matching for response_ms.
+static void inject_pipeline(KrakenConnectionHandle conn, const KrakenConnectionOps *ops, const inject_config_t *cfg, inject_run_t *run) {
+    int order = 0;
+    for (int round = 0; order < run->total; round++) {
+        for (size_t t = 0; t < NUM_TESTS; t++) {
+            if (round < run->stats[t].frames) run->probes[order++].test = (int)t;
         }
     }
 
-    char buf[64];
-    snprintf(buf, sizeof(buf), "  Sent %d NOP frames", sent_count);
-    add_log_v2(result, buf);
-
-    return sent_count > 0 ? 0 : -1;
+    uint8_t frame[KRAKEN_ECAT_MAX_FRAME];
+    int next_frame[NUM_TESTS] = {0};
+    uint8_t index = 0;
+    bool rx = true;
+    int next = 0, matched = 0;
+    int64_t next_send = inject_now_ns(CLOCK_MONOTONIC);
+    int64_t deadline = 0;
+    for (;;) {
+        int64_t now = inject_now_ns(CLOCK_MONOTONIC);
+        if (next < run->total && now >= next_send) {
+            inject_probe_t *p = &run->probes[next];
+            const test_case_t *tc = &tests[p->test];
+            KrakenEcatStamp stamp = {run->run_id, (uint32_t)next, 0};
+            size_t len = tc->build(frame, &stamp, index, next_frame[p->test]++, cfg);
+            KrakenEcatInfo info;
+            if (kraken_ecat_parse(frame, len, &info)) {
+                p->wkc = info.wkc;
+                index = (uint8_t)(index + info.datagrams);
+            } else {
+                index++; // deliberately malformed; still one datagram
+            }
+            int64_t sent_ns = inject_now_ns(CLOCK_REALTIME);
+            kraken_ecat_restamp(frame, len, stamp.seq, sent_ns);
+            if (ops->send(conn, frame, len, 100) >= 0) {
+                p->sent_ns = sent_ns;
+                run->stats[p->test].sent++;
+                kraken_pcapng_write_payload(&run->pcap, frame, len, sent_ns, KRAKEN_PCAPNG_OUT, tc->name);
+            }
+            next_send += (int64_t)cfg->interval_us * 1000;
+            if (++next == run->total) deadline = inject_now_ns(CLOCK_MONOTONIC) + (int64_t)cfg->response_ms * 1000000LL;
+            continue;
+        }
+        if (next == run->total) {
+            matched = 0;
+            for (size_t t = 0; t < NUM_TESTS; t++) matched += run->stats[t].returned;
+            if (!rx || now >= deadline || matched == run->total) break;
+        }
+        if (!rx) {
+            // No receive path: sleep to the next send instead of spinning on the clock
+            struct timespec ts = {(time_t)(next_send / 1000000000LL), (long)(next_send % 1000000000LL)};
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+            continue;
+        }
+        int64_t until = next < run->total ? next_send : deadline;
+        uint32_t wait_ms = until > now ? (uint32_t)((until - now + 999999) / 1000000) : 1;
+        rx = inject_receive(conn, ops, run, wait_ms);
+    }
 }
 
-static test_case_t tests[] = {
-    {"spoofed_wkc", "Inject frame with spoofed working counter", test_spoofed_wkc},
-    {"invalid_length", "Inject frame with invalid length field", test_invalid_length},
-    {"slave_impersonation", "Inject frame impersonating slave response", test_slave_impersonation},
-    {"nop_flood", "Flood with NOP frames", test_nop_flood},
-};
+static void inject_report(KrakenRunResultV2 *result, KrakenFindingV2 *finding, const inject_run_t *run, size_t t) {
+    const inject_stats_t *st = &run->stats[t];
+    char value[256];
+    int n = snprintf(value, sizeof(value), "sent %d/%d, returned %d, WKC changed %d", st->sent, st->frames, st->returned, st->wkc_changed);
+    if (st->wkc_changed > 0 && n > 0 && (size_t)n < sizeof(value))
+        n += snprintf(value + n, sizeof(value) - (size_t)n, " (avg %+.1f)", (double)st->wkc_delta / st->wkc_changed);
+    if (st->rtt.total > 0 && n > 0 && (size_t)n < sizeof(value)) {
+        snprintf(value + n, sizeof(value) - (size_t)n, ", RTT p50 %.1fus p99 %.1fus max %.1fus", kraken_hist_percentile(&st->rtt, 0.50) / 1e3,
+                 kraken_hist_percentile(&st->rtt, 0.99) / 1e3, st->rtt.max / 1e3);
+    }
+    kraken_result_logf(result, "  %s", value);
+    kraken_finding_add_evidence(result, finding, tests[t].name, value);
+}
 
-#define NUM_TESTS (sizeof(tests) / sizeof(tests[0]))
+// Probes seen again however often, in what order and how late
+static void inject_stamp_report(KrakenRunResultV2 *result, KrakenFindingV2 *finding, const inject_run_t *run) {
+    const KrakenStampStats *st = &run->stamps;
+    int sent = 0;
+    for (size_t t = 0; t < NUM_TESTS; t++) sent += run->stats[t].sent;
+    int lost = sent > (int)st->received ? sent - (int)st->received : 0;
+    char value[256];
+    int n = snprintf(value, sizeof(value), "%llu of %d seen again, %d lost, %llu reordered, %llu duplicates", (unsigned long long)st->received,
+                     sent, lost, (unsigned long long)st->reordered, (unsigned long long)st->duplicates);
+    if (st->latency.total > 0 && n > 0 && (size_t)n < sizeof(value)) {
+        snprintf(value + n, sizeof(value) - (size_t)n, ", one-way p50 %.1fus p99 %.1fus max %.1fus", kraken_hist_percentile(&st->latency, 0.50) / 1e3,
+                 kraken_hist_percentile(&st->latency, 0.99) / 1e3, st->latency.max / 1e3);
+    }
+    kraken_result_logf(result, "Stamped frames: %s", value);
+    kraken_finding_add_evidence(result, finding, "stamps", value);
+}
 
-KRAKEN_API int kraken_run_v2(
-    KrakenConnectionHandle conn,
-    const KrakenConnectionOps *ops,
-    const KrakenTarget *target,
-    uint32_t timeout_ms,
-    const char *params_json,
-    KrakenRunResultV2 **out_result
-) {
+static int run_injection_tests(KrakenConnectionHandle conn, const KrakenConnectionOps *ops,
+                               KrakenRunResultV2 *result, uint32_t timeout_ms, const char *params_json) {
     (void)timeout_ms;
-    (void)params_json;
-
-    KrakenRunResultV2 *result = calloc(1, sizeof(KrakenRunResultV2));
-    if (!result) return -1;
-    copy_target(&result->target, target);
 
-    add_log_v2(result, "Starting EtherCAT frame injection tests");
+    kraken_result_log(result, "Starting EtherCAT frame injection tests");
 
-    int passed = 0;
-    int failed = 0;
+    inject_config_t cfg;
+    load_config(&cfg, params_json, result);
 
-    for (size_t i = 0; i < NUM_TESTS; i++) {
-        char buf[128];
-        snprintf(buf, sizeof(buf), "Test: %s", tests[i].name);
-        add_log_v2(result, buf);
+    inject_run_t run;
+    memset(&run, 0, sizeof(run));
+    run.run_id = (uint32_t)(inject_now_ns(CLOCK_REALTIME) >> 10) | 1;
+    kraken_stamp_stats_init(&run.stamps, run.run_id);
+    for (size_t t = 0; t < NUM_TESTS; t++) {
+        run.stats[t].frames = tests[t].frames(&cfg);
+        kraken_hist_init(&run.stats[t].rtt);
+        run.total += run.stats[t].frames;
+    }
+    if (run.total > INJECT_MAX_FRAMES) run.total = INJECT_MAX_FRAMES;
+    run.probes = calloc((size_t)run.total, sizeof(*run.probes));
+    if (!run.probes) return -1;
+
+    kraken_result_logf(result, "Injecting %d stamped frames across %zu tests, one every %dus", run.total, NUM_TESTS, cfg.interval_us);
+    if (kraken_pcapng_open(&run.pcap, &cfg.pcap, result->target.kind == KRAKEN_TARGET_KIND_ETHERCAT ? result->target.u.ethercat.iface : NULL,
+                           ECAT_ETHERTYPE) != 0)
+        kraken_result_logf(result, "  Cannot record to %s (%s)", cfg.pcap.path, strerror(errno));
+    const KrakenConnectionInfo *info = ops->get_info ? ops->get_info(conn) : NULL;
+    kraken_pcapng_set_source(&run.pcap, info ? info->local_addr : NULL);
+    // Replies are EtherCAT frames; let the conduit drop the rest
+    kraken_filter_frames(conn, ops, "ethercat", 0);
+    inject_pipeline(conn, ops, &cfg, &run);
+    if (kraken_pcapng_enabled(&run.pcap)) {
+        kraken_pcapng_close(&run.pcap);
+        char line[512];
+        kraken_pcapng_summary(&run.pcap, line, sizeof(line));
+        kraken_result_logf(result, "  %s", line);
+    }
 
-        int ret = tests[i].test_fn(conn, ops, result);
-        if (ret == 0) {
-            passed++;
-            add_log_v2(result, "  PASS: Frame injected");
+    KrakenFindingV2 finding = {0};
+    int passed = 0;
+    int accepted = 0;
+
+    for (size_t t = 0; t < NUM_TESTS; t++) {
+        const inject_stats_t *st = &run.stats[t];
+        kraken_result_logf(result, "Test: %s", tests[t].name);
+        inject_report(result, &finding, &run, t);
+        if (st->sent == 0) {
+            kraken_result_log(result, "  FAIL: Could not inject");
+            continue;
+        }
+        passed++;
+        if (st->wkc_changed > 0) {
+            accepted++;
+            kraken_result_log(result, "  PASS: Frames processed by slaves");
+        } else if (st->returned > 0) {
+            kraken_result_log(result, "  PASS: Frames came back unprocessed");
         } else {
-            failed++;
-            add_log_v2(result, "  FAIL: Could not inject");
+            kraken_result_log(result, "  PASS: Frame injected, no reply seen");
         }
     }
 
-    char summary[128];
-    snprintf(summary, sizeof(summary), "Results: %d/%zu tests passed", passed, NUM_TESTS);
-    add_log_v2(result, summary);
+    kraken_result_logf(result, "Results: %d/%zu tests passed, %d processed by slaves", passed, NUM_TESTS, accepted);
+    if (run.master.frames > 0) {
+        kraken_result_logf(result, "Master traffic while injecting: %llu frames, longest gap %.1fms",
+                           (unsigned long long)run.master.frames, run.master.max_gap_ns / 1e6);
+        char value[64];
+        snprintf(value, sizeof(value), "%llu frames, longest gap %.1fms", (unsigned long long)run.master.frames, run.master.max_gap_ns / 1e6);
+        kraken_finding_add_evidence(result, &finding, "master_traffic", value);
+    }
+    inject_stamp_report(result, &finding, &run);
+    free(run.probes);
 
     // Create finding
-    KrakenFindingV2 finding = {0};
-    finding.id = mystrdup("ecat-injection");
-    finding.module_id = mystrdup("ecat_inject");
+    finding.id = kraken_result_strdup(result, "ecat-injection");
+    finding.module_id = kraken_result_strdup(result, "ecat_inject");
     finding.success = (passed > 0);
-    finding.title = mystrdup("EtherCAT Frame Injection");
-    finding.severity = mystrdup(passed > 0 ? "medium" : "info");
+    finding.title = kraken_result_strdup(result, "EtherCAT Frame Injection");
+    finding.severity = kraken_result_strdup(result, accepted > 0 ? "high" : passed > 0 ? "medium" : "info");
 
-    snprintf(summary, sizeof(summary),
-             "Injected %d/%zu test frames. Master accepts injected EtherCAT frames on the network.",
-             passed, NUM_TESTS);
-    finding.description = mystrdup(summary);
+    finding.description = kraken_result_sprintf(result,
+        "Injected %d/%zu test frames. Master accepts injected EtherCAT frames on the network; "
+        "slaves processed injected frames in %d test(s).",
+        passed, NUM_TESTS, accepted);
     finding.timestamp = (int64_t)time(NULL);
-    copy_target(&finding.target, target);
+    finding.target = result->target;
 
-    add_finding_v2(result, &finding);
+    kraken_result_add_finding(result, &finding);
 
-    *out_result = result;
     return 0;
 }
 
+KRAKEN_API int kraken_run_v2(
+    KrakenConnectionHandle conn,
+    const KrakenConnectionOps *ops,
+    const KrakenTarget *target,
+    uint32_t timeout_ms,
+    const char *params_json,
+    KrakenRunResultV2 **out_result
+) {
+    return kraken_result_run_v2(run_injection_tests, conn, ops, target, timeout_ms, params_json, out_result);
+}
+
+KRAKEN_API int kraken_run_v3(
+    KrakenConnectionHandle conn,
+    const KrakenConnectionOps *ops,
+    const KrakenTarget *target,
+    uint32_t timeout_ms,
+    const char *params_json,
+    const KrakenResultSink *sink
+) {
+    return kraken_result_run_v3(run_injection_tests, conn, ops, target, timeout_ms, params_json, sink);
+}
+
 KRAKEN_API void kraken_free_v2(void *p) {
-    if (!p) return;
-    KrakenRunResultV2 *r = (KrakenRunResultV2 *)p;
-
-    for (size_t i = 0; i < r->logs.count; i++)
-        free((void *)r->logs.strings[i]);
-    free((void *)r->logs.strings);
-
-    for (size_t i = 0; i < r->findings_count; i++) {
-        KrakenFindingV2 *f = &r->findings[i];
-        free((void *)f->id);
-        free((void *)f->module_id);
-        free((void *)f->title);
-        free((void *)f->severity);
-        free((void *)f->description);
-        free_target(&f->target);
-    }
-    free(r->findings);
-    free_target(&r->target);
-    free(r);
+    kraken_result_free(p);
 }
@@ -1,335 +1,1193 @@
 // EtherCAT MITM Module
-// Tests master's handling of captured/modified/replayed frames
-
+// Tests master's handling of captured/modified/replayed frames, or sits
+// inline between master and slaves rewriting frames as they pass
+//
+// Reentrant: every run keeps its state in structures it allocates, and
+// the only file-scope data is constant, so concurrent runs in one process
+// (one per interface) do not share anything.
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // sendmmsg/recvmmsg in the packet conduit
+#endif
+
+#include <math.h>
+#include <poll.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
 #include <time.h>
+#include <pthread.h>
 
 #include "kraken_module_abi.h"
 #include "kraken_module_abi_v2.h"
+#include "kraken_module_abi_v3.h"
+#include "kraken_ecat_frame.h"
+#include "kraken_ecat_stamp.h"
+#include "kraken_frame_ring.h"
+#include "kraken_histogram.h"
+#include "kraken_packet_conduit.h"
+#include "kraken_params.h"
+#include "kraken_pcapng.h"
+#include "kraken_result.h"
+
+#define RING_FRAMES 1024      // capture ring slots
+#define RING_FRAMES_MAX 32768 // 32768 x 1.5 KB stays inside the 64 MB budget
+#define FRAME_SLOT 1536
+#define SESSION_MS 2000
+#define MUTATE_FRAMES 20       // frames each mutation test works on
+#define MUTATE_FRAMES_MAX 1024 // keeps a replay a test, not a flood
+#define STABLE_CYCLES 100 // cycles per cycle-learning window
+#define STABLE_CYCLES_MAX 100000
+#define SHAPES_MAX 256          // distinct frame shapes tracked
+#define SHAPE_PERIOD_TOL 0.10   // window-to-window period change still counted as stable
+
+#define CAPTURE_BATCH 32
+#define REPLAY_BATCH 64
+
+#define ECAT_ETHERTYPE 0x88A4
+#define PROFILE_STREAMS 256 // distinct (command, address, direction) streams profiled
+#define PROFILE_WKC_BINS 8  // WKC 0..6 counted exactly, 7 and up share the last bin
+#define PROFILE_REPORT 32   // streams reported, busiest first
+#define BRIDGE_BUDGET_US 50 // per-frame forwarding latency budget
+#define BRIDGE_BATCH 32     // frames received per direction per wakeup
+
+typedef enum { MITM_MODE_REPLAY, MITM_MODE_BRIDGE } mitm_mode_t;
+
+// Bridge directions; rewrite_t.dirs is a mask of (1 << dir)
+enum { DIR_TO_SLAVES, DIR_TO_MASTER, NUM_DIRS };
+
+// Rewrite rules applied by the bridge to every datagram it forwards
+typedef struct {
+    int wkc_offset;   // added to the working counter
+    uint8_t lrw_mask; // XORed into LRW process data
+    bool cmd_swap;    // read commands become the matching writes
+    int dirs;         // directions the rules apply to
+} rewrite_t;
 
-// Kraken signature for Wireshark filtering: "KRKN" = 0x4B524B4E
-// Filter in Wireshark: frame contains "KRKN"
-#define KRAKEN_SIG "KRKN"
-#define KRAKEN_SIG_LEN 4
+// Load settings from params_json
+typedef struct {
+    mitm_mode_t mode;
+    int ring_frames;   // capture ring size
+    int duration_ms;   // capture + replay (or bridge) session length
+    int mutate_frames; // frames per mutation test, 0 = every captured frame
+    int stable_cycles; // cycles per learning window, 0 = capture for duration_ms
+
+    char bridge_iface[IF_NAMESIZE]; // slave side; the master is on the target interface
+    int budget_us;
+    bool busy_poll; // spin instead of sleeping in poll()
+    rewrite_t rewrite;
+    KrakenPcapngConfig pcap;
+} mitm_config_t;
+
+static void load_config(mitm_config_t *cfg, const char *params_json, KrakenRunResultV2 *result) {
+    KrakenParams params;
+    if (kraken_params_parse(&params, params_json) != 0)
+        kraken_result_log(result, "Malformed params_json, using defaults");
+
+    int64_t ring = kraken_params_int(&params, "ring_frames", RING_FRAMES);
+    cfg->ring_frames = ring < 16 ? 16 : ring > RING_FRAMES_MAX ? RING_FRAMES_MAX : (int)ring;
+    int64_t duration = kraken_params_int(&params, "duration_ms", SESSION_MS);
+    cfg->duration_ms = duration < 1 ? SESSION_MS : (int)duration;
+    int64_t mutate = kraken_params_int(&params, "mutate_frames", MUTATE_FRAMES);
+    cfg->mutate_frames = mutate < 0 ? MUTATE_FRAMES : mutate > MUTATE_FRAMES_MAX ? MUTATE_FRAMES_MAX : (int)mutate;
+    int64_t stable = kraken_params_int(&params, "stable_cycles", STABLE_CYCLES);
+    cfg->stable_cycles = stable < 0 ? STABLE_CYCLES : stable > STABLE_CYCLES_MAX ? STABLE_CYCLES_MAX : (int)stable;
+
+    char mode[16];
+    cfg->mode = (kraken_params_string(&params, "mode", mode, sizeof(mode)) > 0 && strcmp(mode, "bridge") == 0)
+                    ? MITM_MODE_BRIDGE : MITM_MODE_REPLAY;
+    if (kraken_params_string(&params, "bridge_iface", cfg->bridge_iface, sizeof(cfg->bridge_iface)) <= 0)
+        cfg->bridge_iface[0] = '\0';
+    int64_t budget = kraken_params_int(&params, "budget_us", BRIDGE_BUDGET_US);
+    cfg->budget_us = budget < 1 ? BRIDGE_BUDGET_US : (int)budget;
+    cfg->busy_poll = kraken_params_bool(&params, "busy_poll", false);
+
+    int64_t offset = kraken_params_int(&params, "wkc_offset", 0);
+    cfg->rewrite.wkc_offset = offset < -0xFFFF || offset > 0xFFFF ? 0 : (int)offset;
+    cfg->rewrite.lrw_mask = (uint8_t)kraken_params_int(&params, "lrw_mask", 0);
+    cfg->rewrite.cmd_swap = kraken_params_bool(&params, "cmd_swap", false);
+    char dir[16];
+    cfg->rewrite.dirs = 1 << DIR_TO_MASTER;
+    if (kraken_params_string(&params, "rewrite_dir", dir, sizeof(dir)) > 0) {
+        if (strcmp(dir, "to_slaves") == 0) cfg->rewrite.dirs = 1 << DIR_TO_SLAVES;
+        else if (strcmp(dir, "both") == 0) cfg->rewrite.dirs = (1 << DIR_TO_SLAVES) | (1 << DIR_TO_MASTER);
+    }
+    kraken_pcapng_config(&cfg->pcap, &params);
 
-#define MAX_CAPTURED 100
+    kraken_params_free(&params);
+}
 
-typedef struct {
-    uint8_t data[1500];
-    size_t len;
-} captured_frame_t;
+// strerror() may share a buffer between threads; this does not
+static const char *mitm_strerror(int err, char *buf, size_t size) {
+    return strerror_r(err, buf, size);
+}
 
-static captured_frame_t captured[MAX_CAPTURED];
-static size_t capture_count = 0;
+// Start recording when pcap_path is set; a file that cannot be created is
+// logged and recording stays off
+static void pcap_open(KrakenRunResultV2 *result, KrakenPcapng *pcap, const mitm_config_t *cfg, const char *iface) {
+    char err[128];
+    if (kraken_pcapng_open(pcap, &cfg->pcap, iface, ECAT_ETHERTYPE) != 0)
+        kraken_result_logf(result, "  Cannot record to %s (%s)", cfg->pcap.path, mitm_strerror(errno, err, sizeof(err)));
+}
 
-// Inject Kraken signature into EtherCAT frame data section
-// Returns new length or 0 on failure
-static size_t inject_signature(uint8_t *frame, size_t len) {
-    if (len < 14) return 0;  // Need at least header + datagram header
+static void pcap_close(KrakenRunResultV2 *result, KrakenPcapng *pcap) {
+    if (!kraken_pcapng_enabled(pcap)) return;
+    kraken_pcapng_close(pcap);
+    char line[512];
+    kraken_pcapng_summary(pcap, line, sizeof(line));
+    kraken_result_logf(result, "  %s", line);
+}
 
-    // Parse EtherCAT header
-    uint16_t header = frame[0] | (frame[1] << 8);
-    uint16_t frame_len = header & 0x7FF;
-    uint8_t frame_type = (header >> 12) & 0x0F;
+static int64_t mitm_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
 
-    if (frame_type != 1) return len;  // Not EtherCAT command frame
-    if (frame_len < 12) return len;   // Too short for datagram
+// Walk the datagram chain of an EtherCAT payload in place. Start with
+// *off = 0; each call returns the next datagram header and sets its data
+// length. Returns: NULL after the last well-formed datagram.
+static uint8_t *next_datagram(uint8_t *p, size_t len, size_t *off, size_t *dlen) {
+    if (len < KRAKEN_ECAT_HDR_LEN) return NULL;
+    uint16_t header = kraken_ecat_get16(p);
+    if ((header >> 12) != KRAKEN_ECAT_TYPE_COMMAND) return NULL;
+    size_t end = KRAKEN_ECAT_HDR_LEN + (header & KRAKEN_ECAT_LEN_MASK);
+    if (end > len) end = len;
+
+    if (*off == 0) {
+        *off = KRAKEN_ECAT_HDR_LEN;
+    } else {
+        // Step over the previous datagram unless it was the last
+        uint16_t prev = kraken_ecat_get16(p + *off + 6);
+        if (!(prev & KRAKEN_ECAT_MORE)) return NULL;
+        *off += KRAKEN_ECAT_DGRAM_HDR_LEN + (prev & KRAKEN_ECAT_LEN_MASK) + KRAKEN_ECAT_WKC_LEN;
+    }
+    if (*off + KRAKEN_ECAT_DGRAM_HDR_LEN + KRAKEN_ECAT_WKC_LEN > end) return NULL;
+    *dlen = kraken_ecat_get16(p + *off + 6) & KRAKEN_ECAT_LEN_MASK;
+    if (*off + KRAKEN_ECAT_DGRAM_HDR_LEN + *dlen + KRAKEN_ECAT_WKC_LEN > end) return NULL;
+    return p + *off;
+}
 
-    // Get datagram data length
-    uint16_t len_flags = frame[8] | (frame[9] << 8);
-    uint16_t data_len = len_flags & 0x7FF;
+// APRD(1)->APWR(2), FPRD(4)->FPWR(5), BRD(7)->BWR(8), LRD(10)->LWR(11)
+static uint8_t read_to_write(uint8_t cmd) {
+    if (cmd == KRAKEN_ECAT_CMD_APRD || cmd == KRAKEN_ECAT_CMD_FPRD || cmd == KRAKEN_ECAT_CMD_BRD || cmd == KRAKEN_ECAT_CMD_LRD)
+        return cmd + 1;
+    return cmd;
+}
 
-    // Insert signature at start of data (after datagram header at offset 12)
-    // Shift existing data right by KRAKEN_SIG_LEN
-    size_t new_len = len + KRAKEN_SIG_LEN;
-    if (new_len > 1500) return len;  // Won't fit
+// Put a NOP datagram carrying `stamp` in front of the replayed datagrams,
+// which stay byte for byte as captured. Wireshark: frame contains "KRKN".
+// Returns: the new length, or `len` unchanged when the frame is not a
+// command frame or would outgrow the MTU.
+static size_t inject_stamp(uint8_t *frame, size_t len, const KrakenEcatStamp *stamp) {
+    if (len < KRAKEN_ECAT_HDR_LEN + KRAKEN_ECAT_DGRAM_HDR_LEN) return len;
+    uint16_t header = kraken_ecat_get16(frame);
+    if ((header >> 12) != KRAKEN_ECAT_TYPE_COMMAND) return len;
+    size_t new_len = len + KRAKEN_ECAT_STAMP_OVERHEAD;
+    if (new_len > KRAKEN_ECAT_MAX_FRAME) return len;
+
+    memmove(frame + KRAKEN_ECAT_HDR_LEN + KRAKEN_ECAT_STAMP_OVERHEAD, frame + KRAKEN_ECAT_HDR_LEN, len - KRAKEN_ECAT_HDR_LEN);
+    uint8_t *nop = frame + KRAKEN_ECAT_HDR_LEN;
+    memset(nop, 0, KRAKEN_ECAT_STAMP_OVERHEAD);
+    kraken_ecat_put16(nop + 6, KRAKEN_ECAT_STAMP_LEN | KRAKEN_ECAT_MORE);
+    kraken_ecat_stamp_put(nop + KRAKEN_ECAT_DGRAM_HDR_LEN, stamp);
+    uint16_t body = (uint16_t)((header & KRAKEN_ECAT_LEN_MASK) + KRAKEN_ECAT_STAMP_OVERHEAD);
+    kraken_ecat_put16(frame, (uint16_t)((header & ~KRAKEN_ECAT_LEN_MASK) | (body & KRAKEN_ECAT_LEN_MASK)));
+    return new_len;
+}
 
-    // Move data after offset 12 to make room
-    memmove(frame + 12 + KRAKEN_SIG_LEN, frame + 12, len - 12);
+// Raw frame carrying an EtherCAT command PDU (type 1) after the Ethernet
+// header that is not one of our own replays coming back
+static int is_ecat_command_frame(const uint8_t *frame, size_t len) {
+    if (len <= 16) return 0; // Minimum EtherCAT frame
+    if (frame[12] != 0x88 || frame[13] != 0xA4) return 0;
+    uint16_t header = frame[14] | (frame[15] << 8);
+    if (((header >> 12) & 0x0F) != 1) return 0;
+    // Signature sits at the start of the first datagram's data
+    return !(len >= 26 + KRAKEN_ECAT_SIG_LEN && memcmp(frame + 26, KRAKEN_ECAT_SIG, KRAKEN_ECAT_SIG_LEN) == 0);
+}
 
-    // Insert signature
-    memcpy(frame + 12, KRAKEN_SIG, KRAKEN_SIG_LEN);
+/* ------------------------------------------------------------------ */
+/* Traffic profiler                                                   */
+/* ------------------------------------------------------------------ */
 
-    // Update header length
-    uint16_t new_frame_len = frame_len + KRAKEN_SIG_LEN;
-    frame[0] = new_frame_len & 0xFF;
-    frame[1] = ((new_frame_len >> 8) & 0x07) | (frame_type << 4);
+// Every datagram of every frame seen is folded into a stream keyed by
+// command, address and direction. Cyclic masters send the same datagrams
+// each cycle, so the streams give the cycle period, its jitter, the
+// process image layout and the WKC each slave group answers with.
+// Columns are separate arrays: the lookup scan touches only `key`.
+typedef struct {
+    size_t count;
+    uint64_t unkeyed; // datagrams whose stream did not fit
+    uint64_t frames;
+    uint64_t key[PROFILE_STREAMS]; // cmd << 40 | processed << 32 | adp << 16 | ado
+    uint64_t datagrams[PROFILE_STREAMS];
+    uint16_t len_min[PROFILE_STREAMS];
+    uint16_t len_max[PROFILE_STREAMS];
+    int64_t last_ns[PROFILE_STREAMS];
+    uint64_t intervals[PROFILE_STREAMS];
+    double period_mean[PROFILE_STREAMS]; // inter-arrival ns, Welford mean and M2
+    double period_m2[PROFILE_STREAMS];
+    int64_t period_min[PROFILE_STREAMS];
+    int64_t period_max[PROFILE_STREAMS];
+    uint32_t wkc[PROFILE_STREAMS][PROFILE_WKC_BINS];
+    uint64_t cmd_datagrams[16]; // per command type
+} profile_t;
+
+static const char *const cmd_names[16] = {"NOP", "APRD", "APWR", "APRW", "FPRD", "FPWR", "FPRW", "BRD",
+                                          "BWR", "BRW", "LRD", "LWR", "LRW", "ARMW", "FRMW", "CMD15"};
+
+static bool cmd_is_logical(uint8_t cmd) {
+    return cmd == KRAKEN_ECAT_CMD_LRD || cmd == KRAKEN_ECAT_CMD_LWR || cmd == KRAKEN_ECAT_CMD_LRW;
+}
 
-    // Update datagram data length
-    uint16_t new_data_len = data_len + KRAKEN_SIG_LEN;
-    frame[8] = new_data_len & 0xFF;
-    frame[9] = (len_flags & 0xF800) | ((new_data_len >> 8) & 0x07);
+static size_t profile_stream(profile_t *pf, uint64_t key) {
+    for (size_t i = 0; i < pf->count; i++)
+        if (pf->key[i] == key) return i;
+    if (pf->count == PROFILE_STREAMS) return PROFILE_STREAMS;
+    size_t i = pf->count++;
+    pf->key[i] = key;
+    pf->len_min[i] = UINT16_MAX;
+    pf->period_min[i] = INT64_MAX;
+    return i;
+}
 
-    return new_len;
+// Fold one raw Ethernet frame in. `ts_ns` 0 = no timestamp, which leaves
+// the stream's periods alone.
+static void profile_frame(profile_t *pf, uint8_t *frame, size_t len, int64_t ts_ns) {
+    if (len <= KRAKEN_CONDUIT_ETH_HLEN || frame[12] != 0x88 || frame[13] != 0xA4) return;
+    // Slaves set the locally administered bit of the source MAC on frames they processed
+    uint64_t processed = (frame[6] & 0x02) ? 1 : 0;
+    uint8_t *p = frame + KRAKEN_CONDUIT_ETH_HLEN;
+    size_t plen = len - KRAKEN_CONDUIT_ETH_HLEN;
+    uint8_t *dg;
+    size_t off = 0, dlen = 0;
+    bool any = false;
+    while ((dg = next_datagram(p, plen, &off, &dlen)) != NULL) {
+        any = true;
+        uint8_t cmd = dg[0];
+        pf->cmd_datagrams[cmd & 0x0F]++;
+        uint64_t key = (uint64_t)cmd << 40 | processed << 32 | (uint64_t)kraken_ecat_get16(dg + 2) << 16 | kraken_ecat_get16(dg + 4);
+        size_t i = profile_stream(pf, key);
+        if (i == PROFILE_STREAMS) {
+            pf->unkeyed++;
+            continue;
+        }
+        pf->datagrams[i]++;
+        if (dlen < pf->len_min[i]) pf->len_min[i] = (uint16_t)dlen;
+        if (dlen > pf->len_max[i]) pf->len_max[i] = (uint16_t)dlen;
+        uint16_t wkc = kraken_ecat_get16(dg + KRAKEN_ECAT_DGRAM_HDR_LEN + dlen);
+        pf->wkc[i][wkc < PROFILE_WKC_BINS ? wkc : PROFILE_WKC_BINS - 1]++;
+
+        if (ts_ns == 0) continue;
+        if (pf->last_ns[i] != 0 && ts_ns > pf->last_ns[i]) {
+            int64_t dt = ts_ns - pf->last_ns[i];
+            uint64_t n = ++pf->intervals[i];
+            double delta = (double)dt - pf->period_mean[i];
+            pf->period_mean[i] += delta / (double)n;
+            pf->period_m2[i] += delta * ((double)dt - pf->period_mean[i]);
+            if (dt < pf->period_min[i]) pf->period_min[i] = dt;
+            if (dt > pf->period_max[i]) pf->period_max[i] = dt;
+        }
+        pf->last_ns[i] = ts_ns;
+    }
+    if (any) pf->frames++;
 }
 
-// Capture frames from the network
-static int capture_frames(KrakenConnectionHandle conn, const KrakenConnectionOps *ops,
-                          KrakenRunResultV2 *result, int duration_ms) {
-    capture_count = 0;
-    clock_t start = clock();
-    clock_t end = start + (duration_ms * CLOCKS_PER_SEC / 1000);
-
-    while (clock() < end && capture_count < MAX_CAPTURED) {
-        uint8_t buf[1500];
-        int64_t n = ops->recv(conn, buf, sizeof(buf), 50);
-        if (n > 16) { // Minimum EtherCAT frame
-            // Check if it's EtherCAT (type field at offset 12-13 after eth header is in payload)
-            // We receive raw frames so check header
-            uint16_t header = buf[14] | (buf[15] << 8);
-            uint8_t frame_type = (header >> 12) & 0x0F;
-            if (frame_type == 1) {
-                memcpy(captured[capture_count].data, buf, n);
-                captured[capture_count].len = n;
-                capture_count++;
-            }
+static double profile_jitter_ns(const profile_t *pf, size_t i) {
+    return pf->intervals[i] > 1 ? sqrt(pf->period_m2[i] / (double)(pf->intervals[i] - 1)) : 0.0;
+}
+
+// Log the profile and attach it to `finding` as evidence: totals, the
+// datagram count per command, the cycle period and process image size,
+// then one "stream.N" entry per stream, busiest first.
+static void profile_report(KrakenRunResultV2 *result, KrakenFindingV2 *finding, const profile_t *pf) {
+    char value[384];
+    kraken_result_logf(result, "Traffic profile: %llu frames, %zu datagram streams%s", (unsigned long long)pf->frames, pf->count,
+                       pf->unkeyed ? " (stream table full, some datagrams unprofiled)" : "");
+    snprintf(value, sizeof(value), "%llu", (unsigned long long)pf->frames);
+    kraken_finding_add_evidence(result, finding, "profile.frames", value);
+    if (pf->count == 0) return;
+
+    for (int c = 0; c < 16; c++) {
+        if (pf->cmd_datagrams[c] == 0) continue;
+        char key[32];
+        snprintf(key, sizeof(key), "profile.cmd.%s", cmd_names[c]);
+        snprintf(value, sizeof(value), "%llu", (unsigned long long)pf->cmd_datagrams[c]);
+        kraken_finding_add_evidence(result, finding, key, value);
+    }
+
+    // Busiest first; the cycle is the busiest logical stream, else the busiest of all
+    size_t order[PROFILE_STREAMS] = {0};
+    for (size_t i = 0; i < pf->count; i++) {
+        size_t j = i;
+        while (j > 0 && pf->datagrams[order[j - 1]] < pf->datagrams[i]) {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = i;
+    }
+    size_t cycle = order[0];
+    for (size_t r = 0; r < pf->count; r++) {
+        if (cmd_is_logical((uint8_t)(pf->key[order[r]] >> 40))) {
+            cycle = order[r];
+            break;
         }
     }
+    if (pf->intervals[cycle] > 0) {
+        snprintf(value, sizeof(value), "%.1f", pf->period_mean[cycle] / 1e3);
+        kraken_finding_add_evidence(result, finding, "profile.cycle_us", value);
+        snprintf(value, sizeof(value), "%.1f", profile_jitter_ns(pf, cycle) / 1e3);
+        kraken_finding_add_evidence(result, finding, "profile.cycle_jitter_us", value);
+        kraken_result_logf(result, "  Cycle: %.1fus (jitter %.1fus) from %s stream", pf->period_mean[cycle] / 1e3,
+                           profile_jitter_ns(pf, cycle) / 1e3, cmd_names[(pf->key[cycle] >> 40) & 0x0F]);
+    }
 
-    char log[128];
-    snprintf(log, sizeof(log), "  Captured %zu EtherCAT frames", capture_count);
-    add_log_v2(result, log);
+    // Process image: largest datagram per logical address, each address once
+    unsigned image = 0;
+    for (size_t i = 0; i < pf->count; i++) {
+        if (!cmd_is_logical((uint8_t)(pf->key[i] >> 40))) continue;
+        bool seen = false;
+        for (size_t j = 0; j < i && !seen; j++)
+            seen = cmd_is_logical((uint8_t)(pf->key[j] >> 40)) && (uint32_t)pf->key[j] == (uint32_t)pf->key[i];
+        if (!seen) image += pf->len_max[i];
+    }
+    if (image > 0) {
+        snprintf(value, sizeof(value), "%u", image);
+        kraken_finding_add_evidence(result, finding, "profile.image_bytes", value);
+        kraken_result_logf(result, "  Process image: %u bytes", image);
+    }
 
-    return (int)capture_count;
+    for (size_t r = 0; r < pf->count && r < PROFILE_REPORT; r++) {
+        size_t i = order[r];
+        uint8_t cmd = (uint8_t)(pf->key[i] >> 40);
+        uint16_t adp = (uint16_t)(pf->key[i] >> 16), ado = (uint16_t)pf->key[i];
+        int n = cmd_is_logical(cmd)
+                    ? snprintf(value, sizeof(value), "cmd=%s laddr=0x%08x", cmd_names[cmd & 0x0F], (unsigned)ado << 16 | adp)
+                    : snprintf(value, sizeof(value), "cmd=%s adp=0x%04x ado=0x%04x", cmd_names[cmd & 0x0F], adp, ado);
+        n += snprintf(value + n, sizeof(value) - (size_t)n, " dir=%s n=%llu len=%u", (pf->key[i] >> 32) & 1 ? "ret" : "out",
+                      (unsigned long long)pf->datagrams[i], pf->len_max[i]);
+        if (pf->len_min[i] != pf->len_max[i]) n += snprintf(value + n, sizeof(value) - (size_t)n, "(min %u)", pf->len_min[i]);
+        if (pf->intervals[i] > 0)
+            n += snprintf(value + n, sizeof(value) - (size_t)n, " period_us=%.1f jitter_us=%.1f min_us=%.1f max_us=%.1f",
+                          pf->period_mean[i] / 1e3, profile_jitter_ns(pf, i) / 1e3, pf->period_min[i] / 1e3, pf->period_max[i] / 1e3);
+        n += snprintf(value + n, sizeof(value) - (size_t)n, " wkc=");
+        const char *sep = "";
+        for (int b = 0; b < PROFILE_WKC_BINS; b++) {
+            if (pf->wkc[i][b] == 0) continue;
+            n += snprintf(value + n, sizeof(value) - (size_t)n, "%s%d%s:%u", sep, b, b == PROFILE_WKC_BINS - 1 ? "+" : "", pf->wkc[i][b]);
+            sep = ",";
+        }
+        char key[32];
+        snprintf(key, sizeof(key), "profile.stream.%zu", r);
+        kraken_finding_add_evidence(result, finding, key, value);
+        kraken_result_logf(result, "  %s", value);
+    }
+    if (pf->count > PROFILE_REPORT) kraken_result_logf(result, "  ... %zu quieter streams not listed", pf->count - PROFILE_REPORT);
 }
 
-// Test 1: Simple replay - send captured frames back with Kraken signature
-static int test_replay(KrakenConnectionHandle conn, const KrakenConnectionOps *ops,
-                       KrakenRunResultV2 *result) {
-    if (capture_count == 0) {
-        add_log_v2(result, "  Replay: no frames to replay");
-        return 0;
-    }
+/* ------------------------------------------------------------------ */
+/* Cycle learning                                                     */
+/* ------------------------------------------------------------------ */
+
+// A cyclic master sends the same frames every cycle; only indexes,
+// process data and WKCs change. Frames are grouped into shapes by their
+// datagram structure, and the cycle counts as learned once no new shape
+// has appeared and the period of the busiest shape held steady across
+// two consecutive windows of `stable_cycles` cycles. The latest frame of
+// each shape is kept so mutations can be spread across shapes.
+typedef struct {
+    size_t count;
+    uint64_t untracked;  // frames whose shape did not fit
+    uint64_t generation; // bumped by every new or untracked shape
+    uint64_t hash[SHAPES_MAX];
+    uint64_t seen[SHAPES_MAX];
+    int64_t last_ns[SHAPES_MAX];
+    uint16_t len[SHAPES_MAX];
+    uint8_t frame[SHAPES_MAX][FRAME_SLOT];
+
+    size_t ref;              // busiest shape; its arrivals count cycles
+    uint64_t win_generation; // generation when the window opened
+    int64_t win_ns;          // reference intervals summed over the window
+    int win_cycles;
+    double period_ns; // mean interval of the last full window, 0 = none yet
+    bool learned;
+} shapes_t;
+
+static uint64_t shape_mix(uint64_t h, uint64_t v) {
+    for (int i = 0; i < 8; i++, v >>= 8)
+        h = (h ^ (v & 0xFF)) * 0x100000001b3ULL; // FNV-1a
+    return h;
+}
 
-    int sent = 0;
-    for (size_t i = 0; i < capture_count; i++) {
-        // Copy and inject signature (skip eth header, send EtherCAT payload)
-        if (captured[i].len > 14) {
-            uint8_t modified[1500];
-            size_t ecat_len = captured[i].len - 14;
-            memcpy(modified, captured[i].data + 14, ecat_len);
+// Hash of what a frame keeps from cycle to cycle: direction, then the
+// command, address and length of each datagram
+static uint64_t frame_shape(uint8_t *frame, size_t len) {
+    uint64_t h = shape_mix(0xcbf29ce484222325ULL, frame[6] & 0x02);
+    uint8_t *dg;
+    size_t off = 0, dlen = 0;
+    while ((dg = next_datagram(frame + KRAKEN_CONDUIT_ETH_HLEN, len - KRAKEN_CONDUIT_ETH_HLEN, &off, &dlen)) != NULL)
+        h = shape_mix(h, (uint64_t)dg[0] << 48 | (uint64_t)kraken_ecat_get16(dg + 2) << 32 |
+                             (uint64_t)kraken_ecat_get16(dg + 4) << 16 | dlen);
+    return h;
+}
 
-            // Inject Kraken signature
-            size_t new_len = inject_signature(modified, ecat_len);
+// Close a window of reference cycles: learned when the shape set did not
+// change and the mean period moved less than SHAPE_PERIOD_TOL
+static void shapes_window(shapes_t *sh) {
+    double mean = (double)sh->win_ns / sh->win_cycles;
+    if (sh->period_ns > 0 && sh->win_generation == sh->generation && fabs(mean - sh->period_ns) <= sh->period_ns * SHAPE_PERIOD_TOL)
+        sh->learned = true;
+    sh->period_ns = mean;
+    sh->win_generation = sh->generation;
+    sh->win_ns = 0;
+    sh->win_cycles = 0;
+}
 
-            if (ops->send(conn, modified, new_len, 50) > 0) {
-                sent++;
-            }
+// Fold one captured EtherCAT frame in; `stable_cycles` 0 never learns.
+// Returns: true on the first sighting of a tracked shape.
+static bool shapes_add(shapes_t *sh, uint8_t *frame, size_t len, int64_t ts_ns, int stable_cycles) {
+    uint64_t h = frame_shape(frame, len);
+    size_t i = 0;
+    while (i < sh->count && sh->hash[i] != h)
+        i++;
+    bool fresh = i == sh->count;
+    if (fresh) {
+        sh->generation++;
+        if (sh->count == SHAPES_MAX) {
+            sh->untracked++;
+            return false;
         }
+        sh->hash[sh->count++] = h;
+    }
+    size_t n = len < FRAME_SLOT ? len : FRAME_SLOT;
+    memcpy(sh->frame[i], frame, n);
+    sh->len[i] = (uint16_t)n;
+    sh->seen[i]++;
+    int64_t last = sh->last_ns[i];
+    sh->last_ns[i] = ts_ns;
+
+    if (sh->seen[i] > sh->seen[sh->ref] && i != sh->ref) {
+        // A busier shape takes over; its period starts from scratch
+        sh->ref = i;
+        sh->period_ns = 0;
+        sh->win_ns = 0;
+        sh->win_cycles = 0;
+        sh->win_generation = sh->generation;
+        return fresh;
     }
+    if (i == sh->ref && stable_cycles > 0 && last != 0 && ts_ns >= last) {
+        sh->win_ns += ts_ns - last;
+        if (++sh->win_cycles == stable_cycles) shapes_window(sh);
+    }
+    return fresh;
+}
 
-    char log[128];
-    snprintf(log, sizeof(log), "  Replay: sent %d captured frames", sent);
-    add_log_v2(result, log);
+/* ------------------------------------------------------------------ */
+/* Capture stage                                                      */
+/* ------------------------------------------------------------------ */
 
-    return sent;
+// Capture thread (producer) feeding the replay stage (consumer) through
+// the ring. Frames are received straight into ring slots; anything that
+// is not an EtherCAT command frame is compacted away before publishing.
+typedef struct {
+    KrakenFrameRing ring;
+    KrakenConnectionHandle conn;
+    const KrakenConnectionOps *ops;
+    pthread_t tid;
+    int stop;
+    int failed;        // conduit reported an error
+    bool own_conn;     // conn was opened for the capture thread
+    bool filtered;     // conduit drops non-EtherCAT frames before we see them
+    uint64_t captured; // frames published
+    int64_t first_ns;  // receive time of the first and last captured frame
+    int64_t last_ns;
+    KrakenStampStats stamps; // our own replays coming back from the segment
+    uint64_t truncated;      // captured frames longer than a ring slot
+    const char *clock;       // timestamp source of the first captured frame
+} capture_t;
+
+// Master traffic goes on to the replay stage; our own stamped replays are
+// only counted
+static bool capture_wanted(capture_t *cap, const uint8_t *frame, size_t len, int64_t timestamp_ns) {
+    if (is_ecat_command_frame(frame, len)) return true;
+    kraken_stamp_stats_frame(&cap->stamps, frame, len, timestamp_ns);
+    return false;
 }
 
-// Test 2: Modified replay - change WKC in captured frames
-static int test_modified_wkc(KrakenConnectionHandle conn, const KrakenConnectionOps *ops,
-                             KrakenRunResultV2 *result) {
-    if (capture_count == 0) {
-        add_log_v2(result, "  Modified WKC: no frames");
-        return 0;
-    }
-
-    int sent = 0;
-    for (size_t i = 0; i < capture_count && i < 20; i++) {
-        uint8_t modified[1500];
-        size_t len = captured[i].len;
-        if (len <= 14) continue;
-
-        memcpy(modified, captured[i].data + 14, len - 14);
-        size_t ecat_len = len - 14;
-
-        // Find and modify WKC (at end of each datagram)
-        // Simple approach: modify last 2 bytes before any padding
-        if (ecat_len > 4) {
-            uint16_t header = modified[0] | (modified[1] << 8);
-            uint16_t frame_len = header & 0x7FF;
-            if (frame_len > 2 && frame_len <= ecat_len - 2) {
-                // Set WKC to 0xFF (invalid high value)
-                modified[frame_len] = 0xFF;
-                modified[frame_len + 1] = 0x00;
-            }
+// Keep slot i if it holds an EtherCAT frame: move it down to `kept`
+static bool capture_keep(capture_t *cap, size_t i, size_t kept) {
+    KrakenRingFrame *f = kraken_frame_ring_write_slot(&cap->ring, i);
+    if (!capture_wanted(cap, kraken_frame_ring_data(f), f->len, f->timestamp_ns)) return false;
+    if (f->flags & KRAKEN_RECV_F_TRUNCATED) cap->truncated++;
+    if (i != kept) {
+        KrakenRingFrame *dst = kraken_frame_ring_write_slot(&cap->ring, kept);
+        memcpy(dst, f, sizeof(*f));
+        memcpy(kraken_frame_ring_data(dst), kraken_frame_ring_data(f), f->len);
+    }
+    return true;
+}
+
+static void capture_publish(capture_t *cap, size_t kept) {
+    if (kept == 0) return;
+    KrakenRingFrame *first = kraken_frame_ring_write_slot(&cap->ring, 0);
+    if (cap->first_ns == 0) cap->first_ns = first->timestamp_ns;
+    if (!cap->clock) cap->clock = kraken_recv_clock(first->flags, first->timestamp_ns);
+    cap->last_ns = kraken_frame_ring_write_slot(&cap->ring, kept - 1)->timestamp_ns;
+    cap->captured += kept;
+    kraken_frame_ring_publish(&cap->ring, kept);
+}
+
+// Borrowed receive: frames stay in the conduit's ring until released, so
+// only EtherCAT frames are ever copied out
+static int capture_borrowed(capture_t *cap, uint32_t timeout_ms) {
+    KrakenBorrowedFrame frames[CAPTURE_BATCH];
+    int64_t got = cap->ops->recv_borrow(cap->conn, frames, CAPTURE_BATCH, timeout_ms);
+    if (got <= 0) return got < 0 ? -1 : 0;
+
+    size_t room = kraken_frame_ring_writable(&cap->ring);
+    size_t kept = 0;
+    for (int64_t i = 0; i < got; i++) {
+        if (!capture_wanted(cap, frames[i].data, frames[i].len, frames[i].timestamp_ns)) continue;
+        size_t n = frames[i].len < cap->ring.slot_size ? frames[i].len : cap->ring.slot_size;
+        if (n < frames[i].len || (frames[i].flags & KRAKEN_RECV_F_TRUNCATED)) cap->truncated++;
+        if (kept == room) {
+            cap->ring.dropped++;
+            continue;
         }
+        KrakenRingFrame *dst = kraken_frame_ring_write_slot(&cap->ring, kept++);
+        memcpy(kraken_frame_ring_data(dst), frames[i].data, n);
+        dst->len = (uint32_t)n;
+        dst->flags = frames[i].flags;
+        dst->timestamp_ns = frames[i].timestamp_ns;
+    }
+    cap->ops->recv_release(cap->conn, frames, (size_t)got);
+    capture_publish(cap, kept);
+    return 0;
+}
+
+// One receive call into free ring slots.
+// Returns: -1 on conduit error, otherwise 0.
+static int capture_step(capture_t *cap, uint32_t timeout_ms) {
+    if (cap->ops->recv_borrow && cap->ops->recv_release) return capture_borrowed(cap, timeout_ms);
+
+    size_t room = kraken_frame_ring_writable(&cap->ring);
+    if (room == 0) {
+        // Ring full: receive into a scratch slot so the frame is counted, not queued
+        uint8_t scratch[FRAME_SLOT];
+        KrakenRecvExSlot slot = {.data = scratch, .size = sizeof(scratch)};
+        int64_t got = kraken_recv_frames_ex(cap->conn, cap->ops, &slot, 1, timeout_ms);
+        if (got > 0 && is_ecat_command_frame(scratch, slot.len)) cap->ring.dropped++;
+        return got < 0 ? -1 : 0;
+    }
 
-        // Inject Kraken signature
-        size_t new_len = inject_signature(modified, ecat_len);
+    // recv_ex where the conduit has it: NIC timestamps when enabled
+    KrakenRecvExSlot slots[CAPTURE_BATCH];
+    size_t want = room < CAPTURE_BATCH ? room : CAPTURE_BATCH;
+    for (size_t i = 0; i < want; i++) {
+        KrakenRingFrame *f = kraken_frame_ring_write_slot(&cap->ring, i);
+        slots[i].data = kraken_frame_ring_data(f);
+        slots[i].size = cap->ring.slot_size;
+    }
+    int64_t got = kraken_recv_frames_ex(cap->conn, cap->ops, slots, want, timeout_ms);
+    if (got < 0) return -1;
+
+    size_t kept = 0;
+    for (int64_t i = 0; i < got; i++) {
+        KrakenRingFrame *f = kraken_frame_ring_write_slot(&cap->ring, (size_t)i);
+        f->len = (uint32_t)slots[i].len;
+        f->flags = slots[i].flags;
+        f->timestamp_ns = slots[i].timestamp_ns;
+        // We receive raw frames, so the EtherCAT header follows the Ethernet header
+        if (capture_keep(cap, (size_t)i, kept)) kept++;
+    }
+    capture_publish(cap, kept);
+    return 0;
+}
 
-        if (ops->send(conn, modified, new_len, 50) > 0) {
-            sent++;
+static void *capture_thread(void *arg) {
+    capture_t *cap = arg;
+    while (!__atomic_load_n(&cap->stop, __ATOMIC_ACQUIRE)) {
+        if (capture_step(cap, 20) < 0) {
+            __atomic_store_n(&cap->failed, 1, __ATOMIC_RELEASE);
+            break;
         }
     }
+    return NULL;
+}
 
-    char log[128];
-    snprintf(log, sizeof(log), "  Modified WKC: sent %d frames with altered WKC", sent);
-    add_log_v2(result, log);
+// Capture on a second conduit from its own thread when the runner can
+// open one; otherwise the replay loop captures between replays itself.
+// Returns: true when the capture thread is running.
+static bool capture_start(capture_t *cap, KrakenConnectionHandle conn, const KrakenConnectionOps *ops) {
+    cap->ops = ops;
+    cap->conn = conn;
+    // Only EtherCAT frames reach capture_keep where the conduit filters
+    bool filtered = kraken_filter_frames(conn, ops, "ethercat", 0);
+    cap->filtered = filtered;
+    if (!ops->open || !ops->close) return false;
+    KrakenConnectionHandle own = ops->open(conn, 1000);
+    if (!own) return false;
+    cap->conn = own;
+    cap->own_conn = true;
+    cap->filtered = kraken_filter_frames(own, ops, "ethercat", 0);
+    if (pthread_create(&cap->tid, NULL, capture_thread, cap) != 0) {
+        ops->close(own);
+        cap->conn = conn;
+        cap->own_conn = false;
+        cap->filtered = filtered;
+        return false;
+    }
+    return true;
+}
 
-    return sent;
+static void capture_stop(capture_t *cap) {
+    if (!cap->own_conn) return;
+    __atomic_store_n(&cap->stop, 1, __ATOMIC_RELEASE);
+    pthread_join(cap->tid, NULL);
+    cap->ops->close(cap->conn);
+}
+
+/* ------------------------------------------------------------------ */
+/* Replay and mutation stage                                          */
+/* ------------------------------------------------------------------ */
+
+enum { TEST_REPLAY, TEST_MODIFIED_WKC, TEST_CORRUPTED_DATA, TEST_CMD_SUBSTITUTION, NUM_TESTS };
+
+// Test 1: Simple replay - send captured frames back with Kraken signature only
+static void mutate_none(uint8_t *modified, size_t ecat_len) {
+    (void)modified;
+    (void)ecat_len;
+}
+
+// Test 2: Modified replay - change WKC in captured frames
+static void mutate_wkc(uint8_t *modified, size_t ecat_len) {
+    // WKC of the last datagram, which ends the frame before any padding
+    uint8_t *last = NULL, *dg;
+    size_t off = 0, dlen = 0, last_len = 0;
+    while ((dg = next_datagram(modified, ecat_len, &off, &dlen)) != NULL) {
+        last = dg;
+        last_len = dlen;
+    }
+    // Set WKC to 0xFF (invalid high value)
+    if (last) kraken_ecat_put16(last + KRAKEN_ECAT_DGRAM_HDR_LEN + last_len, 0x00FF);
 }
 
 // Test 3: Modified replay - corrupt data payload
-static int test_corrupted_data(KrakenConnectionHandle conn, const KrakenConnectionOps *ops,
-                               KrakenRunResultV2 *result) {
-    if (capture_count == 0) {
-        add_log_v2(result, "  Corrupted data: no frames");
-        return 0;
-    }
-
-    int sent = 0;
-    for (size_t i = 0; i < capture_count && i < 20; i++) {
-        uint8_t modified[1500];
-        size_t len = captured[i].len;
-        if (len <= 14) continue;
-
-        memcpy(modified, captured[i].data + 14, len - 14);
-        size_t ecat_len = len - 14;
-
-        // Flip some bits in the data section
-        if (ecat_len > 14) {
-            for (size_t j = 12; j < ecat_len - 2 && j < 20; j++) {
-                modified[j] ^= 0xAA;
-            }
+static void mutate_corrupt(uint8_t *modified, size_t ecat_len) {
+    // Flip some bits in the data section
+    if (ecat_len > 14) {
+        for (size_t j = 12; j < ecat_len - 2 && j < 20; j++) {
+            modified[j] ^= 0xAA;
         }
+    }
+}
 
-        // Inject Kraken signature
-        size_t new_len = inject_signature(modified, ecat_len);
+// Test 4: Command substitution - change command type
+static void mutate_cmd(uint8_t *modified, size_t ecat_len) {
+    // Change read commands to write commands
+    if (ecat_len > 2) {
+        modified[2] = read_to_write(modified[2]);
+    }
+}
 
-        if (ops->send(conn, modified, new_len, 50) > 0) {
-            sent++;
-        }
+static const struct {
+    const char *name;
+    const char *what; // "sent %d frames <what>"
+    void (*mutate)(uint8_t *modified, size_t ecat_len);
+} tests[NUM_TESTS] = {
+    {"Simple replay", "captured frames", mutate_none},
+    {"Modified WKC", "frames with altered WKC", mutate_wkc},
+    {"Corrupted data", "frames with flipped bits", mutate_corrupt},
+    {"Command substitution", "frames with changed commands", mutate_cmd},
+};
+
+// Frames built from popped captures, handed to the conduit as a single batch
+typedef struct {
+    uint8_t frames[REPLAY_BATCH][1500];
+    KrakenBuffer bufs[REPLAY_BATCH];
+    int test[REPLAY_BATCH];
+    size_t count;
+} replay_batch_t;
+
+typedef struct {
+    mitm_config_t cfg;
+    replay_batch_t batch;
+    int queued[NUM_TESTS]; // frames each test has built
+    int sent[NUM_TESTS];
+    profile_t profile;
+    shapes_t shapes;
+    KrakenPcapng pcap;
+    uint32_t run_id;   // stamped into every replayed frame
+    uint32_t next_seq;
+} replay_t;
+
+// Send and empty the batch
+static void replay_flush(KrakenConnectionHandle conn, const KrakenConnectionOps *ops, replay_t *rp) {
+    replay_batch_t *batch = &rp->batch;
+    if (batch->count == 0) return;
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    int64_t tx_ns = (int64_t)now.tv_sec * 1000000000LL + now.tv_nsec;
+    for (size_t i = 0; i < batch->count; i++)
+        kraken_ecat_restamp((uint8_t *)batch->bufs[i].data, batch->bufs[i].len, rp->next_seq++, tx_ns);
+    size_t sent = kraken_send_frames(conn, ops, batch->bufs, batch->count, 50);
+    for (size_t i = 0; i < sent; i++) {
+        rp->sent[batch->test[i]]++;
+        kraken_pcapng_write_payload(&rp->pcap, batch->bufs[i].data, batch->bufs[i].len, 0, KRAKEN_PCAPNG_OUT, tests[batch->test[i]].name);
     }
+    batch->count = 0;
+}
 
-    char log[128];
-    snprintf(log, sizeof(log), "  Corrupted data: sent %d frames with flipped bits", sent);
-    add_log_v2(result, log);
+// Queue test `t` built from one captured frame
+static void replay_queue(KrakenConnectionHandle conn, const KrakenConnectionOps *ops, replay_t *rp, int t, const uint8_t *frame, size_t len) {
+    if (len <= 14) return;
+    size_t ecat_len = len - 14;
+    if (ecat_len > 1500) ecat_len = 1500;
+    if (rp->batch.count == REPLAY_BATCH) replay_flush(conn, ops, rp);
+
+    replay_batch_t *batch = &rp->batch;
+    uint8_t *modified = batch->frames[batch->count];
+    memcpy(modified, frame + 14, ecat_len);
+    tests[t].mutate(modified, ecat_len);
+
+    // Sequence number and TX time are filled in when the batch is sent
+    KrakenEcatStamp stamp = {.run = rp->run_id};
+    size_t new_len = inject_stamp(modified, ecat_len, &stamp);
+
+    batch->bufs[batch->count].data = modified;
+    batch->bufs[batch->count].len = new_len;
+    batch->test[batch->count] = t;
+    batch->count++;
+    rp->queued[t]++;
+}
 
-    return sent;
+// Queue the replay of one captured frame, and its mutations when it is
+// the first of its shape (or mutate_frames is 0)
+static void replay_frame(KrakenConnectionHandle conn, const KrakenConnectionOps *ops, replay_t *rp, const uint8_t *frame, size_t len, bool fresh) {
+    for (int t = 0; t < NUM_TESTS; t++) {
+        if (t != TEST_REPLAY && rp->cfg.mutate_frames > 0 && (!fresh || rp->queued[t] >= rp->cfg.mutate_frames)) continue;
+        replay_queue(conn, ops, rp, t, frame, len);
+    }
 }
 
-// Test 4: Command substitution - change command type
-static int test_cmd_substitution(KrakenConnectionHandle conn, const KrakenConnectionOps *ops,
-                                 KrakenRunResultV2 *result) {
-    if (capture_count == 0) {
-        add_log_v2(result, "  Cmd substitution: no frames");
-        return 0;
-    }
-
-    int sent = 0;
-    for (size_t i = 0; i < capture_count && i < 20; i++) {
-        uint8_t modified[1500];
-        size_t len = captured[i].len;
-        if (len <= 14) continue;
-
-        memcpy(modified, captured[i].data + 14, len - 14);
-        size_t ecat_len = len - 14;
-
-        // Change read commands to write commands
-        if (ecat_len > 2) {
-            uint8_t cmd = modified[2];
-            // APRD(1)->APWR(2), FPRD(4)->FPWR(5), BRD(7)->BWR(8), LRD(10)->LWR(11)
-            if (cmd == 1 || cmd == 4 || cmd == 7 || cmd == 10) {
-                modified[2] = cmd + 1;
-            }
-        }
+// Once capture has ended, spend what is left of each mutation budget on
+// the latest frame of each shape in turn
+static void replay_fill(KrakenConnectionHandle conn, const KrakenConnectionOps *ops, replay_t *rp) {
+    const shapes_t *sh = &rp->shapes;
+    if (rp->cfg.mutate_frames == 0 || sh->count == 0) return;
+    for (int t = 0; t < NUM_TESTS; t++) {
+        if (t == TEST_REPLAY) continue;
+        for (size_t i = 0; rp->queued[t] < rp->cfg.mutate_frames; i = (i + 1) % sh->count)
+            replay_queue(conn, ops, rp, t, sh->frame[i], sh->len[i]);
+    }
+    replay_flush(conn, ops, rp);
+}
 
-        // Inject Kraken signature
-        size_t new_len = inject_signature(modified, ecat_len);
+// Pop everything captured so far; returns frames consumed
+static size_t replay_drain(KrakenConnectionHandle conn, const KrakenConnectionOps *ops, replay_t *rp, capture_t *cap) {
+    size_t n = kraken_frame_ring_readable(&cap->ring);
+    if (n == 0) return 0;
+    // Frames without a receive timestamp are timed on arrival here
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    int64_t now_ns = (int64_t)now.tv_sec * 1000000000LL + now.tv_nsec;
+    for (size_t i = 0; i < n; i++) {
+        KrakenRingFrame *f = kraken_frame_ring_read_slot(&cap->ring, i);
+        uint8_t *data = kraken_frame_ring_data(f);
+        profile_frame(&rp->profile, data, f->len, f->timestamp_ns);
+        kraken_pcapng_write(&rp->pcap, data, f->len, f->timestamp_ns, KRAKEN_PCAPNG_IN, "captured");
+        bool fresh = shapes_add(&rp->shapes, data, f->len, f->timestamp_ns ? f->timestamp_ns : now_ns, rp->cfg.stable_cycles);
+        replay_frame(conn, ops, rp, data, f->len, fresh);
+    }
+    replay_flush(conn, ops, rp);
+    kraken_frame_ring_consume(&cap->ring, n);
+    return n;
+}
 
-        if (ops->send(conn, modified, new_len, 50) > 0) {
-            sent++;
+/* ------------------------------------------------------------------ */
+/* Inline bridge                                                      */
+/* ------------------------------------------------------------------ */
+
+// The module sits between the master (target interface) and the slaves
+// (bridge_iface) and forwards every EtherCAT frame both ways, rewriting
+// process data within the cycle. Forwarding latency is measured per frame
+// from the kernel receive timestamp to the return from sendmmsg.
+
+static const char *const dir_names[NUM_DIRS] = {"master->slaves", "slaves->master"};
+
+typedef struct {
+    KrakenPacketConduit *in;
+    KrakenPacketConduit *out;
+    uint8_t frames[BRIDGE_BATCH][FRAME_SLOT];
+    uint64_t forwarded;
+    uint64_t rewritten;
+    uint64_t send_errors; // frames received but not forwarded
+    uint64_t over_budget;
+    KrakenHistogram latency; // ns
+} bridge_dir_t;
+
+// Apply the rewrite rules to every datagram of an EtherCAT payload.
+// Returns: true if the frame changed.
+static bool rewrite_frame(uint8_t *p, size_t len, const rewrite_t *rw) {
+    bool changed = false;
+    uint8_t *dg;
+    size_t off = 0, dlen = 0;
+    while ((dg = next_datagram(p, len, &off, &dlen)) != NULL) {
+        uint8_t *data = dg + KRAKEN_ECAT_DGRAM_HDR_LEN;
+        if (rw->lrw_mask && dg[0] == KRAKEN_ECAT_CMD_LRW && dlen > 0) {
+            for (size_t i = 0; i < dlen; i++) data[i] ^= rw->lrw_mask;
+            changed = true;
+        }
+        if (rw->cmd_swap && read_to_write(dg[0]) != dg[0]) {
+            dg[0] = read_to_write(dg[0]);
+            changed = true;
+        }
+        if (rw->wkc_offset) {
+            kraken_ecat_put16(data + dlen, (uint16_t)(kraken_ecat_get16(data + dlen) + rw->wkc_offset));
+            changed = true;
         }
     }
+    return changed;
+}
 
-    char log[128];
-    snprintf(log, sizeof(log), "  Cmd substitution: sent %d frames with changed commands", sent);
-    add_log_v2(result, log);
+// Forward whatever one direction has queued, then profile and record it.
+// Returns: -1 on a receive error, otherwise 0.
+static int bridge_pump(bridge_dir_t *d, int dir, const mitm_config_t *cfg, profile_t *pf, KrakenPcapng *pcap) {
+    KrakenRecvSlot slots[BRIDGE_BATCH];
+    for (size_t i = 0; i < BRIDGE_BATCH; i++) {
+        slots[i].data = d->frames[i];
+        slots[i].size = FRAME_SLOT;
+    }
+    // Only called once poll() reported the socket readable, so this does not wait
+    int64_t got = kraken_conduit_op_recv_batch(d->in, slots, BRIDGE_BATCH, 1);
+    if (got <= 0) return got < 0 ? -1 : 0;
+
+    bool rewrite = (cfg->rewrite.dirs & (1 << dir)) != 0;
+    bool changed[BRIDGE_BATCH] = {0};
+    KrakenBuffer out[BRIDGE_BATCH];
+    for (int64_t i = 0; i < got; i++) {
+        if (rewrite && slots[i].len > KRAKEN_CONDUIT_ETH_HLEN &&
+            rewrite_frame(slots[i].data + KRAKEN_CONDUIT_ETH_HLEN, slots[i].len - KRAKEN_CONDUIT_ETH_HLEN, &cfg->rewrite)) {
+            changed[i] = true;
+            d->rewritten++;
+        }
+        out[i].data = slots[i].data;
+        out[i].len = slots[i].len;
+    }
+    int64_t sent = kraken_conduit_forward(d->out, out, (size_t)got, 1);
+    if (sent < 0) sent = 0;
+
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    int64_t now = (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+    int64_t budget_ns = (int64_t)cfg->budget_us * 1000;
+    for (int64_t i = 0; i < sent; i++) {
+        if (slots[i].timestamp_ns == 0) continue;
+        int64_t lat = now - slots[i].timestamp_ns;
+        if (lat < 0) lat = 0;
+        kraken_hist_record(&d->latency, (uint64_t)lat);
+        if (lat > budget_ns) d->over_budget++;
+    }
+    d->forwarded += (uint64_t)sent;
+    d->send_errors += (uint64_t)(got - sent);
+
+    // Off the forwarding path: the frames are already on their way
+    for (int64_t i = 0; i < got; i++) profile_frame(pf, slots[i].data, slots[i].len, slots[i].timestamp_ns);
+    if (kraken_pcapng_enabled(pcap)) {
+        char comment[48];
+        for (int64_t i = 0; i < sent; i++) {
+            snprintf(comment, sizeof(comment), "%s%s", dir_names[dir], changed[i] ? ", rewritten" : "");
+            kraken_pcapng_write(pcap, slots[i].data, slots[i].len, now, KRAKEN_PCAPNG_OUT, comment);
+        }
+    }
+    return 0;
+}
 
-    return sent;
+static void bridge_log(KrakenRunResultV2 *result, const char *label, const KrakenHistogram *h, uint64_t over, int budget_us) {
+    if (h->total == 0) {
+        kraken_result_logf(result, "  %s latency: no timestamped frames", label);
+        return;
+    }
+    kraken_result_logf(result, "  %s latency: p50 %.1fus p90 %.1fus p99 %.1fus p99.9 %.1fus max %.1fus, %llu over the %dus budget",
+                       label, kraken_hist_percentile(h, 0.50) / 1e3, kraken_hist_percentile(h, 0.90) / 1e3,
+                       kraken_hist_percentile(h, 0.99) / 1e3, kraken_hist_percentile(h, 0.999) / 1e3, h->max / 1e3,
+                       (unsigned long long)over, budget_us);
 }
 
-KRAKEN_API int kraken_run_v2(
-    KrakenConnectionHandle conn,
-    const KrakenConnectionOps *ops,
-    const KrakenTarget *target,
-    uint32_t timeout_ms,
-    const char *params_json,
-    KrakenRunResultV2 **out_result
-) {
-    (void)timeout_ms;
-    (void)params_json;
+static void bridge_finding(KrakenRunResultV2 *result, const mitm_config_t *cfg, const bridge_dir_t *dirs, const profile_t *pf) {
+    KrakenHistogram all;
+    kraken_hist_init(&all);
+    uint64_t forwarded = 0, rewritten = 0, over = 0;
+    for (int d = 0; d < NUM_DIRS; d++) {
+        kraken_hist_merge(&all, &dirs[d].latency);
+        forwarded += dirs[d].forwarded;
+        rewritten += dirs[d].rewritten;
+        over += dirs[d].over_budget;
+    }
 
-    KrakenRunResultV2 *result = calloc(1, sizeof(KrakenRunResultV2));
-    if (!result) return -1;
-    copy_target(&result->target, target);
+    KrakenFindingV2 finding = {0};
+    finding.id = kraken_result_strdup(result, "ecat-mitm-bridge");
+    finding.module_id = kraken_result_strdup(result, "ecat_mitm");
+    finding.success = rewritten > 0 && dirs[DIR_TO_MASTER].forwarded > 0;
+    finding.title = kraken_result_strdup(result, "EtherCAT Inline MITM");
+    finding.severity = kraken_result_strdup(result, finding.success ? "high" : "info");
+    finding.description = kraken_result_sprintf(result,
+        "Bridged %s <-> %s: forwarded %llu frames, rewrote %llu in flight. Forwarding p99 %.1fus against a %dus budget.",
+        result->target.u.ethercat.iface, cfg->bridge_iface, (unsigned long long)forwarded, (unsigned long long)rewritten,
+        kraken_hist_percentile(&all, 0.99) / 1e3, cfg->budget_us);
+    finding.timestamp = (int64_t)time(NULL);
+    finding.target = result->target;
 
-    add_log_v2(result, "Starting EtherCAT MITM tests");
+    char value[64];
+    for (int d = 0; d < NUM_DIRS; d++) {
+        snprintf(value, sizeof(value), "%llu", (unsigned long long)dirs[d].forwarded);
+        kraken_finding_add_evidence(result, &finding, d == DIR_TO_SLAVES ? "forwarded_to_slaves" : "forwarded_to_master", value);
+    }
+    snprintf(value, sizeof(value), "%llu", (unsigned long long)rewritten);
+    kraken_finding_add_evidence(result, &finding, "rewritten", value);
+    snprintf(value, sizeof(value), "%.1f", kraken_hist_percentile(&all, 0.50) / 1e3);
+    kraken_finding_add_evidence(result, &finding, "latency_p50_us", value);
+    snprintf(value, sizeof(value), "%.1f", kraken_hist_percentile(&all, 0.99) / 1e3);
+    kraken_finding_add_evidence(result, &finding, "latency_p99_us", value);
+    snprintf(value, sizeof(value), "%.1f", all.total ? all.max / 1e3 : 0.0);
+    kraken_finding_add_evidence(result, &finding, "latency_max_us", value);
+    snprintf(value, sizeof(value), "%llu", (unsigned long long)over);
+    kraken_finding_add_evidence(result, &finding, "over_budget", value);
+    profile_report(result, &finding, pf);
+    kraken_result_add_finding(result, &finding);
+}
 
-    // First capture some traffic
-    add_log_v2(result, "Phase 1: Capturing traffic (2 seconds)");
-    capture_frames(conn, ops, result, 2000);
+static int run_bridge(KrakenRunResultV2 *result, const mitm_config_t *cfg) {
+    const char *master = result->target.kind == KRAKEN_TARGET_KIND_ETHERCAT ? result->target.u.ethercat.iface : NULL;
+    if (!master || !master[0] || !cfg->bridge_iface[0]) {
+        kraken_result_log(result, "Bridge mode needs the target interface (master side) and bridge_iface (slave side)");
+        return -1;
+    }
+    if (strcmp(master, cfg->bridge_iface) == 0) {
+        kraken_result_log(result, "Bridge mode needs two different interfaces");
+        return -1;
+    }
 
-    int total_sent = 0;
+    KrakenPacketConduit *ports[NUM_DIRS];
+    ports[DIR_TO_SLAVES] = kraken_conduit_open_frame(master, NULL, ECAT_ETHERTYPE);
+    ports[DIR_TO_MASTER] = kraken_conduit_open_frame(cfg->bridge_iface, NULL, ECAT_ETHERTYPE);
+    bridge_dir_t *dirs = calloc(NUM_DIRS, sizeof(*dirs));
+    profile_t *pf = calloc(1, sizeof(*pf));
+    KrakenPcapng pcap;
+    char err[128];
+    if (!ports[0] || !ports[1] || !dirs || !pf) {
+        kraken_result_logf(result, "Bridge: cannot open raw sockets on %s and %s (%s)", master, cfg->bridge_iface,
+                           mitm_strerror(errno, err, sizeof(err)));
+        kraken_conduit_close(ports[0]);
+        kraken_conduit_close(ports[1]);
+        free(dirs);
+        free(pf);
+        return -1;
+    }
+    for (int d = 0; d < NUM_DIRS; d++) {
+        if (kraken_conduit_set_promisc(ports[d]) != 0)
+            kraken_result_logf(result, "  Bridge: promiscuous mode refused on %s, unicast frames may be missed", ports[d]->iface);
+        dirs[d].in = ports[d];
+        dirs[d].out = ports[1 - d];
+        kraken_hist_init(&dirs[d].latency);
+    }
 
-    add_log_v2(result, "Phase 2: Replay attacks");
+    kraken_result_logf(result, "Bridging %s (master) <-> %s (slaves) for %d ms, latency budget %dus",
+                       master, cfg->bridge_iface, cfg->duration_ms, cfg->budget_us);
+    const rewrite_t *rw = &cfg->rewrite;
+    kraken_result_logf(result, "  Rewrite rules (%s): wkc_offset %d, lrw_mask 0x%02x, cmd_swap %s",
+                       rw->dirs == ((1 << DIR_TO_SLAVES) | (1 << DIR_TO_MASTER)) ? "both directions" : dir_names[rw->dirs >> 1],
+                       rw->wkc_offset, rw->lrw_mask, rw->cmd_swap ? "on" : "off");
+    pcap_open(result, &pcap, cfg, master);
+
+    struct pollfd pfd[NUM_DIRS];
+    for (int d = 0; d < NUM_DIRS; d++) {
+        pfd[d].fd = ports[d]->fd;
+        pfd[d].events = POLLIN;
+    }
+    int failed = 0;
+    int64_t end = mitm_now_ns() + (int64_t)cfg->duration_ms * 1000000LL;
+    while (!failed && mitm_now_ns() < end) {
+        int pr = poll(pfd, NUM_DIRS, cfg->busy_poll ? 0 : 10);
+        if (pr < 0 && errno != EINTR) break;
+        for (int d = 0; d < NUM_DIRS && pr > 0; d++) {
+            if ((pfd[d].revents & POLLIN) && bridge_pump(&dirs[d], d, cfg, pf, &pcap) < 0) failed = 1;
+        }
+    }
+    if (failed) kraken_result_logf(result, "  Bridge: receive error (%s), stopping early", mitm_strerror(errno, err, sizeof(err)));
+    pcap_close(result, &pcap);
+
+    for (int d = 0; d < NUM_DIRS; d++) {
+        kraken_result_logf(result, "  %s: forwarded %llu frames, rewrote %llu, %llu not forwarded", dir_names[d],
+                           (unsigned long long)dirs[d].forwarded, (unsigned long long)dirs[d].rewritten,
+                           (unsigned long long)dirs[d].send_errors);
+        bridge_log(result, dir_names[d], &dirs[d].latency, dirs[d].over_budget, cfg->budget_us);
+    }
+    bridge_finding(result, cfg, dirs, pf);
+
+    kraken_conduit_close(ports[0]);
+    kraken_conduit_close(ports[1]);
+    free(dirs);
+    free(pf);
+    return 0;
+}
+
+// Replays the segment sent back to us while capture ran (capture only sees
+// received frames)
+static void stamp_report(KrakenRunResultV2 *result, KrakenFindingV2 *finding, const KrakenStampStats *st, int sent) {
+    char value[256];
+    int n = snprintf(value, sizeof(value), "%llu of %d seen again, %llu reordered, %llu duplicates", (unsigned long long)st->received,
+                     sent, (unsigned long long)st->reordered, (unsigned long long)st->duplicates);
+    if (st->latency.total > 0 && n > 0 && (size_t)n < sizeof(value)) {
+        snprintf(value + n, sizeof(value) - (size_t)n, ", round trip p50 %.1fus p99 %.1fus max %.1fus", kraken_hist_percentile(&st->latency, 0.50) / 1e3,
+                 kraken_hist_percentile(&st->latency, 0.99) / 1e3, st->latency.max / 1e3);
+    }
+    kraken_result_logf(result, "  Stamped replays: %s", value);
+    kraken_finding_add_evidence(result, finding, "stamps", value);
+}
 
-    add_log_v2(result, "Test 1: Simple replay");
-    total_sent += test_replay(conn, ops, result);
+static int run_mitm_tests(KrakenConnectionHandle conn, const KrakenConnectionOps *ops,
+                          KrakenRunResultV2 *result, uint32_t timeout_ms, const char *params_json) {
+    (void)timeout_ms;
+
+    kraken_result_log(result, "Starting EtherCAT MITM tests");
+
+    mitm_config_t cfg;
+    load_config(&cfg, params_json, result);
+    if (cfg.mode == MITM_MODE_BRIDGE) return run_bridge(result, &cfg);
 
-    add_log_v2(result, "Test 2: Modified WKC");
-    total_sent += test_modified_wkc(conn, ops, result);
+    replay_t *rp = calloc(1, sizeof(*rp));
+    capture_t *cap = calloc(1, sizeof(*cap));
+    if (!rp || !cap) {
+        free(rp);
+        free(cap);
+        return -1;
+    }
+    rp->cfg = cfg;
+    rp->run_id = (uint32_t)(time(NULL) ^ (uint32_t)mitm_now_ns()) | 1;
+    kraken_stamp_stats_init(&cap->stamps, rp->run_id);
+    if (kraken_frame_ring_init(&cap->ring, (size_t)rp->cfg.ring_frames, FRAME_SLOT) != 0) {
+        free(rp);
+        free(cap);
+        return -1;
+    }
 
-    add_log_v2(result, "Test 3: Corrupted data");
-    total_sent += test_corrupted_data(conn, ops, result);
+    kraken_result_logf(result, "Capturing and replaying for up to %d ms through a %zu-frame ring",
+                       rp->cfg.duration_ms, kraken_frame_ring_slots(&cap->ring));
+    pcap_open(result, &rp->pcap, &rp->cfg, result->target.kind == KRAKEN_TARGET_KIND_ETHERCAT ? result->target.u.ethercat.iface : NULL);
+    const KrakenConnectionInfo *info = ops->get_info ? ops->get_info(conn) : NULL;
+    kraken_pcapng_set_source(&rp->pcap, info ? info->local_addr : NULL);
+    bool threaded = capture_start(cap, conn, ops);
+    if (!threaded) kraken_result_log(result, "  Runner cannot open a capture conduit; capturing between replays");
+    if (cap->filtered) kraken_result_log(result, "  Conduit filters for EtherCAT frames");
+
+    // Replay runs while capture continues, until the cycle is learned
+    int64_t start = mitm_now_ns();
+    int64_t end = start + (int64_t)rp->cfg.duration_ms * 1000000LL;
+    while (mitm_now_ns() < end && !rp->shapes.learned) {
+        if (!threaded) {
+            if (capture_step(cap, 1) < 0) break;
+        } else if (__atomic_load_n(&cap->failed, __ATOMIC_ACQUIRE)) {
+            break;
+        }
+        if (replay_drain(conn, ops, rp, cap) == 0 && threaded) {
+            struct timespec idle = {0, 200000};
+            nanosleep(&idle, NULL);
+        }
+    }
+    int64_t capture_ns = mitm_now_ns() - start;
+    capture_stop(cap);
+    int sent_capturing = 0; // replays sent while capture could still see them
+    for (int t = 0; t < NUM_TESTS; t++) sent_capturing += rp->sent[t];
+    replay_drain(conn, ops, rp, cap);
+    replay_fill(conn, ops, rp);
+    pcap_close(result, &rp->pcap);
+
+    kraken_result_logf(result, "  Captured %llu EtherCAT frames, %llu dropped with the ring full (peak %llu queued)",
+                       (unsigned long long)cap->captured, (unsigned long long)cap->ring.dropped, (unsigned long long)cap->ring.peak);
+    if (cap->captured > 1 && cap->first_ns && cap->last_ns) {
+        kraken_result_logf(result, "  Capture span: %.3f ms, %s receive timestamps", (cap->last_ns - cap->first_ns) / 1e6, cap->clock);
+    }
+    if (cap->truncated > 0)
+        kraken_result_logf(result, "  %llu frames were longer than a %d-byte ring slot and were replayed truncated", (unsigned long long)cap->truncated, FRAME_SLOT);
+    const shapes_t *sh = &rp->shapes;
+    if (sh->learned)
+        kraken_result_logf(result, "  Cycle learned after %.1f ms: %zu frame shapes, period %.1fus", capture_ns / 1e6, sh->count, sh->period_ns / 1e3);
+    else
+        kraken_result_logf(result, "  Cycle not learned, captured for %.1f ms: %zu frame shapes%s", capture_ns / 1e6, sh->count,
+                           sh->untracked ? " (shape table full)" : "");
 
-    add_log_v2(result, "Test 4: Command substitution");
-    total_sent += test_cmd_substitution(conn, ops, result);
+    int total_sent = 0;
+    for (int t = 0; t < NUM_TESTS; t++) {
+        kraken_result_logf(result, "Test %d: %s", t + 1, tests[t].name);
+        if (cap->captured == 0)
+            kraken_result_logf(result, "  %s: no frames", tests[t].name);
+        else
+            kraken_result_logf(result, "  %s: sent %d %s", tests[t].name, rp->sent[t], tests[t].what);
+        total_sent += rp->sent[t];
+    }
 
-    char summary[256];
-    snprintf(summary, sizeof(summary), "MITM tests complete. Captured %zu, replayed/modified %d frames",
-             capture_count, total_sent);
-    add_log_v2(result, summary);
+    kraken_result_logf(result, "MITM tests complete. Captured %llu, replayed/modified %d frames",
+                       (unsigned long long)cap->captured, total_sent);
 
     KrakenFindingV2 finding = {0};
-    finding.id = mystrdup("ecat-mitm");
-    finding.module_id = mystrdup("ecat_mitm");
-    finding.success = (capture_count > 0 && total_sent > 0);
-    finding.title = mystrdup("EtherCAT MITM Testing");
-    finding.severity = mystrdup(finding.success ? "high" : "info");
-
-    snprintf(summary, sizeof(summary),
-             "Captured %zu frames, replayed %d modified. Tests replay, WKC mod, corruption, cmd sub.",
-             capture_count, total_sent);
-    finding.description = mystrdup(summary);
+    finding.id = kraken_result_strdup(result, "ecat-mitm");
+    finding.module_id = kraken_result_strdup(result, "ecat_mitm");
+    finding.success = (cap->captured > 0 && total_sent > 0);
+    finding.title = kraken_result_strdup(result, "EtherCAT MITM Testing");
+    finding.severity = kraken_result_strdup(result, finding.success ? "high" : "info");
+
+    finding.description = kraken_result_sprintf(result,
+        "Captured %llu frames, replayed %d modified. Tests replay, WKC mod, corruption, cmd sub.",
+        (unsigned long long)cap->captured, total_sent);
     finding.timestamp = (int64_t)time(NULL);
-    copy_target(&finding.target, target);
+    finding.target = result->target;
+    char value[32];
+    snprintf(value, sizeof(value), "%zu", sh->count);
+    kraken_finding_add_evidence(result, &finding, "capture.shapes", value);
+    snprintf(value, sizeof(value), "%.1f", capture_ns / 1e6);
+    kraken_finding_add_evidence(result, &finding, "capture.ms", value);
+    kraken_finding_add_evidence(result, &finding, "capture.learned", sh->learned ? "true" : "false");
+    kraken_finding_add_evidence(result, &finding, "capture.clock", cap->clock ? cap->clock : "none");
+    if (sh->period_ns > 0) {
+        snprintf(value, sizeof(value), "%.1f", sh->period_ns / 1e3);
+        kraken_finding_add_evidence(result, &finding, "capture.period_us", value);
+    }
+    stamp_report(result, &finding, &cap->stamps, sent_capturing);
+    profile_report(result, &finding, &rp->profile);
 
-    add_finding_v2(result, &finding);
+    kraken_result_add_finding(result, &finding);
 
-    *out_result = result;
+    kraken_frame_ring_free(&cap->ring);
+    free(cap);
+    free(rp);
     return 0;
 }
 
+KRAKEN_API int kraken_run_v2(
+    KrakenConnectionHandle conn,
+    const KrakenConnectionOps *ops,
+    const KrakenTarget *target,
+    uint32_t timeout_ms,
+    const char *params_json,
+    KrakenRunResultV2 **out_result
+) {
+    return kraken_result_run_v2(run_mitm_tests, conn, ops, target, timeout_ms, params_json, out_result);
+}
+
+KRAKEN_API int kraken_run_v3(
+    KrakenConnectionHandle conn,
+    const KrakenConnectionOps *ops,
+    const KrakenTarget *target,
+    uint32_t timeout_ms,
+    const char *params_json,
+    const KrakenResultSink *sink
+) {
+    return kraken_result_run_v3(run_mitm_tests, conn, ops, target, timeout_ms, params_json, sink);
+}
+
 KRAKEN_API void kraken_free_v2(void *p) {
-    if (!p) return;
-    KrakenRunResultV2 *r = (KrakenRunResultV2 *)p;
-    for (size_t i = 0; i < r->logs.count; i++)
-        free((void *)r->logs.strings[i]);
-    free((void *)r->logs.strings);
-    for (size_t i = 0; i < r->findings_count; i++) {
-        KrakenFindingV2 *f = &r->findings[i];
-        free((void *)f->id);
-        free((void *)f->module_id);
-        free((void *)f->title);
-        free((void *)f->severity);
-        free((void *)f->description);
-        free_target(&f->target);
-    }
-    free(r->findings);
-    free_target(&r->target);
-    free(r);
+    kraken_result_free(p);
 }
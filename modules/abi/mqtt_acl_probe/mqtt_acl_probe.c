@@ -1,11 +1,16 @@
 #define KRAKEN_MODULE_BUILD
 #include <kraken_module_abi_v2.h>
+#include <kraken_module_abi_v3.h>
+#include <kraken_mqtt.h>
+#include <kraken_params.h>
+#include <kraken_result.h>
 
 #include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <unistd.h>
 
 KRAKEN_API const uint32_t KRAKEN_MODULE_ABI_VERSION_V2 = KRAKEN_ABI_VERSION_V2;
 static const char *MODULE_ID = "mqtt-acl-probe";
@@ -34,170 +39,86 @@ static void free_cred_list(cred_list_t *cl) {
 
 /* MQTT helpers */
 typedef struct {
-    uint8_t buf[1024];
-    size_t len;
-} mqtt_packet_t;
-
-static int mqtt_encode_string(uint8_t *buf, const char *s) {
-    size_t len = strlen(s);
-    if (len > 65535) return -1;
-    buf[0] = (uint8_t)(len >> 8);
-    buf[1] = (uint8_t)(len & 0xFF);
-    memcpy(buf + 2, s, len);
-    return (int)(len + 2);
-}
-
-static int mqtt_build_connect(mqtt_packet_t *pkt, const char *client_id, const char *user, const char *pass) {
-    pkt->len = 0;
-    uint8_t *p = pkt->buf;
-    const char *proto = "MQTT";
-    int wrote = mqtt_encode_string(p, proto);
-    if (wrote < 0) return -1;
-    p += wrote;
-    *p++ = 4; // Protocol level 3.1.1
-    uint8_t flags = 0;
-    if (user && *user) flags |= 0x80;
-    if (pass && *pass) flags |= 0x40;
-    *p++ = flags;
-    *p++ = 0;
-    *p++ = 60; // Keepalive 60s
-    wrote = mqtt_encode_string(p, client_id);
-    if (wrote < 0) return -1;
-    p += wrote;
-    if (user && *user) {
-        wrote = mqtt_encode_string(p, user);
-        if (wrote < 0) return -1;
-        p += wrote;
-    }
-    if (pass && *pass) {
-        wrote = mqtt_encode_string(p, pass);
-        if (wrote < 0) return -1;
-        p += wrote;
-    }
+    KrakenMqttReader rd;
+    uint8_t rx[2048];
+} mqtt_session_t;
 
-    size_t rem_len = p - pkt->buf;
-    uint8_t head[5];
-    size_t hl = 1;
-    head[0] = 0x10; // CONNECT
-    size_t x = rem_len;
-    do {
-        uint8_t b = x % 128;
-        x /= 128;
-        if (x > 0) b |= 128;
-        head[hl++] = b;
-    } while (x > 0);
-
-    if (rem_len + hl > sizeof(pkt->buf)) return -1;
-    memmove(pkt->buf + hl, pkt->buf, rem_len);
-    memcpy(pkt->buf, head, hl);
-    pkt->len = rem_len + hl;
-    return (int)pkt->len;
-}
-
-static int mqtt_build_subscribe(mqtt_packet_t *pkt, const char *topic) {
-    pkt->len = 0;
-    uint8_t *p = pkt->buf;
-    size_t topic_len = strlen(topic);
-    size_t rem_len = 2 + 2 + topic_len + 1;
-    *p++ = 0x82; // SUBSCRIBE QoS1
-    *p++ = (uint8_t)rem_len;
-    *p++ = 0;
-    *p++ = 1; // Packet ID
-    int wrote = mqtt_encode_string(p, topic);
-    if (wrote < 0) return -1;
-    p += wrote;
-    *p++ = 0; // QoS 0
-    pkt->len = p - pkt->buf;
-    return (int)pkt->len;
-}
-
-static int mqtt_build_publish_qos1(mqtt_packet_t *pkt, const char *topic, const char *msg) {
-    pkt->len = 0;
-    uint8_t *p = pkt->buf;
-    *p++ = 0x32; // PUBLISH QoS1
-    size_t topic_len = strlen(topic);
-    size_t msg_len = strlen(msg);
-    size_t rem_len = 2 + topic_len + 2 + msg_len; // topic len + packet id + payload
-    size_t rem_temp = rem_len;
-    do {
-        uint8_t b = rem_temp % 128;
-        rem_temp /= 128;
-        if (rem_temp > 0) b |= 128;
-        *p++ = b;
-    } while (rem_temp > 0);
-    int wrote = mqtt_encode_string(p, topic);
-    if (wrote < 0) return -1;
-    p += wrote;
-    *p++ = 0; // Packet ID MSB
-    *p++ = 2; // Packet ID LSB
-    memcpy(p, msg, msg_len);
-    p += msg_len;
-    pkt->len = p - pkt->buf;
-    return (int)pkt->len;
-}
+#define MQTT_AWAIT_MAX_READS 8
 
 static int send_all(const KrakenConnectionOps *ops, KrakenConnectionHandle conn, const uint8_t *buf, size_t len, uint32_t timeout_ms) {
     int64_t sent = ops->send(conn, buf, len, timeout_ms);
     return sent == (int64_t)len ? 0 : -1;
 }
 
-static int recv_into(const KrakenConnectionOps *ops, KrakenConnectionHandle conn, uint8_t *buf, size_t bufsize, uint32_t timeout_ms) {
-    int64_t got = ops->recv(conn, buf, bufsize, timeout_ms);
-    if (got <= 0) return -1;
-    return (int)got;
-}
-
-static bool parse_connack_ok(const uint8_t *buf, size_t n, uint8_t *reason_out) {
-    if (n < 4 || buf[0] != 0x20) return false;
-    if (reason_out) *reason_out = buf[3];
-    return buf[3] == 0x00;
-}
-
-static bool parse_suback_ok(const uint8_t *buf, size_t n, uint8_t *reason_out) {
-    if (n < 5 || buf[0] != 0x90) return false;
-    if (reason_out) *reason_out = buf[n - 1];
-    return buf[n - 1] <= 0x02;
+// Send an encoder result; rejects encode failures (0) and overflows (> cap)
+static int send_packet(const KrakenConnectionOps *ops, KrakenConnectionHandle conn, const uint8_t *pkt, size_t len, size_t cap, uint32_t timeout_ms) {
+    if (len == 0 || len > cap) return -1;
+    return send_all(ops, conn, pkt, len, timeout_ms);
 }
 
-static bool parse_puback_ok(const uint8_t *buf, size_t n, uint8_t *reason_out) {
-    if (n < 4 || buf[0] != 0x40) return false;
-    if (reason_out) *reason_out = buf[n - 1];
-    return true;
+// Read until a packet of `type` is framed, skipping others (e.g. the broker
+// delivering our own probe PUBLISH ahead of its PUBACK).
+static bool mqtt_await(const KrakenConnectionOps *ops, KrakenConnectionHandle conn, mqtt_session_t *s, uint8_t type, uint32_t timeout_ms,
+                       KrakenMqttFrame *f) {
+    int reads = 0;
+    for (;;) {
+        int rc = kraken_mqtt_reader_next(&s->rd, f);
+        if (rc < 0) return false;
+        if (rc == 1) {
+            if (f->type == type) return true;
+            continue;
+        }
+        if (reads++ >= MQTT_AWAIT_MAX_READS) return false;
+        size_t room;
+        uint8_t *dst = kraken_mqtt_reader_space(&s->rd, &room);
+        int64_t got = ops->recv(conn, dst, room, timeout_ms);
+        if (got <= 0) return false;
+        kraken_mqtt_reader_commit(&s->rd, got);
+    }
 }
-
-static void add_acl_finding(KrakenRunResultV2 *res, const KrakenTarget *target, const char *id, const char *title, const char *severity, const char *desc, const cred_t *cred,
+static void add_acl_finding(KrakenRunResultV2 *res, const char *id, const char *title, const char *severity, const char *desc, const cred_t *cred,
                             bool success) {
     KrakenFindingV2 f = {0};
-    f.id = mystrdup(id);
-    f.module_id = mystrdup(MODULE_ID);
+    f.id = kraken_result_strdup(res, id);
+    f.module_id = kraken_result_strdup(res, MODULE_ID);
     f.success = success;
-    f.title = mystrdup(title);
-    f.severity = mystrdup(severity);
-    f.description = mystrdup(desc);
+    f.title = kraken_result_strdup(res, title);
+    f.severity = kraken_result_strdup(res, severity);
+    f.description = kraken_result_strdup(res, desc);
     f.timestamp = time(NULL);
-    copy_target(&f.target, target);
+    f.target = res->target;
 
-    f.tags.count = 2;
-    f.tags.strings = (const char **)malloc(2 * sizeof(char *));
-    f.tags.strings[0] = mystrdup("mqtt");
-    f.tags.strings[1] = mystrdup("acl");
+    kraken_finding_add_tag(res, &f, "mqtt");
+    kraken_finding_add_tag(res, &f, "acl");
 
     if (cred) {
-        f.evidence.count = 2;
-        f.evidence.items = (KrakenKeyValue *)calloc(f.evidence.count, sizeof(KrakenKeyValue));
-        f.evidence.items[0].key = mystrdup("username");
-        f.evidence.items[0].value = mystrdup(cred->user ? cred->user : "");
-        f.evidence.items[1].key = mystrdup("password");
-        f.evidence.items[1].value = mystrdup(cred->pass ? cred->pass : "");
+        kraken_finding_add_evidence(res, &f, "username", cred->user ? cred->user : "");
+        kraken_finding_add_evidence(res, &f, "password", cred->pass ? cred->pass : "");
     }
 
-    add_finding_v2(res, &f);
+    kraken_result_add_finding(res, &f);
 }
 
 static void log_prefixed(KrakenRunResultV2 *res, const char *msg) {
-    char buf[256];
-    snprintf(buf, sizeof(buf), "%s%s", LOG_PREFIX, msg);
-    add_log_v2(res, buf);
+    kraken_result_logf(res, "%s%s", LOG_PREFIX, msg);
+}
+
+static void append_cred(cred_list_t *cl, char *line) {
+    char *sep = strchr(line, ':');
+    char *user = NULL;
+    char *pass = NULL;
+    if (sep) {
+        *sep = '\0';
+        user = mystrdup(line);
+        pass = mystrdup(sep + 1);
+    } else {
+        user = mystrdup(line);
+        pass = mystrdup("");
+    }
+    cl->list = (cred_t *)realloc(cl->list, (cl->count + 1) * sizeof(cred_t));
+    cl->list[cl->count].user = user;
+    cl->list[cl->count].pass = pass;
+    cl->count++;
 }
 
 static cred_list_t load_creds(const char *path) {
@@ -211,58 +132,129 @@ static cred_list_t load_creds(const char *path) {
         size_t len = strlen(line);
         while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) line[--len] = '\0';
         if (len == 0 || line[0] == '#') continue;
-        char *sep = strchr(line, ':');
-        char *user = NULL;
-        char *pass = NULL;
-        if (sep) {
-            *sep = '\0';
-            user = mystrdup(line);
-            pass = mystrdup(sep + 1);
-        } else {
-            user = mystrdup(line);
-            pass = mystrdup("");
-        }
-        cl.list = (cred_t *)realloc(cl.list, (cl.count + 1) * sizeof(cred_t));
-        cl.list[cl.count].user = user;
-        cl.list[cl.count].pass = pass;
-        cl.count++;
+        append_cred(&cl, line);
     }
     fclose(f);
     return cl;
 }
 
-static uint32_t extract_timeout(const char *params_json, uint32_t def) {
-    if (!params_json) return def;
-    const char *t = strstr(params_json, "timeout_ms");
-    if (!t) return def;
-    const char *colon = strchr(t, ':');
-    if (!colon) return def;
-    uint32_t v = (uint32_t)strtoul(colon + 1, NULL, 10);
-    return v ? v : def;
-}
-
-static char *extract_string_param(const char *params_json, const char *key) {
-    if (!params_json || !key) return NULL;
-    const char *p = strstr(params_json, key);
-    if (!p) return NULL;
-    const char *colon = strchr(p, ':');
-    if (!colon) return NULL;
-    const char *q = strchr(colon, '\"');
-    if (!q) return NULL;
-    q++; // after quote
-    const char *end = strchr(q, '\"');
-    if (!end) return NULL;
-    size_t len = (size_t)(end - q);
-    char *out = (char *)malloc(len + 1);
-    if (out) {
-        memcpy(out, q, len);
-        out[len] = '\0';
+// Inline "user:pass" entries from the "creds" array parameter
+static void load_inline_creds(cred_list_t *cl, const KrakenParams *params) {
+    size_t count = 0;
+    const KrakenJsonTok *arr = kraken_params_array(params, "creds", &count);
+    for (size_t i = 0; i < count; i++) {
+        char line[512];
+        if (kraken_params_tok_string(params, kraken_params_at(params, arr, i), line, sizeof(line)) <= 0) continue;
+        append_cred(cl, line);
     }
-    return out;
 }
 
-static int probe_credential(KrakenRunResultV2 *res, const KrakenTarget *target, const KrakenConnectionOps *ops, KrakenConnectionHandle base_conn, const cred_t *cred,
-                            const char *topic, uint32_t timeout_ms, bool reuse_conn, bool *connect_ok_out, bool *sub_ok_out, bool *pub_ok_out) {
+// Client ids unique across concurrent runs in one process and across
+// processes: a per-run tag plus a per-run counter.
+typedef struct {
+    uint32_t run;
+    uint32_t next;
+} client_ids_t;
+
+static void client_ids_init(client_ids_t *ids) {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    uint64_t x = (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+    x ^= (uint64_t)getpid() << 32 ^ (uint64_t)(uintptr_t)ids;
+    x *= 0x9E3779B97F4A7C15ULL; // spread the low bits that differ between runs
+    ids->run = (uint32_t)(x >> 32);
+    ids->next = 0;
+}
+
+static void client_id(client_ids_t *ids, char *buf, size_t size) {
+    snprintf(buf, size, "acl-%08x%08x", ids->run, ids->next++);
+}
+
+static size_t encode_connect(uint8_t *pkt, size_t cap, uint8_t version, const cred_t *cred, const char *cid) {
+    KrakenMqttConnect c = {
+        .version = version,
+        .client_id = cid,
+        .username = cred ? cred->user : NULL,
+        .password = cred ? cred->pass : NULL,
+        .keep_alive = 60,
+    };
+    return kraken_mqtt_encode_connect(pkt, cap, &c);
+}
+
+static size_t encode_subscribe(uint8_t *pkt, size_t cap, uint8_t version, const char *topic) {
+    KrakenMqttSubscription sub = {.topic = topic, .options = 0};
+    KrakenMqttSubscribe sreq = {.version = version, .packet_id = 1, .subs = &sub, .count = 1};
+    return kraken_mqtt_encode_subscribe(pkt, cap, &sreq);
+}
+
+// PUBLISH QoS1
+static size_t encode_publish(uint8_t *pkt, size_t cap, uint8_t version, const char *topic) {
+    const char *payload = "kraken-acl-probe";
+    KrakenMqttPublishOut pub = {
+        .version = version,
+        .topic = topic,
+        .payload = payload,
+        .payload_len = strlen(payload),
+        .qos = 1,
+        .packet_id = 2,
+    };
+    return kraken_mqtt_encode_publish(pkt, cap, &pub);
+}
+
+// Outcome reporting shared by the sequential and the concurrent probe. `f`
+// is the awaited packet, NULL when none arrived; `prefix` tags the log lines.
+static bool report_connack(KrakenRunResultV2 *res, const char *prefix, uint8_t version, const KrakenMqttFrame *f) {
+    KrakenMqttConnack ack;
+    if (!f || kraken_mqtt_parse_connack(f, version, &ack) != 0) {
+        kraken_result_logf(res, "%sCONNECT rejected", prefix);
+        return false;
+    }
+    if (ack.reason_code != 0) {
+        kraken_result_logf(res, "%sCONNECT rejected: %s (0x%02x)", prefix, kraken_mqtt_reason_name(version, ack.reason_code), ack.reason_code);
+        return false;
+    }
+    kraken_result_logf(res, "%sCONNECT accepted", prefix);
+    return true;
+}
+
+static bool report_suback(KrakenRunResultV2 *res, const char *prefix, const cred_t *cred, uint8_t version, const KrakenMqttFrame *f) {
+    KrakenMqttSuback suback;
+    bool sub_ok = f && kraken_mqtt_parse_suback(f, version, &suback) == 0 && suback.count > 0;
+    if (sub_ok && suback.reason_codes[0] > 0x02) {
+        kraken_result_logf(res, "%sSUBSCRIBE rejected: %s (0x%02x)", prefix, kraken_mqtt_reason_name(version, suback.reason_codes[0]),
+                           suback.reason_codes[0]);
+        sub_ok = false;
+    } else if (!sub_ok) {
+        kraken_result_logf(res, "%sSUBSCRIBE rejected", prefix);
+    }
+    if (sub_ok) {
+        add_acl_finding(res, "MQTT-ACL-SUB", "MQTT SUBSCRIBE to probe topic", "high", "Probe topic subscription accepted.", cred, true);
+    }
+    return sub_ok;
+}
+
+static bool report_puback(KrakenRunResultV2 *res, const char *prefix, const cred_t *cred, uint8_t version, const KrakenMqttFrame *f) {
+    KrakenMqttAck puback;
+    bool pub_ok = f && kraken_mqtt_parse_ack(f, version, &puback) == 0;
+    if (pub_ok && puback.reason_code >= 0x80) {
+        kraken_result_logf(res, "%sPUBLISH rejected: %s (0x%02x)", prefix, kraken_mqtt_reason_name(version, puback.reason_code), puback.reason_code);
+        pub_ok = false;
+    } else if (!pub_ok) {
+        kraken_result_logf(res, "%sPUBLISH not acknowledged", prefix);
+    }
+    if (pub_ok) {
+        add_acl_finding(res, "MQTT-ACL-PUB", "MQTT PUBLISH to probe topic", "high", "Probe topic publish acknowledged.", cred, true);
+    }
+    return pub_ok;
+}
+
+static void report_subscribe_send_failed(KrakenRunResultV2 *res, const char *prefix, const cred_t *cred) {
+    kraken_result_logf(res, "%sSUBSCRIBE send failed", prefix);
+    add_acl_finding(res, "MQTT-ACL-SUB", "MQTT SUBSCRIBE to probe topic", "info", "Probe topic subscription send failed.", cred, false);
+}
+
+static int probe_credential(KrakenRunResultV2 *res, const KrakenConnectionOps *ops, KrakenConnectionHandle base_conn, client_ids_t *ids,
+                            const cred_t *cred, const char *topic, uint8_t version, uint32_t timeout_ms, bool reuse_conn, bool *connect_ok_out, bool *sub_ok_out, bool *pub_ok_out) {
     if (connect_ok_out) *connect_ok_out = false;
     if (sub_ok_out) *sub_ok_out = false;
     if (pub_ok_out) *pub_ok_out = false;
@@ -276,144 +268,324 @@ static int probe_credential(KrakenRunResultV2 *res, const KrakenTarget *target,
     }
 
     char cid[48];
-    snprintf(cid, sizeof(cid), "acl-%u", (unsigned)rand());
+    client_id(ids, cid, sizeof(cid));
 
-    mqtt_packet_t pkt;
-    if (mqtt_build_connect(&pkt, cid, cred ? cred->user : NULL, cred ? cred->pass : NULL) < 0) {
-        log_prefixed(res, "failed to build CONNECT");
+    mqtt_session_t *s = malloc(sizeof(*s));
+    if (!s) {
         if (opened && ops->close) ops->close(h);
         return -1;
     }
-    if (send_all(ops, h, pkt.buf, pkt.len, timeout_ms) != 0) {
+    kraken_mqtt_reader_init(&s->rd, s->rx, sizeof(s->rx));
+
+    uint8_t pkt[1024];
+    if (send_packet(ops, h, pkt, encode_connect(pkt, sizeof(pkt), version, cred, cid), sizeof(pkt), timeout_ms) != 0) {
         log_prefixed(res, "CONNECT send failed");
+        free(s);
         if (opened && ops->close) ops->close(h);
         return -1;
     }
-    uint8_t resp[128];
-    int n = recv_into(ops, h, resp, sizeof(resp), timeout_ms);
-    uint8_t reason = 0xff;
-    bool conn_ok = n > 0 && parse_connack_ok(resp, (size_t)n, &reason);
-    if (conn_ok) {
-        if (connect_ok_out) *connect_ok_out = true;
-        log_prefixed(res, "CONNECT accepted");
-    } else {
-        log_prefixed(res, "CONNECT rejected");
+    KrakenMqttFrame f;
+    bool got = mqtt_await(ops, h, s, KRAKEN_MQTT_CONNACK, timeout_ms, &f);
+    if (!report_connack(res, LOG_PREFIX, version, got ? &f : NULL)) {
+        free(s);
         if (opened && ops->close) ops->close(h);
         return 0;
     }
+    if (connect_ok_out) *connect_ok_out = true;
 
     // SUBSCRIBE
-    if (mqtt_build_subscribe(&pkt, topic) < 0 || send_all(ops, h, pkt.buf, pkt.len, timeout_ms) != 0) {
-        log_prefixed(res, "SUBSCRIBE send failed");
-        add_acl_finding(res, target, "MQTT-ACL-SUB", "MQTT SUBSCRIBE to probe topic", "info", "Probe topic subscription send failed.", cred, false);
+    if (send_packet(ops, h, pkt, encode_subscribe(pkt, sizeof(pkt), version, topic), sizeof(pkt), timeout_ms) != 0) {
+        report_subscribe_send_failed(res, LOG_PREFIX, cred);
+        free(s);
         if (opened && ops->close) ops->close(h);
         return 0;
     }
-    n = recv_into(ops, h, resp, sizeof(resp), timeout_ms);
-    uint8_t sub_reason = 0xff;
-    bool sub_ok = n > 0 && parse_suback_ok(resp, (size_t)n, &sub_reason);
+    got = mqtt_await(ops, h, s, KRAKEN_MQTT_SUBACK, timeout_ms, &f);
+    bool sub_ok = report_suback(res, LOG_PREFIX, cred, version, got ? &f : NULL);
     if (sub_ok_out) *sub_ok_out = sub_ok;
-    if (sub_ok) {
-        add_acl_finding(res, target, "MQTT-ACL-SUB", "MQTT SUBSCRIBE to probe topic", "high", "Probe topic subscription accepted.", cred, true);
-    } else {
-        log_prefixed(res, "SUBSCRIBE rejected");
-    }
 
-    // PUBLISH QoS1
-    const char *payload = "kraken-acl-probe";
-    if (mqtt_build_publish_qos1(&pkt, topic, payload) >= 0 && send_all(ops, h, pkt.buf, pkt.len, timeout_ms) == 0) {
-        n = recv_into(ops, h, resp, sizeof(resp), timeout_ms);
-        if (n <= 0) {
-            // Retry once in case broker is slow to ACK
-            n = recv_into(ops, h, resp, sizeof(resp), timeout_ms);
-        }
-        uint8_t pub_reason = 0xff;
-        bool pub_ok = n > 0 && parse_puback_ok(resp, (size_t)n, &pub_reason);
+    // PUBLISH
+    if (send_packet(ops, h, pkt, encode_publish(pkt, sizeof(pkt), version, topic), sizeof(pkt), timeout_ms) == 0) {
+        // A subscribed broker may deliver the probe message before the PUBACK
+        got = mqtt_await(ops, h, s, KRAKEN_MQTT_PUBACK, timeout_ms, &f);
+        bool pub_ok = report_puback(res, LOG_PREFIX, cred, version, got ? &f : NULL);
         if (pub_ok_out) *pub_ok_out = pub_ok;
-        if (pub_ok) {
-            add_acl_finding(res, target, "MQTT-ACL-PUB", "MQTT PUBLISH to probe topic", "high", "Probe topic publish acknowledged.", cred, true);
-        } else {
-            log_prefixed(res, "PUBLISH not acknowledged");
-        }
     } else {
         log_prefixed(res, "PUBLISH send failed");
     }
 
+    free(s);
     if (opened && ops->close) ops->close(h);
     return 0;
 }
 
-KRAKEN_API int kraken_run_v2(KrakenConnectionHandle conn, const KrakenConnectionOps *ops, const KrakenTarget *target, uint32_t timeout_ms,
-                             const char *params_json, KrakenRunResultV2 **out_result) {
-    srand((unsigned)time(NULL));
+/* ------------------------------------------------------------------ */
+/* Concurrent credential probing over ops->async                      */
+/* ------------------------------------------------------------------ */
+
+#define ACL_DEFAULT_CONCURRENCY 32
+#define ACL_MAX_CONCURRENCY 1024
+#define ACL_POLL_MS 1000
+
+// Each probe walks these stages on its own connection with exactly one
+// request in flight; the completion's user_data is the probe's slot.
+typedef enum {
+    ACL_OPEN,
+    ACL_CONNECT,
+    ACL_CONNACK,
+    ACL_SUBSCRIBE,
+    ACL_SUBACK,
+    ACL_PUBLISH,
+    ACL_PUBACK,
+} acl_stage_t;
+
+typedef struct {
+    const cred_t *cred; // NULL while the slot is idle
+    acl_stage_t stage;
+    KrakenConnectionHandle conn;
+    int reads;
+    char prefix[160];
+    char cid[48];
+    uint8_t pkt[1024];
+    mqtt_session_t s;
+} acl_probe_t;
+
+typedef struct {
+    KrakenRunResultV2 *res;
+    const KrakenConnectionOps *ops;
+    KrakenAsyncQueue q;
+    client_ids_t *ids;
+    const char *topic;
+    uint8_t version;
+    uint32_t timeout_ms;
+} acl_async_t;
+
+static bool acl_submit(acl_async_t *a, acl_probe_t *p, uint32_t slot, KrakenAsyncOpcode opcode, size_t len) {
+    KrakenAsyncRequest req = {.opcode = opcode, .conn = p->conn, .timeout_ms = a->timeout_ms, .user_data = slot};
+    if (opcode == KRAKEN_ASYNC_SEND) {
+        req.data = p->pkt;
+        req.len = len;
+    } else if (opcode == KRAKEN_ASYNC_RECV) {
+        req.buffer = kraken_mqtt_reader_space(&p->s.rd, &req.len);
+    }
+    return a->ops->async->submit(a->q, &req, 1) == 1;
+}
+
+static bool acl_send(acl_async_t *a, acl_probe_t *p, uint32_t slot, acl_stage_t stage, size_t len) {
+    p->stage = stage;
+    return len > 0 && len <= sizeof(p->pkt) && acl_submit(a, p, slot, KRAKEN_ASYNC_SEND, len);
+}
 
-    KrakenRunResultV2 *result = (KrakenRunResultV2 *)calloc(1, sizeof(KrakenRunResultV2));
-    if (!result) return -1;
+static bool acl_await(acl_async_t *a, acl_probe_t *p, uint32_t slot, acl_stage_t stage) {
+    p->stage = stage;
+    p->reads = 0;
+    return acl_submit(a, p, slot, KRAKEN_ASYNC_RECV, 0);
+}
 
-    copy_target(&result->target, target);
+static void acl_finish(acl_async_t *a, acl_probe_t *p) {
+    if (p->conn && a->ops->close) a->ops->close(p->conn);
+    p->conn = NULL;
+    p->cred = NULL;
+}
+
+static void acl_start(acl_async_t *a, acl_probe_t *p, const cred_t *cred) {
+    memset(p, 0, sizeof(*p));
+    p->cred = cred;
+    p->stage = ACL_OPEN;
+    snprintf(p->prefix, sizeof(p->prefix), "%s[%s] ", LOG_PREFIX, cred->user ? cred->user : "");
+    client_id(a->ids, p->cid, sizeof(p->cid));
+    kraken_mqtt_reader_init(&p->s.rd, p->s.rx, sizeof(p->s.rx));
+    kraken_result_logf(a->res, "%sTesting credential %s/%s", LOG_PREFIX, cred->user ? cred->user : "", cred->pass ? cred->pass : "");
+}
 
-    char *creds_path = extract_string_param(params_json, "creds_file");
-    char *topic = extract_string_param(params_json, "topic");
-    if (!topic) topic = mystrdup("kraken/acl/probe");
-    uint32_t op_timeout = extract_timeout(params_json, timeout_ms ? timeout_ms : 5000);
+// The awaited packet arrived (f) or will not (NULL); report it and move on.
+// Returns false once the probe is done.
+static bool acl_on_packet(acl_async_t *a, acl_probe_t *p, uint32_t slot, const KrakenMqttFrame *f) {
+    switch (p->stage) {
+    case ACL_CONNACK:
+        if (!report_connack(a->res, p->prefix, a->version, f)) return false;
+        if (acl_send(a, p, slot, ACL_SUBSCRIBE, encode_subscribe(p->pkt, sizeof(p->pkt), a->version, a->topic))) return true;
+        report_subscribe_send_failed(a->res, p->prefix, p->cred);
+        return false;
+    case ACL_SUBACK:
+        report_suback(a->res, p->prefix, p->cred, a->version, f);
+        if (acl_send(a, p, slot, ACL_PUBLISH, encode_publish(p->pkt, sizeof(p->pkt), a->version, a->topic))) return true;
+        kraken_result_logf(a->res, "%sPUBLISH send failed", p->prefix);
+        return false;
+    case ACL_PUBACK:
+        report_puback(a->res, p->prefix, p->cred, a->version, f);
+        return false;
+    default:
+        return false;
+    }
+}
+
+// Frame what has been received so far and look for the awaited packet.
+static bool acl_on_data(acl_async_t *a, acl_probe_t *p, uint32_t slot) {
+    uint8_t want = p->stage == ACL_CONNACK ? KRAKEN_MQTT_CONNACK : p->stage == ACL_SUBACK ? KRAKEN_MQTT_SUBACK : KRAKEN_MQTT_PUBACK;
+    KrakenMqttFrame f;
+    for (;;) {
+        int rc = kraken_mqtt_reader_next(&p->s.rd, &f);
+        if (rc < 0) return acl_on_packet(a, p, slot, NULL);
+        if (rc == 0) break;
+        if (f.type == want) return acl_on_packet(a, p, slot, &f);
+    }
+    if (++p->reads > MQTT_AWAIT_MAX_READS || !acl_submit(a, p, slot, KRAKEN_ASYNC_RECV, 0)) return acl_on_packet(a, p, slot, NULL);
+    return true;
+}
+
+// Advance a probe with the completion of its in-flight request.
+// Returns false once the probe is done.
+static bool acl_advance(acl_async_t *a, acl_probe_t *p, uint32_t slot, const KrakenAsyncCompletion *c) {
+    switch (p->stage) {
+    case ACL_OPEN:
+        if (c->result != 0) {
+            kraken_result_logf(a->res, "%sfailed to open connection", p->prefix);
+            return false;
+        }
+        p->conn = c->conn;
+        if (acl_send(a, p, slot, ACL_CONNECT, encode_connect(p->pkt, sizeof(p->pkt), a->version, p->cred, p->cid))) return true;
+        kraken_result_logf(a->res, "%sCONNECT send failed", p->prefix);
+        return false;
+    case ACL_CONNECT:
+        if (c->result > 0 && acl_await(a, p, slot, ACL_CONNACK)) return true;
+        kraken_result_logf(a->res, "%sCONNECT send failed", p->prefix);
+        return false;
+    case ACL_SUBSCRIBE:
+        if (c->result > 0 && acl_await(a, p, slot, ACL_SUBACK)) return true;
+        report_subscribe_send_failed(a->res, p->prefix, p->cred);
+        return false;
+    case ACL_PUBLISH:
+        if (c->result > 0 && acl_await(a, p, slot, ACL_PUBACK)) return true;
+        kraken_result_logf(a->res, "%sPUBLISH send failed", p->prefix);
+        return false;
+    case ACL_CONNACK:
+    case ACL_SUBACK:
+    case ACL_PUBACK:
+        if (c->result <= 0) return acl_on_packet(a, p, slot, NULL);
+        kraken_mqtt_reader_commit(&p->s.rd, (size_t)c->result);
+        return acl_on_data(a, p, slot);
+    }
+    return false;
+}
+
+// Start the next pending credential in `slot`. Returns false when the
+// list is exhausted and the slot stays idle.
+static bool acl_refill(acl_async_t *a, acl_probe_t *probes, uint32_t slot, const cred_list_t *creds, size_t *next, KrakenConnectionHandle base) {
+    acl_probe_t *p = &probes[slot];
+    while (*next < creds->count) {
+        acl_start(a, p, &creds->list[(*next)++]);
+        KrakenAsyncRequest req = {.opcode = KRAKEN_ASYNC_OPEN, .conn = base, .timeout_ms = a->timeout_ms, .user_data = slot};
+        if (a->ops->async->submit(a->q, &req, 1) == 1) return true;
+        kraken_result_logf(a->res, "%sfailed to open connection", p->prefix);
+        acl_finish(a, p);
+    }
+    return false;
+}
+
+// Probe every credential on a fresh connection, `concurrency` at a time.
+// Returns false if the conduit could not set up a queue.
+static bool probe_credentials_async(KrakenRunResultV2 *res, const KrakenConnectionOps *ops, KrakenConnectionHandle conn, client_ids_t *ids,
+                                    const cred_list_t *creds, const char *topic, uint8_t version, uint32_t timeout_ms, uint32_t concurrency) {
+    if (concurrency > creds->count) concurrency = (uint32_t)creds->count;
+    if (concurrency > ACL_MAX_CONCURRENCY) concurrency = ACL_MAX_CONCURRENCY;
+    acl_async_t a = {.res = res, .ops = ops, .ids = ids, .topic = topic, .version = version, .timeout_ms = timeout_ms};
+    a.q = ops->async->create(conn, concurrency);
+    acl_probe_t *probes = calloc(concurrency, sizeof(*probes));
+    if (!a.q || !probes) {
+        if (a.q) ops->async->destroy(a.q);
+        free(probes);
+        return false;
+    }
+
+    size_t next = 0;
+    uint32_t active = 0;
+    for (uint32_t i = 0; i < concurrency; i++) {
+        if (acl_refill(&a, probes, i, creds, &next, conn)) active++;
+    }
+
+    while (active > 0) {
+        KrakenAsyncCompletion done[32];
+        int64_t n = ops->async->poll(a.q, done, 32, ACL_POLL_MS);
+        if (n < 0) {
+            log_prefixed(res, "async poll failed, remaining credentials skipped");
+            break;
+        }
+        for (int64_t k = 0; k < n; k++) {
+            uint32_t slot = (uint32_t)done[k].user_data;
+            acl_probe_t *p = &probes[slot];
+            if (acl_advance(&a, p, slot, &done[k])) continue;
+            acl_finish(&a, p);
+            if (!acl_refill(&a, probes, slot, creds, &next, conn)) active--;
+        }
+    }
+
+    ops->async->destroy(a.q);
+    for (uint32_t i = 0; i < concurrency; i++) {
+        if (probes[i].cred) acl_finish(&a, &probes[i]);
+    }
+    free(probes);
+    return true;
+}
+
+static int run_acl_probe(KrakenConnectionHandle conn, const KrakenConnectionOps *ops, KrakenRunResultV2 *result, uint32_t timeout_ms,
+                         const char *params_json) {
+    client_ids_t ids;
+    client_ids_init(&ids);
+
+    KrakenParams params;
+    if (kraken_params_parse(&params, params_json) != 0) log_prefixed(result, "malformed params_json, using defaults");
+
+    char *creds_path = kraken_params_strdup(&params, "creds_file");
+    char topic[256];
+    if (kraken_params_string(&params, "topic", topic, sizeof(topic)) <= 0) snprintf(topic, sizeof(topic), "kraken/acl/probe");
+    int64_t param_timeout = kraken_params_int(&params, "timeout_ms", 0);
+    uint32_t op_timeout = param_timeout > 0 ? (uint32_t)param_timeout : (timeout_ms ? timeout_ms : 5000);
+    uint8_t version = kraken_params_int(&params, "protocol_version", KRAKEN_MQTT_V311) == KRAKEN_MQTT_V5 ? KRAKEN_MQTT_V5 : KRAKEN_MQTT_V311;
+    int64_t param_concurrency = kraken_params_int(&params, "concurrency", ACL_DEFAULT_CONCURRENCY);
+    uint32_t concurrency = param_concurrency > 0 ? (uint32_t)param_concurrency : ACL_DEFAULT_CONCURRENCY;
 
     cred_list_t creds = load_creds(creds_path);
+    load_inline_creds(&creds, &params);
+    kraken_params_free(&params);
     bool anon_conn = false, anon_sub = false, anon_pub = false;
     cred_t anon = {.user = NULL, .pass = NULL};
     log_prefixed(result, "Testing anonymous access");
-    probe_credential(result, target, ops, conn, &anon, topic, op_timeout, true, &anon_conn, &anon_sub, &anon_pub);
+    probe_credential(result, ops, conn, &ids, &anon, topic, version, op_timeout, true, &anon_conn, &anon_sub, &anon_pub);
 
     if (!(anon_conn && (anon_sub || anon_pub)) && creds.count > 0) {
-        for (size_t i = 0; i < creds.count; i++) {
-            char logbuf[256];
-            snprintf(logbuf, sizeof(logbuf), "%sTesting credential %s/%s", LOG_PREFIX,
-                     creds.list[i].user ? creds.list[i].user : "",
-                     creds.list[i].pass ? creds.list[i].pass : "");
-            add_log_v2(result, logbuf);
-            probe_credential(result, target, ops, conn, &creds.list[i], topic, op_timeout, true, NULL, NULL, NULL);
+        bool probed = false;
+        if (ops->async && ops->close) {
+            kraken_result_logf(result, "%sProbing %zu credentials, %u at a time", LOG_PREFIX, creds.count, concurrency);
+            probed = probe_credentials_async(result, ops, conn, &ids, &creds, topic, version, op_timeout, concurrency);
+            if (!probed) log_prefixed(result, "async queue unavailable, probing sequentially");
+        }
+        for (size_t i = 0; !probed && i < creds.count; i++) {
+            kraken_result_logf(result, "%sTesting credential %s/%s", LOG_PREFIX,
+                               creds.list[i].user ? creds.list[i].user : "",
+                               creds.list[i].pass ? creds.list[i].pass : "");
+            probe_credential(result, ops, conn, &ids, &creds.list[i], topic, version, op_timeout, true, NULL, NULL, NULL);
         }
     } else if (anon_conn && (anon_sub || anon_pub)) {
         log_prefixed(result, "Anonymous access allowed; skipping credential list to reduce noise");
     }
 
     free(creds_path);
-    free(topic);
     free_cred_list(&creds);
 
-    *out_result = result;
     return 0;
 }
 
-KRAKEN_API void kraken_free_v2(void *p) {
-    if (!p) return;
-    KrakenRunResultV2 *res = (KrakenRunResultV2 *)p;
-
-    free_target(&res->target);
-
-    for (size_t i = 0; i < res->findings_count; i++) {
-        KrakenFindingV2 *f = &res->findings[i];
-        free((void *)f->id);
-        free((void *)f->module_id);
-        free((void *)f->title);
-        free((void *)f->severity);
-        free((void *)f->description);
-        free_target(&f->target);
-        for (size_t j = 0; j < f->evidence.count; j++) {
-            free((void *)f->evidence.items[j].key);
-            free((void *)f->evidence.items[j].value);
-        }
-        free(f->evidence.items);
-        for (size_t j = 0; j < f->tags.count; j++) {
-            free((void *)f->tags.strings[j]);
-        }
-        free(f->tags.strings);
-    }
-    free(res->findings);
+KRAKEN_API int kraken_run_v2(KrakenConnectionHandle conn, const KrakenConnectionOps *ops, const KrakenTarget *target, uint32_t timeout_ms,
+                             const char *params_json, KrakenRunResultV2 **out_result) {
+    return kraken_result_run_v2(run_acl_probe, conn, ops, target, timeout_ms, params_json, out_result);
+}
 
-    for (size_t i = 0; i < res->logs.count; i++) {
-        free((void *)res->logs.strings[i]);
-    }
-    free(res->logs.strings);
+KRAKEN_API int kraken_run_v3(KrakenConnectionHandle conn, const KrakenConnectionOps *ops, const KrakenTarget *target, uint32_t timeout_ms,
+                             const char *params_json, const KrakenResultSink *sink) {
+    return kraken_result_run_v3(run_acl_probe, conn, ops, target, timeout_ms, params_json, sink);
+}
 
-    free(res);
+KRAKEN_API void kraken_free_v2(void *p) {
+    kraken_result_free(p);
 }
@@ -1,11 +1,16 @@
 #define KRAKEN_MODULE_BUILD
 #define BUILDING_MQTT_AUTH_CHECK_V2
 #include <kraken_module_abi_v2.h>
+#include <kraken_module_abi_v3.h>
+#include <kraken_mqtt.h>
+#include <kraken_params.h>
+#include <kraken_result.h>
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <unistd.h>
 
 /* ------------------------------------------------------------------ */
 /* ABI Version Export                                                 */
@@ -14,161 +19,120 @@ KRAKEN_API const uint32_t KRAKEN_MODULE_ABI_VERSION_V2 = KRAKEN_ABI_VERSION_V2;
 static const char *LOG_PREFIX = "[mqtt-auth-check] ";
 
 static void log_prefixed(KrakenRunResultV2 *res, const char *msg) {
-    char buf[256];
-    snprintf(buf, sizeof(buf), "%s%s", LOG_PREFIX, msg);
-    add_log_v2(res, buf);
+    kraken_result_logf(res, "%s%s", LOG_PREFIX, msg);
 }
 
-/* -------------------------------------------------------- */
-/* Minimal MQTT Helper                                      */
-/* -------------------------------------------------------- */
+// Client ids unique across concurrent runs in one process and across
+// processes: a per-run tag plus a per-run counter, 23 characters at most
+// (the length every MQTT 3.1.1 broker must accept).
 typedef struct {
-    uint8_t buf[512];
-    size_t len;
-} mqtt_packet_t;
-
-static int mqtt_encode_string(uint8_t *buf, const char *s) {
-    size_t len = strlen(s);
-    if (len > 65535)
-        return -1;
-    buf[0] = (uint8_t)(len >> 8);
-    buf[1] = (uint8_t)(len & 0xFF);
-    memcpy(buf + 2, s, len);
-    return (int)(len + 2);
-}
-
-static int mqtt_build_connect(mqtt_packet_t *pkt, const char *client_id, const char *user, const char *pass) {
-    pkt->len = 0;
-    uint8_t *p = pkt->buf;
-    const char *proto = "MQTT";
-    p += mqtt_encode_string(p, proto);
-    *p++ = 4; // Protocol level 3.1.1
-    uint8_t flags = 0;
-    if (user && *user)
-        flags |= 0x80;
-    if (pass && *pass)
-        flags |= 0x40;
-    *p++ = flags;
-    *p++ = 0;
-    *p++ = 60; // Keepalive 60s
-    p += mqtt_encode_string(p, client_id);
-    if (user && *user)
-        p += mqtt_encode_string(p, user);
-    if (pass && *pass)
-        p += mqtt_encode_string(p, pass);
-
-    size_t rem_len = p - pkt->buf;
-    uint8_t head[5];
-    size_t hl = 1;
-    head[0] = 0x10; // CONNECT
-    size_t x = rem_len;
-    do {
-        uint8_t b = x % 128;
-        x /= 128;
-        if (x > 0)
-            b |= 128;
-        head[hl++] = b;
-    } while (x > 0);
-
-    memmove(pkt->buf + hl, pkt->buf, rem_len);
-    memcpy(pkt->buf, head, hl);
-    pkt->len = rem_len + hl;
-    return (int)pkt->len;
+    uint32_t run;
+    uint32_t next;
+} client_ids_t;
+
+static void client_ids_init(client_ids_t *ids) {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    uint64_t x = (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+    x ^= (uint64_t)getpid() << 32 ^ (uint64_t)(uintptr_t)ids;
+    x *= 0x9E3779B97F4A7C15ULL; // spread the low bits that differ between runs
+    ids->run = (uint32_t)(x >> 32);
+    ids->next = 0;
 }
 
-static int mqtt_build_subscribe(mqtt_packet_t *pkt, const char *topic) {
-    pkt->len = 0;
-    uint8_t *p = pkt->buf;
-    size_t topic_len = strlen(topic);
-    size_t rem_len = 2 + 2 + topic_len + 1;
-    *p++ = 0x82; // SUBSCRIBE
-    *p++ = (uint8_t)rem_len;
-    *p++ = 0;
-    *p++ = 1; // Packet ID
-    p += mqtt_encode_string(p, topic);
-    *p++ = 0; // QoS 0
-    pkt->len = p - pkt->buf;
-    return (int)pkt->len;
-}
-
-static int mqtt_build_publish(mqtt_packet_t *pkt, const char *topic, const char *msg) {
-    pkt->len = 0;
-    uint8_t *p = pkt->buf;
-    *p++ = 0x30; // PUBLISH, QoS 0
-    size_t topic_len = strlen(topic);
-    size_t msg_len = strlen(msg);
-    size_t rem_len = 2 + topic_len + msg_len;
-    size_t rem_temp = rem_len;
-    do {
-        uint8_t b = rem_temp % 128;
-        rem_temp /= 128;
-        if (rem_temp > 0)
-            b |= 128;
-        *p++ = b;
-    } while (rem_temp > 0);
-    p += mqtt_encode_string(p, topic);
-    memcpy(p, msg, msg_len);
-    pkt->len = (p + msg_len) - pkt->buf;
-    return (int)pkt->len;
-}
-
-static int mqtt_parse_connack(uint8_t *buf, size_t n) {
-    return n >= 4 && buf[0] == 0x20 && buf[3] == 0x00;
-}
-
-static int mqtt_parse_suback(uint8_t *buf, size_t n) {
-    return n >= 3 && buf[0] == 0x90;
+static void client_id(client_ids_t *ids, char *buf, size_t size) {
+    snprintf(buf, size, "kraken_%08x%08x", ids->run, ids->next++);
 }
 
 /* ------------------------------------------------------------------ */
 /* MQTT Check Functions using V2 API                                  */
 /* ------------------------------------------------------------------ */
 
-static int mqtt_check_auth(KrakenConnectionHandle conn, const KrakenConnectionOps *ops, const char *user, const char *pass, uint32_t timeout_ms) {
-    mqtt_packet_t pkt;
+// Receive until a packet of `type` is framed; other packets are skipped.
+static bool mqtt_await(KrakenConnectionHandle conn, const KrakenConnectionOps *ops, KrakenMqttReader *rd, uint8_t type, uint32_t timeout_ms,
+                       KrakenMqttFrame *f) {
+    for (int reads = 0;;) {
+        int rc = kraken_mqtt_reader_next(rd, f);
+        if (rc < 0)
+            return false;
+        if (rc == 1) {
+            if (f->type == type)
+                return true;
+            continue;
+        }
+        if (reads++ >= 4)
+            return false;
+        size_t room;
+        uint8_t *dst = kraken_mqtt_reader_space(rd, &room);
+        int64_t received = ops->recv(conn, dst, room, timeout_ms);
+        if (received <= 0)
+            return false;
+        kraken_mqtt_reader_commit(rd, received);
+    }
+}
+
+static int mqtt_check_auth(KrakenConnectionHandle conn, const KrakenConnectionOps *ops, client_ids_t *ids, const char *user, const char *pass,
+                           uint8_t version, uint32_t timeout_ms, uint8_t *reason_out) {
+    uint8_t pkt[512];
     char cid[32];
-    snprintf(cid, sizeof(cid), "kraken_%u", (unsigned)rand());
+    client_id(ids, cid, sizeof(cid));
 
     // Build MQTT CONNECT packet
-    int len = mqtt_build_connect(&pkt, cid, user, pass);
+    KrakenMqttConnect c = {.version = version, .client_id = cid, .username = user, .password = pass, .keep_alive = 60};
+    size_t len = kraken_mqtt_encode_connect(pkt, sizeof(pkt), &c);
+    if (len == 0 || len > sizeof(pkt)) {
+        return -1;
+    }
 
     // Send CONNECT packet over conduit
-    int64_t sent = ops->send(conn, pkt.buf, len, timeout_ms);
+    int64_t sent = ops->send(conn, pkt, len, timeout_ms);
     if (sent <= 0) {
         return -1; // Failed to send
     }
 
     // Receive CONNACK response
-    uint8_t resp[16];
-    int64_t received = ops->recv(conn, resp, sizeof(resp), timeout_ms);
-    if (received <= 0) {
+    uint8_t rx[256];
+    KrakenMqttReader rd;
+    KrakenMqttFrame f;
+    KrakenMqttConnack ack;
+    kraken_mqtt_reader_init(&rd, rx, sizeof(rx));
+    if (!mqtt_await(conn, ops, &rd, KRAKEN_MQTT_CONNACK, timeout_ms, &f) || kraken_mqtt_parse_connack(&f, version, &ack) != 0) {
         return -1; // No response
     }
 
     // Check if CONNACK indicates success
-    return mqtt_parse_connack(resp, (size_t)received) ? 1 : 0;
+    if (reason_out)
+        *reason_out = ack.reason_code;
+    return ack.reason_code == 0 ? 1 : 0;
 }
 
-static int mqtt_check_pubsub(KrakenConnectionHandle conn, const KrakenConnectionOps *ops, uint32_t timeout_ms) {
-    mqtt_packet_t pkt;
+static int mqtt_check_pubsub(KrakenConnectionHandle conn, const KrakenConnectionOps *ops, uint8_t version, uint32_t timeout_ms) {
+    uint8_t pkt[512];
     const char *topic = "kraken/test/topic";
 
     // Try SUBSCRIBE
-    int len = mqtt_build_subscribe(&pkt, topic);
-    int64_t sent = ops->send(conn, pkt.buf, len, timeout_ms);
-    if (sent <= 0) {
+    KrakenMqttSubscription sub = {.topic = topic, .options = 0};
+    KrakenMqttSubscribe sreq = {.version = version, .packet_id = 1, .subs = &sub, .count = 1};
+    size_t len = kraken_mqtt_encode_subscribe(pkt, sizeof(pkt), &sreq);
+    if (len == 0 || len > sizeof(pkt) || ops->send(conn, pkt, len, timeout_ms) <= 0) {
         return 0;
     }
 
-    // Check for SUBACK
-    uint8_t resp[16];
-    int64_t received = ops->recv(conn, resp, sizeof(resp), timeout_ms);
-    int sub_ok = (received > 0 && mqtt_parse_suback(resp, (size_t)received));
+    // Check for SUBACK granting the subscription
+    uint8_t rx[512];
+    KrakenMqttReader rd;
+    KrakenMqttFrame f;
+    KrakenMqttSuback suback;
+    kraken_mqtt_reader_init(&rd, rx, sizeof(rx));
+    int sub_ok = mqtt_await(conn, ops, &rd, KRAKEN_MQTT_SUBACK, timeout_ms, &f) && kraken_mqtt_parse_suback(&f, version, &suback) == 0 &&
+                 suback.count > 0 && suback.reason_codes[0] <= 0x02;
 
     // Try PUBLISH
     const char *msg = "hello from Kraken";
-    len = mqtt_build_publish(&pkt, topic, msg);
-    sent = ops->send(conn, pkt.buf, len, timeout_ms);
+    KrakenMqttPublishOut pub = {.version = version, .topic = topic, .payload = msg, .payload_len = strlen(msg)};
+    len = kraken_mqtt_encode_publish(pkt, sizeof(pkt), &pub);
+    if (len > 0 && len <= sizeof(pkt))
+        ops->send(conn, pkt, len, timeout_ms);
 
     return sub_ok; // Return 1 if subscribe worked
 }
@@ -192,6 +156,12 @@ static void free_creds_list(creds_list_t *list) {
     list->count = 0;
 }
 
+static void append_entry(creds_list_t *list, const char *line) {
+    list->count++;
+    list->entries = (char **)realloc(list->entries, list->count * sizeof(char *));
+    list->entries[list->count - 1] = mystrdup(line);
+}
+
 static creds_list_t load_creds_file(const char *path) {
     creds_list_t list = {0};
 
@@ -212,228 +182,370 @@ static creds_list_t load_creds_file(const char *path) {
             continue; // Skip empty lines and comments
         }
 
-        list.count++;
-        list.entries = (char **)realloc(list.entries, list.count * sizeof(char *));
-        list.entries[list.count - 1] = mystrdup(line);
+        append_entry(&list, line);
     }
 
     fclose(f);
     return list;
 }
 
+static void load_inline_creds(creds_list_t *list, const KrakenParams *params) {
+    size_t count = 0;
+    const KrakenJsonTok *arr = kraken_params_array(params, "creds", &count);
+    for (size_t i = 0; i < count; i++) {
+        char line[256];
+        if (kraken_params_tok_string(params, kraken_params_at(params, arr, i), line, sizeof(line)) > 0) {
+            append_entry(list, line);
+        }
+    }
+}
+
+// Split a "user:pass" entry; no colon means a username with empty password
+static void split_cred(const char *entry, char *user, size_t user_size, char *pass, size_t pass_size) {
+    const char *colon = strchr(entry, ':');
+    memset(user, 0, user_size);
+    memset(pass, 0, pass_size);
+    if (colon) {
+        size_t ulen = (size_t)(colon - entry);
+        if (ulen >= user_size) ulen = user_size - 1;
+        strncpy(user, entry, ulen);
+        strncpy(pass, colon + 1, pass_size - 1);
+    } else {
+        strncpy(user, entry, user_size - 1);
+    }
+}
+
+static void add_weak_creds_finding(KrakenRunResultV2 *result, const char *user, time_t ts) {
+    KrakenFindingV2 f = {0};
+    f.id = kraken_result_strdup(result, "MQTT-WEAK-CREDS");
+    f.module_id = kraken_result_strdup(result, "mqtt-auth-check-v2");
+    f.success = true;
+    f.title = kraken_result_strdup(result, "Weak credentials accepted");
+    f.severity = kraken_result_strdup(result, "high");
+
+    f.description = kraken_result_sprintf(result, "The MQTT broker accepted default/weak credentials: %s", user);
+    f.timestamp = ts;
+    f.target = result->target;
+
+    kraken_finding_add_tag(result, &f, "mqtt");
+    kraken_finding_add_tag(result, &f, "auth");
+    kraken_finding_add_tag(result, &f, "weak-credentials");
+
+    kraken_finding_add_evidence(result, &f, "username", user);
+
+    kraken_result_add_finding(result, &f);
+
+    kraken_result_logf(result, "%sFINDING: Weak credentials accepted: %s", LOG_PREFIX, user);
+}
+
 /* ------------------------------------------------------------------ */
-/* Module Entry Point (V2 API)                                        */
+/* Concurrent Credential Testing (ops->async)                         */
 /* ------------------------------------------------------------------ */
 
-KRAKEN_API int kraken_run_v2(KrakenConnectionHandle conn, const KrakenConnectionOps *ops, const KrakenTarget *target, uint32_t timeout_ms,
-                             const char *params_json, KrakenRunResultV2 **out_result) {
-    srand((unsigned)time(NULL));
+#define AUTH_DEFAULT_CONCURRENCY 32
+#define AUTH_MAX_CONCURRENCY 1024
+#define AUTH_POLL_MS 1000
 
-    // 1. Allocate and initialize the main result structure
-    KrakenRunResultV2 *result = (KrakenRunResultV2 *)calloc(1, sizeof(KrakenRunResultV2));
-    if (!result)
-        return -1;
+// A credential test is OPEN -> send CONNECT -> await CONNACK on a fresh
+// connection, with one request in flight; user_data is the slot index.
+typedef enum {
+    AUTH_OPEN,
+    AUTH_CONNECT,
+    AUTH_CONNACK,
+} auth_stage_t;
+
+typedef struct {
+    bool busy;
+    auth_stage_t stage;
+    KrakenConnectionHandle conn;
+    int reads;
+    char user[128];
+    char pass[128];
+    uint8_t pkt[512];
+    uint8_t rx[256];
+    KrakenMqttReader rd;
+} auth_probe_t;
+
+typedef struct {
+    KrakenRunResultV2 *result;
+    const KrakenConnectionOps *ops;
+    KrakenConnectionHandle base;
+    KrakenAsyncQueue q;
+    client_ids_t *ids;
+    uint8_t version;
+    uint32_t timeout_ms;
+    time_t ts;
+} auth_async_t;
+
+static bool auth_submit(auth_async_t *a, auth_probe_t *p, uint32_t slot, KrakenAsyncOpcode opcode, size_t len) {
+    KrakenAsyncRequest req = {.opcode = opcode, .conn = p->conn, .timeout_ms = a->timeout_ms, .user_data = slot};
+    if (opcode == KRAKEN_ASYNC_OPEN) {
+        req.conn = a->base;
+    } else if (opcode == KRAKEN_ASYNC_SEND) {
+        req.data = p->pkt;
+        req.len = len;
+    } else {
+        req.buffer = kraken_mqtt_reader_space(&p->rd, &req.len);
+    }
+    return a->ops->async->submit(a->q, &req, 1) == 1;
+}
+
+static void auth_finish(auth_async_t *a, auth_probe_t *p) {
+    if (p->conn) a->ops->close(p->conn);
+    p->conn = NULL;
+    p->busy = false;
+}
+
+// Advance a test with the completion of its in-flight request.
+// Returns false once the test is done.
+static bool auth_advance(auth_async_t *a, auth_probe_t *p, uint32_t slot, const KrakenAsyncCompletion *c) {
+    switch (p->stage) {
+    case AUTH_OPEN: {
+        if (c->result != 0) {
+            kraken_result_logf(a->result, "%sFailed to open connection for credential test (%s)", LOG_PREFIX, p->user);
+            return false;
+        }
+        p->conn = c->conn;
+        char cid[32];
+        client_id(a->ids, cid, sizeof(cid));
+        KrakenMqttConnect mc = {.version = a->version, .client_id = cid, .username = p->user, .password = p->pass, .keep_alive = 60};
+        size_t len = kraken_mqtt_encode_connect(p->pkt, sizeof(p->pkt), &mc);
+        p->stage = AUTH_CONNECT;
+        return len > 0 && len <= sizeof(p->pkt) && auth_submit(a, p, slot, KRAKEN_ASYNC_SEND, len);
+    }
+    case AUTH_CONNECT:
+        p->stage = AUTH_CONNACK;
+        return c->result > 0 && auth_submit(a, p, slot, KRAKEN_ASYNC_RECV, 0);
+    case AUTH_CONNACK:
+        if (c->result <= 0) return false; // No response
+        kraken_mqtt_reader_commit(&p->rd, (size_t)c->result);
+        for (;;) {
+            KrakenMqttFrame f;
+            KrakenMqttConnack ack;
+            int rc = kraken_mqtt_reader_next(&p->rd, &f);
+            if (rc < 0) return false;
+            if (rc == 0) break;
+            if (f.type != KRAKEN_MQTT_CONNACK) continue;
+            if (kraken_mqtt_parse_connack(&f, a->version, &ack) == 0 && ack.reason_code == 0) add_weak_creds_finding(a->result, p->user, a->ts);
+            return false;
+        }
+        return ++p->reads <= 4 && auth_submit(a, p, slot, KRAKEN_ASYNC_RECV, 0);
+    }
+    return false;
+}
+
+// Start the next untested credential in `slot`; false once none are left.
+static bool auth_refill(auth_async_t *a, auth_probe_t *probes, uint32_t slot, const creds_list_t *creds, size_t *next) {
+    auth_probe_t *p = &probes[slot];
+    while (*next < creds->count) {
+        memset(p, 0, sizeof(*p));
+        split_cred(creds->entries[(*next)++], p->user, sizeof(p->user), p->pass, sizeof(p->pass));
+        kraken_mqtt_reader_init(&p->rd, p->rx, sizeof(p->rx));
+        kraken_result_logf(a->result, "%sTesting credentials: %s:***", LOG_PREFIX, p->user);
+        p->busy = true;
+        p->stage = AUTH_OPEN;
+        if (auth_submit(a, p, slot, KRAKEN_ASYNC_OPEN, 0)) return true;
+        kraken_result_logf(a->result, "%sFailed to open connection for credential test (%s)", LOG_PREFIX, p->user);
+        auth_finish(a, p);
+    }
+    return false;
+}
+
+// Test every credential on its own connection, `concurrency` at a time.
+// Returns false if the conduit could not set up a queue.
+static bool test_creds_async(KrakenRunResultV2 *result, KrakenConnectionHandle conn, const KrakenConnectionOps *ops, client_ids_t *ids,
+                             const creds_list_t *creds, uint8_t version, uint32_t timeout_ms, uint32_t concurrency, time_t ts) {
+    if (concurrency > creds->count) concurrency = (uint32_t)creds->count;
+    if (concurrency > AUTH_MAX_CONCURRENCY) concurrency = AUTH_MAX_CONCURRENCY;
+    auth_async_t a = {.result = result, .ops = ops, .base = conn, .ids = ids, .version = version, .timeout_ms = timeout_ms, .ts = ts};
+    a.q = ops->async->create(conn, concurrency);
+    auth_probe_t *probes = calloc(concurrency, sizeof(*probes));
+    if (!a.q || !probes) {
+        if (a.q) ops->async->destroy(a.q);
+        free(probes);
+        return false;
+    }
+
+    size_t next = 0;
+    uint32_t active = 0;
+    for (uint32_t i = 0; i < concurrency; i++) {
+        if (auth_refill(&a, probes, i, creds, &next)) active++;
+    }
+
+    while (active > 0) {
+        KrakenAsyncCompletion done[32];
+        int64_t n = ops->async->poll(a.q, done, 32, AUTH_POLL_MS);
+        if (n < 0) {
+            log_prefixed(result, "Async poll failed, remaining credentials skipped");
+            break;
+        }
+        for (int64_t k = 0; k < n; k++) {
+            uint32_t slot = (uint32_t)done[k].user_data;
+            if (auth_advance(&a, &probes[slot], slot, &done[k])) continue;
+            auth_finish(&a, &probes[slot]);
+            if (!auth_refill(&a, probes, slot, creds, &next)) active--;
+        }
+    }
+
+    ops->async->destroy(a.q);
+    for (uint32_t i = 0; i < concurrency; i++) {
+        if (probes[i].busy) auth_finish(&a, &probes[i]);
+    }
+    free(probes);
+    return true;
+}
 
-    copy_target(&result->target, target);
+/* ------------------------------------------------------------------ */
+/* Module Entry Point (V2 API)                                        */
+/* ------------------------------------------------------------------ */
+
+static int run_auth_check(KrakenConnectionHandle conn, const KrakenConnectionOps *ops, KrakenRunResultV2 *result, uint32_t timeout_ms,
+                          const char *params_json) {
+    client_ids_t ids;
+    client_ids_init(&ids);
 
     log_prefixed(result, "MQTT authentication assessment started (V2 with conduit)");
 
-    // 2. Get connection info
+    KrakenParams params;
+    if (kraken_params_parse(&params, params_json) != 0)
+        log_prefixed(result, "Malformed params_json, using defaults");
+    uint8_t version = kraken_params_int(&params, "protocol_version", KRAKEN_MQTT_V311) == KRAKEN_MQTT_V5 ? KRAKEN_MQTT_V5 : KRAKEN_MQTT_V311;
+    int64_t param_concurrency = kraken_params_int(&params, "concurrency", AUTH_DEFAULT_CONCURRENCY);
+    uint32_t concurrency = param_concurrency > 0 ? (uint32_t)param_concurrency : AUTH_DEFAULT_CONCURRENCY;
+
+    // 1. Get connection info
     const KrakenConnectionInfo *info = ops->get_info(conn);
 
-    char log_buf[512];
-    snprintf(log_buf, sizeof(log_buf), "Connection type: %s", info->type == KRAKEN_CONN_TYPE_STREAM ? "stream" : "datagram");
-    add_log_v2(result, log_buf);
+    kraken_result_logf(result, "Connection type: %s", info->type == KRAKEN_CONN_TYPE_STREAM ? "stream" : "datagram");
 
     time_t ts = time(NULL);
 
-    // 3. Test anonymous authentication
+    // 2. Test anonymous authentication
     log_prefixed(result, "Testing anonymous MQTT authentication...");
 
-    int anon_result = mqtt_check_auth(conn, ops, NULL, NULL, timeout_ms);
+    uint8_t anon_reason = 0;
+    int anon_result = mqtt_check_auth(conn, ops, &ids, NULL, NULL, version, timeout_ms, &anon_reason);
 
     if (anon_result == 1) {
         KrakenFindingV2 f = {0};
-        f.id = mystrdup("MQTT-ANON");
-        f.module_id = mystrdup("mqtt-auth-check-v2");
+        f.id = kraken_result_strdup(result, "MQTT-ANON");
+        f.module_id = kraken_result_strdup(result, "mqtt-auth-check-v2");
         f.success = true;
-        f.title = mystrdup("Anonymous authentication accepted");
-        f.severity = mystrdup("high");
-        f.description = mystrdup("The MQTT broker allows unauthenticated clients to connect.");
+        f.title = kraken_result_strdup(result, "Anonymous authentication accepted");
+        f.severity = kraken_result_strdup(result, "high");
+        f.description = kraken_result_strdup(result, "The MQTT broker allows unauthenticated clients to connect.");
         f.timestamp = ts;
-        copy_target(&f.target, target);
+        f.target = result->target;
 
-        f.tags.count = 3;
-        f.tags.strings = (const char **)malloc(3 * sizeof(char *));
-        f.tags.strings[0] = mystrdup("mqtt");
-        f.tags.strings[1] = mystrdup("auth");
-        f.tags.strings[2] = mystrdup("anonymous");
+        kraken_finding_add_tag(result, &f, "mqtt");
+        kraken_finding_add_tag(result, &f, "auth");
+        kraken_finding_add_tag(result, &f, "anonymous");
 
-        add_finding_v2(result, &f);
+        kraken_result_add_finding(result, &f);
         log_prefixed(result, "FINDING: Anonymous authentication is allowed!");
 
-        // 3b. Test publish/subscribe capabilities for anonymous
+        // 2b. Test publish/subscribe capabilities for anonymous
         log_prefixed(result, "Testing anonymous publish/subscribe...");
-        int pubsub_ok = mqtt_check_pubsub(conn, ops, timeout_ms);
+        int pubsub_ok = mqtt_check_pubsub(conn, ops, version, timeout_ms);
 
         if (pubsub_ok) {
             KrakenFindingV2 f_pubsub = {0};
-            f_pubsub.id = mystrdup("MQTT-PUBSUB-ANON");
-            f_pubsub.module_id = mystrdup("mqtt-auth-check-v2");
+            f_pubsub.id = kraken_result_strdup(result, "MQTT-PUBSUB-ANON");
+            f_pubsub.module_id = kraken_result_strdup(result, "mqtt-auth-check-v2");
             f_pubsub.success = true;
-            f_pubsub.title = mystrdup("Unauthenticated publish/subscribe allowed");
-            f_pubsub.severity = mystrdup("critical");
-            f_pubsub.description = mystrdup("The MQTT broker allows unauthenticated clients to publish and/or subscribe to topics.");
+            f_pubsub.title = kraken_result_strdup(result, "Unauthenticated publish/subscribe allowed");
+            f_pubsub.severity = kraken_result_strdup(result, "critical");
+            f_pubsub.description = kraken_result_strdup(result, "The MQTT broker allows unauthenticated clients to publish and/or subscribe to topics.");
             f_pubsub.timestamp = ts;
-            copy_target(&f_pubsub.target, target);
+            f_pubsub.target = result->target;
 
-            f_pubsub.tags.count = 3;
-            f_pubsub.tags.strings = (const char **)malloc(3 * sizeof(char *));
-            f_pubsub.tags.strings[0] = mystrdup("mqtt");
-            f_pubsub.tags.strings[1] = mystrdup("pubsub");
-            f_pubsub.tags.strings[2] = mystrdup("unauthenticated");
+            kraken_finding_add_tag(result, &f_pubsub, "mqtt");
+            kraken_finding_add_tag(result, &f_pubsub, "pubsub");
+            kraken_finding_add_tag(result, &f_pubsub, "unauthenticated");
 
-            add_finding_v2(result, &f_pubsub);
+            kraken_result_add_finding(result, &f_pubsub);
             log_prefixed(result, "FINDING: Anonymous publish/subscribe is allowed!");
         } else {
             log_prefixed(result, "Anonymous publish/subscribe is restricted (good)");
         }
 
     } else if (anon_result == 0) {
-        log_prefixed(result, "Anonymous authentication rejected (good)");
+        kraken_result_logf(result, "%sAnonymous authentication rejected (good): %s", LOG_PREFIX, kraken_mqtt_reason_name(version, anon_reason));
     } else {
         log_prefixed(result, "Failed to test anonymous authentication (connection issue)");
     }
 
-    // 4. Test credentials if file provided
-    char *creds_path = json_extract_string(params_json, "creds_file");
+    // 3. Test credentials from creds_file and the inline creds array
+    creds_list_t creds = {0};
+    char *creds_path = kraken_params_strdup(&params, "creds_file");
     if (creds_path && *creds_path) {
-        snprintf(log_buf, sizeof(log_buf), "%sCredential testing from file: %s", LOG_PREFIX, creds_path);
-        add_log_v2(result, log_buf);
-
-        creds_list_t creds = load_creds_file(creds_path);
-        if (creds.count > 0) {
-            snprintf(log_buf, sizeof(log_buf), "%sLoaded %zu credential pairs", LOG_PREFIX, creds.count);
-            add_log_v2(result, log_buf);
-
-            // Check if ops->open is available for multi-connection testing
-            if (ops->open && ops->close) {
-                for (size_t i = 0; i < creds.count; i++) {
-                    const char *entry = creds.entries[i];
-                    // Parse "user:pass" format
-                    const char *colon = strchr(entry, ':');
-                    char user[128] = {0};
-                    char pass[128] = {0};
-
-                    if (colon) {
-                        size_t ulen = (size_t)(colon - entry);
-                        if (ulen >= sizeof(user)) ulen = sizeof(user) - 1;
-                        strncpy(user, entry, ulen);
-                        strncpy(pass, colon + 1, sizeof(pass) - 1);
-                    } else {
-                        strncpy(user, entry, sizeof(user) - 1);
-                    }
-
-                    snprintf(log_buf, sizeof(log_buf), "%sTesting credentials: %s:***", LOG_PREFIX, user);
-                    add_log_v2(result, log_buf);
-
-                    // Open new connection for this credential test
-                    KrakenConnectionHandle new_conn = ops->open(conn, timeout_ms);
-                    if (!new_conn) {
-                        snprintf(log_buf, sizeof(log_buf), "%sFailed to open connection for credential test", LOG_PREFIX);
-                        add_log_v2(result, log_buf);
-                        continue;
-                    }
-
-                    int cred_result = mqtt_check_auth(new_conn, ops, user, pass, timeout_ms);
-
-                    if (cred_result == 1) {
-                        KrakenFindingV2 f = {0};
-                        f.id = mystrdup("MQTT-WEAK-CREDS");
-                        f.module_id = mystrdup("mqtt-auth-check-v2");
-                        f.success = true;
-                        f.title = mystrdup("Weak credentials accepted");
-                        f.severity = mystrdup("high");
-
-                        char desc[512];
-                        snprintf(desc, sizeof(desc), "The MQTT broker accepted default/weak credentials: %s", user);
-                        f.description = mystrdup(desc);
-                        f.timestamp = ts;
-                        copy_target(&f.target, target);
-
-                        f.tags.count = 3;
-                        f.tags.strings = (const char **)malloc(3 * sizeof(char *));
-                        f.tags.strings[0] = mystrdup("mqtt");
-                        f.tags.strings[1] = mystrdup("auth");
-                        f.tags.strings[2] = mystrdup("weak-credentials");
-
-                        f.evidence.count = 1;
-                        f.evidence.items = (KrakenKeyValue *)malloc(sizeof(KrakenKeyValue));
-                        f.evidence.items[0].key = mystrdup("username");
-                        f.evidence.items[0].value = mystrdup(user);
-
-                        add_finding_v2(result, &f);
-
-                        snprintf(log_buf, sizeof(log_buf), "%sFINDING: Weak credentials accepted: %s", LOG_PREFIX, user);
-                        add_log_v2(result, log_buf);
-                    }
-
-                    ops->close(new_conn);
-                }
-            } else {
-                log_prefixed(result, "Multi-connection not supported by runner, credential testing skipped");
-            }
-        } else {
-            snprintf(log_buf, sizeof(log_buf), "%sNo credentials loaded from %s", LOG_PREFIX, creds_path);
-            add_log_v2(result, log_buf);
-        }
-
-        free_creds_list(&creds);
-        free(creds_path);
+        kraken_result_logf(result, "%sCredential testing from file: %s", LOG_PREFIX, creds_path);
+        creds = load_creds_file(creds_path);
+        if (creds.count == 0)
+            kraken_result_logf(result, "%sNo credentials loaded from %s", LOG_PREFIX, creds_path);
     }
+    load_inline_creds(&creds, &params);
+    kraken_params_free(&params);
 
-    *out_result = result;
-    return 0;
-}
+    if (creds.count > 0) {
+        kraken_result_logf(result, "%sLoaded %zu credential pairs", LOG_PREFIX, creds.count);
 
-/* ------------------------------------------------------------------ */
-/* Memory Deallocator                                                 */
-/* ------------------------------------------------------------------ */
+        bool tested = false;
+        if (ops->async && ops->close) {
+            kraken_result_logf(result, "%sTesting %zu credential pairs, %u at a time", LOG_PREFIX, creds.count, concurrency);
+            tested = test_creds_async(result, conn, ops, &ids, &creds, version, timeout_ms, concurrency, ts);
+            if (!tested) log_prefixed(result, "Async queue unavailable, testing credentials sequentially");
+        }
 
-KRAKEN_API void kraken_free_v2(void *p) {
-    if (!p)
-        return;
+        // Check if ops->open is available for multi-connection testing
+        if (!tested && ops->open && ops->close) {
+            for (size_t i = 0; i < creds.count; i++) {
+                char user[128];
+                char pass[128];
+                split_cred(creds.entries[i], user, sizeof(user), pass, sizeof(pass));
 
-    KrakenRunResultV2 *result = (KrakenRunResultV2 *)p;
+                kraken_result_logf(result, "%sTesting credentials: %s:***", LOG_PREFIX, user);
 
-    free_target(&result->target);
+                // Open new connection for this credential test
+                KrakenConnectionHandle new_conn = ops->open(conn, timeout_ms);
+                if (!new_conn) {
+                    kraken_result_logf(result, "%sFailed to open connection for credential test", LOG_PREFIX);
+                    continue;
+                }
 
-    for (size_t i = 0; i < result->findings_count; i++) {
-        KrakenFindingV2 *f = &result->findings[i];
-        free((void *)f->id);
-        free((void *)f->module_id);
-        free((void *)f->title);
-        free((void *)f->severity);
-        free((void *)f->description);
-        free_target(&f->target);
+                int cred_result = mqtt_check_auth(new_conn, ops, &ids, user, pass, version, timeout_ms, NULL);
 
-        for (size_t j = 0; j < f->evidence.count; j++) {
-            free((void *)f->evidence.items[j].key);
-            free((void *)f->evidence.items[j].value);
-        }
-        free(f->evidence.items);
+                if (cred_result == 1) {
+                    add_weak_creds_finding(result, user, ts);
+                }
 
-        for (size_t j = 0; j < f->tags.count; j++) {
-            free((void *)f->tags.strings[j]);
+                ops->close(new_conn);
+            }
+        } else if (!tested) {
+            log_prefixed(result, "Multi-connection not supported by runner, credential testing skipped");
         }
-        free(f->tags.strings);
     }
-    free(result->findings);
 
-    for (size_t i = 0; i < result->logs.count; i++) {
-        free((void *)result->logs.strings[i]);
-    }
-    free(result->logs.strings);
+    free_creds_list(&creds);
+    free(creds_path);
+
+    return 0;
+}
 
-    free(result);
+KRAKEN_API int kraken_run_v2(KrakenConnectionHandle conn, const KrakenConnectionOps *ops, const KrakenTarget *target, uint32_t timeout_ms,
+                             const char *params_json, KrakenRunResultV2 **out_result) {
+    return kraken_result_run_v2(run_auth_check, conn, ops, target, timeout_ms, params_json, out_result);
+}
+
+KRAKEN_API int kraken_run_v3(KrakenConnectionHandle conn, const KrakenConnectionOps *ops, const KrakenTarget *target, uint32_t timeout_ms,
+                             const char *params_json, const KrakenResultSink *sink) {
+    return kraken_result_run_v3(run_auth_check, conn, ops, target, timeout_ms, params_json, sink);
+}
+
+/* ------------------------------------------------------------------ */
+/* Memory Deallocator                                                 */
+/* ------------------------------------------------------------------ */
+
+KRAKEN_API void kraken_free_v2(void *p) {
+    kraken_result_free(p);
 }
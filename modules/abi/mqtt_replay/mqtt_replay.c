@@ -1,5 +1,7 @@
 #define KRAKEN_MODULE_BUILD
 #include <kraken_module_abi.h>
+#include <kraken_mqtt.h>
+#include <kraken_params.h>
 
 #include <arpa/inet.h>
 #include <errno.h>
@@ -214,34 +216,25 @@ int send_packet(int sock, mqtt_packet *p) {
     return 0;
 }
 
-int read_mqtt_response(int sock) {
-    uint8_t header[5]; // max header size
-    ssize_t r = recv(sock, header, 1, 0);
+/* Receive what the broker sent and frame it; responses are discarded.
+   Partial packets stay buffered in `rd` until the rest arrives. */
+int read_mqtt_response(int sock, KrakenMqttReader *rd) {
+    size_t room;
+    uint8_t *dst = kraken_mqtt_reader_space(rd, &room);
+    ssize_t r = recv(sock, dst, room, 0);
     if (r <= 0)
         return -1;
+    kraken_mqtt_reader_commit(rd, r);
 
-    uint8_t remaining_length = 0;
-    int multiplier = 1;
-    int bytes_read = 0;
-    do {
-        r = recv(sock, &header[bytes_read], 1, 0);
-        if (r <= 0)
-            return -1;
-        remaining_length += (header[bytes_read] & 127) * multiplier;
-        multiplier *= 128;
-        bytes_read++;
-    } while (header[bytes_read - 1] & 128);
-
-    uint8_t *payload = malloc(remaining_length);
-    if (!payload)
-        return -1;
-
-    r = recv(sock, payload, remaining_length, 0);
-    free(payload);
-
-    if (r <= 0)
+    KrakenMqttFrame frame;
+    int rc;
+    while ((rc = kraken_mqtt_reader_next(rd, &frame)) == 1) {
+    }
+    if (rc < 0) {
+        // Lost framing; drop the buffered bytes and resynchronise on new input
+        kraken_mqtt_reader_init(rd, rd->buf, rd->cap);
         return -1;
-
+    }
     return 0;
 }
 
@@ -264,6 +257,9 @@ typedef struct {
 
 void *reading_loop(void *arg) {
     reading_loop_arg *rla = (reading_loop_arg *)arg;
+    uint8_t rx[4096];
+    KrakenMqttReader rd;
+    kraken_mqtt_reader_init(&rd, rx, sizeof(rx));
     while (1) {
         pthread_mutex_lock(rla->mutex);
         int done = rla->conn->done;
@@ -272,7 +268,7 @@ void *reading_loop(void *arg) {
             break;
         }
 
-        read_mqtt_response(rla->conn->sock);
+        read_mqtt_response(rla->conn->sock, &rd);
         usleep(1000);
     }
     return NULL;
@@ -388,22 +384,23 @@ KRAKEN_API int kraken_run(const char *host, uint32_t port, uint32_t timeout_ms,
     result->target.port = (uint16_t)port;
 
     // 2. Perform MQTT checks
-    char *sequence_num = json_extract_string(params_json, "sequence_num");
-    int seq_num = 0;
-    if (sequence_num && *sequence_num) {
-        seq_num = (int)strtol(sequence_num, NULL, 10);
-    } else {
+    KrakenParams params;
+    if (kraken_params_parse(&params, params_json) != 0) {
+        add_log(result, "malformed params_json, ignoring parameters");
+    }
+
+    int seq_num = (int)kraken_params_int(&params, "sequence_num", 0);
+    if (seq_num <= 0) {
         add_log(result, "missing or empty sequence_num, defaulting to 0");
     }
-    free(sequence_num);
 
     time_t ts = time(NULL);
     for (int i = 0; i < seq_num; i++) {
         bool is_successfull = false;
 
-        char buff[1000] = {};
-        int ok = sprintf(buff, "path%d", i);
-        char *path = json_extract_string(params_json, buff);
+        char key[32];
+        snprintf(key, sizeof(key), "path%d", i);
+        char *path = kraken_params_strdup(&params, key);
         if (!path || !*path) {
             add_log(result, "missing replay path in params, skipping entry");
             free(path);
@@ -478,6 +475,8 @@ KRAKEN_API int kraken_run(const char *host, uint32_t port, uint32_t timeout_ms,
         }
     }
 
+    kraken_params_free(&params);
+
     *out_result = result;
     return 0;
 }
@@ -14,132 +14,12 @@
 
 #define KRAKEN_MODULE_BUILD
 #include <kraken_module_abi.h>
+#include <kraken_mqtt.h>
+#include <kraken_params.h>
 
 KRAKEN_API const uint32_t KRAKEN_MODULE_ABI_VERSION = KRAKEN_ABI_VERSION;
 static const char *LOG_PREFIX = "[mqtt-sys-disclosure] ";
 
-/* -------------------------------------------------------- */
-/* Minimal MQTT Helper                                      */
-/* -------------------------------------------------------- */
-
-typedef struct {
-    uint8_t buf[512];
-    size_t len;
-} mqtt_packet_t;
-
-static int mqtt_encode_string(uint8_t *buf, const char *s) {
-    size_t len = strlen(s);
-    if (len > 65535)
-        return -1;
-    buf[0] = (uint8_t)(len >> 8);
-    buf[1] = (uint8_t)(len & 0xFF);
-    memcpy(buf + 2, s, len);
-    return (int)(len + 2);
-}
-
-static int mqtt_build_connect(mqtt_packet_t *pkt, const char *client_id, const char *user, const char *pass) {
-    pkt->len = 0;
-    uint8_t *p = pkt->buf;
-    const char *proto = "MQTT";
-    int wrote = mqtt_encode_string(p, proto);
-    if (wrote < 0)
-        return -1;
-    p += wrote;
-    *p++ = 4; // Protocol level 3.1.1
-    uint8_t flags = 0;
-    if (user && *user)
-        flags |= 0x80;
-    if (pass && *pass)
-        flags |= 0x40;
-    *p++ = flags;
-    *p++ = 0;
-    *p++ = 60; // Keepalive 60s
-    wrote = mqtt_encode_string(p, client_id);
-    if (wrote < 0)
-        return -1;
-    p += wrote;
-    if (user && *user) {
-        wrote = mqtt_encode_string(p, user);
-        if (wrote < 0)
-            return -1;
-        p += wrote;
-    }
-    if (pass && *pass) {
-        wrote = mqtt_encode_string(p, pass);
-        if (wrote < 0)
-            return -1;
-        p += wrote;
-    }
-
-    size_t rem_len = p - pkt->buf;
-    uint8_t head[5];
-    size_t hl = 1;
-    head[0] = 0x10; // CONNECT
-    size_t x = rem_len;
-    do {
-        uint8_t b = x % 128;
-        x /= 128;
-        if (x > 0)
-            b |= 128;
-        head[hl++] = b;
-    } while (x > 0);
-
-    memmove(pkt->buf + hl, pkt->buf, rem_len);
-    memcpy(pkt->buf, head, hl);
-    pkt->len = rem_len + hl;
-    return (int)pkt->len;
-}
-
-static int mqtt_build_subscribe(mqtt_packet_t *pkt, const char *topic) {
-    pkt->len = 0;
-    uint8_t *p = pkt->buf;
-    size_t topic_len = strlen(topic);
-    size_t rem_len = 2 + 2 + topic_len + 1;
-    *p++ = 0x82; // SUBSCRIBE
-    *p++ = (uint8_t)rem_len; // Fits for small topics
-    *p++ = 0;
-    *p++ = 1; // Packet ID
-    int wrote = mqtt_encode_string(p, topic);
-    if (wrote < 0)
-        return -1;
-    p += wrote;
-    *p++ = 0; // QoS 0
-    pkt->len = p - pkt->buf;
-    return (int)pkt->len;
-}
-
-static int mqtt_build_publish(mqtt_packet_t *pkt, const char *topic, const char *msg) {
-    pkt->len = 0;
-    uint8_t *p = pkt->buf;
-    *p++ = 0x30; // PUBLISH, QoS 0
-    size_t topic_len = strlen(topic);
-    size_t msg_len = strlen(msg);
-    size_t rem_len = 2 + topic_len + msg_len;
-    size_t rem_temp = rem_len;
-    do {
-        uint8_t b = rem_temp % 128;
-        rem_temp /= 128;
-        if (rem_temp > 0)
-            b |= 128;
-        *p++ = b;
-    } while (rem_temp > 0);
-    int wrote = mqtt_encode_string(p, topic);
-    if (wrote < 0)
-        return -1;
-    p += wrote;
-    memcpy(p, msg, msg_len);
-    pkt->len = (p + msg_len) - pkt->buf;
-    return (int)pkt->len;
-}
-
-static int mqtt_parse_connack(const uint8_t *buf, size_t n) {
-    return n >= 4 && buf[0] == 0x20 && buf[3] == 0x00;
-}
-
-static int mqtt_parse_suback(const uint8_t *buf, size_t n) {
-    return n >= 3 && buf[0] == 0x90;
-}
-
 /* -------------------------------------------------------- */
 /* Networking helpers                                       */
 /* -------------------------------------------------------- */
@@ -233,112 +113,106 @@ static int connect_tcp(const char *host, uint16_t port, uint32_t timeout_ms) {
     return sock;
 }
 
-static ssize_t mqtt_read_packet(int sock, uint8_t *buf, size_t buf_len) {
-    ssize_t r = recv(sock, buf, 1, 0);
-    if (r <= 0)
-        return r;
-    size_t offset = (size_t)r;
-
-    size_t multiplier = 1;
-    size_t remaining_length = 0;
-    uint8_t byte = 0;
-    do {
-        if (offset >= buf_len)
-            return -1;
-        r = recv(sock, &byte, 1, 0);
-        if (r <= 0)
-            return r;
-        buf[offset++] = byte;
-        remaining_length += (byte & 127) * multiplier;
-        multiplier *= 128;
-        if (multiplier > (128 * 128 * 128 * 128))
-            return -1;
-    } while (byte & 128);
+/* -------------------------------------------------------- */
+/* MQTT operations over raw sockets                         */
+/* -------------------------------------------------------- */
 
-    if (remaining_length > buf_len - offset)
+typedef struct {
+    int sock;
+    KrakenMqttReader rd;
+    uint8_t rx[4096];
+} mqtt_conn_t;
+
+static int mqtt_send_encoded(mqtt_conn_t *c, const uint8_t *pkt, size_t len, size_t cap) {
+    if (len == 0 || len > cap)
         return -1;
+    return send_all(c->sock, pkt, len);
+}
 
-    size_t to_read = remaining_length;
-    while (to_read > 0) {
-        r = recv(sock, buf + offset, to_read, 0);
+/* Next complete packet from the connection, framed in place in c->rx.
+   Returns 1 with `f` filled, 0 on timeout, -1 on error or malformed stream. */
+static int mqtt_next_packet(mqtt_conn_t *c, uint32_t timeout_ms, KrakenMqttFrame *f) {
+    for (;;) {
+        int rc = kraken_mqtt_reader_next(&c->rd, f);
+        if (rc != 0)
+            return rc;
+
+        struct pollfd pfd = {
+            .fd = c->sock,
+            .events = POLLIN,
+        };
+        int pr = poll(&pfd, 1, (int)effective_timeout(timeout_ms));
+        if (pr == 0)
+            return 0; // timeout
+        if (pr < 0) {
+            if (errno == EINTR)
+                return 0;
+            return -1;
+        }
+
+        size_t room;
+        uint8_t *dst = kraken_mqtt_reader_space(&c->rd, &room);
+        ssize_t r = recv(c->sock, dst, room, 0);
+        if (r < 0 && errno == EINTR)
+            continue;
         if (r <= 0)
-            return r;
-        offset += (size_t)r;
-        to_read -= (size_t)r;
+            return -1;
+        kraken_mqtt_reader_commit(&c->rd, r);
     }
-    return (ssize_t)offset;
 }
 
-static ssize_t mqtt_read_packet_with_timeout(int sock, uint8_t *buf, size_t buf_len, uint32_t timeout_ms) {
-    struct pollfd pfd = {
-        .fd = sock,
-        .events = POLLIN,
-    };
-    int wait_ms = (int)effective_timeout(timeout_ms);
-    int pr = poll(&pfd, 1, wait_ms);
-    if (pr == 0)
-        return 0; // timeout
-    if (pr < 0) {
-        if (errno == EINTR)
+/* Wait for a packet of `type`, skipping any other traffic. */
+static int mqtt_await(mqtt_conn_t *c, uint8_t type, uint32_t timeout_ms, KrakenMqttFrame *f) {
+    for (;;) {
+        int rc = mqtt_next_packet(c, timeout_ms, f);
+        if (rc <= 0)
+            return -1;
+        if (f->type == type)
             return 0;
-        return -1;
     }
-    return mqtt_read_packet(sock, buf, buf_len);
 }
 
-/* -------------------------------------------------------- */
-/* MQTT operations over raw sockets                         */
-/* -------------------------------------------------------- */
-
-static int mqtt_client_connect(int *out_sock, const char *host, uint16_t port, const char *client_id, const char *user, const char *pass,
+static int mqtt_client_connect(mqtt_conn_t *c, const char *host, uint16_t port, const char *client_id, const char *user, const char *pass,
                                uint32_t timeout_ms) {
-    int sock = connect_tcp(host, port, timeout_ms);
-    if (sock < 0)
+    c->sock = connect_tcp(host, port, timeout_ms);
+    if (c->sock < 0)
         return -1;
-
-    mqtt_packet_t pkt;
-    if (mqtt_build_connect(&pkt, client_id, user, pass) < 0) {
-        close(sock);
+    kraken_mqtt_reader_init(&c->rd, c->rx, sizeof(c->rx));
+
+    uint8_t pkt[512];
+    KrakenMqttConnect req = {.version = KRAKEN_MQTT_V311, .client_id = client_id, .username = user, .password = pass, .keep_alive = 60};
+    KrakenMqttFrame f;
+    KrakenMqttConnack ack;
+    if (mqtt_send_encoded(c, pkt, kraken_mqtt_encode_connect(pkt, sizeof(pkt), &req), sizeof(pkt)) != 0 ||
+        mqtt_await(c, KRAKEN_MQTT_CONNACK, timeout_ms, &f) != 0 || kraken_mqtt_parse_connack(&f, KRAKEN_MQTT_V311, &ack) != 0 ||
+        ack.reason_code != 0) {
+        close(c->sock);
+        c->sock = -1;
         return -1;
     }
-
-    if (send_all(sock, pkt.buf, pkt.len) != 0) {
-        close(sock);
-        return -1;
-    }
-
-    uint8_t resp[32];
-    ssize_t got = mqtt_read_packet_with_timeout(sock, resp, sizeof(resp), timeout_ms);
-    if (got <= 0 || !mqtt_parse_connack(resp, (size_t)got)) {
-        close(sock);
-        return -1;
-    }
-
-    *out_sock = sock;
     return 0;
 }
 
-static int mqtt_client_subscribe(int sock, const char *topic, uint32_t timeout_ms) {
-    mqtt_packet_t pkt;
-    int len = mqtt_build_subscribe(&pkt, topic);
-    if (len < 0)
-        return -1;
-    if (send_all(sock, pkt.buf, (size_t)len) != 0)
+static int mqtt_client_subscribe(mqtt_conn_t *c, const char *topic, uint32_t timeout_ms) {
+    uint8_t pkt[512];
+    KrakenMqttSubscription sub = {.topic = topic, .options = 0};
+    KrakenMqttSubscribe req = {.version = KRAKEN_MQTT_V311, .packet_id = 1, .subs = &sub, .count = 1};
+    if (mqtt_send_encoded(c, pkt, kraken_mqtt_encode_subscribe(pkt, sizeof(pkt), &req), sizeof(pkt)) != 0)
         return -1;
 
-    uint8_t resp[64];
-    ssize_t got = mqtt_read_packet_with_timeout(sock, resp, sizeof(resp), timeout_ms);
-    if (got <= 0 || !mqtt_parse_suback(resp, (size_t)got))
+    KrakenMqttFrame f;
+    KrakenMqttSuback ack;
+    if (mqtt_await(c, KRAKEN_MQTT_SUBACK, timeout_ms, &f) != 0 || kraken_mqtt_parse_suback(&f, KRAKEN_MQTT_V311, &ack) != 0)
         return -1;
+    if (ack.count == 0 || ack.reason_codes[0] > 0x02)
+        return -1; // Subscription refused (0x80)
     return 0;
 }
 
-static int mqtt_client_publish(int sock, const char *topic, const char *msg, uint32_t timeout_ms) {
-    mqtt_packet_t pkt;
-    int len = mqtt_build_publish(&pkt, topic, msg);
-    if (len < 0)
-        return -1;
-    return send_all(sock, pkt.buf, (size_t)len);
+static int mqtt_client_publish(mqtt_conn_t *c, const char *topic, const char *msg) {
+    uint8_t pkt[512];
+    KrakenMqttPublishOut req = {.version = KRAKEN_MQTT_V311, .topic = topic, .payload = msg, .payload_len = strlen(msg)};
+    return mqtt_send_encoded(c, pkt, kraken_mqtt_encode_publish(pkt, sizeof(pkt), &req), sizeof(pkt));
 }
 
 static uint64_t now_ms(void) {
@@ -347,70 +221,49 @@ static uint64_t now_ms(void) {
     return (uint64_t)tv.tv_sec * 1000ULL + (uint64_t)tv.tv_usec / 1000ULL;
 }
 
-static bool mqtt_wait_for_sys_topic(int sock, const char *prefix, uint32_t wait_window_ms, char *topic_buf, size_t topic_buf_len, char *payload_buf, size_t payload_buf_len) {
+static bool mqtt_wait_for_sys_topic(mqtt_conn_t *c, const char *prefix, uint32_t wait_window_ms, char *topic_buf, size_t topic_buf_len, char *payload_buf, size_t payload_buf_len) {
     if (!prefix || !*prefix)
         prefix = "$SYS/";
     if (topic_buf_len == 0)
         return false;
     size_t prefix_len = strlen(prefix);
     uint64_t deadline = now_ms() + wait_window_ms;
-    uint8_t packet[1024];
 
     while (1) {
         uint64_t now = now_ms();
         if (now >= deadline)
             break;
         uint32_t remaining = (uint32_t)(deadline - now);
-        ssize_t got = mqtt_read_packet_with_timeout(sock, packet, sizeof(packet), remaining);
+        KrakenMqttFrame f;
+        int got = mqtt_next_packet(c, remaining, &f);
         if (got < 0)
             break;
         if (got == 0)
             continue;
-        if ((packet[0] & 0xF0) != 0x30)
-            continue; // Not a PUBLISH
 
-        size_t offset = 1;
-        size_t multiplier = 1;
-        size_t remaining_length = 0;
-        uint8_t byte;
-        do {
-            if (offset >= (size_t)got)
-                break;
-            byte = packet[offset++];
-            remaining_length += (byte & 127) * multiplier;
-            multiplier *= 128;
-        } while (byte & 128);
-        if (offset + 2 > (size_t)got)
-            continue;
-
-        size_t topic_len = ((size_t)packet[offset] << 8) | packet[offset + 1];
-        offset += 2;
-        if (topic_len == 0 || offset + topic_len > (size_t)got)
+        KrakenMqttPublish pub;
+        if (kraken_mqtt_parse_publish(&f, KRAKEN_MQTT_V311, &pub) != 0 || pub.topic_len == 0)
+            continue; // Not a PUBLISH
+        if (pub.topic_len < prefix_len || strncmp(pub.topic, prefix, prefix_len) != 0)
             continue;
 
-        size_t topic_copy_len = topic_len;
+        size_t topic_copy_len = pub.topic_len;
         if (topic_copy_len >= topic_buf_len)
             topic_copy_len = topic_buf_len - 1;
-        memcpy(topic_buf, packet + offset, topic_copy_len);
+        memcpy(topic_buf, pub.topic, topic_copy_len);
         topic_buf[topic_copy_len] = '\0';
 
-        offset += topic_len;
-
-        if (strncmp(topic_buf, prefix, prefix_len) == 0) {
-            if (payload_buf && payload_buf_len > 0) {
-                size_t payload_len = 0;
-                if ((size_t)got > offset)
-                    payload_len = (size_t)got - offset;
-                size_t max_bytes = (payload_buf_len - 1) / 2; // hex encoding
-                if (payload_len > max_bytes)
-                    payload_len = max_bytes;
-                for (size_t i = 0; i < payload_len; i++) {
-                    snprintf(payload_buf + (i * 2), payload_buf_len - (i * 2), "%02x", packet[offset + i]);
-                }
-                payload_buf[payload_len * 2] = '\0';
+        if (payload_buf && payload_buf_len > 0) {
+            size_t payload_len = pub.payload_len;
+            size_t max_bytes = (payload_buf_len - 1) / 2; // hex encoding
+            if (payload_len > max_bytes)
+                payload_len = max_bytes;
+            for (size_t i = 0; i < payload_len; i++) {
+                snprintf(payload_buf + (i * 2), payload_buf_len - (i * 2), "%02x", pub.payload[i]);
             }
-            return true;
+            payload_buf[payload_len * 2] = '\0';
         }
+        return true;
     }
     return false;
 }
@@ -431,11 +284,17 @@ KRAKEN_API int kraken_run(const char *host, uint32_t port, uint32_t timeout_ms,
 snprintf(logbuf, sizeof(logbuf), "%sMQTT $SYS disclosure assessment started", LOG_PREFIX);
 add_log(result, logbuf);
 
-    char *username = json_extract_string(params_json, "username");
-    char *password = json_extract_string(params_json, "password");
+    KrakenParams params;
+    if (kraken_params_parse(&params, params_json) != 0) {
+        snprintf(logbuf, sizeof(logbuf), "%smalformed params_json, ignoring parameters", LOG_PREFIX);
+        add_log(result, logbuf);
+    }
+    char *username = kraken_params_strdup(&params, "username");
+    char *password = kraken_params_strdup(&params, "password");
+    kraken_params_free(&params);
     const char *sys_prefix = "$SYS";
 
-    int sock = -1;
+    mqtt_conn_t *mc = calloc(1, sizeof(*mc));
     bool leak_detected = false;
     char leaked_topic[256] = {0};
     char leaked_payload[512] = {0};
@@ -444,7 +303,9 @@ add_log(result, logbuf);
 
     char client_id[48];
     snprintf(client_id, sizeof(client_id), "krk-sys-%u", (unsigned)rand());
-    if (mqtt_client_connect(&sock, host, (uint16_t)port, client_id, username, password, op_timeout) != 0) {
+    if (mc)
+        mc->sock = -1;
+    if (!mc || mqtt_client_connect(mc, host, (uint16_t)port, client_id, username, password, op_timeout) != 0) {
         snprintf(logbuf, sizeof(logbuf), "%sfailed to connect", LOG_PREFIX);
         add_log(result, logbuf);
         goto finalize;
@@ -454,7 +315,7 @@ add_log(result, logbuf);
 
     char sys_topic[128];
     snprintf(sys_topic, sizeof(sys_topic), "%s/#", sys_prefix);
-    if (mqtt_client_subscribe(sock, sys_topic, op_timeout) != 0) {
+    if (mqtt_client_subscribe(mc, sys_topic, op_timeout) != 0) {
         snprintf(logbuf, sizeof(logbuf), "%sfailed to subscribe to '%s'", LOG_PREFIX, sys_topic);
         add_log(result, logbuf);
         goto finalize;
@@ -464,7 +325,7 @@ add_log(result, logbuf);
 
     char probe_topic[128];
     snprintf(probe_topic, sizeof(probe_topic), "kraken/probe/%u", (unsigned)rand());
-    if (mqtt_client_publish(sock, probe_topic, "1", op_timeout) != 0) {
+    if (mqtt_client_publish(mc, probe_topic, "1") != 0) {
         snprintf(logbuf, sizeof(logbuf), "%sfailed to publish probe", LOG_PREFIX);
         add_log(result, logbuf);
     }
@@ -472,7 +333,7 @@ add_log(result, logbuf);
     uint32_t wait_window = op_timeout * 2;
     if (wait_window > 15000)
         wait_window = 15000;
-    leak_detected = mqtt_wait_for_sys_topic(sock, sys_prefix, wait_window, leaked_topic, sizeof(leaked_topic), leaked_payload, sizeof(leaked_payload));
+    leak_detected = mqtt_wait_for_sys_topic(mc, sys_prefix, wait_window, leaked_topic, sizeof(leaked_topic), leaked_payload, sizeof(leaked_payload));
     if (leak_detected) {
         snprintf(logbuf, sizeof(logbuf), "%sreceived $SYS topic: %s", LOG_PREFIX, leaked_topic);
         add_log(result, logbuf);
@@ -487,8 +348,9 @@ add_log(result, logbuf);
     }
 
 finalize:
-    if (sock >= 0)
-        close(sock);
+    if (mc && mc->sock >= 0)
+        close(mc->sock);
+    free(mc);
 
     KrakenFinding finding = {0};
     finding.id = mystrdup("mqtt-sys-disclosure");
@@ -1,6 +1,7 @@
 #define KRAKEN_MODULE_BUILD
 
 #include <kraken_module_abi.h>
+#include <kraken_params.h>
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -150,9 +151,12 @@ KRAKEN_API int kraken_run(const char *host, uint32_t port, uint32_t timeout_ms,
 #endif
 
     // Parameters
-    char *min_version_str = json_extract_string(params_json, "min_version");
-    char *max_version_str = json_extract_string(params_json, "max_version");
-    char *sni_override = json_extract_string(params_json, "sni");
+    KrakenParams params;
+    bool params_ok = kraken_params_parse(&params, params_json) == 0;
+    char *min_version_str = kraken_params_strdup(&params, "min_version");
+    char *max_version_str = kraken_params_strdup(&params, "max_version");
+    char *sni_override = kraken_params_strdup(&params, "sni");
+    kraken_params_free(&params);
     int min_version = parse_tls_version(min_version_str);
     int max_version = parse_tls_version(max_version_str);
 
@@ -163,6 +167,8 @@ KRAKEN_API int kraken_run(const char *host, uint32_t port, uint32_t timeout_ms,
 
     result->target.host = mystrdup(host);
     result->target.port = (uint16_t)port;
+    if (!params_ok)
+        add_log(result, "malformed params_json, ignoring parameters");
 
     // 2. Perform TLS version checks
     const int versions_to_check[] = {TLS1_VERSION, TLS1_1_VERSION, TLS1_2_VERSION, TLS1_3_VERSION};
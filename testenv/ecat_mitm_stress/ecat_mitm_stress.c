@@ -0,0 +1,274 @@
+// ecat_mitm reentrancy stress test
+// Runs N ecat_mitm sessions at once, one per thread, each on its own veth
+// pair, and checks that every run succeeds and reports only its own
+// traffic. Built with -fsanitize=thread, so any state the runs share
+// without synchronisation fails the test as a data race.
+//
+//   run i --- kmsNa <== veth ==> kmsNb --- segment i (master + slave reply)
+//
+// The segment stands in for a live line: every cycle it sends a master
+// frame and the slave's reply (source MAC U/L bit flipped), and it answers
+// whatever the run replays the same way, so the run sees its stamped
+// replays again. Pairs are created and removed by the test, which needs
+// CAP_NET_ADMIN and CAP_NET_RAW; without them it exits 77 (skipped).
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <getopt.h>
+#include <linux/if_packet.h>
+#include <net/if.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "kraken_ecat_frame.h"
+#include "kraken_module_abi_v3.h"
+#include "kraken_packet_conduit.h"
+
+#define ECAT_ETHERTYPE 0x88A4
+#define MAX_RUNS 16
+#define CYCLE_NS 1000000LL
+#define EXIT_SKIP 77
+
+typedef struct {
+    int index;
+    char run_iface[IF_NAMESIZE]; // the module's end
+    char seg_iface[IF_NAMESIZE]; // the segment's end
+    int duration_ms;
+    char pcap_path[128];
+
+    // Segment
+    int seg_fd;
+    volatile int stop;
+    uint64_t cycles;
+    uint64_t answered;
+
+    // What the run reported through its sink
+    int rc;
+    int logs;
+    int findings;
+    bool success;
+    char finding_iface[IF_NAMESIZE];
+    char stamps[256];
+} stress_run_t;
+
+static int64_t stress_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int sh(const char *fmt, const char *a, const char *b) {
+    char cmd[256];
+    snprintf(cmd, sizeof(cmd), fmt, a, b);
+    return system(cmd);
+}
+
+static bool veth_create(const stress_run_t *r) {
+    sh("ip link del %s 2>/dev/null%s", r->run_iface, "");
+    return sh("ip link add %s type veth peer name %s", r->run_iface, r->seg_iface) == 0 &&
+           sh("ip link set %s up && ip link set %s up", r->run_iface, r->seg_iface) == 0;
+}
+
+static void veth_delete(const stress_run_t *r) {
+    sh("ip link del %s 2>/dev/null%s", r->run_iface, "");
+}
+
+/* ------------------------------------------------------------------ */
+/* Segment                                                            */
+/* ------------------------------------------------------------------ */
+
+static int segment_socket(const char *iface) {
+    int fd = socket(AF_PACKET, SOCK_RAW | SOCK_CLOEXEC, htons(ECAT_ETHERTYPE));
+    if (fd < 0) return -1;
+    struct sockaddr_ll sll = {0};
+    sll.sll_family = AF_PACKET;
+    sll.sll_protocol = htons(ECAT_ETHERTYPE);
+    sll.sll_ifindex = (int)if_nametoindex(iface);
+    if (sll.sll_ifindex == 0 || bind(fd, (struct sockaddr *)&sll, sizeof(sll)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Master frame of cycle `n`: LRW of 8 bytes of process data and a BRD of
+// AL status, from 02:00:00:00:<run>:01
+static size_t segment_frame(const stress_run_t *r, uint8_t *buf, uint64_t n) {
+    static const uint8_t bcast[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+    memcpy(buf, bcast, 6);
+    const uint8_t src[6] = {0x02, 0, 0, 0, (uint8_t)r->index, 0x01};
+    memcpy(buf + 6, src, 6);
+    buf[12] = ECAT_ETHERTYPE >> 8;
+    buf[13] = ECAT_ETHERTYPE & 0xFF;
+    uint8_t pd[8];
+    for (int i = 0; i < 8; i++) pd[i] = (uint8_t)(n >> (8 * (i % 4)));
+    KrakenEcatFrame f;
+    kraken_ecat_frame_init(&f, buf + 14, KRAKEN_ECAT_MAX_FRAME, false);
+    KrakenEcatDatagram lrw = {.cmd = KRAKEN_ECAT_CMD_LRW, .index = (uint8_t)n, .data = pd, .len = sizeof(pd)};
+    KrakenEcatDatagram brd = {.cmd = KRAKEN_ECAT_CMD_BRD, .index = (uint8_t)n, .ado = 0x0130, .len = 2};
+    kraken_ecat_frame_append(&f, &lrw);
+    kraken_ecat_frame_append(&f, &brd);
+    size_t len = 14 + kraken_ecat_frame_finish(&f);
+    return len < 60 ? 60 : len;
+}
+
+// A slave's answer to a frame: same frame, U/L bit of the source flipped
+static void segment_reply(int fd, uint8_t *frame, size_t len) {
+    frame[6] ^= 0x02;
+    send(fd, frame, len, MSG_DONTWAIT);
+}
+
+static void *segment_thread(void *arg) {
+    stress_run_t *r = arg;
+    uint8_t frame[KRAKEN_ECAT_MAX_FRAME + 14];
+    int64_t next = stress_now_ns();
+    while (!__atomic_load_n(&r->stop, __ATOMIC_ACQUIRE)) {
+        size_t len = segment_frame(r, frame, r->cycles++);
+        send(r->seg_fd, frame, len, MSG_DONTWAIT);
+        segment_reply(r->seg_fd, frame, len);
+
+        // Answer the run's replays until the next cycle is due
+        next += CYCLE_NS;
+        for (;;) {
+            int64_t wait = next - stress_now_ns();
+            if (wait <= 0) break;
+            struct timeval tv = {0, (suseconds_t)(wait / 1000)};
+            setsockopt(r->seg_fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+            struct sockaddr_ll from;
+            socklen_t fromlen = sizeof(from);
+            ssize_t n = recvfrom(r->seg_fd, frame, sizeof(frame), 0, (struct sockaddr *)&from, &fromlen);
+            if (n <= 0 || from.sll_pkttype == PACKET_OUTGOING) continue;
+            segment_reply(r->seg_fd, frame, (size_t)n);
+            r->answered++;
+        }
+    }
+    return NULL;
+}
+
+/* ------------------------------------------------------------------ */
+/* Runs                                                               */
+/* ------------------------------------------------------------------ */
+
+static void on_log(void *ctx, const char *line) {
+    stress_run_t *r = ctx;
+    r->logs++;
+    if (getenv("STRESS_VERBOSE")) fprintf(stderr, "[%s] %s\n", r->run_iface, line);
+}
+
+static void on_finding(void *ctx, const KrakenFindingV2 *f) {
+    stress_run_t *r = ctx;
+    r->findings++;
+    r->success = f->success;
+    if (f->target.kind == KRAKEN_TARGET_KIND_ETHERCAT && f->target.u.ethercat.iface)
+        snprintf(r->finding_iface, sizeof(r->finding_iface), "%s", f->target.u.ethercat.iface);
+    for (size_t i = 0; i < f->evidence.count; i++) {
+        if (strcmp(f->evidence.items[i].key, "stamps") == 0)
+            snprintf(r->stamps, sizeof(r->stamps), "%s", f->evidence.items[i].value);
+    }
+}
+
+static void *run_thread(void *arg) {
+    stress_run_t *r = arg;
+    r->rc = -1;
+    KrakenPacketConduit *c = kraken_conduit_open_frame(r->run_iface, NULL, ECAT_ETHERTYPE);
+    if (!c) return NULL;
+    char params[256];
+    snprintf(params, sizeof(params), "{\"duration_ms\":%d,\"pcap_path\":\"%s\"}", r->duration_ms, r->pcap_path);
+    KrakenTarget target = {0};
+    target.kind = KRAKEN_TARGET_KIND_ETHERCAT;
+    target.u.ethercat.iface = r->run_iface;
+    KrakenResultSink sink = {r, on_log, on_finding};
+    r->rc = kraken_run_v3(c, kraken_conduit_ops(), &target, 1000, params, &sink);
+    kraken_conduit_close(c);
+    return NULL;
+}
+
+// Every run must succeed on its own interface, with its own replays seen again
+static bool run_check(const stress_run_t *r) {
+    const char *why = NULL;
+    unsigned long long seen = 0;
+    int sent = 0;
+    if (r->rc != 0) why = "run failed";
+    else if (r->findings != 1) why = "expected exactly one finding";
+    else if (!r->success) why = "finding not successful (nothing captured or replayed)";
+    else if (strcmp(r->finding_iface, r->run_iface) != 0) why = "finding names another run's interface";
+    else if (sscanf(r->stamps, "%llu of %d", &seen, &sent) != 2 || sent == 0 || seen == 0) why = "no stamped replays seen again";
+    fprintf(stderr, "%s %s: rc %d, %d logs, %d findings, segment %llu cycles / %llu answered, stamps: %s%s%s\n", why ? "FAIL" : "ok  ",
+            r->run_iface, r->rc, r->logs, r->findings, (unsigned long long)r->cycles, (unsigned long long)r->answered,
+            r->stamps[0] ? r->stamps : "-", why ? " -- " : "", why ? why : "");
+    return why == NULL;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "usage: %s [-n RUNS] [-d DURATION_MS]\n"
+                    "  -n  concurrent ecat_mitm runs, one veth pair each, 2-%d (default 4)\n"
+                    "  -d  duration_ms of each run (default 1000)\n",
+            prog, MAX_RUNS);
+}
+
+int main(int argc, char **argv) {
+    int runs = 4, duration_ms = 1000, opt;
+    while ((opt = getopt(argc, argv, "n:d:h")) != -1) {
+        switch (opt) {
+        case 'n': runs = atoi(optarg); break;
+        case 'd': duration_ms = atoi(optarg); break;
+        default: usage(argv[0]); return 2;
+        }
+    }
+    if (runs < 2 || runs > MAX_RUNS || duration_ms < 1) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    stress_run_t *r = calloc((size_t)runs, sizeof(*r));
+    if (!r) return 1;
+    int created = 0, rc = 0;
+    for (int i = 0; i < runs; i++, created++) {
+        r[i].index = i;
+        r[i].duration_ms = duration_ms;
+        snprintf(r[i].run_iface, sizeof(r[i].run_iface), "kms%da", i);
+        snprintf(r[i].seg_iface, sizeof(r[i].seg_iface), "kms%db", i);
+        snprintf(r[i].pcap_path, sizeof(r[i].pcap_path), "/tmp/ecat_mitm_stress_%d_%d.pcapng", (int)getpid(), i);
+        if (!veth_create(&r[i]) || (r[i].seg_fd = segment_socket(r[i].seg_iface)) < 0) {
+            fprintf(stderr, "ecat_mitm_stress: cannot set up %s/%s (needs CAP_NET_ADMIN and CAP_NET_RAW), skipping\n", r[i].run_iface,
+                    r[i].seg_iface);
+            veth_delete(&r[i]);
+            rc = EXIT_SKIP;
+            break;
+        }
+    }
+
+    if (rc == 0) {
+        pthread_t seg[MAX_RUNS], run[MAX_RUNS];
+        for (int i = 0; i < runs; i++) pthread_create(&seg[i], NULL, segment_thread, &r[i]);
+        for (int i = 0; i < runs; i++) pthread_create(&run[i], NULL, run_thread, &r[i]);
+        for (int i = 0; i < runs; i++) pthread_join(run[i], NULL);
+        for (int i = 0; i < runs; i++) {
+            __atomic_store_n(&r[i].stop, 1, __ATOMIC_RELEASE);
+            pthread_join(seg[i], NULL);
+        }
+        for (int i = 0; i < runs; i++) {
+            if (!run_check(&r[i])) rc = 1;
+        }
+    }
+
+    for (int i = 0; i < created; i++) {
+        close(r[i].seg_fd);
+        veth_delete(&r[i]);
+        unlink(r[i].pcap_path);
+    }
+    free(r);
+    if (rc == 0) fprintf(stderr, "ecat_mitm_stress: %d concurrent runs passed\n", runs);
+    return rc;
+}
@@ -0,0 +1,757 @@
+// EtherCAT segment simulator
+// A cyclic master and N slaves on one end of a veth pair, so the EtherCAT
+// modules can be benchmarked without hardware:
+//
+//   module --- simA <== veth ==> simB --- ecat_sim (master + slaves)
+//
+// The master sends its cycle frame out of simB. The slaves read it from
+// simB's outgoing tap on a socket of their own, process it against their
+// register maps and send the reply out of simB as well, with the U/L bit
+// of the source MAC flipped like the first slave of a real segment does.
+// A module on simA therefore sees master frames and slave replies as a tap
+// on a real line would, and whatever it sends arrives on simB where the
+// slaves process it in the same receive queue as the master's frames: a
+// flood delays and drops cycles instead of passing by.
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // recvmmsg
+#endif
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <getopt.h>
+#include <linux/filter.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <net/if.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "kraken_ecat_frame.h"
+#include "kraken_frame_filter.h"
+#include "kraken_histogram.h"
+#include "kraken_pacer.h"
+
+#define ECAT_ETHERTYPE 0x88A4
+#define ETH_HLEN_ 14
+#define FRAME_MAX 1518
+#define RX_BATCH 64
+#define MAX_SLAVES 64
+#define MIN_RATE_HZ 1000
+#define MAX_RATE_HZ 10000
+#define PDO_BYTES 4 // process image per slave, outputs and inputs alike
+#define STATION_BASE 0x1001
+#define STARTUP_TIMEOUT_MS 200
+
+// ESC register map, one per slave
+#define ESC_MAP_SIZE 0x2000
+#define REG_TYPE 0x0000
+#define REG_FMMUS 0x0004
+#define REG_SYNCMANAGERS 0x0005
+#define REG_RAM_KB 0x0006
+#define REG_FEATURES 0x0008
+#define REG_STATION 0x0010
+#define REG_AL_CONTROL 0x0120
+#define REG_AL_STATUS 0x0130
+#define REG_AL_CODE 0x0134
+#define REG_DC_RECV_PORT0 0x0900 // written to latch receive times
+#define REG_DC_SYSTEM_TIME 0x0910
+#define REG_DC_RECV_UNIT 0x0918
+#define REG_DC_OFFSET 0x0920
+#define REG_OUTPUTS 0x1000 // process data RAM the logical window maps to
+#define REG_INPUTS 0x1100
+
+#define AL_INIT 0x01
+#define AL_PREOP 0x02
+#define AL_SAFEOP 0x04
+#define AL_OP 0x08
+#define AL_ERROR 0x10
+#define AL_CODE_INVALID_CHANGE 0x0011
+#define AL_CODE_WATCHDOG 0x001B
+
+typedef struct {
+    uint8_t map[ESC_MAP_SIZE];
+    int64_t last_pd_ns; // last LRW/LWR that wrote outputs, for the watchdog
+    uint32_t cycles;    // reported as the slave's inputs
+} slave_t;
+
+typedef struct {
+    // Configuration
+    char iface[IF_NAMESIZE];
+    int slaves;
+    int rate_hz;
+    int duration_s;
+    int watchdog_ms;
+    bool json;
+    bool quiet;
+
+    int master_fd;
+    int slave_fd;
+    uint8_t mac[6]; // the master's; slave replies carry it with the U/L bit flipped
+    volatile sig_atomic_t *stop;
+
+    // Slaves, owned by the slave thread
+    slave_t *slave;
+
+    // Reply slot shared by the master's send loop and receive thread
+    pthread_mutex_t lock;
+    pthread_cond_t replied;
+    uint8_t expect_index;
+    bool waiting;
+    bool answered;
+    uint8_t reply[FRAME_MAX];
+    size_t reply_len;
+
+    // Counters, atomic
+    uint64_t cycles;      // cycle frames sent
+    uint64_t replies;     // cycle frames back before the next cycle
+    uint64_t missed;      // no reply by the next cycle
+    uint64_t wkc_errors;  // reply with an unexpected working counter
+    uint64_t al_errors;   // reply with a slave outside OP
+    uint64_t recoveries;  // OP requests sent after an AL error
+    uint64_t injected;    // EtherCAT frames arriving on the interface (not ours)
+    uint64_t processed;   // frames the slaves processed
+    uint64_t datagrams;   // datagrams the slaves processed
+    uint64_t drops;       // frames the kernel dropped from the slaves' queue
+    uint64_t watchdogs;   // slaves dropped to SAFEOP by the process data watchdog
+} sim_t;
+
+static volatile sig_atomic_t stop_flag;
+
+static void on_signal(int sig) {
+    (void)sig;
+    stop_flag = 1;
+}
+
+static void count(uint64_t *counter, uint64_t n) {
+    __atomic_fetch_add(counter, n, __ATOMIC_RELAXED);
+}
+
+static uint64_t counter(const uint64_t *c) {
+    return __atomic_load_n(c, __ATOMIC_RELAXED);
+}
+
+static void put32(uint8_t *p, uint32_t v) {
+    for (int i = 0; i < 4; i++) p[i] = (uint8_t)(v >> (8 * i));
+}
+
+static uint32_t get32(const uint8_t *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static void put64(uint8_t *p, uint64_t v) {
+    for (int i = 0; i < 8; i++) p[i] = (uint8_t)(v >> (8 * i));
+}
+
+static uint64_t get64(const uint8_t *p) {
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; i--) v = v << 8 | p[i];
+    return v;
+}
+
+/* ------------------------------------------------------------------ */
+/* Raw sockets                                                        */
+/* ------------------------------------------------------------------ */
+
+// ETH_P_ALL socket on `iface`: protocol sockets do not see the outgoing
+// tap. The "ethercat" filter keeps everything else in the kernel.
+// Returns: fd, or -1 with errno set.
+static int sim_socket(const char *iface) {
+    unsigned ifindex = if_nametoindex(iface);
+    if (ifindex == 0) return -1;
+    int fd = socket(AF_PACKET, SOCK_RAW | SOCK_CLOEXEC, htons(ETH_P_ALL));
+    if (fd < 0) return -1;
+    struct sockaddr_ll sll = {0};
+    sll.sll_family = AF_PACKET;
+    sll.sll_protocol = htons(ETH_P_ALL);
+    sll.sll_ifindex = (int)ifindex;
+    KrakenBpfInsn prog[KRAKEN_FILTER_MAX_INSNS];
+    KrakenFrameFilter filter = {.preset = "ethercat"};
+    int n = kraken_frame_filter_compile(&filter, prog, KRAKEN_FILTER_MAX_INSNS);
+    struct sock_fprog fprog = {.len = (unsigned short)n, .filter = (struct sock_filter *)(void *)prog};
+    if (bind(fd, (struct sockaddr *)&sll, sizeof(sll)) != 0 || n <= 0 ||
+        setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &fprog, sizeof(fprog)) != 0) {
+        int err = errno;
+        close(fd);
+        errno = err;
+        return -1;
+    }
+    return fd;
+}
+
+// Receive up to RX_BATCH frames, waiting up to timeout_ms for the first.
+// Returns: frames received, 0 on timeout, -1 on error.
+static int sim_recv(int fd, uint8_t bufs[][FRAME_MAX], struct mmsghdr *msgs, struct sockaddr_ll *from, int timeout_ms) {
+    struct iovec iovs[RX_BATCH];
+    memset(msgs, 0, RX_BATCH * sizeof(*msgs));
+    for (int i = 0; i < RX_BATCH; i++) {
+        iovs[i].iov_base = bufs[i];
+        iovs[i].iov_len = FRAME_MAX;
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        msgs[i].msg_hdr.msg_name = &from[i];
+        msgs[i].msg_hdr.msg_namelen = sizeof(from[i]);
+    }
+    int n = recvmmsg(fd, msgs, RX_BATCH, MSG_DONTWAIT, NULL);
+    if (n > 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) return n;
+    struct pollfd pfd = {.fd = fd, .events = POLLIN};
+    if (poll(&pfd, 1, timeout_ms) <= 0) return 0;
+    n = recvmmsg(fd, msgs, RX_BATCH, MSG_DONTWAIT, NULL);
+    return n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 0 : n;
+}
+
+/* ------------------------------------------------------------------ */
+/* Slaves                                                             */
+/* ------------------------------------------------------------------ */
+
+// Walk the datagram chain of an EtherCAT payload in place. Start with
+// *off = 0; each call returns the next datagram header and sets its data
+// length. Returns: NULL after the last well-formed datagram.
+static uint8_t *next_datagram(uint8_t *p, size_t len, size_t *off, size_t *dlen) {
+    if (len < KRAKEN_ECAT_HDR_LEN) return NULL;
+    uint16_t header = kraken_ecat_get16(p);
+    if ((header >> 12) != KRAKEN_ECAT_TYPE_COMMAND) return NULL;
+    size_t end = KRAKEN_ECAT_HDR_LEN + (header & KRAKEN_ECAT_LEN_MASK);
+    if (end > len) end = len;
+
+    if (*off == 0) {
+        *off = KRAKEN_ECAT_HDR_LEN;
+    } else {
+        uint16_t prev = kraken_ecat_get16(p + *off + 6);
+        if (!(prev & KRAKEN_ECAT_MORE)) return NULL;
+        *off += KRAKEN_ECAT_DGRAM_HDR_LEN + (prev & KRAKEN_ECAT_LEN_MASK) + KRAKEN_ECAT_WKC_LEN;
+    }
+    if (*off + KRAKEN_ECAT_DGRAM_HDR_LEN + KRAKEN_ECAT_WKC_LEN > end) return NULL;
+    *dlen = kraken_ecat_get16(p + *off + 6) & KRAKEN_ECAT_LEN_MASK;
+    if (*off + KRAKEN_ECAT_DGRAM_HDR_LEN + *dlen + KRAKEN_ECAT_WKC_LEN > end) return NULL;
+    return p + *off;
+}
+
+static void slave_init(slave_t *sl) {
+    memset(sl, 0, sizeof(*sl));
+    sl->map[REG_TYPE] = 0x11; // ET1100
+    sl->map[REG_FMMUS] = 8;
+    sl->map[REG_SYNCMANAGERS] = 8;
+    sl->map[REG_RAM_KB] = 8;
+    kraken_ecat_put16(sl->map + REG_FEATURES, 0x0004); // distributed clocks
+    kraken_ecat_put16(sl->map + REG_AL_STATUS, AL_INIT);
+}
+
+static uint16_t slave_station(const slave_t *sl) {
+    return kraken_ecat_get16(sl->map + REG_STATION);
+}
+
+static uint8_t slave_state(const slave_t *sl) {
+    return sl->map[REG_AL_STATUS] & 0x0F;
+}
+
+static void slave_al_error(slave_t *sl, uint8_t state, uint16_t code) {
+    kraken_ecat_put16(sl->map + REG_AL_STATUS, (uint16_t)(state | AL_ERROR));
+    kraken_ecat_put16(sl->map + REG_AL_CODE, code);
+}
+
+// INIT <-> PREOP <-> SAFEOP <-> OP, one step up at a time, any step down.
+// An error flag blocks state changes until the request acknowledges it.
+static void slave_al_control(slave_t *sl, int64_t now) {
+    uint16_t ctl = kraken_ecat_get16(sl->map + REG_AL_CONTROL);
+    uint8_t want = ctl & 0x0F, cur = slave_state(sl);
+    bool error = (sl->map[REG_AL_STATUS] & AL_ERROR) != 0;
+    if (error && !(ctl & AL_ERROR)) return;
+    bool valid = want == AL_INIT || want == AL_PREOP || want == AL_SAFEOP || want == AL_OP;
+    bool up_one = (want == AL_PREOP && cur == AL_INIT) || (want == AL_SAFEOP && cur == AL_PREOP) || (want == AL_OP && cur == AL_SAFEOP);
+    if (!valid || (want > cur && !up_one)) {
+        slave_al_error(sl, cur, AL_CODE_INVALID_CHANGE);
+        return;
+    }
+    kraken_ecat_put16(sl->map + REG_AL_STATUS, want);
+    kraken_ecat_put16(sl->map + REG_AL_CODE, 0);
+    if (want == AL_OP) sl->last_pd_ns = now; // watchdog starts on entering OP
+}
+
+static bool covers(uint16_t ado, size_t len, uint16_t reg) {
+    return reg >= ado && reg < ado + len;
+}
+
+// Register read into `data`; BRD and friends OR the slaves together.
+// Returns: false when the range is outside the map (no WKC).
+static bool slave_read(slave_t *sl, uint16_t ado, uint8_t *data, size_t len, bool or_in, int64_t now) {
+    if ((size_t)ado + len > ESC_MAP_SIZE) return false;
+    if (covers(ado, len, REG_DC_SYSTEM_TIME) || covers(REG_DC_SYSTEM_TIME, 8, ado))
+        put64(sl->map + REG_DC_SYSTEM_TIME, (uint64_t)(now + (int64_t)get64(sl->map + REG_DC_OFFSET)));
+    for (size_t i = 0; i < len; i++) data[i] = or_in ? (uint8_t)(data[i] | sl->map[ado + i]) : sl->map[ado + i];
+    return true;
+}
+
+// Register write from `data`, with the side effects of the registers hit.
+// Returns: false when the range is outside the map (no WKC).
+static bool slave_write(slave_t *sl, uint16_t ado, const uint8_t *data, size_t len, int64_t now) {
+    if ((size_t)ado + len > ESC_MAP_SIZE) return false;
+    for (size_t i = 0; i < len; i++) {
+        uint16_t reg = (uint16_t)(ado + i);
+        // Device information and AL status are read-only
+        if (reg < REG_STATION || (reg >= REG_AL_STATUS && reg < REG_AL_STATUS + 6)) continue;
+        sl->map[reg] = data[i];
+    }
+    if (covers(ado, len, REG_AL_CONTROL)) slave_al_control(sl, now);
+    if (covers(ado, len, REG_DC_RECV_PORT0)) {
+        // Latch the time the frame passed, as seen by this slave
+        put32(sl->map + REG_DC_RECV_PORT0, (uint32_t)now);
+        put64(sl->map + REG_DC_RECV_UNIT, (uint64_t)(now + (int64_t)get64(sl->map + REG_DC_OFFSET)));
+    }
+    return true;
+}
+
+// Logical access through the slave's window [i * PDO_BYTES, +PDO_BYTES):
+// outputs are taken in OP, inputs given from SAFEOP.
+// Returns: WKC increment.
+static uint16_t slave_logical(slave_t *sl, int i, uint8_t cmd, uint32_t laddr, uint8_t *data, size_t len, int64_t now) {
+    uint64_t lo = (uint64_t)i * PDO_BYTES, hi = lo + PDO_BYTES;
+    uint64_t from = laddr > lo ? laddr : lo, to = (uint64_t)laddr + len < hi ? (uint64_t)laddr + len : hi;
+    if (from >= to) return 0;
+    uint8_t state = slave_state(sl);
+    uint16_t wkc = 0;
+    if ((cmd == KRAKEN_ECAT_CMD_LWR || cmd == KRAKEN_ECAT_CMD_LRW) && state == AL_OP && !(sl->map[REG_AL_STATUS] & AL_ERROR)) {
+        for (uint64_t a = from; a < to; a++) sl->map[REG_OUTPUTS + (a - lo)] = data[a - laddr];
+        sl->last_pd_ns = now;
+        sl->cycles++;
+        put32(sl->map + REG_INPUTS, sl->cycles);
+        wkc += cmd == KRAKEN_ECAT_CMD_LRW ? 2 : 1;
+    }
+    if ((cmd == KRAKEN_ECAT_CMD_LRD || cmd == KRAKEN_ECAT_CMD_LRW) && (state == AL_SAFEOP || state == AL_OP)) {
+        for (uint64_t a = from; a < to; a++) data[a - laddr] = sl->map[REG_INPUTS + (a - lo)];
+        wkc += 1;
+    }
+    return wkc;
+}
+
+// One slave's share of a register datagram. Read-multiple-write commands
+// read on the addressed slave and write on every other one.
+// Returns: WKC increment.
+static uint16_t slave_access(slave_t *sl, uint8_t cmd, bool addressed, uint16_t ado, uint8_t *data, size_t len, int64_t now) {
+    switch (cmd) {
+    case 1: case 4: // APRD, FPRD
+        return addressed && slave_read(sl, ado, data, len, false, now) ? 1 : 0;
+    case 2: case 5: // APWR, FPWR
+        return addressed && slave_write(sl, ado, data, len, now) ? 1 : 0;
+    case 3: case 6: { // APRW, FPRW
+        if (!addressed) return 0;
+        uint8_t old[KRAKEN_ECAT_LEN_MASK + 1];
+        if (!slave_read(sl, ado, old, len, false, now)) return 0;
+        slave_write(sl, ado, data, len, now);
+        memcpy(data, old, len);
+        return 3;
+    }
+    case 7: // BRD
+        return slave_read(sl, ado, data, len, true, now) ? 1 : 0;
+    case 8: // BWR
+        return slave_write(sl, ado, data, len, now) ? 1 : 0;
+    case 9: // BRW
+        return slave_write(sl, ado, data, len, now) && slave_read(sl, ado, data, len, true, now) ? 3 : 0;
+    case 13: case 14: // ARMW, FRMW
+        if (addressed) return slave_read(sl, ado, data, len, false, now) ? 1 : 0;
+        return slave_write(sl, ado, data, len, now) ? 1 : 0;
+    default:
+        return 0;
+    }
+}
+
+// Pass one datagram through every slave in line order
+static void slaves_datagram(sim_t *s, uint8_t *dg, size_t dlen, int64_t now) {
+    uint8_t cmd = dg[0];
+    uint8_t *data = dg + KRAKEN_ECAT_DGRAM_HDR_LEN;
+    uint16_t wkc = kraken_ecat_get16(data + dlen);
+    if (cmd >= KRAKEN_ECAT_CMD_LRD && cmd <= KRAKEN_ECAT_CMD_LRW) {
+        uint32_t laddr = get32(dg + 2);
+        for (int i = 0; i < s->slaves; i++) wkc += slave_logical(&s->slave[i], i, cmd, laddr, data, dlen, now);
+    } else if (cmd != KRAKEN_ECAT_CMD_NOP) {
+        uint16_t adp = kraken_ecat_get16(dg + 2), ado = kraken_ecat_get16(dg + 4);
+        bool position = cmd <= 3 || cmd == 13, broadcast = cmd >= 7 && cmd <= 9, fixed = (cmd >= 4 && cmd <= 6) || cmd == 14;
+        for (int i = 0; i < s->slaves; i++) {
+            slave_t *sl = &s->slave[i];
+            bool addressed = broadcast || (position && adp == 0) || (fixed && slave_station(sl) == adp);
+            wkc += slave_access(sl, cmd, addressed, ado, data, dlen, now);
+            // Auto-increment and broadcast addresses count up at every slave
+            if (position || broadcast) adp++;
+        }
+        if (position || broadcast) kraken_ecat_put16(dg + 2, adp);
+    }
+    kraken_ecat_put16(data + dlen, wkc);
+}
+
+static void slaves_watchdog(sim_t *s, int64_t now) {
+    if (s->watchdog_ms <= 0) return;
+    int64_t limit = (int64_t)s->watchdog_ms * 1000000LL;
+    for (int i = 0; i < s->slaves; i++) {
+        slave_t *sl = &s->slave[i];
+        if (slave_state(sl) == AL_OP && !(sl->map[REG_AL_STATUS] & AL_ERROR) && now - sl->last_pd_ns > limit) {
+            slave_al_error(sl, AL_SAFEOP, AL_CODE_WATCHDOG);
+            count(&s->watchdogs, 1);
+        }
+    }
+}
+
+static void slaves_drops(sim_t *s) {
+    struct tpacket_stats st;
+    socklen_t len = sizeof(st);
+    if (getsockopt(s->slave_fd, SOL_PACKET, PACKET_STATISTICS, &st, &len) == 0) count(&s->drops, st.tp_drops);
+}
+
+// Process every EtherCAT command frame reaching the interface - the
+// master's through the outgoing tap, anyone else's as they arrive - and
+// send it back out
+static void *slaves_thread(void *arg) {
+    sim_t *s = arg;
+    static uint8_t bufs[RX_BATCH][FRAME_MAX];
+    struct mmsghdr msgs[RX_BATCH];
+    struct sockaddr_ll from[RX_BATCH];
+    while (!*s->stop) {
+        int n = sim_recv(s->slave_fd, bufs, msgs, from, 10);
+        if (n < 0) break;
+        int64_t now = kraken_pacer_now_ns();
+        for (int i = 0; i < n; i++) {
+            uint8_t *f = bufs[i];
+            size_t len = msgs[i].msg_len;
+            if (len < ETH_HLEN_ + KRAKEN_ECAT_HDR_LEN || len > FRAME_MAX) continue;
+            size_t off = 0, dlen = 0;
+            uint8_t *dg;
+            int dgs = 0;
+            while ((dg = next_datagram(f + ETH_HLEN_, len - ETH_HLEN_, &off, &dlen)) != NULL) {
+                slaves_datagram(s, dg, dlen, now);
+                dgs++;
+            }
+            if (dgs == 0) continue;
+            f[6] ^= 0x02; // processed by the first slave
+            send(s->slave_fd, f, len, 0);
+            count(&s->processed, 1);
+            count(&s->datagrams, (uint64_t)dgs);
+        }
+        slaves_watchdog(s, kraken_pacer_now_ns());
+    }
+    return NULL;
+}
+
+/* ------------------------------------------------------------------ */
+/* Master                                                             */
+/* ------------------------------------------------------------------ */
+
+// Replies to the master's frames come back through the outgoing tap
+// with the master's MAC, U/L bit flipped; EtherCAT frames arriving from
+// the wire are someone else's.
+static void *master_rx_thread(void *arg) {
+    sim_t *s = arg;
+    static uint8_t bufs[RX_BATCH][FRAME_MAX];
+    struct mmsghdr msgs[RX_BATCH];
+    struct sockaddr_ll from[RX_BATCH];
+    while (!*s->stop) {
+        int n = sim_recv(s->master_fd, bufs, msgs, from, 10);
+        if (n < 0) break;
+        for (int i = 0; i < n; i++) {
+            const uint8_t *f = bufs[i];
+            size_t len = msgs[i].msg_len;
+            if (from[i].sll_pkttype != PACKET_OUTGOING) {
+                count(&s->injected, 1);
+                continue;
+            }
+            if (len < ETH_HLEN_ + KRAKEN_ECAT_HDR_LEN + KRAKEN_ECAT_DGRAM_HDR_LEN || len > FRAME_MAX) continue;
+            if (f[6] != (s->mac[0] ^ 0x02) || memcmp(f + 7, s->mac + 1, 5) != 0) continue;
+            pthread_mutex_lock(&s->lock);
+            if (s->waiting && !s->answered && f[ETH_HLEN_ + KRAKEN_ECAT_HDR_LEN + 1] == s->expect_index) {
+                memcpy(s->reply, f, len);
+                s->reply_len = len;
+                s->answered = true;
+                pthread_cond_signal(&s->replied);
+            }
+            pthread_mutex_unlock(&s->lock);
+        }
+    }
+    return NULL;
+}
+
+static size_t master_frame(const sim_t *s, uint8_t *buf, const KrakenEcatDatagram *d, size_t n) {
+    memset(buf, 0xFF, 6);
+    memcpy(buf + 6, s->mac, 6);
+    buf[12] = ECAT_ETHERTYPE >> 8;
+    buf[13] = ECAT_ETHERTYPE & 0xFF;
+    KrakenEcatFrame f;
+    kraken_ecat_frame_init(&f, buf + ETH_HLEN_, FRAME_MAX - ETH_HLEN_, false);
+    for (size_t i = 0; i < n; i++) kraken_ecat_frame_append(&f, &d[i]);
+    size_t len = ETH_HLEN_ + kraken_ecat_frame_finish(&f);
+    return len < 60 ? 60 : len; // minimum Ethernet frame, padding after the EtherCAT length
+}
+
+// Arm the reply slot for `index` and send
+static void master_send(sim_t *s, const uint8_t *frame, size_t len, uint8_t index) {
+    pthread_mutex_lock(&s->lock);
+    s->expect_index = index;
+    s->waiting = true;
+    s->answered = false;
+    pthread_mutex_unlock(&s->lock);
+    send(s->master_fd, frame, len, 0);
+}
+
+// Startup request: send and wait for the reply.
+// Returns: the reply's summed WKC, or -1 on timeout.
+static int master_transact(sim_t *s, const KrakenEcatDatagram *d, size_t n) {
+    uint8_t frame[FRAME_MAX];
+    size_t len = master_frame(s, frame, d, n);
+    master_send(s, frame, len, d[0].index);
+
+    struct timespec until;
+    clock_gettime(CLOCK_REALTIME, &until);
+    until.tv_nsec += STARTUP_TIMEOUT_MS * 1000000L;
+    until.tv_sec += until.tv_nsec / 1000000000L;
+    until.tv_nsec %= 1000000000L;
+    pthread_mutex_lock(&s->lock);
+    while (!s->answered && pthread_cond_timedwait(&s->replied, &s->lock, &until) == 0) {
+    }
+    int wkc = -1;
+    if (s->answered) {
+        KrakenEcatInfo info;
+        if (kraken_ecat_parse(s->reply + ETH_HLEN_, s->reply_len - ETH_HLEN_, &info)) wkc = (int)info.wkc;
+    }
+    s->waiting = false;
+    pthread_mutex_unlock(&s->lock);
+    return wkc;
+}
+
+// Assign station addresses by position and walk every slave up to OP
+static bool master_startup(sim_t *s) {
+    uint8_t index = 0x80;
+    for (int i = 0; i < s->slaves; i++) {
+        uint8_t station[2];
+        kraken_ecat_put16(station, (uint16_t)(STATION_BASE + i));
+        KrakenEcatDatagram d = {.cmd = KRAKEN_ECAT_CMD_APWR, .index = index++, .adp = (uint16_t)-i, .ado = REG_STATION, .data = station, .len = 2};
+        if (master_transact(s, &d, 1) != 1) {
+            fprintf(stderr, "ecat_sim: slave %d did not take station address 0x%04x\n", i, STATION_BASE + i);
+            return false;
+        }
+    }
+    // Every slave acknowledges the AL control write and the status read;
+    // the request for OP takes the first outputs along, so the watchdog
+    // starts with process data in hand
+    static const uint8_t states[] = {AL_PREOP, AL_SAFEOP, AL_OP};
+    for (size_t k = 0; k < sizeof(states); k++) {
+        uint8_t ctl[2] = {states[k], 0};
+        KrakenEcatDatagram d[3] = {
+            {.cmd = KRAKEN_ECAT_CMD_BWR, .index = index, .ado = REG_AL_CONTROL, .data = ctl, .len = 2},
+            {.cmd = KRAKEN_ECAT_CMD_BRD, .index = index, .ado = REG_AL_STATUS, .len = 2},
+            {.cmd = KRAKEN_ECAT_CMD_LWR, .index = index, .len = (uint16_t)(s->slaves * PDO_BYTES)},
+        };
+        index++;
+        int wkc = master_transact(s, d, states[k] == AL_OP ? 3 : 2);
+        if (wkc < 2 * s->slaves) {
+            fprintf(stderr, "ecat_sim: slaves did not reach AL state 0x%02x (wkc %d)\n", states[k], wkc);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Check the previous cycle's reply: LRW (3 per slave), BRD of AL status
+// (1 per slave, all in OP), FPRD of the first slave's DC system time (1).
+// Returns: the AL status of the slaves ORed together, AL_OP when all are
+// running.
+static uint16_t master_check(sim_t *s, const uint8_t *reply, size_t len) {
+    size_t off = 0, dlen = 0;
+    uint8_t *dg;
+    uint32_t wkc = 0;
+    uint16_t al = 0;
+    uint8_t copy[FRAME_MAX];
+    memcpy(copy, reply, len);
+    while ((dg = next_datagram(copy + ETH_HLEN_, len - ETH_HLEN_, &off, &dlen)) != NULL) {
+        wkc += kraken_ecat_get16(dg + KRAKEN_ECAT_DGRAM_HDR_LEN + dlen);
+        if (dg[0] == KRAKEN_ECAT_CMD_BRD && kraken_ecat_get16(dg + 4) == REG_AL_STATUS && dlen >= 2)
+            al = kraken_ecat_get16(dg + KRAKEN_ECAT_DGRAM_HDR_LEN);
+    }
+    if (wkc != (uint32_t)(4 * s->slaves + 1)) count(&s->wkc_errors, 1);
+    if (al != AL_OP) count(&s->al_errors, 1);
+    return al;
+}
+
+static void master_cycle_loop(sim_t *s) {
+    uint8_t frame[FRAME_MAX], outputs[MAX_SLAVES * PDO_BYTES] = {0};
+    uint8_t reply[FRAME_MAX];
+    KrakenEcatDatagram d[3] = {
+        {.cmd = KRAKEN_ECAT_CMD_LRW, .data = outputs, .len = (uint16_t)(s->slaves * PDO_BYTES)},
+        {.cmd = KRAKEN_ECAT_CMD_BRD, .ado = REG_AL_STATUS, .len = 2},
+        {.cmd = KRAKEN_ECAT_CMD_FPRD, .adp = STATION_BASE, .ado = REG_DC_SYSTEM_TIME, .len = 8},
+    };
+
+    KrakenPacer pacer;
+    kraken_pacer_init(&pacer, s->rate_hz, 1, KRAKEN_PACE_UNIFORM, 1);
+    int64_t start = kraken_pacer_start(&pacer);
+    int64_t end = s->duration_s > 0 ? start + (int64_t)s->duration_s * 1000000000LL : INT64_MAX;
+    int64_t next_report = start + 1000000000LL;
+    uint64_t cycle = 0;
+    while (!*s->stop && kraken_pacer_wait(&pacer, end)) {
+        size_t reply_len = 0;
+        pthread_mutex_lock(&s->lock);
+        bool answered = s->answered;
+        if (answered) {
+            memcpy(reply, s->reply, s->reply_len);
+            reply_len = s->reply_len;
+        }
+        pthread_mutex_unlock(&s->lock);
+        if (cycle > 0) {
+            if (!answered) {
+                count(&s->missed, 1);
+            } else {
+                count(&s->replies, 1);
+                uint16_t al = master_check(s, reply, reply_len);
+                if (al != AL_OP) {
+                    // Acknowledge any error and move the lowest slaves one
+                    // state up; slaves above it step down to meet them
+                    uint8_t lowest = (uint8_t)(al & 0x0F & -(al & 0x0F));
+                    uint8_t want = lowest == 0 || lowest == AL_OP ? AL_OP : (uint8_t)(lowest << 1);
+                    uint8_t ctl[2] = {(uint8_t)(want | AL_ERROR), 0};
+                    KrakenEcatDatagram ack = {.cmd = KRAKEN_ECAT_CMD_BWR, .index = 0xFF, .ado = REG_AL_CONTROL, .data = ctl, .len = 2};
+                    size_t len = master_frame(s, frame, &ack, 1);
+                    send(s->master_fd, frame, len, 0);
+                    count(&s->recoveries, 1);
+                }
+            }
+        }
+
+        for (int i = 0; i < s->slaves; i++) put32(outputs + i * PDO_BYTES, (uint32_t)cycle);
+        uint8_t index = (uint8_t)(cycle % 0x7F); // startup and recovery use 0x80 and up
+        d[0].index = index;
+        d[1].index = index;
+        d[2].index = index;
+        size_t len = master_frame(s, frame, d, 3);
+        master_send(s, frame, len, index);
+        count(&s->cycles, 1);
+        cycle++;
+
+        if (!s->quiet && kraken_pacer_now_ns() >= next_report) {
+            slaves_drops(s);
+            fprintf(stderr, "t=%llds cycles %llu replies %llu missed %llu wkc_errors %llu al_errors %llu injected %llu processed %llu drops %llu\n",
+                    (long long)((next_report - start) / 1000000000LL), (unsigned long long)counter(&s->cycles),
+                    (unsigned long long)counter(&s->replies), (unsigned long long)counter(&s->missed),
+                    (unsigned long long)counter(&s->wkc_errors), (unsigned long long)counter(&s->al_errors),
+                    (unsigned long long)counter(&s->injected), (unsigned long long)counter(&s->processed),
+                    (unsigned long long)counter(&s->drops));
+            next_report += 1000000000LL;
+        }
+    }
+    double secs = (kraken_pacer_now_ns() - start) / 1e9;
+    slaves_drops(s);
+
+    const char *fmt = s->json
+        ? "{\"iface\":\"%s\",\"slaves\":%d,\"rate_hz\":%d,\"seconds\":%.3f,\"cycles\":%llu,\"replies\":%llu,\"missed\":%llu,"
+          "\"wkc_errors\":%llu,\"al_errors\":%llu,\"recoveries\":%llu,\"watchdogs\":%llu,\"injected\":%llu,\"processed\":%llu,"
+          "\"datagrams\":%llu,\"drops\":%llu,\"cycle_jitter_p99_us\":%.1f,\"pacer_slips\":%llu}\n"
+        : "ecat_sim on %s: %d slaves at %d Hz for %.3f s\n"
+          "  cycles %llu, replies %llu, missed %llu, wkc_errors %llu, al_errors %llu, recoveries %llu, watchdogs %llu\n"
+          "  injected %llu, processed %llu frames / %llu datagrams, kernel drops %llu\n"
+          "  send jitter p99 %.1fus, pacer slips %llu\n";
+    printf(fmt, s->iface, s->slaves, s->rate_hz, secs, (unsigned long long)counter(&s->cycles), (unsigned long long)counter(&s->replies),
+           (unsigned long long)counter(&s->missed), (unsigned long long)counter(&s->wkc_errors), (unsigned long long)counter(&s->al_errors),
+           (unsigned long long)counter(&s->recoveries), (unsigned long long)counter(&s->watchdogs), (unsigned long long)counter(&s->injected),
+           (unsigned long long)counter(&s->processed), (unsigned long long)counter(&s->datagrams), (unsigned long long)counter(&s->drops),
+           kraken_hist_percentile(&pacer.jitter, 0.99) / 1e3, (unsigned long long)pacer.slips);
+}
+
+/* ------------------------------------------------------------------ */
+/* Main                                                               */
+/* ------------------------------------------------------------------ */
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s -i IFACE [-n SLAVES] [-r RATE_HZ] [-d SECONDS] [-w WATCHDOG_MS] [-j] [-q]\n"
+            "  -i  interface of the simulated segment (one end of a veth pair)\n"
+            "  -n  slaves, 1-%d (default 4)\n"
+            "  -r  master cycle rate, %d-%d Hz (default 1000)\n"
+            "  -d  run time in seconds, 0 until SIGINT (default 0)\n"
+            "  -w  process data watchdog, 0 disables (default 100 ms)\n"
+            "  -j  print the summary as one JSON object\n"
+            "  -q  no per-second counters on stderr\n",
+            prog, MAX_SLAVES, MIN_RATE_HZ, MAX_RATE_HZ);
+}
+
+int main(int argc, char **argv) {
+    sim_t *s = calloc(1, sizeof(*s));
+    if (!s) return 1;
+    s->slaves = 4;
+    s->rate_hz = 1000;
+    s->watchdog_ms = 100;
+    int opt;
+    while ((opt = getopt(argc, argv, "i:n:r:d:w:jqh")) != -1) {
+        switch (opt) {
+        case 'i': snprintf(s->iface, sizeof(s->iface), "%s", optarg); break;
+        case 'n': s->slaves = atoi(optarg); break;
+        case 'r': s->rate_hz = atoi(optarg); break;
+        case 'd': s->duration_s = atoi(optarg); break;
+        case 'w': s->watchdog_ms = atoi(optarg); break;
+        case 'j': s->json = true; break;
+        case 'q': s->quiet = true; break;
+        default: usage(argv[0]); free(s); return 2;
+        }
+    }
+    if (!s->iface[0] || s->slaves < 1 || s->slaves > MAX_SLAVES || s->rate_hz < MIN_RATE_HZ || s->rate_hz > MAX_RATE_HZ || s->duration_s < 0) {
+        usage(argv[0]);
+        free(s);
+        return 2;
+    }
+
+    s->master_fd = sim_socket(s->iface);
+    s->slave_fd = s->master_fd >= 0 ? sim_socket(s->iface) : -1;
+    if (s->slave_fd < 0) {
+        fprintf(stderr, "ecat_sim: cannot open raw sockets on %s: %s (needs CAP_NET_RAW)\n", s->iface, strerror(errno));
+        if (s->master_fd >= 0) close(s->master_fd);
+        free(s);
+        return 1;
+    }
+    struct ifreq ifr;
+    memset(&ifr, 0, sizeof(ifr));
+    snprintf(ifr.ifr_name, sizeof(ifr.ifr_name), "%s", s->iface);
+    if (ioctl(s->master_fd, SIOCGIFHWADDR, &ifr) == 0) memcpy(s->mac, ifr.ifr_hwaddr.sa_data, 6);
+
+    s->slave = calloc((size_t)s->slaves, sizeof(*s->slave));
+    if (!s->slave) {
+        close(s->master_fd);
+        close(s->slave_fd);
+        free(s);
+        return 1;
+    }
+    for (int i = 0; i < s->slaves; i++) slave_init(&s->slave[i]);
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->replied, NULL);
+    s->stop = &stop_flag;
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+
+    pthread_t slaves_tid, rx_tid;
+    bool slaves_started = pthread_create(&slaves_tid, NULL, slaves_thread, s) == 0;
+    bool rx_started = slaves_started && pthread_create(&rx_tid, NULL, master_rx_thread, s) == 0;
+    int rc = 0;
+    if (!rx_started) {
+        fprintf(stderr, "ecat_sim: cannot start threads\n");
+        rc = 1;
+    } else if (master_startup(s)) {
+        if (!s->quiet) fprintf(stderr, "ecat_sim: %d slaves in OP on %s, cycling at %d Hz\n", s->slaves, s->iface, s->rate_hz);
+        master_cycle_loop(s);
+    } else {
+        rc = 1;
+    }
+    stop_flag = 1;
+    if (slaves_started) pthread_join(slaves_tid, NULL);
+    if (rx_started) pthread_join(rx_tid, NULL);
+
+    close(s->master_fd);
+    close(s->slave_fd);
+    pthread_mutex_destroy(&s->lock);
+    pthread_cond_destroy(&s->replied);
+    free(s->slave);
+    free(s);
+    return rc;
+}
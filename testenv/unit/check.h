@@ -0,0 +1,21 @@
+#ifndef KRAKEN_UNIT_CHECK_H
+#define KRAKEN_UNIT_CHECK_H
+
+#include <stdio.h>
+
+/* Minimal checks for the header unit tests: a failed CHECK reports and
+   carries on, and CHECK_DONE turns the count into the exit status. */
+
+static int check_failures;
+
+#define CHECK(cond)                                                                  \
+    do {                                                                             \
+        if (!(cond)) {                                                               \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            check_failures++;                                                        \
+        }                                                                            \
+    } while (0)
+
+#define CHECK_DONE() (check_failures ? (fprintf(stderr, "%d checks failed\n", check_failures), 1) : 0)
+
+#endif /* KRAKEN_UNIT_CHECK_H */
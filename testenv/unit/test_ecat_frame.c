@@ -0,0 +1,148 @@
+// kraken_ecat_frame.h: build/parse round trips for plain, signed and tagged
+// frames, capacity against what append actually packs, and rejection of
+// truncated or malformed payloads
+
+#include <stdint.h>
+#include <string.h>
+
+#include "check.h"
+#include "kraken_ecat_frame.h"
+
+static void test_single(void) {
+    uint8_t buf[KRAKEN_ECAT_MAX_FRAME];
+    const uint8_t data[] = {0xDE, 0xAD, 0xBE, 0xEF};
+    size_t len = kraken_ecat_build(buf, sizeof(buf), KRAKEN_ECAT_CMD_FPWR, 0x1001, 0x0120, data, sizeof(data), 3);
+    CHECK(len == KRAKEN_ECAT_HDR_LEN + KRAKEN_ECAT_DGRAM_HDR_LEN + KRAKEN_ECAT_SIG_LEN + sizeof(data) + KRAKEN_ECAT_WKC_LEN);
+    CHECK(kraken_ecat_get16(buf) >> 12 == KRAKEN_ECAT_TYPE_COMMAND);
+    CHECK((kraken_ecat_get16(buf) & KRAKEN_ECAT_LEN_MASK) == len - KRAKEN_ECAT_HDR_LEN);
+
+    // Wire layout: little-endian ADP/ADO, no MORE bit on a lone datagram
+    const uint8_t *d = buf + KRAKEN_ECAT_HDR_LEN;
+    CHECK(d[0] == KRAKEN_ECAT_CMD_FPWR && d[1] == 0x01);
+    CHECK(d[2] == 0x01 && d[3] == 0x10 && d[4] == 0x20 && d[5] == 0x01);
+    CHECK(kraken_ecat_get16(d + 6) == KRAKEN_ECAT_SIG_LEN + sizeof(data));
+
+    KrakenEcatInfo info;
+    CHECK(kraken_ecat_parse(buf, len, &info));
+    CHECK(info.datagrams == 1 && info.wkc == 3 && info.cmd == KRAKEN_ECAT_CMD_FPWR && info.index == 0x01);
+    CHECK(info.sig && info.data_len == KRAKEN_ECAT_SIG_LEN + sizeof(data));
+    CHECK(memcmp(info.data + KRAKEN_ECAT_SIG_LEN, data, sizeof(data)) == 0);
+
+    // Ethernet padding after the frame is ignored
+    uint8_t padded[64] = {0};
+    memcpy(padded, buf, len);
+    CHECK(kraken_ecat_parse(padded, sizeof(padded), &info) && info.datagrams == 1);
+
+    // Too small for even one datagram
+    CHECK(kraken_ecat_build(buf, len - 1, KRAKEN_ECAT_CMD_FPWR, 0, 0, data, sizeof(data), 0) == 0);
+}
+
+static void test_chain(void) {
+    uint8_t buf[KRAKEN_ECAT_MAX_FRAME];
+    KrakenEcatFrame f;
+    kraken_ecat_frame_init(&f, buf, sizeof(buf), false);
+    CHECK(kraken_ecat_frame_finish(&f) == 0);
+
+    KrakenEcatDatagram d = {.cmd = KRAKEN_ECAT_CMD_LRD, .wkc = 1, .len = 6};
+    for (int i = 0; i < 5; i++) {
+        uint8_t *data = kraken_ecat_frame_append(&f, &d);
+        CHECK(data != NULL);
+        if (data)
+            data[0] = (uint8_t)(0xA0 + i);
+        d.index++;
+    }
+    size_t len = kraken_ecat_frame_finish(&f);
+    CHECK(len == KRAKEN_ECAT_HDR_LEN + 5 * (KRAKEN_ECAT_DGRAM_HDR_LEN + 6 + KRAKEN_ECAT_WKC_LEN));
+
+    // MORE on every datagram but the last
+    size_t off = KRAKEN_ECAT_HDR_LEN;
+    for (int i = 0; i < 5; i++) {
+        uint16_t len_flags = kraken_ecat_get16(buf + off + 6);
+        CHECK(!!(len_flags & KRAKEN_ECAT_MORE) == (i < 4));
+        CHECK((len_flags & KRAKEN_ECAT_LEN_MASK) == 6);
+        CHECK(buf[off + 1] == i && buf[off + KRAKEN_ECAT_DGRAM_HDR_LEN] == 0xA0 + i);
+        off += KRAKEN_ECAT_DGRAM_HDR_LEN + 6 + KRAKEN_ECAT_WKC_LEN;
+    }
+
+    KrakenEcatInfo info;
+    CHECK(kraken_ecat_parse(buf, len, &info));
+    CHECK(info.datagrams == 5 && info.wkc == 5 && info.cmd == KRAKEN_ECAT_CMD_LRD && info.index == 0 && !info.sig);
+
+    // Truncation anywhere inside the chain is rejected
+    for (size_t cut = 0; cut < len; cut++)
+        CHECK(!kraken_ecat_parse(buf, cut, &info));
+    // A header claiming a shorter body cuts the chain short
+    kraken_ecat_put16(buf, (uint16_t)((len - KRAKEN_ECAT_HDR_LEN - 1) | (KRAKEN_ECAT_TYPE_COMMAND << 12)));
+    CHECK(!kraken_ecat_parse(buf, len, &info));
+    // Not a command frame
+    kraken_ecat_put16(buf, (uint16_t)((len - KRAKEN_ECAT_HDR_LEN) | (2 << 12)));
+    CHECK(!kraken_ecat_parse(buf, len, &info));
+}
+
+static void test_tagged(void) {
+    uint8_t buf[KRAKEN_ECAT_MAX_FRAME];
+    KrakenEcatFrame f;
+    kraken_ecat_frame_init_tagged(&f, buf, sizeof(buf), 0xCAFEF00D);
+    const uint8_t data[] = {1, 2};
+    KrakenEcatDatagram d = {.cmd = KRAKEN_ECAT_CMD_BRD, .index = 7, .data = data, .len = sizeof(data)};
+    uint8_t *out = kraken_ecat_frame_append(&f, &d);
+    CHECK(out && out[0] == 1 && out[1] == 2);
+    CHECK(kraken_ecat_frame_append(&f, &d) != NULL); // prefix only on the first
+    size_t len = kraken_ecat_frame_finish(&f);
+    CHECK(len == KRAKEN_ECAT_HDR_LEN + 2 * (KRAKEN_ECAT_DGRAM_HDR_LEN + sizeof(data) + KRAKEN_ECAT_WKC_LEN) + KRAKEN_ECAT_SIG_LEN + KRAKEN_ECAT_TAG_LEN);
+
+    KrakenEcatInfo info;
+    uint32_t tag = 0;
+    CHECK(kraken_ecat_parse(buf, len, &info) && info.datagrams == 2 && info.index == 7);
+    CHECK(kraken_ecat_tag(&info, &tag) && tag == 0xCAFEF00D);
+
+    // Unsigned frames have no tag
+    kraken_ecat_frame_init(&f, buf, sizeof(buf), false);
+    kraken_ecat_frame_append(&f, &d);
+    len = kraken_ecat_frame_finish(&f);
+    CHECK(kraken_ecat_parse(buf, len, &info) && !info.sig && !kraken_ecat_tag(&info, &tag));
+}
+
+// kraken_ecat_frame_capacity must agree with what append packs
+static size_t packed(size_t cap, uint16_t data_len, bool sign) {
+    static uint8_t buf[KRAKEN_ECAT_MAX_FRAME + 64];
+    KrakenEcatFrame f;
+    kraken_ecat_frame_init(&f, buf, cap, sign);
+    KrakenEcatDatagram d = {.cmd = KRAKEN_ECAT_CMD_LWR, .len = data_len};
+    size_t n = 0;
+    while (kraken_ecat_frame_append(&f, &d))
+        n++;
+    size_t len = kraken_ecat_frame_finish(&f);
+    CHECK(len <= f.cap && len <= KRAKEN_ECAT_MAX_FRAME);
+    return n;
+}
+
+static void test_capacity(void) {
+    static const size_t caps[] = {0, 1, 13, 14, 18, 60, 64, 1000, 1499, 1500, 1564};
+    static const uint16_t lens[] = {0, 1, 2, 4, 8, 64, 1024, 1486};
+    for (size_t c = 0; c < sizeof(caps) / sizeof(caps[0]); c++)
+        for (size_t l = 0; l < sizeof(lens) / sizeof(lens[0]); l++)
+            for (int sign = 0; sign < 2; sign++) {
+                size_t want = kraken_ecat_frame_capacity(caps[c], lens[l], sign);
+                size_t got = packed(caps[c], lens[l], sign);
+                if (want != got)
+                    fprintf(stderr, "cap %zu len %u sign %d: capacity %zu, packed %zu\n", caps[c], lens[l], sign, want, got);
+                CHECK(want == got);
+            }
+    CHECK(kraken_ecat_frame_capacity(KRAKEN_ECAT_MAX_FRAME, 0, false) == (KRAKEN_ECAT_MAX_FRAME - KRAKEN_ECAT_HDR_LEN) / 12);
+
+    // A datagram longer than the 11-bit length field never fits
+    uint8_t buf[8];
+    KrakenEcatFrame f;
+    kraken_ecat_frame_init(&f, buf, SIZE_MAX, false);
+    KrakenEcatDatagram d = {.len = KRAKEN_ECAT_LEN_MASK + 1};
+    CHECK(kraken_ecat_frame_append(&f, &d) == NULL && f.count == 0);
+}
+
+int main(void) {
+    test_single();
+    test_chain();
+    test_tagged();
+    test_capacity();
+    return CHECK_DONE();
+}
@@ -0,0 +1,161 @@
+// kraken_ecat_stamp.h and the stamped half of kraken_ecat_frame.h: stamp
+// build/restamp/parse round trips, and the loss, reorder and duplicate
+// accounting of kraken_stamp_stats_* over synthetic captures
+
+#include <stdint.h>
+#include <string.h>
+
+#include "check.h"
+#include "kraken_ecat_stamp.h"
+
+#define ETH_HDR 14
+
+// Ethernet + stamped EtherCAT frame with one 4-byte LRW datagram
+static size_t stamped_frame(uint8_t *frame, size_t cap, uint32_t run, uint32_t seq, int64_t tx_ns) {
+    static const uint8_t eth[ETH_HDR] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x02, 0, 0, 0, 0, 1, 0x88, 0xA4};
+    memcpy(frame, eth, ETH_HDR);
+    KrakenEcatStamp st = {run, seq, tx_ns};
+    KrakenEcatFrame f;
+    kraken_ecat_frame_init_stamped(&f, frame + ETH_HDR, cap - ETH_HDR, &st);
+    KrakenEcatDatagram d = {.cmd = KRAKEN_ECAT_CMD_LRW, .index = 9, .len = 4};
+    if (!kraken_ecat_frame_append(&f, &d))
+        return 0;
+    return ETH_HDR + kraken_ecat_frame_finish(&f);
+}
+
+static void test_round_trip(void) {
+    uint8_t buf[KRAKEN_ECAT_MAX_FRAME];
+    KrakenEcatStamp st = {0xA1B2C3D4, 7, 1700000000123456789LL};
+    KrakenEcatFrame f;
+    kraken_ecat_frame_init_stamped(&f, buf, sizeof(buf), &st);
+    const uint8_t data[] = {0x11, 0x22, 0x33};
+    KrakenEcatDatagram d = {.cmd = KRAKEN_ECAT_CMD_FPRD, .index = 3, .adp = 0x1000, .wkc = 2, .data = data, .len = sizeof(data)};
+    uint8_t *out = kraken_ecat_frame_append(&f, &d);
+    CHECK(out && memcmp(out, data, sizeof(data)) == 0); // no signature in front of the data
+    size_t len = kraken_ecat_frame_finish(&f);
+    CHECK(len == KRAKEN_ECAT_HDR_LEN + KRAKEN_ECAT_STAMP_OVERHEAD + KRAKEN_ECAT_DGRAM_HDR_LEN + sizeof(data) + KRAKEN_ECAT_WKC_LEN);
+
+    // The stamp rides in a leading NOP datagram that chains to the real one
+    KrakenEcatInfo info;
+    KrakenEcatStamp got;
+    CHECK(kraken_ecat_parse(buf, len, &info));
+    CHECK(info.datagrams == 2 && info.cmd == KRAKEN_ECAT_CMD_NOP && info.wkc == 2 && info.sig);
+    CHECK(info.data_len == KRAKEN_ECAT_STAMP_LEN);
+    CHECK(kraken_ecat_get16(buf + KRAKEN_ECAT_HDR_LEN + 6) & KRAKEN_ECAT_MORE);
+    CHECK(kraken_ecat_stamp(&info, &got) && got.run == st.run && got.seq == st.seq && got.tx_ns == st.tx_ns);
+
+    // Restamping changes sequence and TX time only, in place
+    CHECK(kraken_ecat_restamp(buf, len, 0xFFFFFFFF, 42));
+    CHECK(kraken_ecat_parse(buf, len, &info) && kraken_ecat_stamp(&info, &got));
+    CHECK(got.run == st.run && got.seq == 0xFFFFFFFF && got.tx_ns == 42);
+    CHECK(memcmp(buf + len - KRAKEN_ECAT_WKC_LEN - sizeof(data), data, sizeof(data)) == 0);
+
+    // Any flipped bit in run, sequence or TX time breaks the check word
+    uint8_t *block = kraken_ecat_stamp_block(buf, len);
+    CHECK(block == buf + KRAKEN_ECAT_HDR_LEN + KRAKEN_ECAT_DGRAM_HDR_LEN);
+    for (size_t i = KRAKEN_ECAT_SIG_LEN; block && i < KRAKEN_ECAT_STAMP_LEN; i++) {
+        block[i] ^= 0x10;
+        CHECK(!kraken_ecat_stamp_get(block, KRAKEN_ECAT_STAMP_LEN, &got));
+        CHECK(!kraken_ecat_restamp(buf, len, 1, 1));
+        block[i] ^= 0x10;
+    }
+    CHECK(!kraken_ecat_stamp_get(buf + KRAKEN_ECAT_HDR_LEN + KRAKEN_ECAT_DGRAM_HDR_LEN, KRAKEN_ECAT_STAMP_LEN - 1, &got));
+
+    // Signed and tagged frames carry no stamp block
+    size_t plain = kraken_ecat_build(buf, sizeof(buf), KRAKEN_ECAT_CMD_BRD, 0, 0, NULL, 32, 0);
+    CHECK(kraken_ecat_parse(buf, plain, &info) && info.sig && !kraken_ecat_stamp(&info, &got));
+    CHECK(!kraken_ecat_restamp(buf, plain, 1, 1));
+    CHECK(kraken_ecat_stamp_block(buf, KRAKEN_ECAT_HDR_LEN + KRAKEN_ECAT_DGRAM_HDR_LEN + KRAKEN_ECAT_STAMP_LEN - 1) == NULL);
+
+    // Capacity accounts for the stamp datagram
+    for (uint16_t dlen = 0; dlen < 64; dlen += 5) {
+        size_t want = kraken_ecat_frame_capacity_prefixed(KRAKEN_ECAT_MAX_FRAME, dlen, KRAKEN_ECAT_STAMP_OVERHEAD);
+        kraken_ecat_frame_init_stamped(&f, buf, sizeof(buf), &st);
+        KrakenEcatDatagram e = {.cmd = KRAKEN_ECAT_CMD_LRD, .len = dlen};
+        size_t n = 0;
+        while (kraken_ecat_frame_append(&f, &e))
+            n++;
+        CHECK(n == want && kraken_ecat_frame_finish(&f) <= KRAKEN_ECAT_MAX_FRAME);
+    }
+}
+
+static void test_stats(void) {
+    uint8_t frame[128];
+    KrakenStampStats st;
+    kraken_stamp_stats_init(&st, 77);
+    CHECK(kraken_stamp_stats_lost(&st) == 0);
+
+    // 0..9 with 5 lost, 3 after 4, 2 twice, a frame of another run, a
+    // corrupted frame and a non-EtherCAT frame
+    static const uint32_t order[] = {0, 1, 2, 4, 3, 2, 6, 7, 8, 9};
+    for (size_t i = 0; i < sizeof(order) / sizeof(order[0]); i++) {
+        size_t len = stamped_frame(frame, sizeof(frame), 77, order[i], 1000 + order[i]);
+        kraken_stamp_stats_frame(&st, frame, len, 1500 + order[i]);
+    }
+    size_t len = stamped_frame(frame, sizeof(frame), 78, 5, 1000);
+    CHECK(!kraken_stamp_stats_frame(&st, frame, len, 1500));
+    len = stamped_frame(frame, sizeof(frame), 77, 5, 1000);
+    frame[ETH_HDR + KRAKEN_ECAT_HDR_LEN + KRAKEN_ECAT_DGRAM_HDR_LEN + KRAKEN_ECAT_SIG_LEN] ^= 1;
+    CHECK(!kraken_stamp_stats_frame(&st, frame, len, 1500));
+    len = stamped_frame(frame, sizeof(frame), 77, 5, 1000);
+    frame[13] = 0x00;
+    CHECK(!kraken_stamp_stats_frame(&st, frame, len, 1500));
+    CHECK(!kraken_stamp_stats_frame(&st, frame, ETH_HDR - 1, 1500));
+
+    CHECK(st.received == 9 && st.reordered == 1 && st.duplicates == 1 && st.other_runs == 1);
+    CHECK(st.min_seq == 0 && st.max_seq == 9 && kraken_stamp_stats_lost(&st) == 1);
+    CHECK(st.latency.total == 9 && st.latency.min == 500 && st.latency.max == 500 && st.clock_skew == 0);
+
+    // Received before sent: counted, but no latency sample; unknown times neither
+    len = stamped_frame(frame, sizeof(frame), 77, 10, 2000);
+    CHECK(kraken_stamp_stats_frame(&st, frame, len, 1999));
+    len = stamped_frame(frame, sizeof(frame), 77, 11, 2000);
+    CHECK(kraken_stamp_stats_frame(&st, frame, len, 0));
+    CHECK(st.clock_skew == 1 && st.latency.total == 9 && st.received == 11);
+}
+
+static void test_window(void) {
+    KrakenStampStats st;
+    kraken_stamp_stats_init(&st, 0);
+    KrakenEcatStamp s = {5, 100, 0};
+    CHECK(kraken_stamp_stats_add(&st, &s, 0) && st.run == 5); // run 0 adopts the first run
+    s.run = 6;
+    CHECK(!kraken_stamp_stats_add(&st, &s, 0) && st.other_runs == 1);
+
+    // A jump past the window forgets everything older; a straggler from
+    // before the jump is reordered, not a duplicate
+    s.run = 5;
+    s.seq = 100 + 3 * KRAKEN_STAMP_WINDOW;
+    CHECK(kraken_stamp_stats_add(&st, &s, 0));
+    s.seq = 100;
+    CHECK(kraken_stamp_stats_add(&st, &s, 0) && st.duplicates == 0 && st.reordered == 1);
+
+    // Sequence numbers skipped inside the window are not mistaken for
+    // ones seen a window ago
+    kraken_stamp_stats_init(&st, 5);
+    for (uint32_t q = 0; q < KRAKEN_STAMP_WINDOW; q++) {
+        s.seq = q;
+        kraken_stamp_stats_add(&st, &s, 0);
+    }
+    s.seq = KRAKEN_STAMP_WINDOW + 10;
+    kraken_stamp_stats_add(&st, &s, 0);
+    s.seq = KRAKEN_STAMP_WINDOW + 5;
+    CHECK(kraken_stamp_stats_add(&st, &s, 0) && st.duplicates == 0 && st.reordered == 1);
+    CHECK(!kraken_stamp_stats_add(&st, &s, 0) && st.duplicates == 1);
+    CHECK(kraken_stamp_stats_lost(&st) == 9);
+
+    // Sequence numbers wrap
+    kraken_stamp_stats_init(&st, 5);
+    for (uint32_t q = UINT32_MAX - 2; q != 3; q++) {
+        s.seq = q;
+        CHECK(kraken_stamp_stats_add(&st, &s, 0));
+    }
+    CHECK(st.received == 6 && st.reordered == 0 && kraken_stamp_stats_lost(&st) == 0);
+}
+
+int main(void) {
+    test_round_trip();
+    test_stats();
+    test_window();
+    return CHECK_DONE();
+}
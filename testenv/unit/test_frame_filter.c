@@ -0,0 +1,208 @@
+// kraken_frame_filter.h: compiled presets run through a small classic BPF
+// interpreter against sample frames, so the datagram walk of
+// "ethercat+station" is checked without attaching it to a socket
+
+#include <stdint.h>
+#include <string.h>
+
+#include "check.h"
+#include "kraken_ecat_frame.h"
+#include "kraken_frame_filter.h"
+
+#define ETH_HDR 14
+#define STATION 0x1234
+
+// The subset of classic BPF the compiler emits, with the kernel's rules:
+// an out-of-bounds load drops the frame, jumps are relative to the next
+// instruction. Anything else fails the test and drops.
+static uint32_t bpf_run(const KrakenBpfInsn *prog, int n, const uint8_t *pkt, size_t len) {
+    uint32_t a = 0, x = 0, mem[16] = {0};
+    for (int pc = 0; pc < n; pc++) {
+        const KrakenBpfInsn *in = &prog[pc];
+        size_t off = in->k;
+        switch (in->code) {
+        case KRAKEN_BPF_LD_H_IND:
+            off += x;
+            /* fall through */
+        case KRAKEN_BPF_LD_H_ABS:
+            if (off + 2 > len)
+                return 0;
+            a = (uint32_t)(pkt[off] << 8 | pkt[off + 1]);
+            break;
+        case KRAKEN_BPF_LD_B_IND:
+            off += x;
+            /* fall through */
+        case KRAKEN_BPF_LD_B_ABS:
+            if (off + 1 > len)
+                return 0;
+            a = pkt[off];
+            break;
+        case KRAKEN_BPF_LDX_IMM: x = in->k; break;
+        case KRAKEN_BPF_LDX_MEM: x = mem[in->k % 16]; break;
+        case KRAKEN_BPF_ST: mem[in->k % 16] = a; break;
+        case KRAKEN_BPF_ADD_K: a += in->k; break;
+        case KRAKEN_BPF_ADD_X: a += x; break;
+        case KRAKEN_BPF_AND_K: a &= in->k; break;
+        case KRAKEN_BPF_LSH_K: a <<= in->k; break;
+        case KRAKEN_BPF_TAX: x = a; break;
+        case KRAKEN_BPF_JEQ_K: pc += a == in->k ? in->jt : in->jf; break;
+        case KRAKEN_BPF_JSET_K: pc += (a & in->k) ? in->jt : in->jf; break;
+        case KRAKEN_BPF_RET_K: return in->k;
+        default:
+            fprintf(stderr, "pc %d: unexpected opcode 0x%02x\n", pc, in->code);
+            check_failures++;
+            return 0;
+        }
+    }
+    fprintf(stderr, "program ran off its end\n");
+    check_failures++;
+    return 0;
+}
+
+// What the kernel's checker insists on: every jump lands inside the
+// program and the last instruction returns
+static bool bpf_valid(const KrakenBpfInsn *prog, int n) {
+    if (n <= 0 || prog[n - 1].code != KRAKEN_BPF_RET_K)
+        return false;
+    for (int pc = 0; pc < n; pc++)
+        if ((prog[pc].code & 0x07) == 0x05 && (pc + 1 + prog[pc].jt >= n || pc + 1 + prog[pc].jf >= n))
+            return false;
+    return true;
+}
+
+typedef struct {
+    uint8_t cmd;
+    uint16_t adp;
+    uint16_t len;
+} Dgram;
+
+static size_t frame(uint8_t *buf, size_t cap, uint16_t ethertype, const Dgram *d, size_t count) {
+    memset(buf, 0xFF, 12);
+    buf[12] = (uint8_t)(ethertype >> 8);
+    buf[13] = (uint8_t)ethertype;
+    KrakenEcatFrame f;
+    kraken_ecat_frame_init(&f, buf + ETH_HDR, cap - ETH_HDR, false);
+    for (size_t i = 0; i < count; i++) {
+        KrakenEcatDatagram dg = {.cmd = d[i].cmd, .index = (uint8_t)i, .adp = d[i].adp, .len = d[i].len};
+        if (!kraken_ecat_frame_append(&f, &dg))
+            return 0;
+    }
+    return ETH_HDR + kraken_ecat_frame_finish(&f);
+}
+
+static void test_ethercat(void) {
+    KrakenBpfInsn prog[KRAKEN_FILTER_MAX_INSNS];
+    KrakenFrameFilter filter = {.preset = "ethercat"};
+    int n = kraken_frame_filter_compile(&filter, prog, KRAKEN_FILTER_MAX_INSNS);
+    CHECK(bpf_valid(prog, n));
+
+    uint8_t buf[KRAKEN_ECAT_MAX_FRAME + ETH_HDR];
+    Dgram d = {KRAKEN_ECAT_CMD_BRD, 0, 2};
+    size_t len = frame(buf, sizeof(buf), 0x88A4, &d, 1);
+    CHECK(bpf_run(prog, n, buf, len) == KRAKEN_FILTER_SNAPLEN);
+    len = frame(buf, sizeof(buf), 0x0800, &d, 1);
+    CHECK(bpf_run(prog, n, buf, len) == 0);
+    CHECK(bpf_run(prog, n, buf, 13) == 0);
+}
+
+static uint32_t station_run(const KrakenBpfInsn *prog, int n, const Dgram *d, size_t count) {
+    static uint8_t buf[KRAKEN_ECAT_MAX_FRAME + ETH_HDR];
+    size_t len = frame(buf, sizeof(buf), 0x88A4, d, count);
+    CHECK(len > 0);
+    return bpf_run(prog, n, buf, len);
+}
+
+static void test_station(void) {
+    KrakenBpfInsn prog[KRAKEN_FILTER_MAX_INSNS];
+    KrakenFrameFilter filter = {.preset = "ethercat+station", .station = STATION};
+    int n = kraken_frame_filter_compile(&filter, prog, KRAKEN_FILTER_MAX_INSNS);
+    CHECK(bpf_valid(prog, n));
+
+    // Each configured-address command for the station, as the only datagram
+    static const uint8_t fp[] = {KRAKEN_ECAT_CMD_FPRD, KRAKEN_ECAT_CMD_FPWR, 6 /* FPRW */, 14 /* FRMW */};
+    for (size_t i = 0; i < sizeof(fp); i++) {
+        Dgram d = {fp[i], STATION, 2};
+        CHECK(station_run(prog, n, &d, 1) == KRAKEN_FILTER_SNAPLEN);
+    }
+
+    // Other commands with the same ADP, byte-swapped or other stations
+    static const Dgram miss[] = {
+        {KRAKEN_ECAT_CMD_APRD, STATION, 2}, {KRAKEN_ECAT_CMD_BRD, STATION, 2}, {KRAKEN_ECAT_CMD_LRW, STATION, 2},
+        {KRAKEN_ECAT_CMD_FPRD, 0x3412, 2},  {KRAKEN_ECAT_CMD_FPWR, 0x1235, 2}, {KRAKEN_ECAT_CMD_FPRD, 0, 2},
+    };
+    for (size_t i = 0; i < sizeof(miss) / sizeof(miss[0]); i++)
+        CHECK(station_run(prog, n, &miss[i], 1) == 0);
+    CHECK(station_run(prog, n, miss, sizeof(miss) / sizeof(miss[0])) == 0);
+
+    // Found in every walked position, behind datagrams of any length
+    // (the length's high bits included); not beyond the walk
+    Dgram chain[KRAKEN_FILTER_STATION_DGRAMS + 1];
+    uint8_t buf[KRAKEN_ECAT_MAX_FRAME + ETH_HDR];
+    static const uint16_t lens[] = {0, 1, 7, 255, 256, 300};
+    for (size_t l = 0; l < sizeof(lens) / sizeof(lens[0]); l++)
+        for (size_t at = 0; at < sizeof(chain) / sizeof(chain[0]); at++) {
+            for (size_t i = 0; i < at; i++)
+                chain[i] = (Dgram){KRAKEN_ECAT_CMD_FPRD, 0x0001, lens[l]};
+            chain[at] = (Dgram){KRAKEN_ECAT_CMD_FPWR, STATION, 2};
+            size_t len = frame(buf, sizeof(buf), 0x88A4, chain, at + 1);
+            if (len == 0)
+                continue; // does not fit in one frame
+            uint32_t want = at < KRAKEN_FILTER_STATION_DGRAMS ? KRAKEN_FILTER_SNAPLEN : 0;
+            if (bpf_run(prog, n, buf, len) != want)
+                fprintf(stderr, "station in datagram %zu behind length %u\n", at, lens[l]);
+            CHECK(bpf_run(prog, n, buf, len) == want);
+        }
+
+    // Not a command frame, not EtherCAT, or cut short mid-chain
+    chain[0] = (Dgram){KRAKEN_ECAT_CMD_FPRD, 0x0001, 40};
+    chain[1] = (Dgram){KRAKEN_ECAT_CMD_FPRD, STATION, 2};
+    size_t len = frame(buf, sizeof(buf), 0x88A4, chain, 2);
+    CHECK(bpf_run(prog, n, buf, len) == KRAKEN_FILTER_SNAPLEN);
+    CHECK(bpf_run(prog, n, buf, ETH_HDR + KRAKEN_ECAT_HDR_LEN + KRAKEN_ECAT_DGRAM_HDR_LEN + 40 + KRAKEN_ECAT_WKC_LEN) == 0);
+    buf[ETH_HDR + 1] = (uint8_t)((buf[ETH_HDR + 1] & 0x0F) | 0x20);
+    CHECK(bpf_run(prog, n, buf, len) == 0);
+    len = frame(buf, sizeof(buf), 0x0800, chain + 1, 1);
+    CHECK(bpf_run(prog, n, buf, len) == 0);
+}
+
+static void test_compile(void) {
+    KrakenBpfInsn prog[KRAKEN_FILTER_MAX_INSNS];
+    KrakenFrameFilter filter = {.preset = "ethercat+station", .station = 1};
+    int n = kraken_frame_filter_compile(&filter, prog, KRAKEN_FILTER_MAX_INSNS);
+    CHECK(n > 0 && n <= KRAKEN_FILTER_MAX_INSNS);
+    CHECK(kraken_frame_filter_compile(&filter, prog, (size_t)n) == n);
+    CHECK(kraken_frame_filter_compile(&filter, prog, (size_t)n - 1) == -1);
+
+    CHECK(kraken_frame_filter_compile(NULL, prog, KRAKEN_FILTER_MAX_INSNS) == -1);
+    filter.preset = "ethercat+stations";
+    CHECK(kraken_frame_filter_compile(&filter, prog, KRAKEN_FILTER_MAX_INSNS) == -1);
+    filter.preset = "";
+    CHECK(kraken_frame_filter_compile(&filter, prog, KRAKEN_FILTER_MAX_INSNS) == -1);
+
+    // Raw programs are copied unchanged, and run
+    static const KrakenBpfInsn raw[] = {
+        {KRAKEN_BPF_LD_B_ABS, 0, 0, 0},
+        {KRAKEN_BPF_JEQ_K, 0, 1, 0xAA},
+        {KRAKEN_BPF_RET_K, 0, 0, 64},
+        {KRAKEN_BPF_RET_K, 0, 0, 0},
+    };
+    KrakenFrameFilter custom = {.insns = raw, .insn_count = 4};
+    memset(prog, 0, sizeof(prog));
+    CHECK(kraken_frame_filter_compile(&custom, prog, KRAKEN_FILTER_MAX_INSNS) == 4);
+    CHECK(memcmp(prog, raw, sizeof(raw)) == 0);
+    const uint8_t hit[] = {0xAA}, miss[] = {0xAB};
+    CHECK(bpf_run(prog, 4, hit, 1) == 64 && bpf_run(prog, 4, miss, 1) == 0);
+    CHECK(kraken_frame_filter_compile(&custom, prog, 3) == -1);
+    custom.insn_count = 0;
+    CHECK(kraken_frame_filter_compile(&custom, prog, KRAKEN_FILTER_MAX_INSNS) == -1);
+    custom.insns = NULL;
+    custom.insn_count = 4;
+    CHECK(kraken_frame_filter_compile(&custom, prog, KRAKEN_FILTER_MAX_INSNS) == -1);
+}
+
+int main(void) {
+    test_ethercat();
+    test_station();
+    test_compile();
+    return CHECK_DONE();
+}
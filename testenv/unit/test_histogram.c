@@ -0,0 +1,87 @@
+// kraken_histogram.h: bucket boundaries, the 1/KRAKEN_HIST_SUB error
+// bound, percentile ranks and merging
+
+#include <stdint.h>
+#include <string.h>
+
+#include "check.h"
+#include "kraken_histogram.h"
+
+static void test_buckets(void) {
+    // Exact below KRAKEN_HIST_SUB
+    for (uint64_t v = 0; v < KRAKEN_HIST_SUB; v++) CHECK(kraken_hist_bucket(v) == v && kraken_hist_bucket_max((unsigned)v) == v);
+
+    // Buckets tile the value range with no gaps: each ends one below where
+    // the next starts
+    unsigned last = kraken_hist_bucket(UINT64_MAX);
+    CHECK(last < KRAKEN_HIST_BUCKETS);
+    CHECK(kraken_hist_bucket_max(last) == UINT64_MAX);
+    for (unsigned b = 0; b < last; b++) {
+        uint64_t hi = kraken_hist_bucket_max(b);
+        CHECK(kraken_hist_bucket(hi) == b && kraken_hist_bucket(hi + 1) == b + 1);
+    }
+
+    // Monotonic, and the upper bound is within 1/KRAKEN_HIST_SUB of the value
+    uint64_t x = 88172645463325252ULL;
+    unsigned prev = 0;
+    for (uint64_t v = 1; v < (1u << 20); v += 7) {
+        unsigned b = kraken_hist_bucket(v);
+        CHECK(b >= prev);
+        prev = b;
+    }
+    for (int i = 0; i < 100000; i++) {
+        x ^= x << 13, x ^= x >> 7, x ^= x << 17;
+        uint64_t v = x >> (x & 63);
+        uint64_t hi = kraken_hist_bucket_max(kraken_hist_bucket(v));
+        CHECK(hi >= v && hi - v <= v / KRAKEN_HIST_SUB);
+    }
+}
+
+static void test_percentiles(void) {
+    KrakenHistogram h;
+    kraken_hist_init(&h);
+    CHECK(kraken_hist_percentile(&h, 0.5) == 0 && kraken_hist_mean(&h) == 0.0);
+
+    kraken_hist_record(&h, 12345);
+    CHECK(kraken_hist_percentile(&h, 0.0) == 12345 && kraken_hist_percentile(&h, 1.0) == 12345); // clamped to min/max
+
+    kraken_hist_init(&h);
+    for (uint64_t v = 1; v <= 1000; v++) kraken_hist_record(&h, v);
+    CHECK(h.total == 1000 && h.min == 1 && h.max == 1000);
+    CHECK(kraken_hist_mean(&h) == 500.5);
+    static const double qs[] = {0.01, 0.1, 0.5, 0.9, 0.99, 0.999};
+    for (size_t i = 0; i < sizeof(qs) / sizeof(qs[0]); i++) {
+        uint64_t exact = (uint64_t)(qs[i] * 1000 + 0.5);
+        uint64_t got = kraken_hist_percentile(&h, qs[i]);
+        CHECK(got >= exact && got - exact <= exact / KRAKEN_HIST_SUB);
+    }
+    CHECK(kraken_hist_percentile(&h, 0.0) == 1);
+    CHECK(kraken_hist_percentile(&h, 1.0) == 1000);
+    CHECK(kraken_hist_percentile(&h, 2.0) == 1000);
+}
+
+static void test_merge(void) {
+    KrakenHistogram a, b, all;
+    kraken_hist_init(&a);
+    kraken_hist_init(&b);
+    kraken_hist_init(&all);
+    for (uint64_t v = 0; v < 5000; v += 3) {
+        kraken_hist_record(v % 2 ? &a : &b, v * v);
+        kraken_hist_record(&all, v * v);
+    }
+    KrakenHistogram empty;
+    kraken_hist_init(&empty);
+    kraken_hist_merge(&a, &empty);
+    CHECK(a.min != UINT64_MAX);
+    kraken_hist_merge(&a, &b);
+    CHECK(memcmp(a.counts, all.counts, sizeof(a.counts)) == 0);
+    CHECK(a.total == all.total && a.min == all.min && a.max == all.max && a.sum == all.sum);
+    CHECK(kraken_hist_percentile(&a, 0.99) == kraken_hist_percentile(&all, 0.99));
+}
+
+int main(void) {
+    test_buckets();
+    test_percentiles();
+    test_merge();
+    return CHECK_DONE();
+}
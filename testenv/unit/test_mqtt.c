@@ -0,0 +1,301 @@
+// kraken_mqtt.h: varint boundaries, the measure-then-write encoders,
+// KrakenMqttReader framing (split input, oversized packets) and the MQTT 5
+// property, CONNACK, SUBACK, PUBLISH and ack parsers
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "check.h"
+#include "kraken_mqtt.h"
+
+static void test_varint(void) {
+    static const struct {
+        uint32_t v;
+        size_t size;
+    } cases[] = {
+        {0, 1}, {127, 1}, {128, 2}, {16383, 2}, {16384, 3}, {2097151, 3}, {2097152, 4}, {KRAKEN_MQTT_MAX_REMAINING, 4},
+    };
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        uint8_t buf[8];
+        KrakenMqttOut o;
+        kraken_mqtt_out_init(&o, buf, sizeof(buf));
+        kraken_mqtt_put_varint(&o, cases[i].v);
+        CHECK(!o.invalid && o.len == cases[i].size && kraken_mqtt_varint_size(cases[i].v) == cases[i].size);
+        uint32_t got = 0;
+        CHECK(kraken_mqtt_get_varint(buf, o.len, &got) == (int)cases[i].size && got == cases[i].v);
+        CHECK(kraken_mqtt_get_varint(buf, o.len - 1, &got) == 0); // ends mid-integer
+    }
+
+    // 128 in two bytes, little-endian groups of seven
+    const uint8_t two[] = {0x80, 0x01};
+    uint32_t v = 0;
+    CHECK(kraken_mqtt_get_varint(two, sizeof(two), &v) == 2 && v == 128);
+
+    // A fifth byte is never valid, and larger values are not encoded
+    const uint8_t five[] = {0xFF, 0xFF, 0xFF, 0xFF, 0x01};
+    CHECK(kraken_mqtt_get_varint(five, sizeof(five), &v) == -1);
+    CHECK(kraken_mqtt_get_varint(five, 4, &v) == -1);
+    KrakenMqttOut o;
+    kraken_mqtt_out_init(&o, NULL, 0);
+    kraken_mqtt_put_varint(&o, KRAKEN_MQTT_MAX_REMAINING + 1);
+    CHECK(o.invalid && o.len == 0);
+}
+
+static void test_encode(void) {
+    // CONNECT 3.1.1, byte for byte
+    static const uint8_t want[] = {0x10, 0x0D, 0x00, 0x04, 'M', 'Q', 'T', 'T', 0x04, 0x02, 0x00, 0x3C, 0x00, 0x01, 'k'};
+    KrakenMqttConnect c = {.client_id = "k", .keep_alive = 60, .clean_start = true};
+    uint8_t buf[64];
+
+    // Too small: the full length comes back and nothing is written
+    memset(buf, 0xAA, sizeof(buf));
+    CHECK(kraken_mqtt_encode_connect(buf, sizeof(want) - 1, &c) == sizeof(want));
+    CHECK(buf[0] == 0xAA && buf[sizeof(want) - 2] == 0xAA);
+    CHECK(kraken_mqtt_encode_connect(NULL, 0, &c) == sizeof(want));
+    CHECK(kraken_mqtt_encode_connect(buf, sizeof(want), &c) == sizeof(want));
+    CHECK(memcmp(buf, want, sizeof(want)) == 0);
+
+    // Credentials set their flags; MQTT 5 adds the property block
+    uint8_t props[16];
+    KrakenMqttOut po;
+    kraken_mqtt_out_init(&po, props, sizeof(props));
+    kraken_mqtt_prop_u32(&po, KRAKEN_MQTT_PROP_SESSION_EXPIRY, 3600);
+    c = (KrakenMqttConnect){.version = KRAKEN_MQTT_V5, .client_id = "k", .username = "u", .password = "p", .properties = props, .properties_len = po.len};
+    size_t n = kraken_mqtt_encode_connect(buf, sizeof(buf), &c);
+    CHECK(n == 2 + 10 + 1 + 5 + 3 + 3 + 3 && buf[1] == n - 2);
+    CHECK(buf[8] == KRAKEN_MQTT_V5 && buf[9] == 0xC0);
+    CHECK(buf[12] == 5 && buf[13] == KRAKEN_MQTT_PROP_SESSION_EXPIRY && buf[16] == 0x0E && buf[17] == 0x10);
+
+    // Arguments that cannot be encoded
+    KrakenMqttSubscription sub = {"a/#", 1};
+    KrakenMqttSubscribe s = {.packet_id = 0, .subs = &sub, .count = 1};
+    CHECK(kraken_mqtt_encode_subscribe(buf, sizeof(buf), &s) == 0);
+    s.packet_id = 7;
+    CHECK(kraken_mqtt_encode_subscribe(buf, sizeof(buf), &s) == 2 + 2 + 5 + 1 && buf[0] == 0x82);
+    KrakenMqttPublishOut pub = {.topic = "t", .qos = 3};
+    CHECK(kraken_mqtt_encode_publish(buf, sizeof(buf), &pub) == 0);
+    pub.qos = 1;
+    CHECK(kraken_mqtt_encode_publish(buf, sizeof(buf), &pub) == 0); // QoS 1 without a packet id
+    char *long_topic = malloc(70000);
+    CHECK(long_topic != NULL);
+    if (long_topic) {
+        memset(long_topic, 'x', 69999);
+        long_topic[69999] = '\0';
+        KrakenMqttPublishOut big = {.topic = long_topic};
+        CHECK(kraken_mqtt_encode_publish(buf, sizeof(buf), &big) == 0);
+        free(long_topic);
+    }
+    // Measured, never read: a payload past the remaining-length limit
+    KrakenMqttPublishOut huge = {.topic = "t", .payload = buf, .payload_len = KRAKEN_MQTT_MAX_REMAINING};
+    CHECK(kraken_mqtt_encode_publish(buf, sizeof(buf), &huge) == 0);
+    huge.payload_len = KRAKEN_MQTT_MAX_REMAINING - 3;
+    CHECK(kraken_mqtt_encode_publish(buf, sizeof(buf), &huge) == 1 + 4 + KRAKEN_MQTT_MAX_REMAINING);
+
+    // Fixed-size packets
+    CHECK(kraken_mqtt_encode_pingreq(buf, sizeof(buf)) == 2 && buf[0] == 0xC0 && buf[1] == 0);
+    CHECK(kraken_mqtt_encode_disconnect(buf, sizeof(buf), KRAKEN_MQTT_V311, 0x8E) == 2);
+    CHECK(kraken_mqtt_encode_disconnect(buf, sizeof(buf), KRAKEN_MQTT_V5, 0x8E) == 3 && buf[1] == 1 && buf[2] == 0x8E);
+    KrakenMqttAckOut ack = {.version = KRAKEN_MQTT_V5, .packet_id = 0x1234};
+    CHECK(kraken_mqtt_encode_ack(buf, sizeof(buf), KRAKEN_MQTT_PUBREL, &ack) == 4 && buf[0] == 0x62 && buf[2] == 0x12);
+    ack.reason_code = 0x92;
+    CHECK(kraken_mqtt_encode_ack(buf, sizeof(buf), KRAKEN_MQTT_PUBACK, &ack) == 5 && buf[0] == 0x40 && buf[4] == 0x92);
+}
+
+static void test_round_trip(void) {
+    uint8_t props[64], buf[256];
+    KrakenMqttOut po;
+    kraken_mqtt_out_init(&po, props, sizeof(props));
+    kraken_mqtt_prop_str(&po, KRAKEN_MQTT_PROP_CONTENT_TYPE, "text/plain");
+    kraken_mqtt_prop_user(&po, "k", "v");
+    for (int version = KRAKEN_MQTT_V311; version <= (int)KRAKEN_MQTT_V5; version++) {
+        KrakenMqttPublishOut out = {.version = (uint8_t)version, .topic = "a/b", .payload = "hello", .payload_len = 5, .qos = 2, .retain = true,
+                                    .dup = true, .packet_id = 0xBEEF, .properties = props, .properties_len = po.len};
+        size_t n = kraken_mqtt_encode_publish(buf, sizeof(buf), &out);
+        KrakenMqttFrame f;
+        KrakenMqttPublish in;
+        CHECK(kraken_mqtt_frame(buf, n, &f, NULL) == 1 && f.total_len == n && f.type == KRAKEN_MQTT_PUBLISH);
+        CHECK(kraken_mqtt_parse_publish(&f, (uint8_t)version, &in) == 0);
+        CHECK(in.qos == 2 && in.retain && in.dup && in.packet_id == 0xBEEF);
+        CHECK(in.topic_len == 3 && memcmp(in.topic, "a/b", 3) == 0);
+        CHECK(in.payload_len == 5 && memcmp(in.payload, "hello", 5) == 0);
+        CHECK(in.props.len == (version == KRAKEN_MQTT_V5 ? po.len : 0));
+
+        KrakenMqttAckOut ack = {.version = (uint8_t)version, .packet_id = 9, .reason_code = 0x10};
+        KrakenMqttAck got;
+        n = kraken_mqtt_encode_ack(buf, sizeof(buf), KRAKEN_MQTT_PUBCOMP, &ack);
+        CHECK(kraken_mqtt_frame(buf, n, &f, NULL) == 1 && kraken_mqtt_parse_ack(&f, (uint8_t)version, &got) == 0);
+        CHECK(got.packet_id == 9 && got.reason_code == (version == KRAKEN_MQTT_V5 ? 0x10 : 0));
+    }
+}
+
+// Packets in `stream` through a reader of `cap` bytes, `chunk` bytes per read
+static size_t read_all(const uint8_t *stream, size_t len, size_t cap, size_t chunk, uint8_t *types, size_t max, size_t *oversized) {
+    uint8_t *rx = malloc(cap);
+    KrakenMqttReader rd;
+    kraken_mqtt_reader_init(&rd, rx, cap);
+    size_t fed = 0, count = 0;
+    for (;;) {
+        KrakenMqttFrame f;
+        int rc = kraken_mqtt_reader_next(&rd, &f);
+        if (rc < 0) {
+            count = SIZE_MAX;
+            break;
+        }
+        if (rc == 1) {
+            if (count < max)
+                types[count] = f.type;
+            count++;
+            continue;
+        }
+        if (fed == len)
+            break;
+        size_t room;
+        uint8_t *dst = kraken_mqtt_reader_space(&rd, &room);
+        size_t n = len - fed < chunk ? len - fed : chunk;
+        n = n < room ? n : room;
+        memcpy(dst, stream + fed, n);
+        kraken_mqtt_reader_commit(&rd, (int64_t)n);
+        fed += n;
+    }
+    *oversized = rd.oversized;
+    free(rx);
+    return count;
+}
+
+static void test_reader(void) {
+    uint8_t stream[1024];
+    size_t len = 0;
+    uint8_t payload[300] = {0};
+    KrakenMqttPublishOut small = {.topic = "t", .payload = "x", .payload_len = 1};
+    KrakenMqttPublishOut large = {.topic = "t", .payload = payload, .payload_len = sizeof(payload)};
+    KrakenMqttAckOut ack = {.packet_id = 1};
+    len += kraken_mqtt_encode_publish(stream + len, sizeof(stream) - len, &small);
+    len += kraken_mqtt_encode_pingreq(stream + len, sizeof(stream) - len);
+    len += kraken_mqtt_encode_publish(stream + len, sizeof(stream) - len, &large);
+    len += kraken_mqtt_encode_ack(stream + len, sizeof(stream) - len, KRAKEN_MQTT_PUBACK, &ack);
+    len += kraken_mqtt_encode_disconnect(stream + len, sizeof(stream) - len, KRAKEN_MQTT_V311, 0);
+
+    // Whole packets regardless of how the bytes arrive
+    static const size_t chunks[] = {1, 2, 3, 7, 64, 1024};
+    for (size_t i = 0; i < sizeof(chunks) / sizeof(chunks[0]); i++) {
+        uint8_t types[8];
+        size_t oversized;
+        size_t n = read_all(stream, len, 512, chunks[i], types, 8, &oversized);
+        CHECK(n == 5 && oversized == 0);
+        CHECK(types[0] == KRAKEN_MQTT_PUBLISH && types[1] == KRAKEN_MQTT_PINGREQ && types[2] == KRAKEN_MQTT_PUBLISH &&
+              types[3] == KRAKEN_MQTT_PUBACK && types[4] == KRAKEN_MQTT_DISCONNECT);
+
+        // A packet larger than the buffer is skipped, the ones around it kept
+        n = read_all(stream, len, 64, chunks[i], types, 8, &oversized);
+        CHECK(n == 4 && oversized == 1);
+        CHECK(types[0] == KRAKEN_MQTT_PUBLISH && types[1] == KRAKEN_MQTT_PINGREQ && types[2] == KRAKEN_MQTT_PUBACK &&
+              types[3] == KRAKEN_MQTT_DISCONNECT);
+    }
+
+    // A remaining length with a fifth byte poisons the stream
+    const uint8_t bad[] = {0x30, 0xFF, 0xFF, 0xFF, 0xFF, 0x01};
+    uint8_t types[1];
+    size_t oversized;
+    CHECK(read_all(bad, sizeof(bad), 64, 1, types, 1, &oversized) == SIZE_MAX);
+}
+
+static void test_parse_v5(void) {
+    // Every property type, read back in order
+    uint8_t props[128];
+    KrakenMqttOut po;
+    kraken_mqtt_out_init(&po, props, sizeof(props));
+    kraken_mqtt_prop_u8(&po, KRAKEN_MQTT_PROP_MAXIMUM_QOS, 1);
+    kraken_mqtt_prop_u16(&po, KRAKEN_MQTT_PROP_RECEIVE_MAXIMUM, 20);
+    kraken_mqtt_prop_u32(&po, KRAKEN_MQTT_PROP_MAXIMUM_PACKET_SIZE, 1u << 20);
+    kraken_mqtt_put_u8(&po, KRAKEN_MQTT_PROP_SUBSCRIPTION_ID);
+    kraken_mqtt_put_varint(&po, 300);
+    kraken_mqtt_prop_str(&po, KRAKEN_MQTT_PROP_ASSIGNED_CLIENT_ID, "auto-1");
+    kraken_mqtt_put_u8(&po, KRAKEN_MQTT_PROP_AUTH_DATA);
+    kraken_mqtt_put_bin(&po, "\x00\x01", 2);
+    kraken_mqtt_prop_user(&po, "key", "value");
+    CHECK(!po.invalid && po.len <= sizeof(props));
+
+    KrakenMqttProps it = {props, po.len};
+    KrakenMqttProp p;
+    CHECK(kraken_mqtt_prop_next(&it, &p) == 1 && p.type == KRAKEN_MQTT_PT_BYTE && p.value == 1);
+    CHECK(kraken_mqtt_prop_next(&it, &p) == 1 && p.type == KRAKEN_MQTT_PT_U16 && p.value == 20);
+    CHECK(kraken_mqtt_prop_next(&it, &p) == 1 && p.type == KRAKEN_MQTT_PT_U32 && p.value == 1u << 20);
+    CHECK(kraken_mqtt_prop_next(&it, &p) == 1 && p.type == KRAKEN_MQTT_PT_VARINT && p.value == 300);
+    CHECK(kraken_mqtt_prop_next(&it, &p) == 1 && p.type == KRAKEN_MQTT_PT_STRING && p.data_len == 6 && memcmp(p.data, "auto-1", 6) == 0);
+    CHECK(kraken_mqtt_prop_next(&it, &p) == 1 && p.type == KRAKEN_MQTT_PT_BINARY && p.data_len == 2 && p.data[1] == 1);
+    CHECK(kraken_mqtt_prop_next(&it, &p) == 1 && p.type == KRAKEN_MQTT_PT_PAIR && p.data_len == 3 && p.data2_len == 5 &&
+          memcmp(p.data2, "value", 5) == 0);
+    CHECK(kraken_mqtt_prop_next(&it, &p) == 0);
+
+    KrakenMqttProps all = {props, po.len};
+    CHECK(kraken_mqtt_props_find(all, KRAKEN_MQTT_PROP_ASSIGNED_CLIENT_ID, &p) && p.data_len == 6);
+    CHECK(!kraken_mqtt_props_find(all, KRAKEN_MQTT_PROP_TOPIC_ALIAS, &p));
+
+    // Truncated anywhere inside a property, or an unknown identifier
+    for (size_t cut = 1; cut < po.len; cut++) {
+        KrakenMqttProps t = {props, cut};
+        int rc;
+        while ((rc = kraken_mqtt_prop_next(&t, &p)) == 1)
+            ;
+        size_t whole[] = {2, 5, 10, 13, 22, 27, po.len};
+        bool boundary = false;
+        for (size_t i = 0; i < sizeof(whole) / sizeof(whole[0]); i++)
+            boundary |= cut == whole[i];
+        CHECK(rc == (boundary ? 0 : -1));
+    }
+    const uint8_t unknown[] = {0x7F, 0x00};
+    KrakenMqttProps u = {unknown, sizeof(unknown)};
+    CHECK(kraken_mqtt_prop_next(&u, &p) == -1);
+
+    // CONNACK: session present, reason code, properties
+    uint8_t pkt[160];
+    size_t n = 0;
+    pkt[n++] = KRAKEN_MQTT_CONNACK << 4;
+    pkt[n++] = (uint8_t)(2 + 1 + po.len);
+    pkt[n++] = 0x01;
+    pkt[n++] = 0x00;
+    pkt[n++] = (uint8_t)po.len;
+    memcpy(pkt + n, props, po.len);
+    n += po.len;
+    KrakenMqttFrame f;
+    KrakenMqttConnack ack;
+    CHECK(kraken_mqtt_frame(pkt, n, &f, NULL) == 1 && kraken_mqtt_parse_connack(&f, KRAKEN_MQTT_V5, &ack) == 0);
+    CHECK(ack.session_present && ack.reason_code == 0 && ack.props.len == po.len);
+    CHECK(kraken_mqtt_props_find(ack.props, KRAKEN_MQTT_PROP_RECEIVE_MAXIMUM, &p) && p.value == 20);
+    pkt[4] = (uint8_t)(po.len + 1); // property length past the packet
+    CHECK(kraken_mqtt_frame(pkt, n, &f, NULL) == 1 && kraken_mqtt_parse_connack(&f, KRAKEN_MQTT_V5, &ack) == -1);
+
+    const uint8_t connack311[] = {0x20, 0x02, 0x00, 0x05};
+    CHECK(kraken_mqtt_frame(connack311, sizeof(connack311), &f, NULL) == 1 && kraken_mqtt_parse_connack(&f, KRAKEN_MQTT_V311, &ack) == 0);
+    CHECK(!ack.session_present && ack.reason_code == 5 && strcmp(kraken_mqtt_reason_name(KRAKEN_MQTT_V311, ack.reason_code), "Not authorized") == 0);
+    CHECK(strcmp(kraken_mqtt_reason_name(KRAKEN_MQTT_V5, 0x87), "Not authorized") == 0);
+    CHECK(strcmp(kraken_mqtt_reason_name(KRAKEN_MQTT_V5, 0x05), "Unknown") == 0);
+    const uint8_t short_connack[] = {0x20, 0x01, 0x00};
+    CHECK(kraken_mqtt_frame(short_connack, sizeof(short_connack), &f, NULL) == 1 && kraken_mqtt_parse_connack(&f, KRAKEN_MQTT_V311, &ack) == -1);
+
+    // SUBACK: one reason code per topic after the properties
+    const uint8_t suback5[] = {0x90, 0x06, 0x00, 0x07, 0x00, 0x01, 0x80, 0x02};
+    KrakenMqttSuback sa;
+    CHECK(kraken_mqtt_frame(suback5, sizeof(suback5), &f, NULL) == 1 && kraken_mqtt_parse_suback(&f, KRAKEN_MQTT_V5, &sa) == 0);
+    CHECK(sa.packet_id == 7 && sa.count == 3 && sa.reason_codes[0] == 0x01 && sa.reason_codes[1] == 0x80 && sa.props.len == 0);
+    CHECK(kraken_mqtt_parse_suback(&f, KRAKEN_MQTT_V311, &sa) == 0 && sa.count == 4); // no property block on 3.1.1
+    const uint8_t suback_bad[] = {0x90, 0x03, 0x00, 0x07, 0x05};
+    CHECK(kraken_mqtt_frame(suback_bad, sizeof(suback_bad), &f, NULL) == 1 && kraken_mqtt_parse_suback(&f, KRAKEN_MQTT_V5, &sa) == -1);
+    CHECK(kraken_mqtt_frame(connack311, sizeof(connack311), &f, NULL) == 1 && kraken_mqtt_parse_suback(&f, KRAKEN_MQTT_V5, &sa) == -1);
+
+    // DISCONNECT with a reason code only
+    uint8_t disc[4];
+    n = kraken_mqtt_encode_disconnect(disc, sizeof(disc), KRAKEN_MQTT_V5, 0x8B);
+    KrakenMqttDisconnect d;
+    CHECK(kraken_mqtt_frame(disc, n, &f, NULL) == 1 && kraken_mqtt_parse_disconnect(&f, KRAKEN_MQTT_V5, &d) == 0 && d.reason_code == 0x8B);
+}
+
+int main(void) {
+    test_varint();
+    test_encode();
+    test_round_trip();
+    test_reader();
+    test_parse_v5();
+    return CHECK_DONE();
+}
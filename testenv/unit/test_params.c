@@ -0,0 +1,204 @@
+// kraken_params.h: lookups on well-formed params_json, and rejection of
+// malformed input with every query falling back to its default
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "check.h"
+#include "kraken_params.h"
+
+static int parses(const char *json) {
+    KrakenParams p;
+    int rc = kraken_params_parse(&p, json);
+    kraken_params_free(&p);
+    return rc;
+}
+
+static void test_lookups(void) {
+    KrakenParams p;
+    CHECK(kraken_params_parse(&p, " {\"topic\": \"a/b\", \"n\": 42, \"neg\": -7, \"frac\": 3.9, \"exp\": 1e3, \"on\": true, \"off\": false,"
+                                  " \"nil\": null, \"str_n\": \"12\", \"creds\": [\"u:p\", \"x:y\"], \"deep\": {\"k\": [1, {\"z\": 2}]},"
+                                  " \"esc\": \"q\\\"\\n\\u00e9\"} ") == 0);
+    char buf[64];
+    CHECK(kraken_params_string(&p, "topic", buf, sizeof(buf)) == 3 && strcmp(buf, "a/b") == 0);
+    CHECK(kraken_params_int(&p, "n", 0) == 42);
+    CHECK(kraken_params_int(&p, "neg", 0) == -7);
+    CHECK(kraken_params_int(&p, "frac", 0) == 3); // fraction truncates
+    CHECK(kraken_params_int(&p, "exp", 0) == 1000); // exponent applies before truncating
+    CHECK(kraken_params_int(&p, "str_n", 0) == 12);
+    CHECK(kraken_params_int(&p, "topic", -1) == -1);
+    CHECK(kraken_params_int(&p, "missing", 5) == 5);
+    CHECK(kraken_params_bool(&p, "on", false) == true);
+    CHECK(kraken_params_bool(&p, "off", true) == false);
+    CHECK(kraken_params_bool(&p, "nil", true) == true);
+    CHECK(kraken_params_has(&p, "nil") && !kraken_params_has(&p, "k")); // nested keys are not top-level
+
+    size_t count = 0;
+    const KrakenJsonTok *arr = kraken_params_array(&p, "creds", &count);
+    CHECK(arr && count == 2);
+    CHECK(kraken_params_tok_string(&p, kraken_params_at(&p, arr, 1), buf, sizeof(buf)) == 3 && strcmp(buf, "x:y") == 0);
+    CHECK(kraken_params_at(&p, arr, 2) == NULL);
+    CHECK(kraken_params_array(&p, "topic", &count) == NULL && count == 0);
+
+    CHECK(kraken_params_string(&p, "esc", buf, sizeof(buf)) == 5 && memcmp(buf, "q\"\n\xc3\xa9", 5) == 0);
+    CHECK(kraken_params_string(&p, "topic", buf, 3) == -1); // does not fit with its terminator
+    char *dup = kraken_params_strdup(&p, "esc");
+    CHECK(dup && strcmp(dup, "q\"\n\xc3\xa9") == 0);
+    free(dup);
+    kraken_params_free(&p);
+}
+
+static void test_int_range(void) {
+    KrakenParams p;
+    CHECK(kraken_params_parse(&p, "{\"max\": 9223372036854775807, \"min\": -9223372036854775808, \"over\": 9223372036854775808,"
+                                  " \"under\": -9223372036854775809, \"wrap\": 18446744073709551617, \"twenty\": 99999999999999999999,"
+                                  " \"bad_str\": \"7x\", \"minus\": \"-\"}") == 0);
+    CHECK(kraken_params_int(&p, "max", 0) == INT64_MAX);
+    CHECK(kraken_params_int(&p, "min", 0) == INT64_MIN);
+    CHECK(kraken_params_int(&p, "over", -1) == -1);
+    CHECK(kraken_params_int(&p, "under", -1) == -1);
+    CHECK(kraken_params_int(&p, "wrap", -1) == -1); // would wrap to 1 in uint64
+    CHECK(kraken_params_int(&p, "twenty", -1) == -1);
+    CHECK(kraken_params_int(&p, "bad_str", -1) == -1);
+    CHECK(kraken_params_int(&p, "minus", -1) == -1);
+    kraken_params_free(&p);
+
+    static const struct {
+        const char *json;
+        int64_t want;
+    } nums[] = {
+        {"[-3.9]", -3},
+        {"[2.5e-1]", 0},
+        {"[1.5E1]", 15},
+        {"[-2e+3]", -2000},
+        {"[0e999999]", 0},
+        {"[7e-999999]", 0},
+        {"[9.223372036854775807e18]", INT64_MAX},
+        {"[-9223372036854775808e0]", INT64_MIN},
+        {"[12345678901234567890123e-4]", 1234567890123456789},
+        {"[0.000000000000000000000123e24]", 123},
+        {"[1e19]", -1},
+        {"[1e999999]", -1},
+    };
+    for (size_t i = 0; i < sizeof(nums) / sizeof(nums[0]); i++) {
+        CHECK(kraken_params_parse(&p, nums[i].json) == 0);
+        int64_t got = kraken_params_tok_int(&p, kraken_params_at(&p, &p.toks[0], 0), -1);
+        if (got != nums[i].want)
+            fprintf(stderr, "%s: %lld, want %lld\n", nums[i].json, (long long)got, (long long)nums[i].want);
+        CHECK(got == nums[i].want);
+        kraken_params_free(&p);
+    }
+    CHECK(kraken_params_parse(&p, "[\"1e3\", \"1.5\"]") == 0); // numeric strings stay digits only
+    CHECK(kraken_params_tok_int(&p, kraken_params_at(&p, &p.toks[0], 0), -1) == -1);
+    CHECK(kraken_params_tok_int(&p, kraken_params_at(&p, &p.toks[0], 1), -1) == -1);
+    kraken_params_free(&p);
+}
+
+static void test_malformed(void) {
+    static const char *const bad[] = {
+        "{\"a\" 1}",         // key without ':'
+        "{\"a\"}",           // key without ':' or value
+        "{\"a\", \"b\": 1}", // key without ':' before ','
+        "{\"a\"::1}",        // doubled ':'
+        "{\"a\":1:2}",       // ':' after a value
+        "[1:2]",             // ':' in an array
+        "{:1}",              // ':' without a key
+        "{1: 2}",            // key not a string
+        "{\"a\": \"x}",      // unterminated string
+        "{\"a\": [1, 2}",    // mismatched brackets
+        "{\"a\": 1}}",       // unbalanced close
+        "{\"a\": 1} x",      // trailing garbage
+        "{\"a\": tru}",      // bad literal
+        "{\"a\": 1",         // unterminated object
+        ",",                 // separator at top level
+        "{\"a\":1 2}",       // value after a value
+        "[1 2 3]",           // elements without ','
+        "{\"a\":1 \"b\":2}", // members without ','
+        "{\"a\":1,}",        // trailing ',' in an object
+        "[1,]",              // trailing ',' in an array
+        "{\"a\":[1,,2]}",    // empty element
+        "[,1]",              // ',' before the first element
+        "{,}",               // ',' in an empty object
+        "{\"a\":}",          // key without a value
+        "{\"a\":12abc}",     // number followed by garbage
+        "{\"a\":-}",         // sign without digits
+        "[01]",              // leading zero
+        "[1.]",              // fraction without digits
+        "[.5]",              // no integer part
+        "[1e]",              // exponent without digits
+        "[+1]",              // explicit plus
+        "[\"\\u12g4\"]",     // non-hex \u digit
+        "[\"\\u12\"]",       // short \u escape
+    };
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        if (parses(bad[i]) != -1) {
+            fprintf(stderr, "accepted malformed %s\n", bad[i]);
+            check_failures++;
+        }
+    }
+
+    char deep[2 * KRAKEN_PARAMS_MAX_DEPTH + 8];
+    size_t n = 0;
+    for (int i = 0; i <= KRAKEN_PARAMS_MAX_DEPTH; i++) deep[n++] = '[';
+    for (int i = 0; i <= KRAKEN_PARAMS_MAX_DEPTH; i++) deep[n++] = ']';
+    deep[n] = '\0';
+    CHECK(parses(deep) == -1);
+
+    // Missing ',' with the tokens spilled to the heap: members and
+    // tokens must not disagree, or the key index walks past the block
+    size_t cap = 4096;
+    char *spill = malloc(cap);
+    CHECK(spill != NULL);
+    if (spill) {
+        n = (size_t)snprintf(spill, cap, "{\"a\":[");
+        for (int i = 0; i < 252; i++) n += (size_t)snprintf(spill + n, cap - n, "%s%d", i ? "," : "", i);
+        snprintf(spill + n, cap - n, "] 7}");
+        CHECK(parses(spill) == -1);
+        free(spill);
+    }
+
+    // A failed parse leaves nothing to find
+    KrakenParams p;
+    CHECK(kraken_params_parse(&p, "{\"n\": 3, \"x\" 4}") == -1);
+    CHECK(kraken_params_int(&p, "n", 9) == 9);
+    CHECK(!kraken_params_has(&p, "n"));
+    kraken_params_free(&p);
+
+    CHECK(parses(NULL) == 0);
+    CHECK(parses("") == 0);
+    CHECK(parses("{}") == 0);
+    CHECK(parses("{\"a\": {}, \"b\": []}") == 0);
+    CHECK(parses("[0, -0, 1.5, -2e3, 4E+1, 6.02e-23, \"\\u00Af\"]") == 0);
+}
+
+// More tokens than fit inline, and more keys than the index holds
+static void test_large(void) {
+    size_t cap = 64 * 1024, n = 0;
+    char *json = malloc(cap);
+    CHECK(json != NULL);
+    if (!json) return;
+    n += (size_t)snprintf(json + n, cap - n, "{\"arr\": [");
+    for (int i = 0; i < 1000; i++) n += (size_t)snprintf(json + n, cap - n, "%s%d", i ? "," : "", i * 3);
+    n += (size_t)snprintf(json + n, cap - n, "]");
+    for (int i = 0; i < 200; i++) n += (size_t)snprintf(json + n, cap - n, ", \"k%d\": %d", i, i);
+    snprintf(json + n, cap - n, "}");
+
+    KrakenParams p;
+    CHECK(kraken_params_parse(&p, json) == 0);
+    size_t count = 0;
+    const KrakenJsonTok *arr = kraken_params_array(&p, "arr", &count);
+    CHECK(count == 1000);
+    CHECK(kraken_params_tok_int(&p, kraken_params_at(&p, arr, 999), -1) == 2997);
+    CHECK(kraken_params_int(&p, "k0", -1) == 0 && kraken_params_int(&p, "k199", -1) == 199);
+    kraken_params_free(&p);
+    free(json);
+}
+
+int main(void) {
+    test_lookups();
+    test_int_range();
+    test_malformed();
+    test_large();
+    return CHECK_DONE();
+}